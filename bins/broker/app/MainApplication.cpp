@@ -20,6 +20,7 @@
 
 #include <AsyncHandlerRegestry.h>
 #include <Poco/DateTime.h>
+#include <Poco/NumberParser.h>
 #include <Poco/Util/PropertyFileConfiguration.h>
 #include <Poco/String.h>
 #include <cstdlib>
@@ -31,6 +32,9 @@
 #include "Exception.h"
 #include "Exchange.h"
 #include "MainApplication.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "SpillStore.h"
 #include "Version.hpp"
 #include "ParallelSocketReactor.h"
 #include "ParallelSocketAcceptor.h"
@@ -100,6 +104,8 @@ int MainApplication::main(const std::vector<std::string> &args) {
     return Application::EXIT_OK;
   }
 
+  // NOTE: the registry is created before the destinations and connections, they register their series from different threads
+  METRICS::Instance();
   loadBrokerConfiguration();
 
   // TODO : wrap with macro ifdef..
@@ -123,10 +129,8 @@ int MainApplication::main(const std::vector<std::string> &args) {
                           ServerSocket(static_cast<Poco::UInt16>(CONFIGURATION::Instance().http().port)),
                           Poco::MakeAuto<Poco::Net::HTTPServerParams>());
   Poco::File wwwDir(CONFIGURATION::Instance().http().site);
-  if (wwwDir.exists()) {
-    s.start();
-  }
-
+  // NOTE: /metrics is served without the site
+  s.start();
 #endif
 
   log->critical("%s", std::string("-").append(" * ").append("<<========= start =========>>"));
@@ -184,6 +188,26 @@ int MainApplication::main(const std::vector<std::string> &args) {
   upmq::Net::SocketReactor reactor(CONFIGURATION::Instance().net().maxConnections);
   auto acceptor = std::make_unique<upmq::Net::ParallelSocketAcceptor<AsyncTCPHandler, upmq::Net::SocketReactor>>(
       svs, reactor, CONFIGURATION::Instance().threads().accepters);
+
+  // NOTE: local clients can connect through unix domain socket, it's served by the same handlers
+  std::unique_ptr<upmq::Net::ParallelSocketAcceptor<AsyncTCPHandler, upmq::Net::SocketReactor>> localAcceptor;
+  const std::string &unixSocket = CONFIGURATION::Instance().net().unixSocket;
+  if (!unixSocket.empty()) {
+#ifdef POCO_HAS_UNIX_SOCKET
+    Poco::File unixSocketFile(unixSocket);
+    if (unixSocketFile.exists()) {
+      unixSocketFile.remove();
+    }
+    ServerSocket uds;
+    uds.bind(Poco::Net::SocketAddress(Poco::Net::SocketAddress::UNIX_LOCAL, unixSocket));
+    uds.listen(CONFIGURATION::Instance().net().maxConnections);
+    localAcceptor = std::make_unique<upmq::Net::ParallelSocketAcceptor<AsyncTCPHandler, upmq::Net::SocketReactor>>(
+        uds, reactor, CONFIGURATION::Instance().threads().accepters);
+    log->information("%s", std::string("-").append(" * ").append("listen unix socket : ").append(unixSocket));
+#else
+    log->warning("%s", std::string("-").append(" ! ").append("unix socket is not supported on this platform : ").append(unixSocket));
+#endif
+  }
   Thread thread;
   thread.start(reactor);
 
@@ -208,6 +232,9 @@ int MainApplication::main(const std::vector<std::string> &args) {
   reactor.wakeUp();
   thread.join();
   acceptor->unregisterAcceptor();
+  if (localAcceptor) {
+    localAcceptor->unregisterAcceptor();
+  }
 
   BROKER::Instance().stop();
   EXCHANGE::Instance().stop();
@@ -218,6 +245,13 @@ int MainApplication::main(const std::vector<std::string> &args) {
   EXCHANGE::destroyInstance();
 
   acceptor.reset(nullptr);
+  if (localAcceptor) {
+    localAcceptor.reset(nullptr);
+    try {
+      Poco::File(unixSocket).remove();
+    } catch (...) {  // -V565
+    }
+  }
 
   log->critical("%s", std::string("-").append(" * ").append(">>========= stop =========<<"));
   ASYNCLOGGER::Instance().destroy(CONFIGURATION::Instance().log().name);
@@ -247,6 +281,10 @@ void MainApplication::loadBrokerConfiguration() {
   loadDestinationConfig();
 
   loadStorageConfig();
+
+  loadMemoryConfig();
+
+  loadTraceConfig();
 }
 
 void MainApplication::loadStorageConfig() const {
@@ -280,6 +318,37 @@ void MainApplication::loadStorageConfig() const {
   storage.messages.nonPresistentSize = config().getUInt("broker.storage.messages.non-persistent-size", 100000);
   CONFIGURATION::Instance().setStorage(storage);
 }
+void MainApplication::loadMemoryConfig() const {
+  Configuration::Memory memory;
+  // NOTE: limits can exceed 4Gb, so they are parsed as 64-bit numbers
+  memory.limit = Poco::NumberParser::parseUnsigned64(config().getString("broker.memory.limit", std::to_string(memory.limit)));
+  memory.destinationLimit =
+      Poco::NumberParser::parseUnsigned64(config().getString("broker.memory.destination-limit", std::to_string(memory.destinationLimit)));
+  memory.highWatermark = config().getInt("broker.memory.high-watermark", memory.highWatermark);
+  memory.lowWatermark = config().getInt("broker.memory.low-watermark", memory.lowWatermark);
+  if ((memory.highWatermark <= 0) || (memory.highWatermark > 100)) {
+    memory.highWatermark = 100;
+  }
+  if ((memory.lowWatermark < 0) || (memory.lowWatermark > memory.highWatermark)) {
+    memory.lowWatermark = memory.highWatermark;
+  }
+  memory.spill = config().getBool("broker.memory.spill[@enabled]", memory.spill);
+  memory.spillSegmentSize = Poco::NumberParser::parseUnsigned64(
+      config().getString("broker.memory.spill[@segment-size]", std::to_string(memory.spillSegmentSize)));
+  CONFIGURATION::Instance().setMemory(memory);
+
+  MEMORYBUDGET::Instance().configure(static_cast<int64_t>(memory.limit), memory.highWatermark, memory.lowWatermark);
+  if (memory.spill) {
+    Poco::Path spillPath(STORAGE_CONFIG.data.get());
+    spillPath.makeDirectory().pushDirectory("spill");
+    SPILLSTORE::Instance().configure(spillPath.toString(), memory.spillSegmentSize);
+  }
+}
+void MainApplication::loadTraceConfig() const {
+  Configuration::Trace trace;
+  trace.sampling = config().getUInt("broker.trace[@sampling]", static_cast<unsigned>(trace.sampling));
+  CONFIGURATION::Instance().setTrace(trace);
+}
 void MainApplication::loadDestinationConfig() const {
   Configuration::Destinations destinations;
   destinations.maxCount = config().getUInt("broker.destinations.max-count", static_cast<uint32_t>(destinations.maxCount));
@@ -291,6 +360,7 @@ void MainApplication::loadLogConfig() {
   Configuration::Log confLog;
   confLog.level = config().getInt("broker.log.level", confLog.level) % 9;
   confLog.isInteractive = config().getBool("broker.log.interactive", confLog.isInteractive);
+  confLog.ringSize = config().getUInt("broker.log.ring-size", static_cast<uint32_t>(confLog.ringSize));
   confLog.name = CONFIGURATION::Instance().name();
   Poco::Path prefix = expandPath(config().getString("broker.log.path[@_nix]", Poco::Path::current()));
 
@@ -299,6 +369,7 @@ void MainApplication::loadLogConfig() {
   CONFIGURATION::Instance().setLog(confLog);
 
   ASYNCLOGGER::Instance().logPriority = confLog.level;
+  ASYNCLOGGER::Instance().ringSize = confLog.ringSize;
 
   if (config().getBool("application.runAsDaemon", false)) {
     ASYNCLOGGER::Instance().isInteractive = false;
@@ -315,11 +386,16 @@ void MainApplication::loadThreadsConfig() const {
   threads.writers = config().getUInt("broker.threads.writer", procCount);
   threads.accepters = config().getUInt("broker.threads.accepter", procCount);
   threads.subscribers = config().getUInt("broker.threads.subscriber", procCount);
+  threads.shards = config().getUInt("broker.threads.shards", threads.shards);
   CONFIGURATION::Instance().setThreads(threads);
 }
 void MainApplication::loadNetConfig() const {
   Configuration::Net net;
   net.maxConnections = config().getInt("broker.net.max-connections", net.maxConnections);
+  net.maxOutputSize = config().getUInt("broker.net.max-output-size", static_cast<uint32_t>(net.maxOutputSize));
+  net.maxHeaderSize = config().getUInt("broker.net.max-header-size", static_cast<uint32_t>(net.maxHeaderSize));
+  net.maxBodySize = Poco::NumberParser::parseUnsigned64(config().getString("broker.net.max-body-size", std::to_string(net.maxBodySize)));
+  net.unixSocket = config().getString("broker.net.unix-socket", net.unixSocket);
   CONFIGURATION::Instance().setNet(net);
 }
 
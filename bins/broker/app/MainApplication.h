@@ -81,6 +81,8 @@ class MainApplication : public swf::Application {
   void loadLogConfig();
   void loadDestinationConfig() const;
   void loadStorageConfig() const;
+  void loadMemoryConfig() const;
+  void loadTraceConfig() const;
 };
 }  // namespace broker
 }  // namespace upmq
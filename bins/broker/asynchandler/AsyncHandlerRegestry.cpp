@@ -24,7 +24,7 @@ namespace broker {
 AsyncHandlerRegestry::AsyncHandlerRegestry()
     : _size(static_cast<size_t>(NET_CONFIG.maxConnections)),
       _thread("AsyncHandlerRegestry"),
-      _connections(_size),
+      _connections(_size, MAX_THREADS),
       _isRunning(false),
       _current_size(0),
       _connectionCounter(0) {
@@ -36,56 +36,65 @@ AsyncHandlerRegestry::AsyncHandlerRegestry()
 void AsyncHandlerRegestry::addAHandler(AsyncTCPHandler *ahandler) {
   int nextNum = freeNum();
   if (nextNum != -1) {
-    ahandler->num = static_cast<size_t>(nextNum);
-    _connections[ahandler->num] = std::shared_ptr<AsyncTCPHandler>(ahandler);
+    ahandler->num = _connections.insert(static_cast<size_t>(nextNum), ahandler);
     ++_current_size;
   } else {
     throw EXCEPTION("can't get free connection handeler", "try to encrease max connections", -1);
   }
 }
 
-std::shared_ptr<AsyncTCPHandler> AsyncHandlerRegestry::aHandler(size_t num) const { return _connections[num]; }
+AsyncHandlerRegestry::AHandlerPtr AsyncHandlerRegestry::aHandler(size_t num) const { return _connections.find(num); }
 
 void AsyncHandlerRegestry::deleteAHandler(size_t num) {
-  _freeNums.enqueue(static_cast<int>(num));
+  _freeNums.enqueue(static_cast<int>(ConnectionsListType::index(num)));
   --_current_size;
 }
 void AsyncHandlerRegestry::put(size_t num, std::shared_ptr<MessageDataContainer> sMessage) {
-  if (_connections[num] == nullptr) {
+  auto connection = _connections.find(num);
+  if (connection == nullptr) {
     throw EXCEPTION("tcp connection not found", std::to_string(num), ERROR_CONNECTION);
   }
-  _connections[num]->put(std::move(sMessage));
+  connection->put(std::move(sMessage));
+}
+void AsyncHandlerRegestry::eraseConnection(size_t index) {
+  // NOTE: handler is deleted by reclaim() when no one reader holds it
+  _connections.remove(index);
 }
 void AsyncHandlerRegestry::run() {
   _isRunning = true;
-  int num;
+  size_t num;
   while (_isRunning) {
-    if (_needToErase.wait_dequeue_timed(num, 1000000)) {
-      auto &connection = _connections[static_cast<size_t>(num)];
-      if (connection && connection->needErase()) {
+    // NOTE: retired handlers are waiting for the readers, so don't sleep too long
+    const int64_t timeout = (_connections.retiredCount() > 0) ? 10000 : 1000000;
+    if (_needToErase.wait_dequeue_timed(num, timeout)) {
+      const size_t index = ConnectionsListType::index(num);
+      AsyncTCPHandler *connection = _connections.get(index);
+      if (connection && (connection->num == num) && connection->needErase()) {
         if (connection->readComplete()) {
-          connection = nullptr;
+          eraseConnection(index);
         } else {
           connection->onReadable(nullptr);
           if (connection->readComplete()) {
-            connection = nullptr;
+            eraseConnection(index);
           }
         }
       }
     }
+    _connections.reclaim();
   }
 
   size_t cnt = 0;
-  while (cnt != _connections.size()) {
+  while (cnt != _connections.capacity()) {
     cnt = 0;
-    for (auto &connection : _connections) {
+    for (size_t index = 0; index < _connections.capacity(); ++index) {
+      AsyncTCPHandler *connection = _connections.get(index);
       if (!connection) {
         ++cnt;
         continue;
       }
       if (connection->needErase()) {
         if (connection->readComplete()) {
-          connection = nullptr;
+          eraseConnection(index);
         } else {
           connection->onReadable(nullptr);
         }
@@ -93,23 +102,25 @@ void AsyncHandlerRegestry::run() {
         connection->setNeedErase();
         connection->onReadable(nullptr);
         if (connection->readComplete()) {
-          connection = nullptr;
+          eraseConnection(index);
           ++cnt;
         }
       }
     }
+    _connections.reclaim();
   }
 
-  try {
-    _connections.clear();
-  } catch (...) {
+  // NOTE: readers and writers are stopped already, the rest is deleted with the table
+  for (int i = 0; i < 100 && _connections.reclaim() > 0; ++i) {
+    Poco::Thread::sleep(10);
   }
 }
 int AsyncHandlerRegestry::erasedConnections() {
   int erased = 0;
-  for (auto &connection : _connections) {
+  for (size_t index = 0; index < _connections.capacity(); ++index) {
+    AsyncTCPHandler *connection = _connections.get(index);
     if (connection && connection->needErase()) {
-      connection = nullptr;
+      eraseConnection(index);
       ++erased;
     }
   }
@@ -142,6 +153,6 @@ int AsyncHandlerRegestry::freeNum() const {
   return num;
 }
 AsyncHandlerRegestry::~AsyncHandlerRegestry() = default;
-void AsyncHandlerRegestry::needToErase(size_t num) { _needToErase.enqueue(static_cast<int>(num)); }
+void AsyncHandlerRegestry::needToErase(size_t num) { _needToErase.enqueue(num); }
 }  // namespace broker
 }  // namespace upmq
@@ -24,17 +24,21 @@
 #include "AsyncTCPHandler.h"
 #include "MessageDataContainer.h"
 #include "Singleton.h"
+#include "SlotTable.h"
 #include "BlockingConcurrentQueueHeader.h"
 namespace upmq {
 namespace broker {
 
 class AsyncHandlerRegestry : public Poco::Runnable {
  public:
-  typedef std::vector<std::shared_ptr<AsyncTCPHandler>> ConnectionsListType;
+  /// @brief ConnectionsListType - slot table of handlers, num of handler is the generation tagged slot handle
+  typedef SlotTable<AsyncTCPHandler> ConnectionsListType;
+  /// @brief AHandlerPtr - handler can't be deleted while its AHandlerPtr is alive
+  typedef ConnectionsListType::Ptr AHandlerPtr;
   AsyncHandlerRegestry();
   ~AsyncHandlerRegestry() override;
   void addAHandler(AsyncTCPHandler* ahandler);
-  std::shared_ptr<AsyncTCPHandler> aHandler(size_t num) const;
+  AHandlerPtr aHandler(size_t num) const;
   void deleteAHandler(size_t num);
   void put(size_t num, std::shared_ptr<MessageDataContainer> sMessage);
   void run() override;
@@ -52,11 +56,13 @@ class AsyncHandlerRegestry : public Poco::Runnable {
   Poco::Condition _condition;
   ConnectionsListType _connections;
   mutable moodycamel::BlockingConcurrentQueue<int> _freeNums{};
-  moodycamel::BlockingConcurrentQueue<int> _needToErase{};
+  moodycamel::BlockingConcurrentQueue<size_t> _needToErase{};
   std::atomic_bool _isRunning;
   std::atomic_size_t _current_size;
   int erasedConnections();
   int freeNum() const;
+  void eraseConnection(size_t index);
+  enum { MAX_THREADS = 1024 };
 
  public:
   std::atomic_size_t _connectionCounter;
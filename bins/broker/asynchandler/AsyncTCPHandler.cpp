@@ -17,6 +17,7 @@
 #include <Exchange.h>
 #include <Poco/File.h>
 #include <S2SProto.h>
+#include <algorithm>
 #include <memory>
 #include <fake_cpp14.h>
 #include "AsyncHandlerRegestry.h"
@@ -33,6 +34,14 @@
 
 #endif
 
+#ifdef ENABLE_USING_IOURING
+#include "iouring/IOUring.h"
+#endif
+
+#ifdef UPMQ_HAS_SHM_RING
+#include <sys/socket.h>
+#endif
+
 #ifdef _WIN32
 using send_size_t = int;
 #else
@@ -42,39 +51,68 @@ using send_size_t = size_t;
 namespace upmq {
 namespace broker {
 
+namespace {
+bool isLocalSocket(const Poco::Net::StreamSocket &socket) {
+#ifdef POCO_HAS_UNIX_SOCKET
+  return socket.address().family() == Poco::Net::SocketAddress::UNIX_LOCAL;
+#else
+  (void)socket;
+  return false;
+#endif
+}
+std::string peerAddressOf(const Poco::Net::StreamSocket &socket) {
+  // NOTE: peer of unix domain socket is unnamed, so the listening path is used
+  if (isLocalSocket(socket)) {
+    return std::string("unix:").append(socket.address().toString());
+  }
+  return socket.peerAddress().toString();
+}
+}  // namespace
+
 AsyncTCPHandler::AsyncTCPHandler(Poco::Net::StreamSocket &socket, upmq::Net::SocketReactor &reactor)
     : _socket(socket),
       _reactor(reactor),
-      _peerAddress(socket.peerAddress().toString()),
+      _peerAddress(peerAddressOf(socket)),
       _readableCallBack(*this, &AsyncTCPHandler::onReadable),
       _errorCallBack(*this, &AsyncTCPHandler::onError),
       _shutdownCallBack(*this, &AsyncTCPHandler::onShutdown),
       _wasError(false),
       _needErase(false),
       _maxNotAcknowledgedMessages(0),
+      _maxOutputSize(NET_CONFIG.maxOutputSize),
       _connection(nullptr),
       _readComplete(true) {
   AHRegestry::Instance().addAHandler(this);
 
+  const Metrics::Labels labels{{"connection", std::to_string(num)}, {"peer", _peerAddress}};
+  _bytesIn = METRICS::Instance().counter("upmq_connection_received_bytes_total", "Bytes received from the connection", labels);
+  _bytesOut = METRICS::Instance().counter("upmq_connection_sent_bytes_total", "Bytes sent to the connection", labels);
+
   const size_t queueNum = AHRegestry::Instance()._connectionCounter++;
 
-  _queueReadNum = queueNum % THREADS_CONFIG.readers;
-  _queueWriteNum = queueNum % THREADS_CONFIG.writers;
+  if (THREADS_CONFIG.shards != 0) {
+    // NOTE: the connection is owned by one shard, which reads and writes it
+    _queueReadNum = queueNum % THREADS_CONFIG.shards;
+    _queueWriteNum = _queueReadNum;
+  } else {
+    _queueReadNum = queueNum % THREADS_CONFIG.readers;
+    _queueWriteNum = queueNum % THREADS_CONFIG.writers;
+  }
 
   log = &Poco::Logger::get(CONFIGURATION::Instance().log().name);
 
-  _socket.setNoDelay(true);
+  if (!isLocalSocket(_socket)) {
+    _socket.setNoDelay(true);
+  }
+#ifdef UPMQ_HAS_SHM_RING
+  // NOTE: client of the unix socket can offer the shared memory segment by the first frame
+  _shmHandshake = isLocalSocket(_socket);
+#endif
   _socket.setBlocking(false);
 
-  log->information("%s",
-                   std::to_string(num)
-                       .append(" * => new asynchandler from ")
-                       .append(_peerAddress)
-                       .append(" q-num : ")
-                       .append(std::to_string(queueNum))
-                       .append(" ( ")
-                       .append(std::to_string(AHRegestry::Instance().size()))
-                       .append(" asynchandlers now )"));
+  BROKER_INFORMATION(log,
+                     num << " * => new asynchandler from " << _peerAddress << " q-num : " << queueNum << " ( " << AHRegestry::Instance().size()
+                         << " asynchandlers now )");
 
   _reactor.addEventHandler(_socket, _readableCallBack);
   _reactor.addEventHandler(_socket, _shutdownCallBack);
@@ -117,11 +155,16 @@ AsyncTCPHandler::~AsyncTCPHandler() {
     BROKER::Instance().removeTcpConnection(_clientID, num);
     EXCHANGE::Instance().dropOwnedDestination(_clientID);
 
+#ifdef UPMQ_HAS_SHM_RING
+    if (_shmSegmentFd >= 0) {
+      ::close(_shmSegmentFd);
+    }
+#endif
   } catch (std::exception &ex) {
     log->critical("%s", std::to_string(num).append(" ! => ").append(std::string(ex.what())));
   }
 
-  log->information("%s", std::to_string(num).append(" * => destruct asynchandler from ").append(_peerAddress));
+  BROKER_INFORMATION(log, num << " * => destruct asynchandler from " << _peerAddress);
 }
 
 void AsyncTCPHandler::onReadable(const AutoPtr<upmq::Net::ReadableNotification> &pNf) {
@@ -143,17 +186,86 @@ void AsyncTCPHandler::onReadable(const AutoPtr<upmq::Net::ReadableNotification>
   }
 }
 void AsyncTCPHandler::put(std::shared_ptr<MessageDataContainer> sMessage) {
+  if (sMessage->header.empty()) {
+    sMessage->serialize();
+  }
+  const uint64_t size = outputSize(*sMessage);
+  _outputSize += size;
   do {
     if (_needErase) {
+      _outputSize -= size;
       return;
     }
   } while (!outputQueue.enqueue(std::move(sMessage)));
   BROKER::Instance().putWritable(_queueWriteNum, num);
 }
+void AsyncTCPHandler::releaseOutput(const MessageDataContainer &sMessage) {
+  const bool wasFull = isOutputFull();
+  _outputSize -= outputSize(sMessage);
+  if (wasFull && !isOutputFull()) {
+    if (!_throttled) {
+      resumeRead();
+    }
+    std::unordered_set<std::string> destinations;
+    {
+      Poco::FastMutex::ScopedLock lock(_waitOutputLock);
+      destinations.swap(_waitOutputDestinations);
+    }
+    for (const auto &destination : destinations) {
+      EXCHANGE::Instance().postNewMessageEvent(destination);
+    }
+  }
+}
+bool AsyncTCPHandler::isOutputFull() const { return (_maxOutputSize != 0) && (_outputSize >= _maxOutputSize); }
+void AsyncTCPHandler::waitOutput(const std::string &destinationName) {
+  {
+    Poco::FastMutex::ScopedLock lock(_waitOutputLock);
+    _waitOutputDestinations.insert(destinationName);
+  }
+  // NOTE: writer could release output between the check and the insert
+  if (!isOutputFull()) {
+    EXCHANGE::Instance().postNewMessageEvent(destinationName);
+  }
+}
+void AsyncTCPHandler::pauseRead() {
+  _readPaused = true;
+  // NOTE: the output or the budget could be released before the pause
+  if (!isOutputFull() && !_throttled) {
+    resumeRead();
+  }
+}
+void AsyncTCPHandler::resumeRead() {
+  if (_readPaused.exchange(false)) {
+    BROKER::Instance().putReadable(_queueReadNum, num);
+  }
+}
+void AsyncTCPHandler::throttle(MemoryBudget &budget) {
+  _throttled = true;
+  if (!budget.wait(num)) {
+    _throttled = false;
+  }
+}
+void AsyncTCPHandler::unthrottle() {
+  _throttled = false;
+  if (!isOutputFull()) {
+    resumeRead();
+  }
+}
+bool AsyncTCPHandler::isThrottled() const { return _throttled; }
+bool AsyncTCPHandler::hasSubscriptions() const {
+  return std::any_of(
+      _subscriptions.begin(), _subscriptions.end(), [](const SubscriptionsList::value_type &subs) { return !subs.second.empty(); });
+}
+uint64_t AsyncTCPHandler::outputSize() const { return _outputSize; }
+uint64_t AsyncTCPHandler::maxOutputSize() const { return _maxOutputSize; }
+uint64_t AsyncTCPHandler::outputSize(const MessageDataContainer &sMessage) {
+  // NOTE: file data is read from disk while sending, so only memory buffers are counted
+  return sMessage.header.size() + (sMessage.withFile() ? 0 : sMessage.data.size());
+}
 
 void AsyncTCPHandler::onShutdown(const AutoPtr<upmq::Net::ShutdownNotification> &pNf) {
   UNUSED_VAR(pNf);
-  log->notice("%s", std::to_string(num).append(" ! => shutdown : ").append(_peerAddress));
+  BROKER_NOTICE(log, num << " ! => shutdown : " << _peerAddress);
   emitCloseEvent();
 }
 
@@ -163,7 +275,34 @@ void AsyncTCPHandler::onError(const AutoPtr<upmq::Net::ErrorNotification> &pNf)
   emitCloseEvent(true);
 }
 
+void AsyncTCPHandler::countSent(const MessageDataContainer &sMessage) {
+  _bytesOut->inc(sizeof(uint32_t) + sizeof(uint64_t) + sMessage.header.size() + sMessage.dataSize());
+}
 AsyncTCPHandler::DataStatus AsyncTCPHandler::sendHeaderAndData(MessageDataContainer &sMessage) {
+  DataStatus status = DataStatus::AS_ERROR;
+  try {
+    status = sendFrame(sMessage);
+  } catch (...) {
+    _outputSent = 0;
+    throw;
+  }
+  // NOTE: on TRYAGAIN the frame is started, the next call with the same frame goes on from the sent bytes
+  if (status != DataStatus::TRYAGAIN) {
+    _outputSent = 0;
+  }
+  return status;
+}
+AsyncTCPHandler::DataStatus AsyncTCPHandler::sendFrame(MessageDataContainer &sMessage) {
+#ifdef UPMQ_HAS_SHM_RING
+  if (_shm != nullptr) {
+    return sendHeaderAndDataByShm(sMessage);
+  }
+#endif
+#ifdef ENABLE_USING_IOURING
+  if (!sMessage.withFile() && (IOUring::local() != nullptr)) {
+    return sendHeaderAndDataByRing(sMessage);
+  }
+#endif
   uint32_t headerSize = static_cast<uint32_t>(sMessage.header.size());
   uint64_t dataSize = sMessage.dataSize();
 
@@ -177,29 +316,24 @@ AsyncTCPHandler::DataStatus AsyncTCPHandler::sendHeaderAndData(MessageDataContai
     sSize.append(sMessage.data);
   }
   ptrdiff_t n = 0;
-  ptrdiff_t sent = 0;
-  send_size_t allSize = static_cast<send_size_t>(sSize.size());
+  size_t sent = static_cast<size_t>(std::min<uint64_t>(_outputSent, sSize.size()));
 
-  do {
-    send_size_t tmpDataSize = (allSize < static_cast<send_size_t>(BUFFER_SIZE)) ? allSize : static_cast<send_size_t>(BUFFER_SIZE);
+  while (sent < sSize.size()) {
+    send_size_t tmpDataSize = static_cast<send_size_t>(std::min<size_t>(sSize.size() - sent, static_cast<size_t>(BUFFER_SIZE)));
     errno = 0;
     do {
       n = ::send(_socket.impl()->sockfd(), &sSize.c_str()[sent], tmpDataSize, MSG_NOSIGNAL);
     } while (n < 0 && Poco::Error::last() == POCO_EINTR);
     int error = Poco::Error::last();
     if ((error == POCO_EAGAIN) || (error == POCO_EWOULDBLOCK)) {
-      if (sent == 0) {
-        return DataStatus::TRYAGAIN;
-      }
-      Poco::Thread::yield();
-      continue;
+      _outputSent = sent;
+      return DataStatus::TRYAGAIN;
     }
     if (n < 0) {
       return DataStatus::AS_ERROR;
     }
-    sent += n;
-    allSize -= static_cast<send_size_t>(n);
-  } while (allSize > 0);
+    sent += static_cast<size_t>(n);
+  }
 
   if (sMessage.withFile() && dataSize != 0) {
 #ifdef ENABLE_USING_SENDFILE
@@ -208,33 +342,267 @@ AsyncTCPHandler::DataStatus AsyncTCPHandler::sendHeaderAndData(MessageDataContai
       return DataStatus::AS_ERROR;
     }
 #else  // !ENABLE_USING_SENDFILE
-    sent = 0;
-    do {
-      int tmpDataSize = ((dataSize - sent) < BUFFER_SIZE) ? static_cast<int>(dataSize - sent) : BUFFER_SIZE;
-      const std::vector<char> partOfData = sMessage.getPartOfData(static_cast<size_t>(sent), static_cast<size_t>(tmpDataSize));
-      tmpDataSize = partOfData.size();  // should be the same, but just in case
+    uint64_t dataSent = (_outputSent > sSize.size()) ? (_outputSent - sSize.size()) : 0;
+    while (dataSent < dataSize) {
+      const size_t partSize = static_cast<size_t>(std::min<uint64_t>(BUFFER_SIZE, dataSize - dataSent));
+      const std::vector<char> partOfData = sMessage.getPartOfData(static_cast<size_t>(dataSent), partSize);
+      if (partOfData.empty()) {
+        throw EXCEPTION("sendHeaderAndData", "can't read message data", EIO);
+      }
       size_t tmpOffs = 0;
-      do {
+      while (tmpOffs < partOfData.size()) {
+        errno = 0;
         do {
-          n = ::send(_socket.impl()->sockfd(), &partOfData[static_cast<size_t>(tmpOffs)], tmpDataSize, MSG_NOSIGNAL);
+          n = ::send(_socket.impl()->sockfd(), &partOfData[tmpOffs], static_cast<send_size_t>(partOfData.size() - tmpOffs), MSG_NOSIGNAL);
         } while (n < 0 && Poco::Error::last() == POCO_EINTR);
         int error = Poco::Error::last();
         if ((error == POCO_EAGAIN) || (error == POCO_EWOULDBLOCK)) {
-          n = 0;
-          Poco::Thread::yield();
-          continue;
+          _outputSent = sSize.size() + dataSent + tmpOffs;
+          return DataStatus::TRYAGAIN;
         } else if (n < 0) {
           throw EXCEPTION("sendHeaderAndData", Poco::Error::getMessage(error), error);
         }
         tmpOffs += static_cast<size_t>(n);
-        sent += static_cast<uint64_t>(n);
-        tmpDataSize -= n;
-      } while (tmpDataSize > 0);
-    } while (dataSize > sent);
+      }
+      dataSent += partOfData.size();
+    }
 #endif  // !ENABLE_USING_SENDFILE
   }
   return DataStatus::OK;
 }
+#ifdef ENABLE_USING_IOURING
+AsyncTCPHandler::DataStatus AsyncTCPHandler::sendHeaderAndDataByRing(MessageDataContainer &sMessage) {
+  uint32_t headerSize = static_cast<uint32_t>(sMessage.header.size());
+  uint64_t dataSize = sMessage.dataSize();
+
+  std::string sSize;
+  sSize.reserve(sizeof(headerSize) + sizeof(dataSize) + headerSize);
+  sSize.append((char *)&headerSize, sizeof(headerSize));
+  sSize.append((char *)&dataSize, sizeof(dataSize));
+  sSize.append(sMessage.header);
+
+  // NOTE: header and body are gathered by the one sqe, body is not copied
+  struct iovec iov[2];
+  iov[0].iov_base = &sSize[0];
+  iov[0].iov_len = sSize.size();
+  iov[1].iov_base = &sMessage.data[0];
+  iov[1].iov_len = sMessage.data.size();
+  const size_t allSize = iov[0].iov_len + iov[1].iov_len;
+
+  ssize_t n = 0;
+  size_t sent = static_cast<size_t>(_outputSent);
+  if (sent == 0) {
+    do {
+      n = IOUring::local()->send(_socket.impl()->sockfd(), iov, (iov[1].iov_len > 0) ? 2 : 1, MSG_NOSIGNAL | MSG_WAITALL);
+    } while (n == -EINTR);
+    if ((n == -EAGAIN) || (n == -EWOULDBLOCK)) {
+      return DataStatus::TRYAGAIN;
+    }
+    if (n < 0) {
+      return DataStatus::AS_ERROR;
+    }
+    sent = static_cast<size_t>(n);
+  }
+
+  // short send or the frame started by the previous call, the rest is sent by the socket
+  while (sent < allSize) {
+    const struct iovec &part = (sent < iov[0].iov_len) ? iov[0] : iov[1];
+    const size_t partOffset = (sent < iov[0].iov_len) ? sent : (sent - iov[0].iov_len);
+    errno = 0;
+    do {
+      n = ::send(_socket.impl()->sockfd(), static_cast<const char *>(part.iov_base) + partOffset, part.iov_len - partOffset, MSG_NOSIGNAL);
+    } while (n < 0 && Poco::Error::last() == POCO_EINTR);
+    int error = Poco::Error::last();
+    if ((error == POCO_EAGAIN) || (error == POCO_EWOULDBLOCK)) {
+      _outputSent = sent;
+      return DataStatus::TRYAGAIN;
+    }
+    if (n < 0) {
+      return DataStatus::AS_ERROR;
+    }
+    sent += static_cast<size_t>(n);
+  }
+  return DataStatus::OK;
+}
+#endif  // ENABLE_USING_IOURING
+
+#ifdef UPMQ_HAS_SHM_RING
+AsyncTCPHandler::DataStatus AsyncTCPHandler::sendHeaderAndDataByShm(MessageDataContainer &sMessage) {
+  uint32_t headerSize = static_cast<uint32_t>(sMessage.header.size());
+  uint64_t dataSize = sMessage.dataSize();
+
+  std::string sSize;
+  sSize.reserve(sizeof(headerSize) + sizeof(dataSize) + headerSize);
+  sSize.append((char *)&headerSize, sizeof(headerSize));
+  sSize.append((char *)&dataSize, sizeof(dataSize));
+  sSize.append(sMessage.header);
+
+  uint64_t offset = 0;
+  DataStatus status = writeToShm(sSize.c_str(), sSize.size(), offset);
+  if (status != DataStatus::OK) {
+    return status;
+  }
+  if (!sMessage.withFile()) {
+    status = writeToShm(sMessage.data.c_str(), sMessage.data.size(), offset);
+  } else {
+    uint64_t sent = (_outputSent > offset) ? (_outputSent - offset) : 0;
+    offset += sent;
+    while ((status == DataStatus::OK) && (sent < dataSize)) {
+      const size_t partSize = static_cast<size_t>(std::min<uint64_t>(BUFFER_SIZE, dataSize - sent));
+      const std::vector<char> partOfData = sMessage.getPartOfData(static_cast<size_t>(sent), partSize);
+      if (partOfData.empty()) {
+        throw EXCEPTION("sendHeaderAndData", "can't read message data", EIO);
+      }
+      status = writeToShm(partOfData.data(), partOfData.size(), offset);
+      sent += partOfData.size();
+    }
+  }
+  ringDoorbell();
+  return status;
+}
+AsyncTCPHandler::DataStatus AsyncTCPHandler::writeToShm(const char *buf, size_t size, uint64_t &offset) {
+  shm::Ring ring = _shm->toClient();
+  // NOTE: the bytes written by the previous call with the same frame are skipped
+  size_t written = (_outputSent > offset) ? static_cast<size_t>(std::min<uint64_t>(_outputSent - offset, size)) : 0;
+  while (written < size) {
+    const size_t n = ring.write(buf + written, size - written);
+    if (n == 0) {
+      if (_needErase) {
+        return DataStatus::AS_ERROR;
+      }
+      // NOTE: the ring is full, the client frees it on the doorbell and the writer gets the connection again
+      ringDoorbell();
+      _outputSent = offset + written;
+      return DataStatus::TRYAGAIN;
+    }
+    written += n;
+  }
+  offset += size;
+  return DataStatus::OK;
+}
+void AsyncTCPHandler::ringDoorbell() {
+  if (_shm->toClient().needNotify()) {
+    // NOTE: if the socket buffer is full, the client is woken up by the bytes already sent
+    const ssize_t n = ::send(_socket.impl()->sockfd(), &shm::DOORBELL, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    UNUSED_VAR(n);
+  }
+}
+bool AsyncTCPHandler::drainDoorbell() {
+  char bell[64];
+  for (;;) {
+    const ssize_t n = ::recv(_socket.impl()->sockfd(), bell, sizeof(bell), MSG_DONTWAIT);
+    if (n > 0) {
+      continue;
+    }
+    if (n == 0) {
+      errno = ECONNRESET;
+      return false;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+  }
+}
+ptrdiff_t AsyncTCPHandler::receiveWithSegment(char *buf, size_t len) {
+  struct iovec iov {};
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  union {
+    struct cmsghdr align;
+    char data[CMSG_SPACE(sizeof(int))];
+  } control{};
+  struct msghdr msg {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.data;
+  msg.msg_controllen = sizeof(control.data);
+  const ssize_t n = ::recvmsg(_socket.impl()->sockfd(), &msg, MSG_CMSG_CLOEXEC);
+  if (n > 0) {
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if ((cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+        int fd = -1;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+        if (_shmSegmentFd < 0) {
+          _shmSegmentFd = fd;
+        } else {
+          ::close(fd);
+        }
+      }
+    }
+  }
+  return n;
+}
+AsyncTCPHandler::DataStatus AsyncTCPHandler::acceptShm(uint64_t segmentSize) {
+  const int fd = _shmSegmentFd;
+  _shmSegmentFd = -1;
+  if ((fd < 0) || (headerBodyLens.headerLen != shm::HANDSHAKE_MAGIC)) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    log->error("%s", std::to_string(num).append(" ! => invalid shared memory handshake from ").append(_peerAddress));
+    return DataStatus::AS_ERROR;
+  }
+  std::unique_ptr<shm::Segment> segment = std::make_unique<shm::Segment>();
+  const bool mapped = segment->map(fd, segmentSize, false);
+  ::close(fd);
+  if (!mapped) {
+    log->error("%s", std::to_string(num).append(" ! => can't map shared memory segment from ").append(_peerAddress));
+    return DataStatus::AS_ERROR;
+  }
+  ssize_t n = 0;
+  do {
+    n = ::send(_socket.impl()->sockfd(), &shm::HANDSHAKE_ACK, 1, MSG_NOSIGNAL);
+  } while (n < 0 && errno == EINTR);
+  if (n != 1) {
+    return DataStatus::AS_ERROR;
+  }
+  _shm = std::move(segment);
+  BROKER_INFORMATION(log, num << " * => shared memory transport (" << segmentSize << " bytes)");
+  return DataStatus::OK;
+}
+#endif  // UPMQ_HAS_SHM_RING
+ptrdiff_t AsyncTCPHandler::receive(char *buf, size_t len) {
+#ifdef UPMQ_HAS_SHM_RING
+  if (_shmHandshake) {
+    return receiveWithSegment(buf, len);
+  }
+  if (_shm != nullptr) {
+    shm::Ring ring = _shm->toBroker();
+    size_t n = ring.read(buf, len);
+    if (n == 0) {
+      // NOTE: doorbell is drained only on the empty ring, the socket is also checked for disconnect here
+      if (!drainDoorbell()) {
+        return -1;
+      }
+      n = ring.read(buf, len);
+      if (n == 0) {
+        errno = EAGAIN;
+        return -1;
+      }
+    }
+    _bytesIn->inc(n);
+    return static_cast<ptrdiff_t>(n);
+  }
+#endif
+  const ptrdiff_t n = ::recv(_socket.impl()->sockfd(), buf, static_cast<send_size_t>(len), MSG_NOSIGNAL);
+  if (n > 0) {
+    _bytesIn->inc(static_cast<uint64_t>(n));
+  }
+  return n;
+}
+bool AsyncTCPHandler::hasBufferedInput() const {
+#ifdef UPMQ_HAS_SHM_RING
+  return (_shm != nullptr) && !_shm->toBroker().isEmpty();
+#else
+  return false;
+#endif
+}
+void AsyncTCPHandler::continueRead() {
+  if (hasBufferedInput() && !_needErase && !_readPaused && _allowPutEvent.exchange(false)) {
+    BROKER::Instance().putReadable(_queueReadNum, num);
+  }
+}
 
 void AsyncTCPHandler::emitCloseEvent(bool withError) {
   if (_needErase) {
@@ -262,7 +630,7 @@ std::string AsyncTCPHandler::toString() const {
   std::stringstream out;
   out << "tcp connection id : " << num << " : "
       << "client id : " << _clientID << " : " << clientVersion.toString() << " : " << heartbeat.toString() << " : " << protocolVersion.toString()
-      << " max_not_acknowledged_messages = " << std::to_string(_maxNotAcknowledgedMessages);
+      << " max_not_acknowledged_messages = " << std::to_string(_maxNotAcknowledgedMessages) << " max_output_size = " << std::to_string(_maxOutputSize);
   return out.str();
 }
 void AsyncTCPHandler::setClientID(const std::string &clientID) { _clientID = clientID; }
@@ -288,6 +656,11 @@ void AsyncTCPHandler::storeClientInfo(const MessageDataContainer &sMessage) {
 
   _maxNotAcknowledgedMessages = connect.max_not_acknowledged_messages();
 
+  const auto maxOutputBytes = static_cast<uint64_t>(connect.max_output_bytes());
+  if ((maxOutputBytes > 0) && ((_maxOutputSize == 0) || (maxOutputBytes < _maxOutputSize))) {
+    _maxOutputSize = maxOutputBytes;
+  }
+
   setClientID(connect.client_id());
 }
 void AsyncTCPHandler::initSubscription(const MessageDataContainer &sMessage) const {
@@ -323,12 +696,17 @@ AsyncTCPHandler::DataStatus AsyncTCPHandler::fillHeaderBodyLens() {
   do {
     errno = 0;
     do {
-      n = ::recv(_socket.impl()->sockfd(), &hbLens[tmpDtSize], static_cast<send_size_t>(sizeof(hbLens)) - tmpDtSize, MSG_NOSIGNAL);  // -V781
+      n = receive(&hbLens[tmpDtSize], static_cast<send_size_t>(sizeof(hbLens)) - tmpDtSize);  // -V781
     } while (n < 0 && Poco::Error::last() == POCO_EINTR);
     if ((n < 0) || (n == 0 && (tmpDtSize != sizeof(hbLens)))) {
       int error = Poco::Error::last();
       if ((error == POCO_EWOULDBLOCK) || (error == POCO_EAGAIN)) {
         if (tmpDtSize == 0) {
+#ifdef UPMQ_HAS_SHM_RING
+          if ((_shm != nullptr) && !_shm->toBroker().prepareWait()) {
+            continue;
+          }
+#endif
           return DataStatus::TRYAGAIN;
         }
         Poco::Thread::yield();
@@ -345,6 +723,18 @@ AsyncTCPHandler::DataStatus AsyncTCPHandler::fillHeaderBodyLens() {
   headerBodyLens.headerLen = *reinterpret_cast<uint32_t *>(hbLens);
   headerBodyLens.bodyLen = *reinterpret_cast<uint64_t *>(&hbLens[sizeof(uint32_t)]);
 
+#ifdef UPMQ_HAS_SHM_RING
+  if (_shmHandshake) {
+    _shmHandshake = false;
+    if ((headerBodyLens.headerLen == shm::HANDSHAKE_MAGIC) || (_shmSegmentFd >= 0)) {
+      if (acceptShm(headerBodyLens.bodyLen) != DataStatus::OK) {
+        return DataStatus::AS_ERROR;
+      }
+      return fillHeaderBodyLens();
+    }
+  }
+#endif
+
   if (headerBodyLens.headerLen == 0) {
     return DataStatus::AS_ERROR;
   }
@@ -353,18 +743,57 @@ AsyncTCPHandler::DataStatus AsyncTCPHandler::fillHeaderBodyLens() {
     return DataStatus::AS_ERROR;
   }
 
+  // NOTE: the buffers are allocated by these lengths, so the frame over the limits isn't read at all
+  if ((headerBodyLens.headerLen > NET_CONFIG.maxHeaderSize) || ((NET_CONFIG.maxBodySize != 0) && (headerBodyLens.bodyLen > NET_CONFIG.maxBodySize))) {
+    log->error("%s",
+               std::to_string(num)
+                   .append(" ! => frame is too big (header ")
+                   .append(std::to_string(headerBodyLens.headerLen))
+                   .append(", body ")
+                   .append(std::to_string(headerBodyLens.bodyLen))
+                   .append(") from ")
+                   .append(_peerAddress));
+    return DataStatus::AS_ERROR;
+  }
+
   return DataStatus::OK;
 }
 AsyncTCPHandler::DataStatus AsyncTCPHandler::fillHeader(MessageDataContainer &sMessage) {
+  // NOTE: the length is known, so the header is received right into the buffer of its size
+  if (headerBodyLens.headerLen <= BufferPool::MAX_CLASS_SIZE) {
+    sMessage.header = BufferPool::acquire(headerBodyLens.headerLen);
+    if (receiveInto(&sMessage.header[0], sMessage.header.size()) == DataStatus::AS_ERROR) {
+      return DataStatus::AS_ERROR;
+    }
+  } else if (receiveAppend(sMessage.header, headerBodyLens.headerLen) == DataStatus::AS_ERROR) {
+    return DataStatus::AS_ERROR;
+  }
+  headerBodyLens.headerLen = 0;
+  return DataStatus::OK;
+}
+AsyncTCPHandler::DataStatus AsyncTCPHandler::fillBody(MessageDataContainer &sMessage) {
+  sMessage.initPersistentDataFileLink();
+  if (!sMessage.withFile()) {
+    if (headerBodyLens.bodyLen <= BufferPool::MAX_CLASS_SIZE) {
+      sMessage.data = BufferPool::acquire(static_cast<size_t>(headerBodyLens.bodyLen));
+      if (receiveInto(&sMessage.data[0], sMessage.data.size()) == DataStatus::AS_ERROR) {
+        return DataStatus::AS_ERROR;
+      }
+    } else if (receiveAppend(sMessage.data, headerBodyLens.bodyLen) == DataStatus::AS_ERROR) {
+      return DataStatus::AS_ERROR;
+    }
+    headerBodyLens.bodyLen = 0;
+    return DataStatus::OK;
+  }
   ptrdiff_t n = 0;
   do {
-    send_size_t tmpHeaderSize =
-        (headerBodyLens.headerLen < INT_MAX) ? static_cast<send_size_t>(headerBodyLens.headerLen) : static_cast<send_size_t>(BUFFER_SIZE);
+    send_size_t tmpDataSize =
+        (headerBodyLens.bodyLen < INT_MAX) ? static_cast<send_size_t>(headerBodyLens.bodyLen) : static_cast<send_size_t>(BUFFER_SIZE);
     errno = 0;
     do {
-      n = ::recv(_socket.impl()->sockfd(), pBuffer, std::min<send_size_t>(BUFFER_SIZE, tmpHeaderSize), MSG_NOSIGNAL);
+      n = receive(pBuffer, std::min<send_size_t>(BUFFER_SIZE, tmpDataSize));
     } while (n < 0 && Poco::Error::last() == POCO_EINTR);
-    if (n < 0 || (n == 0 && (headerBodyLens.headerLen > 0))) {
+    if (n < 0 || (n == 0 && (headerBodyLens.bodyLen > 0))) {
       int error = Poco::Error::last();
       if ((error == POCO_EWOULDBLOCK) || (error == POCO_EAGAIN)) {
         Poco::Thread::yield();
@@ -375,36 +804,42 @@ AsyncTCPHandler::DataStatus AsyncTCPHandler::fillHeader(MessageDataContainer &sM
     if (n == 0) {
       break;
     }
-    headerBodyLens.headerLen -= static_cast<uint32_t>(n);
-    sMessage.header.append(pBuffer, static_cast<size_t>(n));
-  } while (headerBodyLens.headerLen > 0);
+    headerBodyLens.bodyLen -= static_cast<uint64_t>(n);
+    sMessage.appendData(pBuffer, static_cast<size_t>(n));
+  } while (headerBodyLens.bodyLen > 0);
+  sMessage.flushData();
   return DataStatus::OK;
 }
-AsyncTCPHandler::DataStatus AsyncTCPHandler::fillBody(MessageDataContainer &sMessage) {
+AsyncTCPHandler::DataStatus AsyncTCPHandler::receiveInto(char *buffer, size_t size) {
   ptrdiff_t n = 0;
-  sMessage.initPersistentDataFileLink();
-  do {
-    send_size_t tmpDataSize =
-        (headerBodyLens.bodyLen < INT_MAX) ? static_cast<send_size_t>(headerBodyLens.bodyLen) : static_cast<send_size_t>(BUFFER_SIZE);
+  while (size > 0) {
     errno = 0;
     do {
-      n = ::recv(_socket.impl()->sockfd(), pBuffer, std::min<send_size_t>(BUFFER_SIZE, tmpDataSize), MSG_NOSIGNAL);
+      n = receive(buffer, std::min<size_t>(size, INT_MAX));
     } while (n < 0 && Poco::Error::last() == POCO_EINTR);
-    if (n < 0 || (n == 0 && (headerBodyLens.bodyLen > 0))) {
+    if (n <= 0) {
       int error = Poco::Error::last();
-      if ((error == POCO_EWOULDBLOCK) || (error == POCO_EAGAIN)) {
+      if ((n < 0) && ((error == POCO_EWOULDBLOCK) || (error == POCO_EAGAIN))) {
         Poco::Thread::yield();
         continue;
       }
       return DataStatus::AS_ERROR;
     }
-    if (n == 0) {
-      break;
+    buffer += n;
+    size -= static_cast<size_t>(n);
+  }
+  return DataStatus::OK;
+}
+AsyncTCPHandler::DataStatus AsyncTCPHandler::receiveAppend(std::string &out, uint64_t size) {
+  out.clear();
+  while (size > 0) {
+    const size_t chunk = static_cast<size_t>(std::min<uint64_t>(size, BUFFER_SIZE));
+    if (receiveInto(pBuffer, chunk) == DataStatus::AS_ERROR) {
+      return DataStatus::AS_ERROR;
     }
-    headerBodyLens.bodyLen -= static_cast<uint64_t>(n);
-    sMessage.appendData(pBuffer, static_cast<size_t>(n));
-  } while (headerBodyLens.bodyLen > 0);
-  sMessage.flushData();
+    out.append(pBuffer, chunk);
+    size -= chunk;
+  }
   return DataStatus::OK;
 }
 AsyncTCPHandler::DataStatus AsyncTCPHandler::tryMoveBodyByLink(MessageDataContainer &sMessage) {
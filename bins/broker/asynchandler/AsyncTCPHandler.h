@@ -39,7 +39,9 @@
 #include <unordered_set>
 #include "AsyncLogger.h"
 #include "MessageDataContainer.h"
+#include "Metrics.h"
 #include "ConcurrentQueueHeader.h"
+#include "ShmRing.h"
 #include <Poco/Logger.h>
 #ifdef __APPLE__
 #define MSG_NOSIGNAL 0
@@ -81,6 +83,28 @@ class AsyncTCPHandler {
 
   enum class DataStatus { AS_ERROR, TRYAGAIN, OK };
 
+  /// @brief OutputRelease - releases the output of the dequeued frame on any exit of the writer
+  /// ** sent or dropped by the error, the frame doesn't hold the output anymore
+  /// ** dismiss() keeps the output if the frame is put back to the queue
+  class OutputRelease {
+    AsyncTCPHandler *_handler;
+    const MessageDataContainer &_sMessage;
+
+   public:
+    OutputRelease(AsyncTCPHandler &handler, const MessageDataContainer &sMessage) : _handler(&handler), _sMessage(sMessage) {}
+    OutputRelease(const OutputRelease &) = delete;
+    OutputRelease &operator=(const OutputRelease &) = delete;
+    ~OutputRelease() {
+      if (_handler != nullptr) {
+        try {
+          _handler->releaseOutput(_sMessage);
+        } catch (...) {
+        }
+      }
+    }
+    void dismiss() { _handler = nullptr; }
+  };
+
   AsyncTCPHandler(Poco::Net::StreamSocket &socket, upmq::Net::SocketReactor &reactor);
   void removeErrorShutdownHandler();
   void removeConsumers();
@@ -98,6 +122,18 @@ class AsyncTCPHandler {
   const std::string &peerAddress() const;
 
   void put(std::shared_ptr<MessageDataContainer> sMessage);
+  void releaseOutput(const MessageDataContainer &sMessage);
+  bool isOutputFull() const;
+  void waitOutput(const std::string &destinationName);
+  void pauseRead();
+  void resumeRead();
+  // reading is paused until the budget falls below the low watermark
+  void throttle(MemoryBudget &budget);
+  void unthrottle();
+  bool isThrottled() const;
+  bool hasSubscriptions() const;
+  uint64_t outputSize() const;
+  uint64_t maxOutputSize() const;
 
   std::string toString() const;
 
@@ -108,24 +144,56 @@ class AsyncTCPHandler {
 
   void emitCloseEvent(bool withError = false);
 
+  // on TRYAGAIN the frame may be sent partly, so the same frame has to be passed again before the next one
   DataStatus sendHeaderAndData(MessageDataContainer &sMessage);
+  // counts the frame sent by sendHeaderAndData
+  void countSent(const MessageDataContainer &sMessage);
 
   size_t queueReadNum() const;
   size_t queueWriteNum() const;
 
+  // true if frames are already received but the socket isn't readable (shared memory transport)
+  bool hasBufferedInput() const;
+  // puts the read event for the buffered input, the reactor doesn't see it
+  void continueRead();
+
  private:
   enum { BUFFER_SIZE = 65536 };
+  DataStatus sendFrame(MessageDataContainer &sMessage);
+#ifdef ENABLE_USING_IOURING
+  DataStatus sendHeaderAndDataByRing(MessageDataContainer &sMessage);
+#endif
+  ptrdiff_t receive(char *buf, size_t len);
+#ifdef UPMQ_HAS_SHM_RING
+  ptrdiff_t receiveWithSegment(char *buf, size_t len);
+  DataStatus acceptShm(uint64_t segmentSize);
+  DataStatus sendHeaderAndDataByShm(MessageDataContainer &sMessage);
+  DataStatus writeToShm(const char *buf, size_t size, uint64_t &offset);
+  bool drainDoorbell();
+  void ringDoorbell();
+
+  // NOTE: after the handshake frames are read from and written to the shared memory rings
+  std::unique_ptr<shm::Segment> _shm;
+  bool _shmHandshake{false};
+  int _shmSegmentFd{-1};
+#endif
 
   Poco::Net::StreamSocket _socket;
   upmq::Net::SocketReactor &_reactor;
   std::string _peerAddress;
   std::atomic_bool _allowPutEvent{true};
+  std::atomic_bool _readPaused{false};
+  std::atomic_bool _throttled{false};
+  std::shared_ptr<Metrics::Counter> _bytesIn;
+  std::shared_ptr<Metrics::Counter> _bytesOut;
 
  public:
   void allowPutReadEvent();
 
  public:
   moodycamel::ConcurrentQueue<std::shared_ptr<MessageDataContainer> > outputQueue;
+  // the frame started but not sent completely, it goes before outputQueue (under onWritableLock)
+  std::shared_ptr<MessageDataContainer> pendingOutput;
   Poco::FastMutex onWritableLock;
   Poco::FastMutex onReadableLock;
   char pBuffer[BUFFER_SIZE]{};
@@ -149,6 +217,12 @@ class AsyncTCPHandler {
   size_t _queueWriteNum = 0;
 
   int _maxNotAcknowledgedMessages;
+  std::atomic<uint64_t> _outputSize{0};
+  uint64_t _maxOutputSize;
+  // bytes of the current output frame written before the socket or the ring got full
+  uint64_t _outputSent{0};
+  Poco::FastMutex _waitOutputLock;
+  std::unordered_set<std::string> _waitOutputDestinations;
   std::string _clientID;
   mutable SubscriptionsList _subscriptions;
   mutable Connection *_connection;
@@ -166,6 +240,13 @@ class AsyncTCPHandler {
   AsyncTCPHandler::DataStatus tryMoveBodyByLink(MessageDataContainer &sMessage);
   void setReadComplete(bool readComplete);
   bool readComplete() const;
+
+ private:
+  static uint64_t outputSize(const MessageDataContainer &sMessage);
+  // receives the whole size into the buffer
+  AsyncTCPHandler::DataStatus receiveInto(char *buffer, size_t size);
+  // receives the whole size appending it to the buffer by chunks, the buffer grows as the data arrives
+  AsyncTCPHandler::DataStatus receiveAppend(std::string &out, uint64_t size);
 };
 }  // namespace broker
 }  // namespace upmq
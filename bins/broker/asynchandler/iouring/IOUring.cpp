@@ -0,0 +1,344 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "IOUring.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+constexpr unsigned RING_ENTRIES = 64;
+constexpr size_t MAX_INFLIGHT_WRITES = 32;
+
+namespace upmq {
+namespace broker {
+
+namespace {
+int sys_io_uring_setup(unsigned entries, io_uring_params *params) { return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params)); }
+int sys_io_uring_enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nrArgs) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nrArgs));
+}
+inline unsigned loadAcquire(const unsigned *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline void storeRelease(unsigned *p, unsigned v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+template <typename T>
+inline T *offsetPtr(void *base, uint32_t offset) {
+  return reinterpret_cast<T *>(static_cast<char *>(base) + offset);
+}
+}  // namespace
+
+IOUring *IOUring::local() {
+  static thread_local std::unique_ptr<IOUring> ring;
+  static thread_local bool tried = false;
+  if (!tried) {
+    tried = true;
+    std::unique_ptr<IOUring> tmp(new IOUring);
+    if (tmp->init(RING_ENTRIES) && tmp->isSupported()) {
+      ring = std::move(tmp);
+    }
+  }
+  if (ring && ring->_failed) {
+    return nullptr;
+  }
+  return ring.get();
+}
+
+bool IOUring::init(unsigned entries) {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  _fd = sys_io_uring_setup(entries, &params);
+  if (_fd < 0) {
+    _fd = -1;
+    return false;
+  }
+
+  _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  const bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (singleMmap) {
+    _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+  }
+
+  _sqRing = ::mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+  if (_sqRing == MAP_FAILED) {
+    _sqRing = nullptr;
+    return false;
+  }
+  if (singleMmap) {
+    _cqRing = _sqRing;
+  } else {
+    _cqRing = ::mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+    if (_cqRing == MAP_FAILED) {
+      _cqRing = nullptr;
+      return false;
+    }
+  }
+  _sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+  void *sqes = ::mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) {
+    return false;
+  }
+  _sqes = static_cast<io_uring_sqe *>(sqes);
+
+  _sqHead = offsetPtr<unsigned>(_sqRing, params.sq_off.head);
+  _sqTail = offsetPtr<unsigned>(_sqRing, params.sq_off.tail);
+  _sqMask = offsetPtr<unsigned>(_sqRing, params.sq_off.ring_mask);
+  _sqEntries = offsetPtr<unsigned>(_sqRing, params.sq_off.ring_entries);
+  _sqArray = offsetPtr<unsigned>(_sqRing, params.sq_off.array);
+  _cqHead = offsetPtr<unsigned>(_cqRing, params.cq_off.head);
+  _cqTail = offsetPtr<unsigned>(_cqRing, params.cq_off.tail);
+  _cqMask = offsetPtr<unsigned>(_cqRing, params.cq_off.ring_mask);
+  _cqes = offsetPtr<void>(_cqRing, params.cq_off.cqes);
+  return true;
+}
+
+bool IOUring::isSupported() const {
+  // NOTE: IORING_REGISTER_PROBE is available since 5.6 as well as IORING_OP_SENDMSG/IORING_OP_WRITE
+  const size_t probeSize = sizeof(io_uring_probe) + IORING_OP_LAST * sizeof(io_uring_probe_op);
+  std::vector<char> buffer(probeSize, 0);
+  auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+  if (sys_io_uring_register(_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0) {
+    return false;
+  }
+  auto supported = [probe](unsigned op) { return (op <= probe->last_op) && ((probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0); };
+  return supported(IORING_OP_SENDMSG) && supported(IORING_OP_WRITE);
+}
+
+IOUring::~IOUring() {
+  if (_sqes != nullptr) {
+    ::munmap(_sqes, _sqesSize);
+  }
+  if ((_cqRing != nullptr) && (_cqRing != _sqRing)) {
+    ::munmap(_cqRing, _cqRingSize);
+  }
+  if (_sqRing != nullptr) {
+    ::munmap(_sqRing, _sqRingSize);
+  }
+  if (_fd >= 0) {
+    ::close(_fd);
+  }
+}
+
+io_uring_sqe *IOUring::nextSqe() {
+  unsigned tail = *_sqTail;
+  while (tail - loadAcquire(_sqHead) >= *_sqEntries) {
+    if (_failed || submit(0) < 0) {
+      return nullptr;
+    }
+  }
+  const unsigned index = tail & *_sqMask;
+  io_uring_sqe *sqe = &_sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  _sqArray[index] = index;
+  return sqe;
+}
+
+void IOUring::push() {
+  // NOTE: sqe must be filled before the tail is published
+  storeRelease(_sqTail, *_sqTail + 1);
+  ++_toSubmit;
+}
+
+int IOUring::submit(unsigned waitNr) {
+  int result = 0;
+  do {
+    result = sys_io_uring_enter(_fd, _toSubmit, waitNr, (waitNr > 0) ? IORING_ENTER_GETEVENTS : 0);
+  } while (result < 0 && errno == EINTR);
+  if (result < 0) {
+    if ((errno == EAGAIN) || (errno == EBUSY)) {
+      // completion queue is full, let the caller reap it and try again
+      reap();
+      return 0;
+    }
+    setFailed();
+    return -errno;
+  }
+  _toSubmit -= std::min(_toSubmit, static_cast<unsigned>(result));
+  return result;
+}
+
+void IOUring::reap() {
+  if (_failed) {
+    return;
+  }
+  unsigned head = *_cqHead;
+  const unsigned tail = loadAcquire(_cqTail);
+  auto *cqes = static_cast<io_uring_cqe *>(_cqes);
+  while (head != tail) {
+    const io_uring_cqe &cqe = cqes[head & *_cqMask];
+    auto *completion = reinterpret_cast<Completion *>(static_cast<uintptr_t>(cqe.user_data));
+    if (completion != nullptr) {
+      completion->res = cqe.res;
+      completion->done = true;
+    }
+    ++head;
+  }
+  storeRelease(_cqHead, head);
+}
+
+void IOUring::wait(Completion &completion) {
+  reap();
+  while (!completion.done) {
+    if (_failed) {
+      completion.res = -EIO;
+      completion.done = true;
+      break;
+    }
+    submit(1);
+    reap();
+  }
+}
+
+void IOUring::setFailed() {
+  // NOTE: in-flight completions can't be trusted anymore, ring will not be used by this thread
+  _failed = true;
+}
+
+ssize_t IOUring::send(int sd, const struct iovec *iov, size_t count, int flags) {
+  io_uring_sqe *sqe = nextSqe();
+  if (sqe == nullptr) {
+    return -EIO;
+  }
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec *>(iov);
+  msg.msg_iovlen = count;
+
+  Completion completion;
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = sd;
+  sqe->addr = reinterpret_cast<uintptr_t>(&msg);
+  sqe->len = 1;
+  sqe->msg_flags = static_cast<uint32_t>(flags);
+  sqe->user_data = reinterpret_cast<uintptr_t>(&completion);
+  push();
+  wait(completion);
+  return completion.res;
+}
+
+bool IOUring::write(int fd, const void *buf, size_t size, uint64_t offset, Completion &completion) {
+  io_uring_sqe *sqe = nextSqe();
+  if (sqe == nullptr) {
+    return false;
+  }
+  completion = Completion();
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(buf);
+  sqe->len = static_cast<uint32_t>(size);
+  sqe->off = offset;
+  sqe->user_data = reinterpret_cast<uintptr_t>(&completion);
+  push();
+  return submit(0) >= 0;
+}
+
+IOUringFileWriter::IOUringFileWriter(IOUring &ring, const std::string &path) : _ring(ring) {
+  do {
+    _fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+  } while (_fd < 0 && errno == EINTR);
+  if (_fd < 0) {
+    _error = errno;
+    return;
+  }
+  // NOTE: explicit offsets instead of O_APPEND, submitted writes can be completed out of order
+  struct stat st;
+  if (::fstat(_fd, &st) == 0) {
+    _offset = static_cast<uint64_t>(st.st_size);
+  }
+}
+
+IOUringFileWriter::~IOUringFileWriter() { close(); }
+
+bool IOUringFileWriter::write(const char *part, size_t size) {
+  if (!isOpen()) {
+    return false;
+  }
+  if (size == 0) {
+    return true;
+  }
+  while (_inflight.size() >= MAX_INFLIGHT_WRITES) {
+    std::unique_ptr<Chunk> chunk = std::move(_inflight.front());
+    _inflight.pop_front();
+    if (!complete(*chunk)) {
+      return false;
+    }
+  }
+  std::unique_ptr<Chunk> chunk(new Chunk);
+  chunk->buffer.assign(part, size);
+  chunk->offset = _offset;
+  _offset += size;
+  if (!_ring.write(_fd, chunk->buffer.data(), chunk->buffer.size(), chunk->offset, chunk->completion)) {
+    // NOTE: sqe could be lost together with the ring, write it synchronously
+    chunk->completion.res = 0;
+    chunk->completion.done = true;
+  }
+  _inflight.emplace_back(std::move(chunk));
+  return true;
+}
+
+bool IOUringFileWriter::complete(Chunk &chunk) {
+  _ring.wait(chunk.completion);
+  size_t written = (chunk.completion.res > 0) ? static_cast<size_t>(chunk.completion.res) : 0;
+  if (chunk.completion.res < 0 && chunk.completion.res != -EIO && chunk.completion.res != -EAGAIN && chunk.completion.res != -EINTR) {
+    _error = -chunk.completion.res;
+    return false;
+  }
+  // short write or failed ring, finish it synchronously
+  while (written < chunk.buffer.size()) {
+    ssize_t n = ::pwrite(_fd, chunk.buffer.data() + written, chunk.buffer.size() - written, static_cast<off_t>(chunk.offset + written));
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      _error = errno;
+      return false;
+    }
+    written += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+bool IOUringFileWriter::flush() {
+  bool result = (_error == 0);
+  while (!_inflight.empty()) {
+    std::unique_ptr<Chunk> chunk = std::move(_inflight.front());
+    _inflight.pop_front();
+    if (!complete(*chunk)) {
+      result = false;
+    }
+  }
+  return result;
+}
+
+void IOUringFileWriter::close() {
+  flush();
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+}  // namespace broker
+}  // namespace upmq
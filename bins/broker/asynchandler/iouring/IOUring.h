@@ -0,0 +1,124 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __BROKER_IOURING_H
+#define __BROKER_IOURING_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+
+struct io_uring_sqe;
+
+namespace upmq {
+namespace broker {
+
+// Minimal io_uring submission/completion ring (linux only, without liburing)
+// NOTE: ring is thread local, every submitted operation must be waited on the same thread
+class IOUring {
+ public:
+  struct Completion {
+    int32_t res = 0;
+    bool done = false;
+  };
+
+  // ring of the current thread or nullptr if io_uring is not available (old kernel, seccomp, etc.)
+  static IOUring *local();
+
+  ~IOUring();
+  IOUring(const IOUring &) = delete;
+  IOUring &operator=(const IOUring &) = delete;
+
+  // gather send of iov[0..count) to the socket, returns sent bytes or -errno
+  ssize_t send(int sd, const struct iovec *iov, size_t count, int flags);
+  // submit write of the buffer to the file at offset, completion must live until wait()
+  bool write(int fd, const void *buf, size_t size, uint64_t offset, Completion &completion);
+  // wait for the completion of previously submitted operation
+  void wait(Completion &completion);
+
+ private:
+  IOUring() = default;
+  bool init(unsigned entries);
+  bool isSupported() const;
+  io_uring_sqe *nextSqe();
+  void push();
+  int submit(unsigned waitNr);
+  void reap();
+  void setFailed();
+
+ private:
+  int _fd{-1};
+  bool _failed{false};
+  unsigned _toSubmit{0};
+  void *_sqRing{nullptr};
+  size_t _sqRingSize{0};
+  void *_cqRing{nullptr};
+  size_t _cqRingSize{0};
+  io_uring_sqe *_sqes{nullptr};
+  size_t _sqesSize{0};
+  unsigned *_sqHead{nullptr};
+  unsigned *_sqTail{nullptr};
+  unsigned *_sqMask{nullptr};
+  unsigned *_sqEntries{nullptr};
+  unsigned *_sqArray{nullptr};
+  unsigned *_cqHead{nullptr};
+  unsigned *_cqTail{nullptr};
+  unsigned *_cqMask{nullptr};
+  void *_cqes{nullptr};
+};
+
+// Sequential file writer, every appended part is submitted to the thread ring without waiting
+class IOUringFileWriter {
+ public:
+  IOUringFileWriter(IOUring &ring, const std::string &path);
+  ~IOUringFileWriter();
+  IOUringFileWriter(const IOUringFileWriter &) = delete;
+  IOUringFileWriter &operator=(const IOUringFileWriter &) = delete;
+
+  inline bool isOpen() const { return _fd >= 0; }
+
+  inline int lastError() const { return _error; }
+
+  // returns false on error, see lastError()
+  bool write(const char *part, size_t size);
+  // wait for all submitted writes
+  bool flush();
+  void close();
+
+ private:
+  struct Chunk {
+    std::string buffer;
+    uint64_t offset = 0;
+    IOUring::Completion completion;
+  };
+  bool complete(Chunk &chunk);
+
+ private:
+  IOUring &_ring;
+  int _fd{-1};
+  uint64_t _offset{0};
+  int _error{0};
+  std::deque<std::unique_ptr<Chunk>> _inflight;
+};
+
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // __BROKER_IOURING_H
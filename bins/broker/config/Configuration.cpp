@@ -89,6 +89,10 @@ const Configuration::Destinations &Configuration::destinations() const { return
 void Configuration::setDestinations(const Configuration::Destinations &destinations) { _destinations = destinations; }
 const Configuration::Storage &Configuration::storage() const { return _storage; }
 void Configuration::setStorage(const Configuration::Storage &storage) { _storage = storage; }
+const Configuration::Memory &Configuration::memory() const { return _memory; }
+void Configuration::setMemory(const Configuration::Memory &memory) { _memory = memory; }
+const Configuration::Trace &Configuration::trace() const { return _trace; }
+void Configuration::setTrace(const Configuration::Trace &trace) { _trace = trace; }
 std::string Configuration::toString() const {
   return std::string("\n- * \tport\t\t\t: ")
       .append(std::to_string(_port))
@@ -111,7 +115,11 @@ std::string Configuration::toString() const {
       .append("\n- * \tdestination\t\t=> ")
       .append(_destinations.toString())
       .append("\n- * \tstorage\t\t\t=> ")
-      .append(_storage.toString());
+      .append(_storage.toString())
+      .append("\n- * \tmemory\t\t\t=> ")
+      .append(_memory.toString())
+      .append("\n- * \ttrace\t\t\t: ")
+      .append(_trace.toString());
 }
 std::vector<std::string> Configuration::toStringLines() const {
   std::string s = toString();
@@ -124,7 +132,31 @@ std::string Configuration::Http::toString() const {
   return std::string("\n- * \t\tport\t\t: ").append(std::to_string(port)).append("\n- * \t\tsite\t\t: [").append(site.toString()).append("]");
 }
 std::string Configuration::HeartBeat::toString() const { return std::to_string(sendTimeout).append(".").append(std::to_string(recvTimeout)); }
-std::string Configuration::Net::toString() const { return std::string("\n- * \t\tmax-connections\t: ").append(std::to_string(maxConnections)); }
+std::string Configuration::Net::toString() const {
+  return std::string("\n- * \t\tmax-connections\t: ")
+      .append(std::to_string(maxConnections))
+      .append("\n- * \t\tmax-output-size\t: ")
+      .append(std::to_string(maxOutputSize))
+      .append("\n- * \t\tmax-header-size\t: ")
+      .append(std::to_string(maxHeaderSize))
+      .append("\n- * \t\tmax-body-size\t: ")
+      .append(maxBodySize == 0 ? "unlimited" : std::to_string(maxBodySize))
+      .append("\n- * \t\tunix-socket\t: ")
+      .append(unixSocket.empty() ? "disabled" : unixSocket);
+}
+std::string Configuration::Memory::toString() const {
+  return std::string("\n- * \t\tlimit\t\t: ")
+      .append(limit == 0 ? "unlimited" : std::to_string(limit))
+      .append("\n- * \t\tdestination-limit\t: ")
+      .append(destinationLimit == 0 ? "unlimited" : std::to_string(destinationLimit))
+      .append("\n- * \t\twatermarks\t: ")
+      .append(std::to_string(highWatermark))
+      .append("/")
+      .append(std::to_string(lowWatermark))
+      .append("\n- * \t\tspill\t\t: ")
+      .append(spill ? std::to_string(spillSegmentSize) : "disabled");
+}
+std::string Configuration::Trace::toString() const { return (sampling == 0) ? "disabled" : std::string("1/").append(std::to_string(sampling)); }
 std::string Configuration::Threads::toString() const {
   return std::string("\n- * \t\taccept\t\t: ")
       .append(std::to_string(accepters))
@@ -133,14 +165,18 @@ std::string Configuration::Threads::toString() const {
       .append("\n- * \t\tsubscribe\t: ")
       .append(std::to_string(subscribers))
       .append("\n- * \t\twrite\t\t: ")
-      .append(std::to_string(writers));
+      .append(std::to_string(writers))
+      .append("\n- * \t\tshards\t\t: ")
+      .append((shards == 0) ? "disabled" : std::to_string(shards));
 }
-uint32_t Configuration::Threads::all() const { return accepters + readers + writers + subscribers; }
+uint32_t Configuration::Threads::all() const { return accepters + readers + writers + subscribers + shards; }
 std::string Configuration::Log::toString() const {
   return std::string("\n- * \t\tlevel\t\t: ")
       .append(std::to_string(level))
       .append("\n- * \t\tinteracive\t: ")
       .append(isInteractive ? "true" : "false")
+      .append("\n- * \t\tring-size\t: ")
+      .append(std::to_string(ringSize))
       .append("\n- * \t\tpath\t\t: [")
       .append(path.toString())
       .append("]");
@@ -51,6 +51,14 @@ class Configuration {
 
   struct Net {
     int maxConnections{1024};
+    // NOTE: max size of not sent data per connection (bytes), 0 - unlimited
+    size_t maxOutputSize{67108864};
+    // NOTE: max size of the incoming frame header (bytes), the connection of the bigger frame is closed
+    size_t maxHeaderSize{16777216};
+    // NOTE: max size of the incoming frame body (bytes), 0 - unlimited
+    uint64_t maxBodySize{0};
+    // NOTE: path of unix domain socket for local clients, empty - disabled
+    std::string unixSocket;
     std::string toString() const;
   };
 
@@ -59,6 +67,8 @@ class Configuration {
     uint32_t readers{8};
     uint32_t writers{8};
     uint32_t subscribers{8};
+    // NOTE: thread per core mode, count of shards, 0 - disabled
+    uint32_t shards{0};
     std::string toString() const;
     uint32_t all() const;
   };
@@ -68,6 +78,8 @@ class Configuration {
     std::string name{"broker"};
     Poco::Path path;
     bool isInteractive{true};
+    // records per thread ring of the AsyncLogger, the record is dropped if the ring is full
+    size_t ringSize{1024};
     std::string toString() const;
   };
 
@@ -141,6 +153,26 @@ class Configuration {
     static std::string typeName(storage::DBMSType dbmsType);
   };
 
+  struct Memory {
+    // NOTE: bytes of message bodies held in memory by the broker, 0 - unlimited
+    size_t limit{0};
+    // NOTE: bytes of message bodies held in memory per destination, 0 - unlimited
+    size_t destinationLimit{0};
+    // NOTE: percents of the limit, producers are throttled from the high watermark until the low one
+    int highWatermark{90};
+    int lowWatermark{70};
+    // NOTE: non-persistent bodies over the high watermark are written to temporary segment files
+    bool spill{false};
+    size_t spillSegmentSize{67108864};
+    std::string toString() const;
+  };
+
+  struct Trace {
+    // NOTE: one of N messages is traced through the broker stages, 0 - disabled
+    size_t sampling{0};
+    std::string toString() const;
+  };
+
   Configuration();
   virtual ~Configuration() = default;
 
@@ -170,6 +202,10 @@ class Configuration {
   void setDestinations(const Destinations &destinations);
   const Storage &storage() const;
   void setStorage(const Storage &storage);
+  const Memory &memory() const;
+  void setMemory(const Memory &memory);
+  const Trace &trace() const;
+  void setTrace(const Trace &trace);
 
   std::string toString() const;
   std::vector<std::string> toStringLines() const;
@@ -186,6 +222,8 @@ class Configuration {
   Subscriptions _subscriptions;
   Destinations _destinations;
   Storage _storage;
+  Memory _memory;
+  Trace _trace;
 };
 }  // namespace broker
 }  // namespace upmq
@@ -199,5 +237,7 @@ typedef Singleton<upmq::broker::Configuration> CONFIGURATION;
 #define THREADS_CONFIG CONFIGURATION::Instance().threads()
 #define NET_CONFIG CONFIGURATION::Instance().net()
 #define LOG_CONFIG CONFIGURATION::Instance().log()
+#define MEMORY_CONFIG CONFIGURATION::Instance().memory()
+#define TRACE_CONFIG CONFIGURATION::Instance().trace()
 
 #endif  // BROKER_CONFIGURATION_H
@@ -15,6 +15,7 @@
  */
 
 #include <fake_cpp14.h>
+#include <algorithm>
 #include "Connection.h"
 #include "AsyncHandlerRegestry.h"
 #include "Broker.h"
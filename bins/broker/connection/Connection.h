@@ -19,6 +19,7 @@
 
 #include <Poco/RWLock.h>
 #include <atomic>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -26,7 +27,8 @@
 #include "AsyncTCPHandler.h"
 #include "Selector.h"
 #include "Session.h"
-#include "FixedSizeUnorderedMap.h"
+#include "ConcurrentHashMap.h"
+#include "MoveableRWLock.h"
 
 namespace upmq {
 namespace broker {
@@ -35,7 +37,7 @@ class Connection {
  public:
   using TCPConnectionsList = std::set<size_t>;
   // SessionsList - map<session_id, session>
-  using SessionsList = FSUnorderedMap<std::string, std::unique_ptr<upmq::broker::Session>>;
+  using SessionsList = ConcurrentHashMap<std::string, std::unique_ptr<upmq::broker::Session>>;
 
  private:
   std::string _clientID;
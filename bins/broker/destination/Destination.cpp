@@ -15,12 +15,14 @@
  */
 
 #include "Destination.h"
+#include <algorithm>
 #include <Poco/Delegate.h>
 #include <Poco/StringTokenizer.h>
 #include <Poco/UUIDGenerator.h>
 #include <Poco/URI.h>
 #include "Connection.h"
 #include "Exchange.h"
+#include "Interner.h"
 #include "MiscDefines.h"
 #include "fake_cpp14.h"
 #include "NextBindParam.h"
@@ -32,17 +34,22 @@ Destination::Destination(const Exchange &exchange, const std::string &uri, Type
     : _id(getStoredDestinationID(exchange, Exchange::mainDestinationPath(uri), type)),
       _uri(uri),
       _name(Exchange::mainDestinationPath(uri)),
+      _handle(INTERNER::Instance().intern(_name)),
       _subscriptions(SUBSCRIPTIONS_CONFIG.maxCount),
       _storage(_id, STORAGE_CONFIG.messages.nonPresistentSize),
       _type(type),
       _exchange(exchange),
       _subscriptionsT("\"" + _id + "_subscriptions\""),
-      _consumerMode(makeConsumerMode(_uri)) {
+      _consumerMode(makeConsumerMode(_uri)),
+      _deliveryHeaders(STORAGE_CONFIG.messages.nonPresistentSize),
+      _memoryBudget(std::make_shared<MemoryBudget>(
+          static_cast<int64_t>(MEMORY_CONFIG.destinationLimit), MEMORY_CONFIG.highWatermark, MEMORY_CONFIG.lowWatermark, &MEMORYBUDGET::Instance())) {
   _storage.setParent(this);
   storage::DBMSSession dbSession = dbms::Instance().dbmsSession();
   dbSession.beginTX(_id);
   createSubscriptionsTable(dbSession);
   createJournalTable(dbSession);
+  initMetrics(dbSession);
   dbSession.commitTX();
 }
 Destination::~Destination() {
@@ -72,6 +79,12 @@ Destination::~Destination() {
       CATCH_POCO_DATA_EXCEPTION_PURE_NO_EXCEPT("can't update subscription count", sql.str(), ERROR_UNKNOWN)
       _storage.dropTables();
     }
+    for (const auto &item : _notAckList) {
+      INTERNER::Instance().release(item.first);
+    }
+    for (const auto &item : _creditList) {
+      INTERNER::Instance().release(item.first);
+    }
   } catch (...) {
     // TODO : make log
   }
@@ -177,7 +190,9 @@ void Destination::subscribeOnNotify(Subscription &subscription) const {
   {
     upmq::ScopedWriteRWLock writeRWLock(_routingLock);
     _routing.insert(std::make_pair(subscription.routingKey(), std::make_unique<Poco::FIFOEvent<const MessageDataContainer *>>()));
-    *_routing[subscription.routingKey()] += Poco::delegate(&subscription, &Subscription::onEvent);
+    auto &event = _routing[subscription.routingKey()];
+    *event += Poco::delegate(&subscription, &Subscription::onEvent);
+    _routingTrie.add(subscription.routingKey(), event.get());
   }
   subscription.setHasNotify(true);
 }
@@ -188,6 +203,7 @@ void Destination::unsubscribeFromNotify(Subscription &subscription) const {
     if (item != _routing.end()) {
       *item->second -= Poco::delegate(&subscription, &Subscription::onEvent);
       if (!item->second->hasDelegates()) {
+        _routingTrie.remove(item->first);
         _routing.erase(item);
       }
     }
@@ -258,7 +274,10 @@ Subscription &Destination::subscription(const Session &session, const MessageDat
   if (isTopicFamily() && session.isTransactAcknowledge()) {
     subs.storage().begin(session, subs.id());
   }
-  subs.addClient(session, sMessage.handlerNum, sMessage.objectID(), subscription.selector(), localMode);
+  if (subscription.credit_bytes() > 0) {
+    addToCreditList(sMessage.objectID(), subscription.credit_bytes());
+  }
+  subs.addClient(session, sMessage.handlerNum, sMessage.objectID(), subscription.selector(), localMode, subscription.batch_size(), subscription.priority(), subscription.weight());
   return subs;
 }
 Subscription::ConsumerMode Destination::makeConsumerMode(const std::string &uri) {
@@ -288,7 +307,18 @@ std::string Destination::routingKey(const std::string &uri) {
   Poco::StringTokenizer URI(uri, ":", Poco::StringTokenizer::TOK_TRIM);
   std::string routingKey = URI[1];
   routingKey = Poco::replace(routingKey, "//", " ");
-  DestinationFactory::removeParamsAndFragmentFromURI(routingKey);
+  std::string::size_type pos = routingKey.find('?');
+  if (pos != std::string::npos) {
+    routingKey.erase(pos);
+  }
+  // NOTE: '#' level is the wildcard of the routing key, other '#' is the fragment of the uri
+  for (pos = routingKey.find('#'); pos != std::string::npos; pos = routingKey.find('#', pos + 1)) {
+    const bool isLevel = (pos > 0) && (routingKey[pos - 1] == '/') && ((pos + 1 == routingKey.size()) || (routingKey[pos + 1] == '/'));
+    if (!isLevel) {
+      routingKey.erase(pos);
+      break;
+    }
+  }
   Poco::trimInPlace(routingKey);
   return routingKey;
 }
@@ -347,6 +377,7 @@ size_t Destination::subscriptionsCount() const {
 }
 size_t Destination::subscriptionsTrueCount() const { return _subscriptions.size(); }
 const std::string &Destination::name() const { return _name; }
+uint32_t Destination::handle() const { return _handle; }
 void Destination::removeMessageOrGroup(const Session &session, Storage &storage, const MessageInfo &msg, message::GroupStatus groupStatus) {
   if (groupStatus == message::LAST_IN_GROUP) {
     storage.removeGroupMessage(msg.tuple.get<message::field_group_id.position>().value(), session);
@@ -365,8 +396,16 @@ void Destination::removeMessageOrGroup(const Session &session, Storage &storage,
 void Destination::doAck(
     const Session &session, const MessageDataContainer &sMessage, Storage &storage, bool browser, const std::vector<MessageInfo> &messages) {
   message::GroupStatus groupStatus = message::NOT_IN_GROUP;
+  bool opened = false;
+  bool openedAll = false;
   for (const auto &msg : messages) {
     groupStatus = getMsgGroupStatus(msg);
+    if (groupStatus == message::ONE_OF_GROUP && !browser) {
+      // NOTE: only the client acknowledge removes the message of the open group from the storage
+      storage.groups().acknowledged(msg.tuple.get<message::field_group_id.position>().value(),
+                                    msg.tuple.get<message::field_message_id.position>(),
+                                    session.isClientAcknowledge());
+    }
     if (session.isClientAcknowledge()) {
       removeMessageOrGroup(session, storage, msg, groupStatus);
     } else if (session.isTransactAcknowledge() || browser) {
@@ -380,12 +419,20 @@ void Destination::doAck(
     }
 
     if (!session.isClientAcknowledge() && _consumerMode == Subscription::ConsumerMode::EXCLUSIVE) {
-      increaseNotAcknowledged(sMessage.objectID());
+      opened = increaseNotAcknowledged(sMessage.objectID()) || opened;
     } else {
-      increaseNotAcknowledgedAll();
+      openedAll = increaseNotAcknowledgedAll() || openedAll;
     }
+    // NOTE: acknowledged group could be taken over by another consumer
+    openedAll = openedAll || (groupStatus != message::NOT_IN_GROUP);
+  }
+  countAcknowledged(messages.size());
+  // NOTE: the consumer which still has the open window is dispatched without the ack
+  if (openedAll) {
+    postNewMessageEvent();
+  } else if (opened) {
+    postSubscriptionEvent(sMessage.ack().subscription_name());
   }
-  postNewMessageEvent();
 }
 message::GroupStatus Destination::getMsgGroupStatus(const MessageInfo &msg) const {
   message::GroupStatus groupStatus = message::NOT_IN_GROUP;
@@ -398,48 +445,126 @@ message::GroupStatus Destination::getMsgGroupStatus(const MessageInfo &msg) cons
   }
   return groupStatus;
 }
-void Destination::increaseNotAcknowledged(const std::string &objectID) {
+bool Destination::increaseNotAcknowledged(const std::string &objectID) {
+  const uint32_t consumerHandle = INTERNER::Instance().find(objectID);
   upmq::ScopedReadRWLock readRWLock(_notAckLock);
-  auto it = _notAckList.find(objectID);
+  auto it = _notAckList.find(consumerHandle);
   if (it != _notAckList.end()) {
-    ++(*it->second);
+    return ((*it->second)++ == 0);
   }
+  return false;
 }
-void Destination::increaseNotAcknowledgedAll() {
+bool Destination::increaseNotAcknowledgedAll() {
+  bool opened = false;
   upmq::ScopedReadRWLock readRWLock(_notAckLock);
   for (auto &it : _notAckList) {
-    ++(*it.second);
+    if ((*it.second)++ == 0) {
+      opened = true;
+    }
   }
+  return opened;
 }
-bool Destination::canSendNextMessages(const std::string &objectID) const {
+bool Destination::canSendNextMessages(uint32_t consumerHandle) const {
   upmq::ScopedReadRWLock readRWLock(_notAckLock);
-  const auto it = _notAckList.find(objectID);
+  const auto it = _notAckList.find(consumerHandle);
   if (it != _notAckList.end()) {
-    return (*(it->second) > 0);
+    if (*(it->second) <= 0) {
+      return false;
+    }
+    const auto cit = _creditList.find(consumerHandle);
+    return ((cit == _creditList.end()) || ((cit->second->bytes > 0) && (cit->second->bytes >= cit->second->needed)));
   }
   return false;
 }
-void Destination::decreesNotAcknowledged(const std::string &objectID) const {
+void Destination::decreesNotAcknowledged(uint32_t consumerHandle) const {
   upmq::ScopedReadRWLock readRWLock(_notAckLock);
-  auto it = _notAckList.find(objectID);
+  auto it = _notAckList.find(consumerHandle);
   if (it != _notAckList.end()) {
     --(*it->second);
   }
 }
-void Destination::addToNotAckList(const std::string &objectID, int count) const {
+uint32_t Destination::addToNotAckList(const std::string &objectID, int count) const {
+  const uint32_t consumerHandle = INTERNER::Instance().intern(objectID);
   upmq::ScopedWriteRWLock writeRWLock(_notAckLock);
-  _notAckList.insert(std::make_pair(objectID, std::make_unique<std::atomic_int>(count)));
+  if (!_notAckList.insert(std::make_pair(consumerHandle, std::make_unique<std::atomic_int>(count))).second) {
+    INTERNER::Instance().release(consumerHandle);
+  }
+  return consumerHandle;
 }
-void Destination::remFromNotAck(const std::string &objectID) const {
+void Destination::remFromNotAck(uint32_t consumerHandle) const {
   upmq::ScopedWriteRWLock writeRWLock(_notAckLock);
-  _notAckList.erase(objectID);
+  if (_notAckList.erase(consumerHandle) > 0) {
+    INTERNER::Instance().release(consumerHandle);
+  }
+  if (_creditList.erase(consumerHandle) > 0) {
+    INTERNER::Instance().release(consumerHandle);
+  }
+}
+void Destination::addToCreditList(const std::string &objectID, int64_t credit) const {
+  const uint32_t consumerHandle = INTERNER::Instance().intern(objectID);
+  upmq::ScopedWriteRWLock writeRWLock(_notAckLock);
+  auto &item = _creditList[consumerHandle];
+  if (item != nullptr) {
+    INTERNER::Instance().release(consumerHandle);
+  }
+  item = std::make_unique<ConsumerCredit>(credit);
+}
+bool Destination::increaseCredit(const std::string &objectID, int64_t credit) {
+  const uint32_t consumerHandle = INTERNER::Instance().find(objectID);
+  {
+    upmq::ScopedReadRWLock readRWLock(_notAckLock);
+    auto it = _creditList.find(consumerHandle);
+    if (it == _creditList.end()) {
+      return false;
+    }
+    // NOTE: the consumer could wait with positive credit if the next message doesn't fit the window
+    if (it->second->bytes.fetch_add(credit) + credit <= 0) {
+      return false;
+    }
+  }
+  postNewMessageEvent();
+  return true;
+}
+bool Destination::canSendMessage(uint32_t consumerHandle, const MessageDataContainer &sMessage) const {
+  upmq::ScopedReadRWLock readRWLock(_notAckLock);
+  auto it = _creditList.find(consumerHandle);
+  if (it == _creditList.end()) {
+    return true;
+  }
+  ConsumerCredit &credit = *(it->second);
+  const int64_t bytes = credit.bytes;
+  const auto size = static_cast<int64_t>(sMessage.headerSize() + sMessage.dataSize());
+  if ((size <= bytes) || (bytes >= credit.window)) {
+    credit.needed = 1;
+    return true;
+  }
+  credit.needed = std::min(size, credit.window);
+  return false;
+}
+void Destination::decreaseCredit(uint32_t consumerHandle, int64_t size) const {
+  upmq::ScopedReadRWLock readRWLock(_notAckLock);
+  auto it = _creditList.find(consumerHandle);
+  if (it != _creditList.end()) {
+    it->second->bytes -= size;
+  }
 }
 void Destination::postNewMessageEvent() const {
-  const size_t subsCnt = isTopicFamily() ? subscriptionsTrueCount() : 1;
-  for (size_t i = 0; i < subsCnt; ++i) {
-    EXCHANGE::Instance().postNewMessageEvent(name());
+  _allHaveEvents.store(true, std::memory_order_release);
+  EXCHANGE::Instance().postNewMessageEvent(*this);
+}
+void Destination::postSubscriptionEvent(const Subscription &subscription) const {
+  subscription.setHasEvents();
+  EXCHANGE::Instance().postNewMessageEvent(*this);
+}
+void Destination::postSubscriptionEvent(const std::string &subscriptionName) const {
+  auto it = _subscriptions.find(subscriptionName);
+  if (it.hasValue()) {
+    postSubscriptionEvent(*it);
+  } else {
+    postNewMessageEvent();
   }
 }
+DispatchState &Destination::dispatchState() const { return _dispatchState; }
 bool Destination::removeConsumer(const std::string &sessionID, const std::string &subscriptionID, size_t tcpNum) {
   std::string toerase;
   bool result = false;
@@ -462,6 +587,60 @@ bool Destination::removeConsumer(const std::string &sessionID, const std::string
   return result;
 }
 Storage &Destination::storage() const { return _storage; }
+std::string Destination::deliveryHeaderKey(const std::string &messageID, bool useFileLink) { return (useFileLink ? "L" : "S") + messageID; }
+std::shared_ptr<const DeliveryHeader> Destination::deliveryHeader(const std::string &messageID, bool useFileLink) const {
+  auto item = _deliveryHeaders.find(deliveryHeaderKey(messageID, useFileLink));
+  if (item.hasValue()) {
+    return *item;
+  }
+  return {};
+}
+void Destination::addDeliveryHeader(bool useFileLink, std::shared_ptr<const DeliveryHeader> deliveryHeader) const {
+  // NOTE: it's the cache, templates of messages removed without removeMessage are dropped when it's full
+  if (_deliveryHeaders.size() + 2 >= _deliveryHeaders.capacity()) {
+    _deliveryHeaders.clear();
+  }
+  std::string key = deliveryHeaderKey(deliveryHeader->messageID(), useFileLink);
+  _deliveryHeaders.emplace(std::move(key), std::move(deliveryHeader));
+}
+void Destination::removeDeliveryHeaders(const std::string &messageID) const {
+  _deliveryHeaders.erase(deliveryHeaderKey(messageID, false));
+  _deliveryHeaders.erase(deliveryHeaderKey(messageID, true));
+}
+const std::shared_ptr<MemoryBudget> &Destination::memoryBudget() const { return _memoryBudget; }
+void Destination::initMetrics(storage::DBMSSession &dbSession) {
+  const Metrics::Labels labels{{"destination", _name}};
+  Metrics &metrics = METRICS::Instance();
+  _enqueuedMetric = metrics.counter("upmq_destination_enqueued_total", "Messages saved into the destination", labels);
+  _dequeuedMetric = metrics.counter("upmq_destination_dequeued_total", "Messages delivered to consumers of the destination", labels);
+  _acknowledgedMetric = metrics.counter("upmq_destination_acknowledged_total", "Messages acknowledged by consumers of the destination", labels);
+  _depthMetric = metrics.gauge("upmq_destination_messages", "Messages stored in the destination", labels);
+  _tracer = std::make_shared<StageTracer>(_name);
+  _subscriptionsProbe = metrics.probe(
+      "upmq_destination_subscriptions", "Subscriptions of the destination", labels, [this]() { return static_cast<double>(_subscriptions.size()); });
+  _consumersProbe = metrics.probe(
+      "upmq_destination_consumers", "Consumers of the destination", labels, [this]() { return static_cast<double>(consumersCount()); });
+
+  std::stringstream sql;
+  sql << "select count(*) from " << STORAGE_CONFIG.messageJournal(_name) << ";";
+  Poco::Int64 depth = 0;
+  TRY_POCO_DATA_EXCEPTION { dbSession << sql.str(), Poco::Data::Keywords::into(depth), Poco::Data::Keywords::now; }
+  CATCH_POCO_DATA_EXCEPTION_PURE("can't init destination", sql.str(), ERROR_DESTINATION);
+  _depthMetric->set(depth);
+}
+size_t Destination::consumersCount() const {
+  size_t result = 0;
+  _subscriptions.applyForEach([&result](const SubscriptionsList::ItemType::KVPair &pair) { result += pair.second.consumersCount(); });
+  return result;
+}
+void Destination::countEnqueued() const {
+  _enqueuedMetric->inc();
+  _depthMetric->add();
+}
+void Destination::countDequeued(size_t count) const { _dequeuedMetric->inc(count); }
+void Destination::countAcknowledged(size_t count) const { _acknowledgedMetric->inc(count); }
+void Destination::countRemoved(size_t count) const { _depthMetric->sub(static_cast<int64_t>(count)); }
+StageTracer &Destination::tracer() const { return *_tracer; }
 int64_t Destination::initBrowser(const std::string &subscriptionName) {
   auto it = _subscriptions.find(subscriptionName);
   if (!it.hasValue()) {
@@ -510,15 +689,35 @@ void Destination::closeAllSubscriptions(const Session &session, size_t tcpNum) {
   } while (item.first != item.second);
   postNewMessageEvent();
 }
-bool Destination::getNexMessageForAllSubscriptions() {
+bool Destination::getNexMessageForAllSubscriptions(bool &hasProgress) {
   bool result = false;
-  _subscriptions.changeForEach([&result](SubscriptionsList::ItemType::KVPair &pair) {
-    if (pair.second.isRunning()) {
-      Subscription::ProcessMessageResult pmr = pair.second.getNextMessage();
-      if (!result) {
-        result = (pmr == Subscription::ProcessMessageResult::CONSUMER_NOT_RAN);
+  const bool all = _allHaveEvents.exchange(false, std::memory_order_acq_rel);
+  _subscriptions.changeForEach([&result, &hasProgress, all](SubscriptionsList::ItemType::KVPair &pair) {
+    Subscription &subs = pair.second;
+    if (!subs.takeEvents() && !all) {
+      return;
+    }
+    if (subs.isRunning()) {
+      Subscription::ProcessMessageResult pmr = subs.getNextMessage();
+      switch (pmr) {
+        case Subscription::ProcessMessageResult::OK_COMPLETE:
+          // NOTE: the subscription could have more messages, it's dispatched again without the event
+          subs.setHasEvents();
+          hasProgress = true;
+          break;
+        case Subscription::ProcessMessageResult::CONSUMER_NOT_RAN:
+          subs.setHasEvents();
+          result = true;
+          break;
+        case Subscription::ProcessMessageResult::CONSUMER_LOCKED:
+          // NOTE: the owner of the lock posts own event, the mark keeps the subscription for the next pass
+          subs.setHasEvents();
+          break;
+        default:
+          break;
       }
     } else {
+      subs.setHasEvents();
       result = true;
     }
   });
@@ -27,8 +27,14 @@
 #include <memory>
 #include <utility>
 #include "DestinationOwner.h"
+#include "DestinationScheduler.h"
+#include "RoutingTrie.h"
 #include "Subscription.h"
-#include "FixedSizeUnorderedMap.h"
+#include "ConcurrentHashMap.h"
+#include "MemoryBudget.h"
+#include "Metrics.h"
+#include "StageTracer.h"
+#include "MoveableRWLock.h"
 
 namespace upmq {
 namespace broker {
@@ -39,14 +45,29 @@ class Destination {
  public:
   enum class Type : int { NONE = 0, QUEUE = 1, TOPIC = 2, TEMPORARY_QUEUE = 3, TEMPORARY_TOPIC = 4 };
   /// @brief SubscriptionsList - map<subs-name, subs>
-  using SubscriptionsList = FSUnorderedMap<std::string, Subscription>;
+  using SubscriptionsList = ConcurrentHashMap<std::string, Subscription>;
   /// @brief RoutingList - map<routingKey, message>
   using RoutingList = std::unordered_map<std::string, std::unique_ptr<Poco::FIFOEvent<const MessageDataContainer *>>>;
-  /// @brief NotAckConsumersInfoList - map<object_id, message_count>
-  using NotAckConsumersInfoList = std::unordered_map<std::string, std::unique_ptr<std::atomic_int>>;
+  /// @brief NotAckConsumersInfoList - map<object_id handle, message_count>
+  /// ** object_id is interned by addToNotAckList and released by remFromNotAck
+  using NotAckConsumersInfoList = std::unordered_map<uint32_t, std::unique_ptr<std::atomic_int>>;
+  /// @brief ConsumerCredit - rest of the credit window of the consumer in bytes
+  struct ConsumerCredit {
+    explicit ConsumerCredit(int64_t window_) : bytes(window_), window(window_) {}
+    std::atomic<int64_t> bytes;
+    // the consumer isn't ready until the rest of the window fits the message waiting for it
+    std::atomic<int64_t> needed{1};
+    const int64_t window;
+  };
+  /// @brief CreditConsumersInfoList - map<object_id handle, credit>
+  /// ** only consumers with credit based flow control
+  using CreditConsumersInfoList = std::unordered_map<uint32_t, std::unique_ptr<ConsumerCredit>>;
   /// @brief Session2SubscriptionMap - map<session_id, {subs-name}>
   /// ** used for binding destinations to clients
   using Session2SubsList = std::unordered_multimap<std::string, std::string>;
+  /// @brief DeliveryHeadersList - map<message_id + link mode, header template>
+  /// ** shared by subscriptions of the destination, so the topic fan-out serializes the stored header once
+  using DeliveryHeadersList = ConcurrentHashMap<std::string, std::shared_ptr<const DeliveryHeader>>;
   /// @brief PredefinedClients - set<client-id>
   /// ** used for binding destinations to clients
   using PredefinedClients = std::unordered_map<std::string, bool>;
@@ -81,14 +102,17 @@ class Destination {
   std::string _id;
   std::string _uri;
   std::string _name;
+  uint32_t _handle;
   SubscriptionsList _subscriptions;
   mutable Storage _storage;
   Type _type;
   mutable upmq::MRWLock _routingLock;
   mutable RoutingList _routing;
+  mutable RoutingTrie<Poco::FIFOEvent<const MessageDataContainer *>> _routingTrie;
   const Exchange &_exchange;
   std::string _subscriptionsT;
   mutable NotAckConsumersInfoList _notAckList;
+  mutable CreditConsumersInfoList _creditList;
   mutable upmq::MRWLock _notAckLock;
   mutable Session2SubsList _s2subsList;
   mutable upmq::MRWLock _s2subsLock;
@@ -99,6 +123,21 @@ class Destination {
   std::unique_ptr<DestinationOwner> _owner;
   std::unique_ptr<Poco::Timestamp> _created{new Poco::Timestamp};
   Subscription::ConsumerMode _consumerMode{Subscription::ConsumerMode::ROUND_ROBIN};
+  mutable DispatchState _dispatchState;
+  // NOTE: the event concerns all subscriptions (new message, consumer changes), otherwise only marked ones are dispatched
+  mutable std::atomic_bool _allHaveEvents{true};
+  mutable DeliveryHeadersList _deliveryHeaders;
+  // NOTE: charges of bodies can outlive the destination (output queues), so the budget is shared
+  std::shared_ptr<MemoryBudget> _memoryBudget;
+  // NOTE: series of the destination are dropped from the registry with the destination, probes are detached first
+  std::shared_ptr<Metrics::Counter> _enqueuedMetric;
+  std::shared_ptr<Metrics::Counter> _dequeuedMetric;
+  std::shared_ptr<Metrics::Counter> _acknowledgedMetric;
+  std::shared_ptr<Metrics::Gauge> _depthMetric;
+  // NOTE: traces of frames can outlive the destination, so the tracer is shared
+  std::shared_ptr<StageTracer> _tracer;
+  Metrics::Probe _subscriptionsProbe;
+  Metrics::Probe _consumersProbe;
 
  private:
   void addS2Subs(const std::string &sesionID, const std::string &subsID);
@@ -108,6 +147,9 @@ class Destination {
   static std::string getStoredDestinationID(const Exchange &exchange, const std::string &name, Destination::Type type);
   static void saveDestinationId(
       const std::string &id, storage::DBMSSession &dbSession, const Exchange &exchange, const std::string &name, Destination::Type type);
+  static std::string deliveryHeaderKey(const std::string &messageID, bool useFileLink);
+  void initMetrics(storage::DBMSSession &dbSession);
+  size_t consumersCount() const;
 
  public:
   Destination(const Exchange &exchange, const std::string &uri, Type type);
@@ -149,19 +191,42 @@ class Destination {
   size_t subscriptionsCount() const;
   size_t subscriptionsTrueCount() const;
   const std::string &name() const;
+  // NOTE: interned name, it's used by the exchange events instead of the name
+  uint32_t handle() const;
   void doAck(const Session &session, const MessageDataContainer &sMessage, Storage &storage, bool browser, const std::vector<MessageInfo> &messages);
-  void increaseNotAcknowledged(const std::string &objectID);
-  void increaseNotAcknowledgedAll();
-  void decreesNotAcknowledged(const std::string &objectID) const;
-  bool canSendNextMessages(const std::string &objectID) const;
-  void addToNotAckList(const std::string &objectID, int count) const;
-  void remFromNotAck(const std::string &objectID) const;
+  // increase* return true if the closed window of some consumer was opened
+  bool increaseNotAcknowledged(const std::string &objectID);
+  bool increaseNotAcknowledgedAll();
+  void decreesNotAcknowledged(uint32_t consumerHandle) const;
+  bool canSendNextMessages(uint32_t consumerHandle) const;
+  // returns the consumer handle
+  uint32_t addToNotAckList(const std::string &objectID, int count) const;
+  void remFromNotAck(uint32_t consumerHandle) const;
+  void addToCreditList(const std::string &objectID, int64_t credit) const;
+  bool increaseCredit(const std::string &objectID, int64_t credit);
+  // message fits the rest of the credit window, the message bigger than the window is sent alone
+  // otherwise the consumer waits for the credit of the message
+  bool canSendMessage(uint32_t consumerHandle, const MessageDataContainer &sMessage) const;
+  void decreaseCredit(uint32_t consumerHandle, int64_t size) const;
   void postNewMessageEvent() const;
+  void postSubscriptionEvent(const Subscription &subscription) const;
+  void postSubscriptionEvent(const std::string &subscriptionName) const;
+  DispatchState &dispatchState() const;
   bool removeConsumer(const std::string &sessionID, const std::string &subscriptionID, size_t tcpNum);
   void subscribeOnNotify(Subscription &subscription) const;
   void unsubscribeFromNotify(Subscription &subscription) const;
   int64_t initBrowser(const std::string &subscriptionName);
   Storage &storage() const;
+  std::shared_ptr<const DeliveryHeader> deliveryHeader(const std::string &messageID, bool useFileLink) const;
+  void addDeliveryHeader(bool useFileLink, std::shared_ptr<const DeliveryHeader> deliveryHeader) const;
+  void removeDeliveryHeaders(const std::string &messageID) const;
+  const std::shared_ptr<MemoryBudget> &memoryBudget() const;
+  // depth is the count of messages in the journal, it's read from the database only when the destination is created
+  void countEnqueued() const;
+  void countDequeued(size_t count) const;
+  void countAcknowledged(size_t count) const;
+  void countRemoved(size_t count) const;
+  StageTracer &tracer() const;
   void copyMessagesTo(Subscription &subscription);
   virtual Subscription createSubscription(const std::string &name, const std::string &routingKey, Subscription::Type type) = 0;
   virtual void addSendersFromCache(const Session &session, const MessageDataContainer &sMessage, Subscription &subscription) = 0;
@@ -177,7 +242,8 @@ class Destination {
   void setOwner(const std::string &clientID, size_t tcpID);
   const DestinationOwner &owner() const;
   bool hasOwner() const;
-  bool getNexMessageForAllSubscriptions();
+  // returns true if some consumers aren't ready, hasProgress is set if some subscription has sent messages
+  bool getNexMessageForAllSubscriptions(bool &hasProgress);
   Info info() const;
   static std::string typeName(Type type);
   static Destination::Type type(const std::string &typeName);
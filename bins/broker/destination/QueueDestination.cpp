@@ -39,7 +39,6 @@ void QueueDestination::save(const Session &session, const MessageDataContainer &
 }
 void QueueDestination::ack(const Session &session, const MessageDataContainer &sMessage) {
   const Proto::Ack &ack = sMessage.ack();
-  const std::string &messageID = ack.message_id();
   const std::string &subscriptionName = ack.subscription_name();
 
   Storage *storage = &_storage;
@@ -54,7 +53,7 @@ void QueueDestination::ack(const Session &session, const MessageDataContainer &s
     }
   }
 
-  std::vector<MessageInfo> sentMsgs = storage->getMessagesBelow(session, messageID);
+  std::vector<MessageInfo> sentMsgs = storage->getMessagesBelow(session, ack);
   Destination::doAck(session, sMessage, *storage, browser, sentMsgs);
 }
 void QueueDestination::commit(const Session &session) {
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_ROUTINGTRIE_H
+#define BROKER_ROUTINGTRIE_H
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace upmq {
+namespace broker {
+
+/// @brief RoutingTrie - routing keys of the topic subscriptions by levels
+/// ** subscription gets messages of its routing key and of all its child keys (a/b gets a/b and a/b/c)
+/// ** '*' level matches any one level, '#' level matches zero or more levels
+/// ** the match walks the trie over the key without allocations, results of hot keys are cached
+/// NOTE: add, remove and match have to be called under the routing lock of the destination, add and remove - under the write lock
+template <typename Event>
+class RoutingTrie {
+ public:
+  using Events = std::vector<Event *>;
+  using EventsPtr = std::shared_ptr<const Events>;
+
+ private:
+  enum { CACHE_SIZE = 4096 };
+
+  struct Node {
+    std::string level;
+    Event *event = nullptr;
+    std::vector<std::unique_ptr<Node>> children;
+
+    Node *child(const char *level_, size_t size) const {
+      for (const auto &item : children) {
+        if ((item->level.size() == size) && (item->level.compare(0, size, level_, size) == 0)) {
+          return item.get();
+        }
+      }
+      return nullptr;
+    }
+  };
+
+  Node _root;
+  mutable std::mutex _cacheLock;
+  mutable std::unordered_map<std::string, EventsPtr> _cache;
+
+  // returns the end of the level started at pos
+  static size_t levelEnd(const std::string &key, size_t pos) {
+    const size_t end = key.find('/', pos);
+    return (end == std::string::npos) ? key.size() : end;
+  }
+  static size_t nextLevel(const std::string &key, size_t end) { return (end < key.size()) ? (end + 1) : std::string::npos; }
+
+  static void collect(const Node &node, Events &events) {
+    if ((node.event != nullptr) && (std::find(events.begin(), events.end(), node.event) == events.end())) {
+      events.push_back(node.event);
+    }
+  }
+  // pos is the start of the next level of the key or npos if the key is over
+  static void match(const Node &node, const std::string &key, size_t pos, Events &events) {
+    collect(node, events);
+    const Node *hash = node.child("#", 1);
+    if (pos == std::string::npos) {
+      if (hash != nullptr) {
+        match(*hash, key, pos, events);
+      }
+      return;
+    }
+    const size_t end = levelEnd(key, pos);
+    const size_t next = nextLevel(key, end);
+    const Node *exact = node.child(key.data() + pos, end - pos);
+    if (exact != nullptr) {
+      match(*exact, key, next, events);
+    }
+    const Node *star = node.child("*", 1);
+    if ((star != nullptr) && (star != exact)) {
+      match(*star, key, next, events);
+    }
+    if ((hash != nullptr) && (hash != exact)) {
+      // NOTE: '#' takes zero or more levels
+      for (size_t from = pos; from != std::string::npos; from = nextLevel(key, levelEnd(key, from))) {
+        match(*hash, key, from, events);
+      }
+      match(*hash, key, std::string::npos, events);
+    }
+  }
+  static bool prune(Node &node, const std::string &key, size_t pos) {
+    if (pos != std::string::npos) {
+      const size_t end = levelEnd(key, pos);
+      Node *next = node.child(key.data() + pos, end - pos);
+      if ((next != nullptr) && prune(*next, key, nextLevel(key, end))) {
+        node.children.erase(std::find_if(node.children.begin(), node.children.end(), [next](const std::unique_ptr<Node> &item) {
+          return item.get() == next;
+        }));
+      }
+    } else {
+      node.event = nullptr;
+    }
+    return (node.event == nullptr) && node.children.empty();
+  }
+
+ public:
+  RoutingTrie() = default;
+  RoutingTrie(const RoutingTrie &) = delete;
+  RoutingTrie &operator=(const RoutingTrie &) = delete;
+
+  void add(const std::string &key, Event *event) {
+    Node *node = &_root;
+    for (size_t pos = key.empty() ? std::string::npos : 0; pos != std::string::npos;) {
+      const size_t end = levelEnd(key, pos);
+      Node *next = node->child(key.data() + pos, end - pos);
+      if (next == nullptr) {
+        node->children.emplace_back(new Node());
+        next = node->children.back().get();
+        next->level.assign(key, pos, end - pos);
+      }
+      node = next;
+      pos = nextLevel(key, end);
+    }
+    node->event = event;
+    clearCache();
+  }
+  void remove(const std::string &key) {
+    prune(_root, key, key.empty() ? std::string::npos : 0);
+    clearCache();
+  }
+  // events of all subscriptions for the message with the routing key
+  EventsPtr match(const std::string &key) const {
+    {
+      std::lock_guard<std::mutex> lock(_cacheLock);
+      auto it = _cache.find(key);
+      if (it != _cache.end()) {
+        return it->second;
+      }
+    }
+    auto events = std::make_shared<Events>();
+    if (!key.empty()) {
+      match(_root, key, 0, *events);
+    }
+    std::lock_guard<std::mutex> lock(_cacheLock);
+    if (_cache.size() >= CACHE_SIZE) {
+      _cache.clear();
+    }
+    _cache.emplace(key, events);
+    return events;
+  }
+  void clearCache() const {
+    std::lock_guard<std::mutex> lock(_cacheLock);
+    _cache.clear();
+  }
+};
+
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // BROKER_ROUTINGTRIE_H
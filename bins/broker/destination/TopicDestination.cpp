@@ -31,10 +31,13 @@ void TopicDestination::save(const Session &session, const MessageDataContainer &
 
   TRY_POCO_DATA_EXCEPTION {
     std::string routingK = routingKey(sMessage.message().destination_uri());
-    ParentTopics parentTopics = generateParentTopics(routingK);
     bool needRemoveBody = true;
-    for (const auto &topic : parentTopics) {
-      if (notifySubscription(topic, session, sMessage)) {
+    {
+      upmq::ScopedReadRWLock readRWLock(_routingLock);
+      const auto events = _routingTrie.match(routingK);
+      const MessageDataContainer *dc = &sMessage;
+      for (auto *event : *events) {
+        event->notify(&session, dc);
         needRemoveBody = false;
       }
     }
@@ -46,19 +49,18 @@ void TopicDestination::save(const Session &session, const MessageDataContainer &
 }
 void TopicDestination::ack(const Session &session, const MessageDataContainer &sMessage) {
   const Proto::Ack &ack = sMessage.ack();
-  const std::string &messageID = ack.message_id();
   const std::string &subscriptionName = ack.subscription_name();
 
   if (session.isClientAcknowledge()) {
-    _subscriptions.changeForEach([this, &session, &messageID, &sMessage](SubscriptionsList::ItemType::KVPair &pair) {
-      std::vector<MessageInfo> sentMsgs = pair.second.storage().getMessagesBelow(session, messageID);
+    _subscriptions.changeForEach([this, &session, &ack, &sMessage](SubscriptionsList::ItemType::KVPair &pair) {
+      std::vector<MessageInfo> sentMsgs = pair.second.storage().getMessagesBelow(session, ack);
       Destination::doAck(session, sMessage, pair.second.storage(), false, sentMsgs);
     });
   } else {
     auto it = _subscriptions.find(subscriptionName);
     if (it.hasValue()) {
       auto &subs = *it;
-      std::vector<MessageInfo> sentMsgs = subs.storage().getMessagesBelow(session, messageID);
+      std::vector<MessageInfo> sentMsgs = subs.storage().getMessagesBelow(session, ack);
       Destination::doAck(session, sMessage, subs.storage(), false, sentMsgs);
     }
   }
@@ -159,16 +161,6 @@ TopicDestination::ParentTopics TopicDestination::generateParentTopics(const std:
   return parentTopics;
 }
 
-bool TopicDestination::notifySubscription(const std::string &routingKey, const Session &session, const MessageDataContainer &sMessage) {
-  upmq::ScopedReadRWLock readRWLock(_routingLock);
-  auto it = _routing.find(routingKey);
-  if (it != _routing.end()) {
-    const MessageDataContainer *dc = &sMessage;
-    it->second->notify(&session, dc);
-    return true;
-  }
-  return false;
-}
 void TopicDestination::addSendersFromCache(const Session &session, const MessageDataContainer &sMessage, Subscription &subscription) {
   upmq::ScopedReadRWLock readRWLock(_senderCacheLock);
   const std::string &routingKey = subscription.routingKey();
@@ -43,9 +43,6 @@ class TopicDestination : public Destination {
   void removeSenderByID(const Session &session, const std::string &senderID) override;
   static ParentTopics generateParentTopics(const std::string &routingKey);
 
- private:
-  bool notifySubscription(const std::string &routingKey, const Session &session, const MessageDataContainer &sMessage);
-
  private:
   SenderCache _senderCache;
   upmq::MRWLock _senderCacheLock;
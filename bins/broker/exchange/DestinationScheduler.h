@@ -0,0 +1,304 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_DESTINATIONSCHEDULER_H
+#define BROKER_DESTINATIONSCHEDULER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace upmq {
+namespace broker {
+
+/// @brief DispatchState - state of the destination in the scheduler
+/// ** destination is queued at most once, events during the dispatching mark it dirty and it's queued again after
+class DispatchState {
+  enum : int { IDLE = 0, SCHEDULED, RUNNING, RUNNING_DIRTY };
+  std::atomic_int _state{IDLE};
+
+ public:
+  // new event, returns true if the destination has to be queued
+  bool schedule() {
+    int state = _state.load(std::memory_order_acquire);
+    for (;;) {
+      if (state == IDLE) {
+        if (_state.compare_exchange_weak(state, SCHEDULED)) {
+          return true;
+        }
+      } else if (state == RUNNING) {
+        if (_state.compare_exchange_weak(state, RUNNING_DIRTY)) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    }
+  }
+  // worker takes the destination, returns false if another worker dispatches it now
+  bool begin() {
+    int state = _state.load(std::memory_order_acquire);
+    for (;;) {
+      if (state == IDLE || state == SCHEDULED) {
+        if (_state.compare_exchange_weak(state, RUNNING)) {
+          return true;
+        }
+      } else if (state == RUNNING) {
+        if (_state.compare_exchange_weak(state, RUNNING_DIRTY)) {
+          return false;
+        }
+      } else {
+        return false;
+      }
+    }
+  }
+  // worker has finished, returns true if the destination got events meanwhile and has to be queued again
+  bool end() {
+    int state = RUNNING;
+    if (_state.compare_exchange_strong(state, IDLE)) {
+      return false;
+    }
+    _state.store(SCHEDULED);
+    return true;
+  }
+  // NOTE: the destination could be queued before it was added into the exchange and the entry was dropped
+  void reset() { _state.store(IDLE); }
+};
+
+/// @brief DestinationScheduler - queues of destinations for the exchange workers
+/// ** every worker has own deque, the idle worker steals from the others
+/// ** a new destination wakes up only one idle worker
+/// ** delayed destinations (consumers aren't ready) are retried after the timeout
+class DestinationScheduler {
+  struct Worker {
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::deque<uint32_t> items;
+    bool notified = false;
+  };
+
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::mutex _idleLock;
+  std::vector<size_t> _idle;
+  std::atomic_size_t _idleCount{0};
+  std::atomic_size_t _next{0};
+  std::atomic_bool _stopped{false};
+  std::mutex _delayedLock;
+  std::vector<uint32_t> _delayed;
+  std::atomic<int64_t> _delayedDue{0};
+  std::chrono::milliseconds _delay;
+
+  struct Current {
+    const DestinationScheduler *scheduler = nullptr;
+    size_t worker = 0;
+  };
+  static Current &current() {
+    static thread_local Current cur;
+    return cur;
+  }
+  static int64_t now() { return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+  bool takeOwn(size_t worker, uint32_t &handle) {
+    Worker &w = *_workers[worker];
+    std::lock_guard<std::mutex> lock(w.lock);
+    if (w.items.empty()) {
+      return false;
+    }
+    handle = w.items.front();
+    w.items.pop_front();
+    return true;
+  }
+  bool steal(size_t worker, uint32_t &handle) {
+    const size_t count = _workers.size();
+    for (size_t i = 1; i < count; ++i) {
+      Worker &victim = *_workers[(worker + i) % count];
+      std::lock_guard<std::mutex> lock(victim.lock);
+      if (!victim.items.empty()) {
+        handle = victim.items.back();
+        victim.items.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+  bool hasWork() {
+    for (auto &w : _workers) {
+      std::lock_guard<std::mutex> lock(w->lock);
+      if (!w->items.empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+  void takeDelayed(size_t worker) {
+    const int64_t due = _delayedDue.load(std::memory_order_relaxed);
+    if ((due == 0) || (now() < due)) {
+      return;
+    }
+    std::vector<uint32_t> delayed;
+    {
+      std::lock_guard<std::mutex> lock(_delayedLock);
+      delayed.swap(_delayed);
+      _delayedDue = 0;
+    }
+    if (!delayed.empty()) {
+      Worker &w = *_workers[worker];
+      std::lock_guard<std::mutex> lock(w.lock);
+      w.items.insert(w.items.end(), delayed.begin(), delayed.end());
+    }
+  }
+  void setIdle(size_t worker) {
+    std::lock_guard<std::mutex> lock(_idleLock);
+    _idle.push_back(worker);
+    ++_idleCount;
+  }
+  void unsetIdle(size_t worker) {
+    std::lock_guard<std::mutex> lock(_idleLock);
+    for (auto it = _idle.begin(); it != _idle.end(); ++it) {
+      if (*it == worker) {
+        _idle.erase(it);
+        --_idleCount;
+        return;
+      }
+    }
+  }
+  void wakeOne() {
+    // NOTE: the item is pushed before the check, the worker registers itself before its last check
+    if (_idleCount.load() == 0) {
+      return;
+    }
+    size_t worker = 0;
+    {
+      std::lock_guard<std::mutex> lock(_idleLock);
+      if (_idle.empty()) {
+        return;
+      }
+      worker = _idle.back();
+      _idle.pop_back();
+      --_idleCount;
+    }
+    Worker &w = *_workers[worker];
+    {
+      std::lock_guard<std::mutex> lock(w.lock);
+      w.notified = true;
+    }
+    w.wakeup.notify_one();
+  }
+
+ public:
+  explicit DestinationScheduler(size_t workers, std::chrono::milliseconds delay = std::chrono::milliseconds(1000)) : _delay(delay) {
+    _workers.reserve(workers);
+    for (size_t i = 0; i < workers; ++i) {
+      _workers.emplace_back(new Worker());
+    }
+    _idle.reserve(workers);
+  }
+  DestinationScheduler(const DestinationScheduler &) = delete;
+  DestinationScheduler &operator=(const DestinationScheduler &) = delete;
+
+  size_t size() const { return _workers.size(); }
+  // destinations waiting for workers, including delayed ones
+  size_t queued() {
+    size_t result = 0;
+    for (auto &w : _workers) {
+      std::lock_guard<std::mutex> lock(w->lock);
+      result += w->items.size();
+    }
+    std::lock_guard<std::mutex> lock(_delayedLock);
+    return result + _delayed.size();
+  }
+
+  // queues the destination handle, worker queues into own deque, other threads spread destinations between workers
+  void push(uint32_t handle) {
+    const Current &cur = current();
+    const size_t worker = (cur.scheduler == this) ? cur.worker : (_next++ % _workers.size());
+    {
+      Worker &w = *_workers[worker];
+      std::lock_guard<std::mutex> lock(w.lock);
+      w.items.push_back(handle);
+    }
+    wakeOne();
+  }
+  // queues the destination after the delay
+  void delay(uint32_t handle) {
+    std::lock_guard<std::mutex> lock(_delayedLock);
+    if (_delayed.empty()) {
+      _delayedDue = now() + _delay.count();
+    }
+    _delayed.push_back(handle);
+  }
+  // next destination for the worker, waits up to timeout, returns false on timeout or stop
+  bool pop(size_t worker, uint32_t &handle, std::chrono::milliseconds timeout) {
+    Current &cur = current();
+    cur.scheduler = this;
+    cur.worker = worker;
+    Worker &w = *_workers[worker];
+    const int64_t deadline = now() + timeout.count();
+    for (;;) {
+      if (_stopped) {
+        return false;
+      }
+      takeDelayed(worker);
+      if (takeOwn(worker, handle) || steal(worker, handle)) {
+        return true;
+      }
+      setIdle(worker);
+      if (hasWork()) {
+        unsetIdle(worker);
+        continue;
+      }
+      // NOTE: the wait is bounded by the due time of the delayed destinations, they aren't taken before it
+      int64_t wait = deadline - now();
+      const int64_t due = _delayedDue.load(std::memory_order_relaxed);
+      if (due != 0) {
+        wait = std::min<int64_t>(wait, due - now());
+      }
+      bool woken = false;
+      {
+        std::unique_lock<std::mutex> lock(w.lock);
+        woken = w.wakeup.wait_for(
+            lock, std::chrono::milliseconds(std::max<int64_t>(0, wait)), [&w, this]() { return w.notified || !w.items.empty() || _stopped; });
+        w.notified = false;
+      }
+      unsetIdle(worker);
+      if (!woken && (now() >= deadline)) {
+        takeDelayed(worker);
+        return takeOwn(worker, handle) || steal(worker, handle);
+      }
+    }
+  }
+  void stop() {
+    _stopped = true;
+    for (auto &w : _workers) {
+      {
+        std::lock_guard<std::mutex> lock(w->lock);
+        w->notified = true;
+      }
+      w->wakeup.notify_all();
+    }
+  }
+};
+
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // BROKER_DESTINATIONSCHEDULER_H
@@ -15,12 +15,14 @@
  */
 
 #include "Exchange.h"
+#include <algorithm>
 #include <Poco/String.h>
 #include <Poco/StringTokenizer.h>
 #include <sstream>
 #include <fake_cpp14.h>
 #include "Broker.h"
 #include "MiscDefines.h"
+#include "ShardPool.h"
 
 namespace upmq {
 namespace broker {
@@ -28,9 +30,8 @@ namespace broker {
 Exchange::Exchange()
     : _destinations(DESTINATION_CONFIG.maxCount),
       _destinationsT("\"" + BROKER::Instance().id() + "_destinations\""),
-      _mutexDestinations(THREADS_CONFIG.subscribers),
-      _conditionDestinations(_mutexDestinations.size()),
-      _threadPool("exchange", 1, static_cast<int>(_mutexDestinations.size()) + 1) {
+      _scheduler(THREADS_CONFIG.subscribers),
+      _threadPool("exchange", 1, static_cast<int>(_scheduler.size()) + 1) {
   std::stringstream sql;
   sql << "create table if not exists " << _destinationsT << "("
       << " id text not null primary key"
@@ -43,6 +44,9 @@ Exchange::Exchange()
       << ";";
   TRY_POCO_DATA_EXCEPTION { dbms::Instance().doNow(sql.str()); }
   CATCH_POCO_DATA_EXCEPTION_PURE("can't init exchange", sql.str(), ERROR_STORAGE);
+  _queuedProbe = METRICS::Instance().probe("upmq_exchange_queued_destinations", "Destinations waiting for the dispatch", {}, [this]() {
+    return static_cast<double>(_scheduler.queued());
+  });
 }
 Exchange::~Exchange() {
   try {
@@ -51,6 +55,10 @@ Exchange::~Exchange() {
   }
 };
 Destination &Exchange::destination(const std::string &uri, Exchange::DestinationCreationMode creationMode) const {
+  Destination *cached = cachedDestination(uri);
+  if (cached != nullptr) {
+    return *cached;
+  }
   std::string mainDP;
   if (uri.find("://") != std::string::npos) {
     mainDP = mainDestinationPath(uri);
@@ -70,18 +78,29 @@ Destination &Exchange::destination(const std::string &uri, Exchange::Destination
           err.append(Destination::consumerModeName(dest->consumerMode()));
           throw EXCEPTION("destination was initiated with another consumer mode", err, ERROR_DESTINATION);
         }
+        cacheDestination(uri, *dest);
         return *dest;
       }
 
       // FIXME: if mainDP isn't uri then createDestination throw exception
       _destinations.insert(std::make_pair(mainDP, DestinationFactory::createDestination(*this, uri)));
       it = _destinations.find(mainDP);
+      // NOTE: events of the constructor could be dropped by workers before the insert
+      (*it)->dispatchState().reset();
+      (*it)->postNewMessageEvent();
 
       return *(*it);
     }
   }
   throw EXCEPTION("invalid creation mode", std::to_string(static_cast<int>(creationMode)), ERROR_UNKNOWN);
 }  // namespace broker
+Destination &Exchange::destination(uint32_t handle) const {
+  auto name = INTERNER::Instance().name(handle);
+  if (name == nullptr) {
+    throw EXCEPTION("destination not found", std::to_string(handle), ERROR_UNKNOWN);
+  }
+  return getDestination(*name);
+}
 Destination &Exchange::getDestination(const std::string &id) const {
   auto it = _destinations.find(id);
   if (!it.hasValue()) {
@@ -89,9 +108,53 @@ Destination &Exchange::getDestination(const std::string &id) const {
   }
   return *(*it);
 }
+Destination *Exchange::cachedDestination(const std::string &uri) const {
+  std::string name;
+  {
+    upmq::ScopedReadRWLock readRWLock(_uriCacheLock);
+    auto item = _uriCache.find(uri);
+    if (item == _uriCache.end()) {
+      return nullptr;
+    }
+    name = item->second;
+  }
+  // NOTE: the destination is found by its name, so the destination recreated meanwhile is still the one of the uri
+  auto it = _destinations.find(name);
+  return it.hasValue() ? (*it).get() : nullptr;
+}
+void Exchange::cacheDestination(const std::string &uri, const Destination &dest) const {
+  upmq::ScopedWriteRWLock writeRWLock(_uriCacheLock);
+  if (_uriCache.size() >= URI_CACHE_SIZE) {
+    _uriCache.clear();
+  }
+  _uriCache.emplace(uri, dest.name());
+}
+void Exchange::eraseDestination(const std::string &id) {
+  uint32_t handle = 0;
+  {
+    auto it = _destinations.find(id);
+    if (!it.hasValue()) {
+      return;
+    }
+    handle = (*it)->handle();
+  }
+  _destinations.erase(id);
+  {
+    // NOTE: the recreated destination could have another consumer mode, so its uris are checked again
+    upmq::ScopedWriteRWLock writeRWLock(_uriCacheLock);
+    for (auto item = _uriCache.begin(); item != _uriCache.end();) {
+      if (item->second == id) {
+        item = _uriCache.erase(item);
+      } else {
+        ++item;
+      }
+    }
+  }
+  INTERNER::Instance().release(handle);
+}
 void Exchange::deleteDestination(const std::string &uri) {
   std::string mainDP = mainDestinationPath(uri);
-  _destinations.erase(mainDP);
+  eraseDestination(mainDP);
 }
 std::string Exchange::mainDestinationPath(const std::string &uri) {
   Poco::StringTokenizer URI(uri, ":", Poco::StringTokenizer::TOK_TRIM);
@@ -100,7 +163,8 @@ std::string Exchange::mainDestinationPath(const std::string &uri) {
 void Exchange::saveMessage(const Session &session, const MessageDataContainer &sMessage) {
   std::stringstream sql;
   const Proto::Message &message = sMessage.message();
-  Destination &dest = destination(message.destination_uri(), DestinationCreationMode::NO_CREATE);
+  Destination &dest = (sMessage.destinationHandle != 0) ? destination(sMessage.destinationHandle)
+                                                        : destination(message.destination_uri(), DestinationCreationMode::NO_CREATE);
   sql << "insert into " << STORAGE_CONFIG.messageJournal(dest.name()) << "("
       << "message_id, uri, body_type, subscribers_count"
       << ")"
@@ -115,6 +179,10 @@ void Exchange::saveMessage(const Session &session, const MessageDataContainer &s
   TRY_POCO_DATA_EXCEPTION { (*session.currentDBSession) << sql.str(), Poco::Data::Keywords::now; }
   CATCH_POCO_DATA_EXCEPTION("can't save message", sql.str(), session.currentDBSession.reset(nullptr), ERROR_ON_SAVE_MESSAGE)
   dest.save(session, sMessage);
+  dest.countEnqueued();
+  if (sMessage.traceDecoded != 0) {
+    dest.tracer().stored(message.message_id(), sMessage.traceDecoded);
+  }
 }
 const std::string &Exchange::destinationsT() const { return _destinationsT; }
 void Exchange::removeConsumer(const std::string &sessionID, const std::string &destinationID, const std::string &subscriptionID, size_t tcpNum) {
@@ -155,7 +223,7 @@ void Exchange::dropDestination(const std::string &id, DestinationOwner *owner) {
     }
   }
   if (needErase) {
-    _destinations.erase(id);
+    eraseDestination(id);
   }
 }
 
@@ -175,7 +243,7 @@ void Exchange::dropOwnedDestination(const std::string &clientId) {
     }
   }
   if (needErase) {
-    _destinations.erase(key);
+    eraseDestination(key);
   }
 }
 
@@ -218,9 +286,13 @@ void Exchange::removeSenderFromAnyDest(const upmq::broker::Session &session, con
   _destinations.changeForEach([&session, &senderID](DestinationsList::ItemType::KVPair &dest) { dest.second->removeSenderByID(session, senderID); });
 }
 void Exchange::start() {
+  _isRunning = true;
+  if (THREADS_CONFIG.shards != 0) {
+    // NOTE: destinations are dispatched by the shard threads
+    return;
+  }
   _threadAdapter = std::make_unique<Poco::RunnableAdapter<Exchange>>(*this, &Exchange::run);
   int count = _threadPool.capacity() - 1;
-  _isRunning = true;
   for (int i = 0; i < count; ++i) {
     _threadPool.start(*_threadAdapter);
   }
@@ -228,53 +300,75 @@ void Exchange::start() {
 void Exchange::stop() {
   if (_isRunning) {
     _isRunning = false;
+    _scheduler.stop();
     _threadPool.joinAll();
   }
 }
 void Exchange::postNewMessageEvent(const std::string &name) const {
-  const int count = _threadPool.capacity() - 1;
-
-  addNewMessageEvent(name);
-
-  for (size_t i = 0; i < static_cast<size_t>(count); ++i) {
-    _conditionDestinations[i].notify_one();
+  if (name.empty()) {
+    return;
+  }
+  auto item = _destinations.find(name);
+  if (item.hasValue()) {
+    (*item)->postNewMessageEvent();
   }
 }
-
-void Exchange::addNewMessageEvent(const std::string &name) const {
-  if (!name.empty()) {
-    _destinationEvents.enqueue(name);
+void Exchange::postNewMessageEvent(const Destination &destination) const {
+  if (destination.dispatchState().schedule()) {
+    if (THREADS_CONFIG.shards != 0) {
+      SHARDS::Instance().postDispatch(destination.handle());
+    } else {
+      _scheduler.push(destination.handle());
+    }
+  }
+}
+Exchange::DispatchResult Exchange::dispatch(uint32_t handle) {
+  // NOTE: the handle of the erased destination could be reused, the extra dispatch of the other destination is harmless
+  auto name = INTERNER::Instance().name(handle);
+  if (name == nullptr) {
+    return DispatchResult::DONE;
+  }
+  auto item = _destinations.find(*name);
+  if (!item.hasValue()) {
+    return DispatchResult::DONE;
   }
+  Destination &dest = *(*item);
+  if (!dest.dispatchState().begin()) {
+    return DispatchResult::DONE;
+  }
+  bool needRetry = false;
+  bool hasProgress = false;
+  try {
+    needRetry = dest.getNexMessageForAllSubscriptions(hasProgress);
+  } catch (Poco::Exception &pex) {
+    std::cerr << "!!! " << pex.message() << " " << pex.className() << " " << pex.code() << std::endl;
+  }
+  // NOTE: the destination which has sent messages is queued again, unless an event has already queued it
+  if (dest.dispatchState().end() || (hasProgress && dest.dispatchState().schedule())) {
+    return DispatchResult::AGAIN;
+  }
+  return needRetry ? DispatchResult::RETRY : DispatchResult::DONE;
 }
 
 void Exchange::run() {
   const size_t num = _thrNum++;
 
-  std::string queueId;
+  uint32_t queueId = 0;
   while (_isRunning) {
-    do {
-      queueId.clear();
-      if (_destinationEvents.try_dequeue(queueId)) {
-        if (!queueId.empty()) {
-          auto item = _destinations.find(queueId);
-          if (item.hasValue()) {
-            try {
-              if ((*item)->getNexMessageForAllSubscriptions()) {
-                _destinationEvents.enqueue(queueId);
-                break;
-              }
-            } catch (Poco::Exception &pex) {
-              std::cerr << "!!! " << pex.message() << " " << pex.className() << " " << pex.code() << std::endl;
-            }
-          }
-        }
-      }
-    } while (!queueId.empty());
-
-    auto &mut = _mutexDestinations[num];
-
-    std::unique_lock<std::mutex> lock(mut);
-    _conditionDestinations[num].wait_for(lock, std::chrono::milliseconds(1000));
+    if (!_scheduler.pop(num, queueId, std::chrono::milliseconds(1000))) {
+      continue;
+    }
+    switch (dispatch(queueId)) {
+      case DispatchResult::AGAIN:
+        _scheduler.push(queueId);
+        break;
+      case DispatchResult::RETRY:
+        // NOTE: some consumers aren't ready, a new event dispatches the destination before the delay
+        _scheduler.delay(queueId);
+        break;
+      case DispatchResult::DONE:
+        break;
+    }
   }
 }
 std::vector<Destination::Info> Exchange::info() const {
@@ -20,9 +20,12 @@
 #include <Poco/RWLock.h>
 #include <Poco/ThreadPool.h>
 #include <unordered_map>
-#include <condition_variable>
 #include <Poco/RunnableAdapter.h>
 #include "DestinationFactory.h"
+#include "DestinationScheduler.h"
+#include "Interner.h"
+#include "Metrics.h"
+#include "MoveableRWLock.h"
 #include "Singleton.h"
 
 namespace upmq {
@@ -33,25 +36,33 @@ class Session;
 class Exchange {
  public:
   enum class DestinationCreationMode { NO_CREATE = 0, CREATE };
+  // DispatchResult - DONE, AGAIN - destination got events during the dispatching, RETRY - some consumers aren't ready
+  enum class DispatchResult { DONE = 0, AGAIN, RETRY };
   // DestinationsList - map<mainDestinationPath, Destination>
-  using DestinationsList = FSUnorderedMap<std::string, std::unique_ptr<Destination>>;
+  using DestinationsList = ConcurrentHashMap<std::string, std::unique_ptr<Destination>>;
+  /// @brief DestinationsCache - map<uri, mainDestinationPath>
+  /// ** resolved uris, the next lookup of the uri doesn't parse it
+  /// ** the cache is cleared when it's full, uris differ by parameters
+  using DestinationsCache = std::unordered_map<std::string, std::string>;
 
  private:
+  enum { URI_CACHE_SIZE = 4096 };
   mutable DestinationsList _destinations;
+  mutable DestinationsCache _uriCache;
+  mutable upmq::MRWLock _uriCacheLock;
   const std::string _destinationsT;
   std::atomic_bool _isRunning{false};
-  mutable std::vector<std::mutex> _mutexDestinations;
-  mutable std::vector<std::condition_variable> _conditionDestinations;
+  mutable DestinationScheduler _scheduler;
   Poco::ThreadPool _threadPool;
   std::unique_ptr<Poco::RunnableAdapter<Exchange>> _threadAdapter;
   std::atomic_size_t _thrNum{0};
-  using BQ = moodycamel::ConcurrentQueue<std::string>;
-  mutable BQ _destinationEvents;
+  Metrics::Probe _queuedProbe;
 
  public:
   Exchange();
   virtual ~Exchange();
   Destination &destination(const std::string &uri, Exchange::DestinationCreationMode creationMode = Exchange::DestinationCreationMode::CREATE) const;
+  Destination &destination(uint32_t handle) const;
   void deleteDestination(const std::string &uri);
   static std::string mainDestinationPath(const std::string &uri);
   void saveMessage(const Session &session, const MessageDataContainer &sMessage);
@@ -71,11 +82,16 @@ class Exchange {
   void start();
   void stop();
   void postNewMessageEvent(const std::string &name) const;
-  void addNewMessageEvent(const std::string &name) const;
+  // NOTE: only queues the destination, the events are marked by Destination::postNewMessageEvent/postSubscriptionEvent
+  void postNewMessageEvent(const Destination &destination) const;
+  DispatchResult dispatch(uint32_t handle);
   std::vector<Destination::Info> info() const;
 
  private:
   Destination &getDestination(const std::string &id) const;
+  Destination *cachedDestination(const std::string &uri) const;
+  void cacheDestination(const std::string &uri, const Destination &dest) const;
+  void eraseDestination(const std::string &id);
   void removeSenderFromAnyDest(const upmq::broker::Session &session, const std::string &senderID);
   void run();
 };
@@ -15,6 +15,8 @@
  */
 
 #include "AsyncLogger.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <Poco/File.h>
 #include "Defines.h"
@@ -25,7 +27,26 @@ namespace broker {
 
 constexpr char DEFAULT_PATTERN[] = "%Y-%m-%d %H:%M:%S:%i %t";
 
-AutoPtr<FormattingChannel> AsyncLogger::createFormatter(const std::string &name, bool interactive) {
+// NOTE: the writer takes a part of the ring at once, so the busy thread doesn't hold back the others
+constexpr size_t MAX_BATCH_RECORDS = 256;
+constexpr std::chrono::milliseconds IDLE_TIMEOUT(10);
+
+LogChannel::LogChannel(std::string name, AutoPtr<Poco::Formatter> formatter, AutoPtr<Poco::Channel> channel)
+    : _name(std::move(name)), _formatter(std::move(formatter)), _channel(std::move(channel)) {}
+
+void LogChannel::log(const Poco::Message &msg) { ASYNCLOGGER::Instance().post(LogRecord(*this, msg)); }
+
+void LogChannel::close() { _channel->close(); }
+
+const std::string &LogChannel::name() const { return _name; }
+
+void LogChannel::format(const LogRecord &record, std::string &text) const { _formatter->format(record.message(_name), text); }
+
+void LogChannel::write(const std::string &text, int priority) const {
+  _channel->log(Poco::Message(_name, text, static_cast<Poco::Message::Priority>(priority)));
+}
+
+AutoPtr<LogChannel> AsyncLogger::createChannel(const std::string &name, bool interactive) {
 #if !defined(WIN32) && !defined(WIN32)
   AutoPtr<ColorConsoleChannel> colorChannel;
 #else
@@ -47,23 +68,17 @@ AutoPtr<FormattingChannel> AsyncLogger::createFormatter(const std::string &name,
     colorChannel->setProperty("errorColor", "magenta");
     colorChannel->setProperty("criticalColor", "lightRed");
     colorChannel->setProperty("fatalColor", "red");
-    AutoPtr<Poco::AsyncChannel> colorAsyncChannel = Poco::MakeAuto<Poco::AsyncChannel>(colorChannel);
-    colorAsyncChannel->setProperty("priority", "lowest");
-    splitter->addChannel(colorAsyncChannel);
+    splitter->addChannel(colorChannel);
   }
   AutoPtr<FileChannel> fileChannel = Poco::MakeAuto<FileChannel>(name + ".log");
-  AutoPtr<Poco::AsyncChannel> fileAsyncChannel = Poco::MakeAuto<Poco::AsyncChannel>(fileChannel);
 
   fileChannel->setProperty("rotation", "10 M");
   fileChannel->setProperty("times", "local");
-  fileAsyncChannel->setProperty("priority", "lowest");
-  splitter->addChannel(fileAsyncChannel);
+  splitter->addChannel(fileChannel);
 
   AutoPtr<PatternFormatter> patternFormatter = Poco::MakeAuto<PatternFormatter>(DEFAULT_PATTERN);
 
-  AutoPtr<FormattingChannel> formattingChannel = Poco::MakeAuto<FormattingChannel>(patternFormatter);
-  formattingChannel->setChannel(splitter);
-  return formattingChannel;
+  return Poco::MakeAuto<LogChannel>(Poco::Path(name).getFileName(), patternFormatter, splitter);
 }
 
 Poco::Logger &AsyncLogger::get(const std::string &name) { return Logger::get(name); }
@@ -91,8 +106,7 @@ Logger &AsyncLogger::add(const std::string &name, const std::string &subdir) {
       if (!f.exists()) {
         f.createDirectories();
       }
-      _formattingChannel = createFormatter(dirpath.toString(), isInteractive);
-      return Logger::create(name, _formattingChannel, logPriority);
+      return Logger::create(name, createChannel(dirpath.toString(), isInteractive), logPriority);
     }
     return *loggetPtr;
   } catch (Poco::Exception &ex) {
@@ -102,11 +116,14 @@ Logger &AsyncLogger::add(const std::string &name, const std::string &subdir) {
 }
 
 void AsyncLogger::destroy(const std::string &name) {
+  // NOTE: posted records refer to the logger
+  flush();
   Poco::ScopedLock<Poco::FastMutex> lock(logLock);
   Logger::destroy(name);
 }
 
 void AsyncLogger::destroy(const Poco::Path &name) {
+  flush();
   Poco::ScopedLock<Poco::FastMutex> lock(logLock);
   Logger::destroy(name.toString());
 }
@@ -121,6 +138,168 @@ void AsyncLogger::remove(const std::string &name, const std::string &subdir) {
   }
 }
 
+AsyncLogger::~AsyncLogger() {
+  if (_writer.joinable()) {
+    _isRunning = false;
+    _wakeup.notify_one();
+    _writer.join();
+  }
+}
+
+AsyncLogger::Ring &AsyncLogger::localRing() {
+  static thread_local LocalRing local;
+  if (local.owner != this) {
+    if (local.ring != nullptr) {
+      local.ring->abandoned = true;
+    }
+    local.ring = std::make_shared<Ring>(ringSize);
+    local.owner = this;
+    std::lock_guard<std::mutex> lock(_ringsLock);
+    _rings.emplace_back(local.ring);
+    ++_ringsVersion;
+    if (!_writer.joinable()) {
+      _isRunning = true;
+      _writer = std::thread(&AsyncLogger::writeRecords, this);
+    }
+  }
+  return *local.ring;
+}
+
+void AsyncLogger::post(LogRecord &&record) {
+  if (!localRing().records.tryPush(std::move(record))) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  if (_isSleeping.load(std::memory_order_relaxed)) {
+    _wakeup.notify_one();
+  }
+}
+
+void AsyncLogger::flush() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard<std::mutex> lock(_ringsLock);
+    if (!_writer.joinable()) {
+      return;
+    }
+    rings = _rings;
+  }
+  auto isDrained = [&rings]() {
+    for (const auto &ring : rings) {
+      if (!ring->records.empty()) {
+        return false;
+      }
+    }
+    return true;
+  };
+  while (!isDrained() || _isWriting) {
+    _wakeup.notify_one();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+}
+
+uint64_t AsyncLogger::dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+void AsyncLogger::writeRecords() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  size_t ringsVersion = 0;
+  uint64_t reported = 0;
+  Batch batch;
+  while (_isRunning) {
+    if (ringsVersion != _ringsVersion) {
+      std::lock_guard<std::mutex> lock(_ringsLock);
+      // NOTE: the abandoned ring is forgotten when it's drained, it can't get new records
+      _rings.erase(std::remove_if(_rings.begin(),
+                                  _rings.end(),
+                                  [](const std::shared_ptr<Ring> &ring) { return ring->abandoned && ring->records.empty(); }),
+                   _rings.end());
+      rings = _rings;
+      ringsVersion = _ringsVersion;
+    }
+    _isWriting = true;
+    const size_t count = drain(rings, batch);
+    const uint64_t dropped = _dropped.load(std::memory_order_relaxed);
+    if ((dropped != reported) && (batch.channel != nullptr)) {
+      const std::string text = std::string("- ! => ").append(std::to_string(dropped - reported)).append(" log records were dropped, rings are full");
+      write(LogRecord(*batch.channel, Poco::Message(batch.channel->name(), text, Poco::Message::PRIO_WARNING)), batch);
+      reported = dropped;
+    }
+    flushBatch(batch);
+    batch.channel = nullptr;
+    _isWriting = false;
+    if (count == 0) {
+      for (const auto &ring : rings) {
+        if (ring->abandoned) {
+          ++_ringsVersion;
+          break;
+        }
+      }
+      std::unique_lock<std::mutex> lock(_sleepLock);
+      _isSleeping = true;
+      _wakeup.wait_for(lock, IDLE_TIMEOUT);
+      _isSleeping = false;
+    }
+  }
+  _isWriting = true;
+  {
+    std::lock_guard<std::mutex> lock(_ringsLock);
+    rings = _rings;
+  }
+  while (drain(rings, batch) > 0) {
+  }
+  flushBatch(batch);
+  _isWriting = false;
+}
+
+size_t AsyncLogger::drain(const std::vector<std::shared_ptr<Ring>> &rings, Batch &batch) {
+  size_t count = 0;
+  LogRecord record;
+  for (const auto &ring : rings) {
+    for (size_t i = 0; (i < MAX_BATCH_RECORDS) && ring->records.tryPop(record); ++i) {
+      write(record, batch);
+      ++count;
+    }
+  }
+  return count;
+}
+
+void AsyncLogger::write(const LogRecord &record, Batch &batch) {
+  LogChannel *channel = record.channel();
+  if (channel == nullptr) {
+    auto loggerChannel = record.logger()->getChannel();
+    channel = !loggerChannel ? nullptr : dynamic_cast<LogChannel *>(&(*loggerChannel));
+    if (channel == nullptr) {
+      // NOTE: the logger wasn't added by the AsyncLogger
+      record.logger()->log(record.message(record.logger()->name()));
+      return;
+    }
+  }
+  if ((channel != batch.channel) || (record.priority() != batch.priority)) {
+    flushBatch(batch);
+    batch.channel = channel;
+    batch.priority = record.priority();
+  }
+  if (!batch.text.empty()) {
+    batch.text.push_back('\n');
+  }
+  try {
+    channel->format(record, batch.text);
+  } catch (...) {
+  }
+}
+
+void AsyncLogger::flushBatch(Batch &batch) {
+  if (batch.text.empty()) {
+    return;
+  }
+  try {
+    batch.channel->write(batch.text, batch.priority);
+  } catch (Poco::Exception &ex) {
+    std::cerr << ex.displayText() << non_std_endl;
+  }
+  batch.text.clear();
+}
+
 bool AsyncLogger::exists(const std::string &name) {
   Poco::AutoPtr<Poco::Logger> loggetPtr = Logger::has(name);
   return loggetPtr.isNull();
@@ -19,7 +19,6 @@
 
 #include <Poco/Logger.h>
 #include <Poco/FileChannel.h>
-#include <Poco/AsyncChannel.h>
 #include <Poco/ConsoleChannel.h>
 #include <Poco/SplitterChannel.h>
 #include <Poco/FormattingChannel.h>
@@ -36,8 +35,15 @@
 #include <Poco/WindowsConsoleChannel.h>
 #endif
 
+#include "LogRecord.h"
+#include "SPSCQueue.h"
 #include "Singleton.h"
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using Poco::SplitterChannel;
 #ifdef POCO_OS_FAMILY_WINDOWS
@@ -49,7 +55,6 @@ using Poco::ColorConsoleChannel;
 using Poco::ConsoleChannel;
 using Poco::SyslogChannel;
 #endif
-using Poco::AsyncChannel;
 using Poco::AutoPtr;
 using Poco::FileChannel;
 using Poco::FormattingChannel;
@@ -59,11 +64,72 @@ using Poco::PatternFormatter;
 namespace upmq {
 namespace broker {
 
+/// @brief LogChannel - the channel of the broker loggers
+/// ** the message is copied into the LogRecord and pushed into the ring of the calling thread
+/// ** the AsyncLogger thread formats records and writes them into the file and console channels
+class LogChannel : public Poco::Channel {
+  std::string _name;
+  AutoPtr<Poco::Formatter> _formatter;
+  AutoPtr<Poco::Channel> _channel;
+
+ public:
+  LogChannel(std::string name, AutoPtr<Poco::Formatter> formatter, AutoPtr<Poco::Channel> channel);
+  void log(const Poco::Message &msg) override;
+  void close() override;
+  const std::string &name() const;
+  // appends the formatted line, it's called by the AsyncLogger thread
+  void format(const LogRecord &record, std::string &text) const;
+  // writes lines of the same priority as the one message, it's called by the AsyncLogger thread
+  void write(const std::string &text, int priority) const;
+};
+
+/// @brief AsyncLogger - loggers of the broker and the writer of their records
+/// ** every thread pushes records into own ring, push never blocks, the record is dropped if the ring is full
+/// ** the writer thread drains rings and writes the lines of the same channel and priority by one write
 class AsyncLogger {
-  AutoPtr<FormattingChannel> _formattingChannel;
+  struct Ring {
+    explicit Ring(size_t capacity) : records(capacity) {}
+    SPSCQueue<LogRecord> records;
+    // NOTE: the owner thread has exited, the ring is removed when it's drained
+    std::atomic_bool abandoned{false};
+  };
+  struct LocalRing {
+    const AsyncLogger *owner = nullptr;
+    std::shared_ptr<Ring> ring;
+    ~LocalRing() {
+      if (ring != nullptr) {
+        ring->abandoned = true;
+      }
+    }
+  };
+  struct Batch {
+    LogChannel *channel = nullptr;
+    int priority = 0;
+    std::string text;
+  };
+
+  std::mutex _ringsLock;
+  std::vector<std::shared_ptr<Ring>> _rings;
+  std::atomic_size_t _ringsVersion{0};
+  std::thread _writer;
+  std::atomic_bool _isRunning{false};
+  std::atomic_bool _isSleeping{false};
+  std::atomic_bool _isWriting{false};
+  std::mutex _sleepLock;
+  std::condition_variable _wakeup;
+  std::atomic<uint64_t> _dropped{0};
+
+  Ring &localRing();
+  void writeRecords();
+  size_t drain(const std::vector<std::shared_ptr<Ring>> &rings, Batch &batch);
+  void write(const LogRecord &record, Batch &batch);
+  static void flushBatch(Batch &batch);
 
  public:
   AsyncLogger() = default;
+  ~AsyncLogger();
+  AsyncLogger(const AsyncLogger &) = delete;
+  AsyncLogger &operator=(const AsyncLogger &) = delete;
 
   static Logger &get(const std::string &name);
 
@@ -77,15 +143,26 @@ class AsyncLogger {
 
   void remove(const std::string &name, const std::string &subdir = ".");
 
+  void post(LogRecord &&record);
+
+  // waits until the posted records are written
+  void flush();
+
+  // count of records dropped because the ring of the thread was full
+  uint64_t dropped() const;
+
   bool isInteractive = true;
 
+  // records per thread ring
+  size_t ringSize = 1024;
+
   int logPriority = Poco::Message::PRIO_TRACE;
 
   Poco::FastMutex logLock;
 
   static bool exists(const std::string &name);
 
-  static AutoPtr<FormattingChannel> createFormatter(const std::string &name, bool interactive);
+  static AutoPtr<LogChannel> createChannel(const std::string &name, bool interactive);
 };
 
 }  // namespace broker
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_LOGRECORD_H
+#define BROKER_LOGRECORD_H
+
+#include <Poco/Logger.h>
+#include <Poco/Message.h>
+#include <Poco/Thread.h>
+#include <Poco/Timestamp.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace upmq {
+namespace broker {
+
+class LogChannel;
+
+/// @brief LogRecord - binary log record, its text is formatted by the AsyncLogger thread
+/// ** fields are copied as is: integers, strings (length + bytes) and pointers of the string literals
+/// ** record has the fixed size, the tail of the long record is dropped and marked by "..."
+/// ** char arrays are stored as pointers, so only string literals can be passed as arrays
+/// ** the text of the Poco::Message (LogChannel) is kept as the string field, the long one is moved to the heap
+class LogRecord {
+ public:
+  static constexpr size_t CAPACITY = 232;
+
+ private:
+  enum Tag : char { LITERAL = 1, STRING, INT, UINT };
+
+  Poco::Logger *_logger = nullptr;
+  LogChannel *_channel = nullptr;
+  std::unique_ptr<std::string> _text;
+  Poco::Timestamp::TimeVal _time = 0;
+  long _tid = 0;
+  int _priority = Poco::Message::PRIO_INFORMATION;
+  uint16_t _size = 0;
+  bool _truncated = false;
+  char _data[CAPACITY];
+
+  bool reserve(size_t size) {
+    if (_truncated || (_size + size > CAPACITY)) {
+      _truncated = true;
+      return false;
+    }
+    return true;
+  }
+  template <typename T>
+  void put(Tag tag, const T &value) {
+    if (reserve(1 + sizeof(T))) {
+      _data[_size++] = tag;
+      memcpy(&_data[_size], &value, sizeof(T));
+      _size += static_cast<uint16_t>(sizeof(T));
+    }
+  }
+  template <typename T>
+  static T get(const char *data, size_t &pos) {
+    T value;
+    memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+  }
+
+ public:
+  LogRecord() = default;
+  LogRecord(Poco::Logger &logger, int priority)
+      : _logger(&logger), _time(Poco::Timestamp().epochMicroseconds()), _tid(Poco::Thread::currentTid()), _priority(priority) {}
+  LogRecord(LogChannel &channel, const Poco::Message &msg)
+      : _channel(&channel), _time(msg.getTime().epochMicroseconds()), _tid(msg.getTid()), _priority(msg.getPriority()) {
+    if (msg.getText().size() + 1 + sizeof(uint16_t) > CAPACITY) {
+      _text.reset(new std::string(msg.getText()));
+    } else {
+      *this << msg.getText();
+    }
+  }
+  LogRecord(LogRecord &&) = default;
+  LogRecord &operator=(LogRecord &&) = default;
+
+  template <size_t N>
+  LogRecord &operator<<(const char (&literal)[N]) {
+    const char *ptr = literal;
+    put(LITERAL, ptr);
+    return *this;
+  }
+  LogRecord &operator<<(const std::string &str) {
+    // NOTE: the string is cut to the free space, so the beginning of the long id is kept
+    if (reserve(1 + sizeof(uint16_t) + 1)) {
+      const auto length = static_cast<uint16_t>(std::min(str.size(), CAPACITY - _size - 1 - sizeof(uint16_t)));
+      _data[_size++] = STRING;
+      memcpy(&_data[_size], &length, sizeof(length));
+      _size += static_cast<uint16_t>(sizeof(length));
+      memcpy(&_data[_size], str.data(), length);
+      _size += length;
+      _truncated = (length < str.size());
+    }
+    return *this;
+  }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, LogRecord &>::type operator<<(T value) {
+    put(INT, static_cast<int64_t>(value));
+    return *this;
+  }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value, LogRecord &>::type operator<<(T value) {
+    put(UINT, static_cast<uint64_t>(value));
+    return *this;
+  }
+
+  // logger of BROKER_LOG, nullptr if the record was made by LogChannel
+  Poco::Logger *logger() const { return _logger; }
+  LogChannel *channel() const { return _channel; }
+  int priority() const { return _priority; }
+
+  // formats the record, it's called by the AsyncLogger thread
+  void format(std::string &text) const {
+    if (_text != nullptr) {
+      text.append(*_text);
+      return;
+    }
+    size_t pos = 0;
+    while (pos < _size) {
+      switch (_data[pos++]) {
+        case LITERAL:
+          text.append(get<const char *>(_data, pos));
+          break;
+        case STRING: {
+          const auto length = get<uint16_t>(_data, pos);
+          text.append(&_data[pos], length);
+          pos += length;
+        } break;
+        case INT:
+          text.append(std::to_string(get<int64_t>(_data, pos)));
+          break;
+        case UINT:
+          text.append(std::to_string(get<uint64_t>(_data, pos)));
+          break;
+        default:
+          pos = _size;
+          break;
+      }
+    }
+    if (_truncated) {
+      text.append("...");
+    }
+  }
+  Poco::Message message(const std::string &source) const {
+    std::string text;
+    text.reserve(_size + 32);
+    format(text);
+    Poco::Message msg(source, text, static_cast<Poco::Message::Priority>(_priority));
+    msg.setTime(Poco::Timestamp(_time));
+    msg.setTid(_tid);
+    return msg;
+  }
+};
+}  // namespace broker
+}  // namespace upmq
+
+/// @brief BROKER_LOG - the level is checked before the record is built, so the disabled level costs nothing
+/// ** usage: BROKER_INFORMATION(log, tcpNum << " # => " << clientID);
+#define BROKER_LOG(logger, priority, fields)                           \
+  do {                                                                 \
+    if ((logger)->is(priority)) {                                      \
+      upmq::broker::LogRecord brokerLogRecord_(*(logger), (priority)); \
+      brokerLogRecord_ << fields;                                      \
+      ASYNCLOGGER::Instance().post(std::move(brokerLogRecord_));       \
+    }                                                                  \
+  } while (false)
+
+#define BROKER_NOTICE(logger, fields) BROKER_LOG(logger, Poco::Message::PRIO_NOTICE, fields)
+#define BROKER_INFORMATION(logger, fields) BROKER_LOG(logger, Poco::Message::PRIO_INFORMATION, fields)
+#define BROKER_DEBUG(logger, fields) BROKER_LOG(logger, Poco::Message::PRIO_DEBUG, fields)
+#define BROKER_TRACE(logger, fields) BROKER_LOG(logger, Poco::Message::PRIO_TRACE, fields)
+
+#endif  // BROKER_LOGRECORD_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BufferPool.h"
+#include <algorithm>
+
+namespace upmq {
+namespace broker {
+
+constexpr size_t BufferPool::MIN_CLASS_SHIFT;
+constexpr size_t BufferPool::MAX_CLASS_SHIFT;
+constexpr size_t BufferPool::MAX_CLASS_SIZE;
+constexpr size_t BufferPool::MAX_CLASS_BYTES;
+constexpr size_t BufferPool::CLASS_COUNT;
+
+BufferPool::SizeClass *BufferPool::sizeClasses() {
+  // NOTE: the pool isn't destroyed, containers can be released by threads that outlive static objects
+  static SizeClass *classes = []() {
+    auto *result = new SizeClass[CLASS_COUNT];
+    for (size_t i = 0; i < CLASS_COUNT; ++i) {
+      result[i].maxCount = std::max<size_t>(2, MAX_CLASS_BYTES >> (MIN_CLASS_SHIFT + i));
+    }
+    return result;
+  }();
+  return classes;
+}
+std::string BufferPool::reserve(size_t capacity) {
+  std::string buffer;
+  if (capacity > (size_t(1) << MAX_CLASS_SHIFT)) {
+    buffer.reserve(capacity);
+    return buffer;
+  }
+  size_t shift = MIN_CLASS_SHIFT;
+  while ((size_t(1) << shift) < capacity) {
+    ++shift;
+  }
+  SizeClass &sizeClass = sizeClasses()[shift - MIN_CLASS_SHIFT];
+  if (sizeClass.buffers.try_dequeue(buffer)) {
+    --sizeClass.count;
+  } else {
+    buffer.reserve(size_t(1) << shift);
+  }
+  return buffer;
+}
+std::string BufferPool::acquire(size_t size) {
+  std::string buffer = reserve(size);
+  buffer.resize(size);
+  return buffer;
+}
+std::string BufferPool::copy(const std::string &from) {
+  std::string buffer = reserve(from.size());
+  buffer.assign(from);
+  return buffer;
+}
+void BufferPool::release(std::string &buffer) {
+  std::string released;
+  released.swap(buffer);
+  const size_t capacity = released.capacity();
+  // NOTE: the buffer of the size class has its capacity at least, so it's returned to the largest class it covers
+  if ((capacity < (size_t(1) << MIN_CLASS_SHIFT)) || (capacity >= (size_t(1) << (MAX_CLASS_SHIFT + 1)))) {
+    return;
+  }
+  size_t shift = MAX_CLASS_SHIFT;
+  while ((size_t(1) << shift) > capacity) {
+    --shift;
+  }
+  SizeClass &sizeClass = sizeClasses()[shift - MIN_CLASS_SHIFT];
+  if (sizeClass.count.fetch_add(1) >= sizeClass.maxCount) {
+    --sizeClass.count;
+    return;
+  }
+  released.clear();
+  sizeClass.buffers.enqueue(std::move(released));
+}
+}  // namespace broker
+}  // namespace upmq
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_BUFFERPOOL_H
+#define BROKER_BUFFERPOOL_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include "ConcurrentQueueHeader.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief BufferPool - size-class pool of frame buffers (headers and in-memory bodies)
+/// ** the buffer is taken once the frame length is known, its capacity is rounded up to the power of two size class
+/// ** released buffers are kept in the lock-free free list of their size class, the free list is bounded by bytes
+/// ** small and huge buffers aren't pooled, they are allocated and freed as usual
+class BufferPool {
+ public:
+  static constexpr size_t MIN_CLASS_SHIFT = 8;
+  static constexpr size_t MAX_CLASS_SHIFT = 22;
+  // NOTE: the biggest pooled buffer, bigger ones are allocated as usual
+  static constexpr size_t MAX_CLASS_SIZE = size_t(1) << MAX_CLASS_SHIFT;
+  // NOTE: bytes kept by the free list of the one size class, the free list keeps two buffers at least
+  static constexpr size_t MAX_CLASS_BYTES = 2 * 1024 * 1024;
+
+  // the buffer of the given size, its content is zeroed
+  static std::string acquire(size_t size);
+  // the empty buffer with the given capacity at least
+  static std::string reserve(size_t capacity);
+  static std::string copy(const std::string &from);
+  // the buffer is moved into the pool, it's empty then
+  static void release(std::string &buffer);
+
+ private:
+  struct SizeClass {
+    moodycamel::ConcurrentQueue<std::string> buffers;
+    std::atomic<size_t> count{0};
+    size_t maxCount = 0;
+  };
+  static constexpr size_t CLASS_COUNT = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+
+  static SizeClass *sizeClasses();
+};
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // BROKER_BUFFERPOOL_H
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DeliveryHeader.h"
+
+namespace upmq {
+namespace broker {
+
+DeliveryHeader::DeliveryHeader(Proto::Message &message)
+    : _messageID(message.message_id()), _hasGroupID(message.has_group_id()), _groupSeq(message.group_seq()) {
+  message.clear_session_id();
+  message.clear_redelivered();
+  message.clear_delivery_count();
+  // NOTE: session_id is required, the template is completed by the fields of the delivery
+  message.SerializePartialToString(&_message);
+}
+const std::string &DeliveryHeader::messageID() const { return _messageID; }
+bool DeliveryHeader::hasGroupID() const { return _hasGroupID; }
+int DeliveryHeader::groupSeq() const { return _groupSeq; }
+size_t DeliveryHeader::messageSize(const Fields &fields) const {
+  size_t size = _message.size() + stringSize(Proto::Message::kSessionIdFieldNumber, fields.sessionID);
+  if (fields.hasRedelivered) {
+    size += tagSize(Proto::Message::kRedeliveredFieldNumber) + 1;
+  }
+  if (fields.deliveryCount != 0) {
+    size += int32Size(Proto::Message::kDeliveryCountFieldNumber, fields.deliveryCount);
+  }
+  return size;
+}
+void DeliveryHeader::appendMessage(std::string &out, const Fields &fields) const {
+  out.append(_message);
+  appendString(out, Proto::Message::kSessionIdFieldNumber, fields.sessionID);
+  if (fields.hasRedelivered) {
+    appendTag(out, Proto::Message::kRedeliveredFieldNumber, VARINT);
+    out.push_back(fields.redelivered ? 1 : 0);
+  }
+  if (fields.deliveryCount != 0) {
+    appendInt32(out, Proto::Message::kDeliveryCountFieldNumber, fields.deliveryCount);
+  }
+}
+size_t DeliveryHeader::frameSize(const Fields &fields) const {
+  const size_t size = messageSize(fields);
+  return tagSize(Proto::ProtoMessage::kMessageFieldNumber) + varintSize(size) + size +
+         stringSize(Proto::ProtoMessage::kObjectIdFieldNumber, fields.objectID) +
+         int32Size(Proto::ProtoMessage::kRequestReplyIdFieldNumber, fields.rrID);
+}
+void DeliveryHeader::appendFrame(std::string &out, const Fields &fields) const {
+  out.reserve(out.size() + frameSize(fields));
+  appendTag(out, Proto::ProtoMessage::kMessageFieldNumber, LENGTH_DELIMITED);
+  appendVarint(out, messageSize(fields));
+  appendMessage(out, fields);
+  appendString(out, Proto::ProtoMessage::kObjectIdFieldNumber, fields.objectID);
+  appendInt32(out, Proto::ProtoMessage::kRequestReplyIdFieldNumber, fields.rrID);
+}
+size_t DeliveryHeader::varintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+void DeliveryHeader::appendVarint(std::string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+size_t DeliveryHeader::tagSize(uint32_t field) { return varintSize(static_cast<uint64_t>(field) << 3); }
+void DeliveryHeader::appendTag(std::string &out, uint32_t field, WireType type) { appendVarint(out, (static_cast<uint64_t>(field) << 3) | type); }
+// NOTE: the negative int32 is sign extended to 10 bytes as protobuf does
+size_t DeliveryHeader::int32Size(uint32_t field, int32_t value) {
+  return tagSize(field) + varintSize(static_cast<uint64_t>(static_cast<int64_t>(value)));
+}
+void DeliveryHeader::appendInt32(std::string &out, uint32_t field, int32_t value) {
+  appendTag(out, field, VARINT);
+  appendVarint(out, static_cast<uint64_t>(static_cast<int64_t>(value)));
+}
+size_t DeliveryHeader::stringSize(uint32_t field, const std::string &value) { return tagSize(field) + varintSize(value.size()) + value.size(); }
+void DeliveryHeader::appendString(std::string &out, uint32_t field, const std::string &value) {
+  appendTag(out, field, LENGTH_DELIMITED);
+  appendVarint(out, value.size());
+  out.append(value);
+}
+}  // namespace broker
+}  // namespace upmq
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_DELIVERYHEADER_H
+#define BROKER_DELIVERYHEADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "ProtoBuf.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief DeliveryHeader - serialized Proto::Message of the stored message, it's shared by all deliveries of the message
+/// ** the template has no fields of the delivery, they are appended to the copy of the template,
+///    the parser takes the last value of the field, so the position of the field doesn't matter
+/// ** redelivery and topic fan-out build the frame header without the protobuf serialization
+class DeliveryHeader {
+ public:
+  /// @brief Fields - fields of the one delivery
+  struct Fields {
+    std::string objectID;
+    std::string sessionID;
+    int rrID = 0;
+    // NOTE: value of delivery_count, 0 - the field isn't set
+    int deliveryCount = 0;
+    bool hasRedelivered = false;
+    bool redelivered = false;
+  };
+
+  // strips fields of the delivery from the message and keeps its serialized form
+  explicit DeliveryHeader(Proto::Message &message);
+  DeliveryHeader(const DeliveryHeader &) = delete;
+  DeliveryHeader &operator=(const DeliveryHeader &) = delete;
+
+  const std::string &messageID() const;
+  bool hasGroupID() const;
+  int groupSeq() const;
+
+  // size of the Proto::Message of the delivery
+  size_t messageSize(const Fields &fields) const;
+  // appends the Proto::Message of the delivery
+  void appendMessage(std::string &out, const Fields &fields) const;
+  // size of the Proto::ProtoMessage frame header of the delivery
+  size_t frameSize(const Fields &fields) const;
+  // appends the Proto::ProtoMessage frame header of the delivery
+  void appendFrame(std::string &out, const Fields &fields) const;
+
+  // protobuf wire format
+  enum WireType : uint32_t { VARINT = 0, LENGTH_DELIMITED = 2 };
+  static size_t varintSize(uint64_t value);
+  static void appendVarint(std::string &out, uint64_t value);
+  static size_t tagSize(uint32_t field);
+  static void appendTag(std::string &out, uint32_t field, WireType type);
+  static size_t int32Size(uint32_t field, int32_t value);
+  static void appendInt32(std::string &out, uint32_t field, int32_t value);
+  static size_t stringSize(uint32_t field, const std::string &value);
+  static void appendString(std::string &out, uint32_t field, const std::string &value);
+
+ private:
+  std::string _message;
+  std::string _messageID;
+  bool _hasGroupID;
+  int _groupSeq;
+};
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // BROKER_DELIVERYHEADER_H
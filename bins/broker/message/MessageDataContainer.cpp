@@ -28,6 +28,50 @@
 namespace upmq {
 namespace broker {
 
+namespace {
+struct FreeContainers {
+  moodycamel::ConcurrentQueue<MessageDataContainer *> containers;
+  std::atomic<size_t> count{0};
+};
+
+FreeContainers &freeContainers() {
+  // NOTE: the free list isn't destroyed, containers can be released by threads that outlive static objects
+  static auto *instance = new FreeContainers();
+  return *instance;
+}
+}  // namespace
+
+constexpr size_t MessageDataContainer::MAX_FREE_CONTAINERS;
+
+std::shared_ptr<MessageDataContainer> MessageDataContainer::make(std::string path) {
+  FreeContainers &free = freeContainers();
+  MessageDataContainer *container = nullptr;
+  if (free.containers.try_dequeue(container)) {
+    --free.count;
+    container->_path = std::move(path);
+  } else {
+    container = new MessageDataContainer(std::move(path));
+  }
+  return std::shared_ptr<MessageDataContainer>(container, Recycler());
+}
+void MessageDataContainer::Recycler::operator()(MessageDataContainer *container) const {
+  std::unique_ptr<MessageDataContainer> recycled(container);
+  recycled->recycle();
+  FreeContainers &free = freeContainers();
+  if (free.count.fetch_add(1) >= MAX_FREE_CONTAINERS) {
+    --free.count;
+    return;
+  }
+  free.containers.enqueue(recycled.release());
+}
+void MessageDataContainer::recycle() {
+  BufferPool::release(header);
+  BufferPool::release(data);
+  // NOTE: the message of the arena is released before its arena
+  _headerMessage.reset();
+  *this = MessageDataContainer();
+}
+
 MessageDataContainer::MessageDataContainer() = default;
 
 MessageDataContainer::MessageDataContainer(std::string path) : _path(std::move(path)) {}
@@ -58,6 +102,27 @@ void MessageDataContainer::initDataFileStream() {
     }
   }
 }
+#ifdef ENABLE_USING_IOURING
+bool MessageDataContainer::initDataFileWriter() {
+  if (!_dataFileWriter) {
+    IOUring *ring = IOUring::local();
+    if (ring == nullptr) {
+      return false;
+    }
+    Poco::Path dataFilePath(_path);
+    dataFilePath.append(data).makeFile();
+    Poco::File pathDir(dataFilePath.parent());
+    if (!pathDir.exists()) {
+      pathDir.createDirectories();
+    }
+    _dataFileWriter = std::make_unique<IOUringFileWriter>(*ring, dataFilePath.toString());
+    if (!_dataFileWriter->isOpen()) {
+      throw EXCEPTION("can't open data file", dataFilePath.toString(), _dataFileWriter->lastError());
+    }
+  }
+  return true;
+}
+#endif
 MessageDataContainer::MessageDataContainer(ProtoMessage *headerProtoMessage) : _headerMessage(headerProtoMessage) { data.clear(); }
 MessageDataContainer::MessageDataContainer(ProtoMessage *headerProtoMessage, Body *dataBody)
     : _headerMessage(headerProtoMessage), _dataMessage(dataBody) {
@@ -65,7 +130,7 @@ MessageDataContainer::MessageDataContainer(ProtoMessage *headerProtoMessage, Bod
   data = _dataMessage->SerializeAsString();
 }
 MessageDataContainer::~MessageDataContainer() = default;
-bool MessageDataContainer::empty() const { return (!_headerMessage && !_dataMessage && header.empty() && data.empty()); }
+bool MessageDataContainer::empty() const { return (!_headerMessage && !_deliveryHeader && !_dataMessage && header.empty() && data.empty()); }
 ProtoMessage &MessageDataContainer::protoMessage() const {
   initHeader();
   return *_headerMessage;
@@ -79,14 +144,35 @@ const Proto::Disconnect &MessageDataContainer::disconnect() const {
   return _headerMessage->disconnect();
 }
 void MessageDataContainer::initHeader() const {
+  if (_deliveryHeader && !_headerMessage) {
+    std::string frame;
+    _deliveryHeader->appendFrame(frame, _delivery);
+    if (!newHeader().ParseFromString(frame)) {
+      _headerMessage->Clear();
+    }
+    return;
+  }
   if (!header.empty() && !_headerMessage) {
-    _headerMessage = std::make_unique<ProtoMessage>();
-    if (!_headerMessage->ParseFromString(header)) {
+    if (!newHeader().ParseFromString(header)) {
       _headerMessage->Clear();
     }
   }
 }
+ProtoMessage &MessageDataContainer::newHeader() const {
+  _deliveryHeader.reset();
+  _headerMessage.reset(nullptr);
+  if (_arena) {
+    _arena->reset();
+  } else {
+    _arena = ProtoArena::acquire();
+  }
+  _headerMessage = _arena->create<ProtoMessage>();
+  return *_headerMessage;
+}
 ProtoMessage::ProtoMessageTypeCase MessageDataContainer::type() const {
+  if (_deliveryHeader) {
+    return ProtoMessage::kMessage;
+  }
   initHeader();
   return _headerMessage->ProtoMessageType_case();
 }
@@ -108,12 +194,14 @@ bool MessageDataContainer::isBegin() const { return (type() == ProtoMessage::kBe
 bool MessageDataContainer::isCommit() const { return (type() == ProtoMessage::kCommit); }
 bool MessageDataContainer::isAbort() const { return (type() == ProtoMessage::kAbort); }
 bool MessageDataContainer::isAck() const { return (type() == ProtoMessage::kAck); }
+bool MessageDataContainer::isCredit() const { return (type() == ProtoMessage::kCredit); }
 bool MessageDataContainer::isMessage() const { return (type() == ProtoMessage::kMessage); }
+bool MessageDataContainer::isMessageBatch() const { return (type() == ProtoMessage::kMessageBatch); }
 bool MessageDataContainer::isBrowser() const { return (type() == ProtoMessage::kBrowser); }
 bool MessageDataContainer::isForServer() const {
   return (isConnect() || isClientInfo() || isDisconnect() || isSession() || isUnsession() || isDestination() || isUndestination() || isSender() ||
           isUnsender() || isSubscription() || isSubscribe() || isUnsubscribe() || isUnsubscription() || isBegin() || isCommit() || isAbort() ||
-          isAck() || isMessage() || isBrowser() || isPing());
+          isAck() || isCredit() || isMessage() || isBrowser() || isPing());
 }
 bool MessageDataContainer::isNotForServer() const { return !isForServer(); }
 std::string MessageDataContainer::typeName() const {
@@ -152,8 +240,12 @@ std::string MessageDataContainer::typeName() const {
       return "abort";
     case ProtoMessage::kAck:
       return "ack";
+    case ProtoMessage::kCredit:
+      return "credit";
     case ProtoMessage::kMessage:
       return "message";
+    case ProtoMessage::kMessageBatch:
+      return "message_batch";
     case ProtoMessage::kConnected:
       return "connected";
     case ProtoMessage::kReceipt:
@@ -181,6 +273,22 @@ Proto::Message &MessageDataContainer::mutableMessage() const {
   initHeader();
   return *_headerMessage->mutable_message();
 }
+const std::string &MessageDataContainer::messageID() const { return _deliveryHeader ? _deliveryHeader->messageID() : message().message_id(); }
+bool MessageDataContainer::hasGroupID() const { return _deliveryHeader ? _deliveryHeader->hasGroupID() : message().has_group_id(); }
+int MessageDataContainer::groupSeq() const { return _deliveryHeader ? _deliveryHeader->groupSeq() : message().group_seq(); }
+size_t MessageDataContainer::headerSize() const {
+  return _deliveryHeader ? _deliveryHeader->frameSize(_delivery) : protoMessage().ByteSizeLong();
+}
+size_t MessageDataContainer::messageSize() const {
+  return _deliveryHeader ? _deliveryHeader->messageSize(_delivery) : message().ByteSizeLong();
+}
+void MessageDataContainer::appendMessage(std::string &out) const {
+  if (_deliveryHeader) {
+    _deliveryHeader->appendMessage(out, _delivery);
+  } else {
+    message().AppendPartialToString(&out);
+  }
+}
 bool MessageDataContainer::isNeedReceipt() const {
   initHeader();
   switch (type()) {
@@ -252,6 +360,10 @@ bool MessageDataContainer::isNeedReceipt() const {
       const Proto::Ack &aAck = ack();
       return !(aAck.receipt_id().empty());
     }
+    case ProtoMessage::kCredit: {
+      const Proto::Credit &aCredit = credit();
+      return !(aCredit.receipt_id().empty());
+    }
     default:
       break;
   }
@@ -317,6 +429,10 @@ const Proto::Ack &MessageDataContainer::ack() const {
   initHeader();
   return _headerMessage->ack();
 }
+const Proto::Credit &MessageDataContainer::credit() const {
+  initHeader();
+  return _headerMessage->credit();
+}
 const Proto::Browser &MessageDataContainer::browser() const {
   initHeader();
   return _headerMessage->browser();
@@ -392,33 +508,62 @@ std::string MessageDataContainer::receiptId() const {
       const Proto::Ack &aAck = ack();
       return aAck.receipt_id();
     }
+    case ProtoMessage::kCredit: {
+      const Proto::Credit &aCredit = credit();
+      return aCredit.receipt_id();
+    }
     default:
       break;
   }
   return emptyString;
 }
 std::string MessageDataContainer::objectID() const {
+  if (_deliveryHeader) {
+    return _delivery.objectID;
+  }
   initHeader();
   return _headerMessage->object_id();
 }
 void MessageDataContainer::setObjectID(const std::string &newObjectID) {
+  if (_deliveryHeader) {
+    _delivery.objectID = newObjectID;
+    return;
+  }
   initHeader();
   _headerMessage->set_object_id(newObjectID);
 }
 int MessageDataContainer::rrID() const {
+  if (_deliveryHeader) {
+    return _delivery.rrID;
+  }
   initHeader();
   return _headerMessage->request_reply_id();
 }
 void MessageDataContainer::setRRID(int rrID) {
-  if (_headerMessage) {
+  if (_deliveryHeader) {
+    _delivery.rrID = rrID;
+  } else if (_headerMessage) {
     _headerMessage->set_request_reply_id(rrID);
   }
 }
 void MessageDataContainer::setRedelivered(bool status) {
+  if (_deliveryHeader) {
+    _delivery.hasRedelivered = true;
+    _delivery.redelivered = status;
+    return;
+  }
   initHeader();
   _headerMessage->mutable_message()->set_redelivered(status);
 }
 void MessageDataContainer::setDeliveryCount(int count) {
+  if (_deliveryHeader) {
+    if (count > 0) {
+      _delivery.hasRedelivered = true;
+      _delivery.redelivered = true;
+    }
+    _delivery.deliveryCount = count + 1;
+    return;
+  }
   initHeader();
   if (count > 0) {
     _headerMessage->mutable_message()->set_redelivered(true);
@@ -492,6 +637,10 @@ Proto::Pong &MessageDataContainer::createPong(const std::string &objectID) {
   newMessage(objectID);
   return *_headerMessage->mutable_pong();
 }
+Proto::MessageBatch &MessageDataContainer::createMessageBatch(const std::string &objectID) {
+  newMessage(objectID);
+  return *_headerMessage->mutable_message_batch();
+}
 Proto::Message &MessageDataContainer::createMessageHeader(const std::string &objectID) {
   newMessage(objectID);
   return *_headerMessage->mutable_message();
@@ -503,20 +652,74 @@ Proto::Body &MessageDataContainer::createMessageBody() {
   _dataMessage = std::make_unique<Body>();
   return *_dataMessage;
 }
+Proto::ProtoMessage &MessageDataContainer::createHeader() { return newHeader(); }
 void MessageDataContainer::newMessage(const std::string &objectID) {
-  if (_headerMessage) {
-    _headerMessage.reset(nullptr);
-  }
   if (_dataMessage) {
     _dataMessage.reset(nullptr);
   }
   header.clear();
   data.clear();
-  _headerMessage = std::make_unique<ProtoMessage>();
-  _headerMessage->set_object_id(objectID);
+  newHeader().set_object_id(objectID);
+}
+void MessageDataContainer::setDeliveryHeader(std::shared_ptr<const DeliveryHeader> deliveryHeader,
+                                             const std::string &objectID,
+                                             const std::string &sessionID,
+                                             int deliveryCount) {
+  _headerMessage.reset(nullptr);
+  header.clear();
+  _deliveryHeader = std::move(deliveryHeader);
+  _delivery = DeliveryHeader::Fields();
+  _delivery.objectID = objectID;
+  _delivery.sessionID = sessionID;
+  setDeliveryCount(deliveryCount);
+}
+void MessageDataContainer::serializeMessageBatch(const std::string &objectID, const std::vector<std::shared_ptr<MessageDataContainer>> &messages) {
+  // NOTE: MessageBatch is written by hand, so headers of the delivery are copied without the protobuf serialization
+  _deliveryHeader.reset();
+  _headerMessage.reset(nullptr);
+  _dataMessage.reset(nullptr);
+  BufferPool::release(header);
+  BufferPool::release(data);
+  size_t batchSize = 0;
+  size_t bodySizesSize = 0;
+  size_t dataSize = 0;
+  for (const auto &item : messages) {
+    const size_t size = item->messageSize();
+    batchSize += DeliveryHeader::tagSize(MessageBatch::kMessageFieldNumber) + DeliveryHeader::varintSize(size) + size;
+    bodySizesSize += DeliveryHeader::varintSize(item->data.size());
+    dataSize += item->data.size();
+  }
+  if (!messages.empty()) {
+    batchSize += DeliveryHeader::tagSize(MessageBatch::kBodySizeFieldNumber) + DeliveryHeader::varintSize(bodySizesSize) + bodySizesSize;
+  }
+  header = BufferPool::reserve(batchSize + objectID.size() + 32);
+  DeliveryHeader::appendTag(header, ProtoMessage::kMessageBatchFieldNumber, DeliveryHeader::LENGTH_DELIMITED);
+  DeliveryHeader::appendVarint(header, batchSize);
+  for (const auto &item : messages) {
+    DeliveryHeader::appendTag(header, MessageBatch::kMessageFieldNumber, DeliveryHeader::LENGTH_DELIMITED);
+    DeliveryHeader::appendVarint(header, item->messageSize());
+    item->appendMessage(header);
+  }
+  if (!messages.empty()) {
+    DeliveryHeader::appendTag(header, MessageBatch::kBodySizeFieldNumber, DeliveryHeader::LENGTH_DELIMITED);
+    DeliveryHeader::appendVarint(header, bodySizesSize);
+    for (const auto &item : messages) {
+      DeliveryHeader::appendVarint(header, item->data.size());
+    }
+  }
+  DeliveryHeader::appendString(header, ProtoMessage::kObjectIdFieldNumber, objectID);
+  DeliveryHeader::appendInt32(header, ProtoMessage::kRequestReplyIdFieldNumber, 0);
+  data = BufferPool::reserve(dataSize);
+  for (const auto &item : messages) {
+    data.append(item->data);
+  }
 }
 void MessageDataContainer::serialize() {
-  if (_headerMessage) {
+  if (_deliveryHeader) {
+    BufferPool::release(header);
+    header = BufferPool::reserve(_deliveryHeader->frameSize(_delivery));
+    _deliveryHeader->appendFrame(header, _delivery);
+  } else if (_headerMessage) {
     header = _headerMessage->SerializeAsString();
   }
   if (_dataMessage) {
@@ -530,11 +733,7 @@ void MessageDataContainer::debugPrintHeader() const {
 }
 void MessageDataContainer::reparseHeader() {
   if (!header.empty()) {
-    if (_headerMessage) {
-      _headerMessage.reset(nullptr);
-    }
-    _headerMessage = std::make_unique<ProtoMessage>();
-    if (!_headerMessage->ParseFromString(header)) {
+    if (!newHeader().ParseFromString(header)) {
       _headerMessage->Clear();
     }
   }
@@ -543,7 +742,9 @@ void MessageDataContainer::reparseHeader() {
   }
 }
 void MessageDataContainer::resetSessionId(const std::string &sessionID) {
-  if (_headerMessage && _headerMessage->has_message()) {
+  if (_deliveryHeader) {
+    _delivery.sessionID = sessionID;
+  } else if (_headerMessage && _headerMessage->has_message()) {
     _headerMessage->mutable_message()->set_session_id(sessionID);
   }
 }
@@ -552,8 +753,14 @@ MessageDataContainer *MessageDataContainer::clone() const {
   dataContainer->header = header;
   dataContainer->data = data;
   dataContainer->clientID = clientID;
+  dataContainer->groupID = groupID;
   dataContainer->setWithFile(withFile());
-  dataContainer->initHeader();
+  if (_deliveryHeader) {
+    dataContainer->_deliveryHeader = _deliveryHeader;
+    dataContainer->_delivery = _delivery;
+  } else {
+    dataContainer->initHeader();
+  }
   return dataContainer.release();
 }
 bool MessageDataContainer::withFile() const { return _withFile; }
@@ -578,6 +785,14 @@ uint64_t MessageDataContainer::dataSize() const {
 }
 void MessageDataContainer::appendData(const char *part, size_t size) {
   if (_withFile) {
+#ifdef ENABLE_USING_IOURING
+    if (initDataFileWriter()) {
+      if (!_dataFileWriter->write(part, size)) {
+        throw EXCEPTION("can't write data file", data, _dataFileWriter->lastError());
+      }
+      return;
+    }
+#endif
     initDataFileStream();
     _dataFileStream->write(part, size);
   } else {
@@ -609,6 +824,16 @@ std::vector<char> MessageDataContainer::getPartOfData(size_t offset, size_t size
 void MessageDataContainer::setData(const std::string &in) { data = in; }
 void MessageDataContainer::flushData() {
   if (_withFile) {
+#ifdef ENABLE_USING_IOURING
+    if (_dataFileWriter) {
+      const bool flushed = _dataFileWriter->flush();
+      const int error = _dataFileWriter->lastError();
+      _dataFileWriter.reset();
+      if (!flushed) {
+        throw EXCEPTION("can't write data file", data, error);
+      }
+    }
+#endif
     if (_dataFileStream) {
       _dataFileStream->flush();
     }
@@ -617,6 +842,9 @@ void MessageDataContainer::flushData() {
 const std::string &MessageDataContainer::path() const { return _path; }
 void MessageDataContainer::removeLinkedFile() {
   if (_withFile) {
+#ifdef ENABLE_USING_IOURING
+    _dataFileWriter.reset();
+#endif
     if (_dataFileStream) {
       _dataFileStream->close();
     }
@@ -23,9 +23,19 @@
 #include <memory>
 #include <string>
 #include <fstream>
+#include <vector>
+#include "BufferPool.h"
+#include "DeliveryHeader.h"
+#include "MemoryBudget.h"
 #include "MessageInfo.h"
+#include "ProtoArena.h"
 #include "ProtoBuf.h"
+#include "SpillStore.h"
+#include "StageTracer.h"
 #include "StorageDefines.h"
+#ifdef ENABLE_USING_IOURING
+#include "iouring/IOUring.h"
+#endif
 
 using namespace Proto;
 
@@ -34,6 +44,16 @@ namespace broker {
 
 class MessageDataContainer {
  public:
+  /// @brief Recycler - deleter of the pooled container
+  /// ** the container is reset, its buffers go to BufferPool and the container itself goes to the bounded free list
+  struct Recycler {
+    void operator()(MessageDataContainer *container) const;
+  };
+  static constexpr size_t MAX_FREE_CONTAINERS = 1024;
+
+  // the container from the free list, it's recycled when the last owner releases it
+  static std::shared_ptr<MessageDataContainer> make(std::string path = std::string());
+
   MessageDataContainer();
   explicit MessageDataContainer(std::string path);
   explicit MessageDataContainer(ProtoMessage *headerProtoMessage);
@@ -62,6 +82,16 @@ class MessageDataContainer {
   Proto::Body &createMessageBody();
   Proto::BrowserInfo &createBrowserInfo(const std::string &objectID);
   Proto::Pong &createPong(const std::string &objectID);
+  Proto::MessageBatch &createMessageBatch(const std::string &objectID);
+  // empty header of the reply, it's allocated in the arena of the container
+  Proto::ProtoMessage &createHeader();
+  // header of the stored message delivery, it's the shared template with the fields of the delivery
+  void setDeliveryHeader(std::shared_ptr<const DeliveryHeader> deliveryHeader,
+                         const std::string &objectID,
+                         const std::string &sessionID,
+                         int deliveryCount);
+  // header is the MessageBatch of messages, data is the concatenation of their bodies
+  void serializeMessageBatch(const std::string &objectID, const std::vector<std::shared_ptr<MessageDataContainer>> &messages);
   void serialize();
 
   bool empty() const;
@@ -84,7 +114,13 @@ class MessageDataContainer {
   const Proto::Commit &commit() const;
   const Proto::Abort &abort() const;
   const Proto::Ack &ack() const;
+  const Proto::Credit &credit() const;
   const Proto::Message &message() const;
+  // NOTE: fields of the message that don't parse the header of the delivery
+  const std::string &messageID() const;
+  bool hasGroupID() const;
+  int groupSeq() const;
+  size_t headerSize() const;
   Proto::Message &mutableMessage() const;
   const Proto::Browser &browser() const;
   Proto::ProtoMessage::ProtoMessageTypeCase type() const;
@@ -106,7 +142,9 @@ class MessageDataContainer {
   bool isCommit() const;
   bool isAbort() const;
   bool isAck() const;
+  bool isCredit() const;
   bool isMessage() const;
+  bool isMessageBatch() const;
   bool isForServer() const;
   bool isNotForServer() const;
   bool isNeedReceipt() const;
@@ -125,7 +163,19 @@ class MessageDataContainer {
   std::string header = "";
   mutable std::string data = "";
   std::string clientID = "";
+  // NOTE: group id in the storage, the message itself has the client group id
+  std::string groupID = "";
+  // NOTE: handle of the resolved destination of the incoming message, 0 - not resolved yet
+  mutable uint32_t destinationHandle = 0;
   size_t handlerNum = 0;
+  // NOTE: bytes of the body held in memory, they are released with the container
+  MemoryBudget::Charge memoryCharge;
+  // NOTE: the non-persistent body written to the spill segment, data is empty then
+  std::shared_ptr<const SpillStore::Record> spilledData;
+  // NOTE: decode stamp of the sampled incoming message, 0 - the message isn't traced
+  int64_t traceDecoded = 0;
+  // NOTE: traces of sampled messages in the outgoing frame, they are completed when the frame is written
+  std::vector<StageTracer::Trace> traces;
   void reparseHeader();
   void resetSessionId(const std::string &sessionID);
   MessageDataContainer *clone() const;
@@ -146,13 +196,26 @@ class MessageDataContainer {
 
  private:
   std::string _path;
-  mutable std::unique_ptr<ProtoMessage> _headerMessage;
+  // NOTE: the arena is returned into the pool when the frame is sent and the container is released
+  mutable ProtoArena::Lease _arena;
+  mutable ProtoArena::Ptr<ProtoMessage> _headerMessage;
+  // NOTE: the header is parsed from the template only if it's accessed by protobuf api
+  mutable std::shared_ptr<const DeliveryHeader> _deliveryHeader;
+  DeliveryHeader::Fields _delivery;
   mutable std::unique_ptr<Body> _dataMessage;
   bool _withFile = false;
   std::unique_ptr<std::fstream> _dataFileStream;
+#ifdef ENABLE_USING_IOURING
+  std::unique_ptr<IOUringFileWriter> _dataFileWriter;
+  bool initDataFileWriter();
+#endif
   void initHeader() const;
+  ProtoMessage &newHeader() const;
+  size_t messageSize() const;
+  void appendMessage(std::string &out) const;
   void newMessage(const std::string &objectID);
   void initDataFileStream();
+  void recycle();
 };
 }  // namespace broker
 }  // namespace upmq
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProtoArena.h"
+#include <mutex>
+#include <vector>
+
+namespace upmq {
+namespace broker {
+
+namespace {
+constexpr size_t MAX_LOCAL_ARENAS = 64;
+constexpr size_t TRANSFER_ARENAS = MAX_LOCAL_ARENAS / 2;
+constexpr size_t MAX_DEPOT_ARENAS = 1024;
+
+using Arenas = std::vector<std::unique_ptr<ProtoArena>>;
+
+struct Depot {
+  std::mutex lock;
+  Arenas arenas;
+};
+
+Depot &depot() {
+  static Depot instance;
+  return instance;
+}
+
+Arenas &localArenas() {
+  // NOTE: the pool of the exited thread is freed, it doesn't touch the depot that can be destroyed already
+  thread_local Arenas arenas;
+  return arenas;
+}
+
+void moveArenas(Arenas &from, Arenas &to, size_t count) {
+  while ((count-- > 0) && !from.empty()) {
+    to.emplace_back(std::move(from.back()));
+    from.pop_back();
+  }
+}
+}  // namespace
+
+ProtoArena::ProtoArena() : _arena(options(_block)) {}
+
+google::protobuf::ArenaOptions ProtoArena::options(char *block) {
+  google::protobuf::ArenaOptions result;
+  result.initial_block = block;
+  result.initial_block_size = INITIAL_BLOCK_SIZE;
+  result.start_block_size = INITIAL_BLOCK_SIZE;
+  result.max_block_size = MAX_BLOCK_SIZE;
+  return result;
+}
+
+void ProtoArena::reset() { _arena.Reset(); }
+
+ProtoArena::Lease ProtoArena::acquire() {
+  Arenas &arenas = localArenas();
+  if (arenas.empty()) {
+    Depot &shared = depot();
+    std::lock_guard<std::mutex> lock(shared.lock);
+    moveArenas(shared.arenas, arenas, TRANSFER_ARENAS);
+  }
+  if (arenas.empty()) {
+    return Lease(new ProtoArena());
+  }
+  Lease lease(arenas.back().release());
+  arenas.pop_back();
+  return lease;
+}
+
+void ProtoArena::Releaser::operator()(ProtoArena *arena) const {
+  std::unique_ptr<ProtoArena> released(arena);
+  released->reset();
+  Arenas &arenas = localArenas();
+  if (arenas.size() >= MAX_LOCAL_ARENAS) {
+    // NOTE: the writer thread releases arenas taken by the reader and exchange threads, so the surplus is shared
+    Depot &shared = depot();
+    std::lock_guard<std::mutex> lock(shared.lock);
+    if (shared.arenas.size() < MAX_DEPOT_ARENAS) {
+      moveArenas(arenas, shared.arenas, TRANSFER_ARENAS);
+    } else {
+      arenas.resize(MAX_LOCAL_ARENAS - TRANSFER_ARENAS);
+    }
+  }
+  arenas.emplace_back(std::move(released));
+}
+}  // namespace broker
+}  // namespace upmq
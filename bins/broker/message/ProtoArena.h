@@ -0,0 +1,78 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_PROTOARENA_H
+#define BROKER_PROTOARENA_H
+
+#include <google/protobuf/arena.h>
+#include <cstddef>
+#include <memory>
+
+namespace upmq {
+namespace broker {
+
+/// @brief ProtoArena - protobuf arena of the one frame
+/// ** the arena starts in the own initial block, so the small frame is built without malloc
+/// ** arenas are reused by the per-thread pools, the released arena is reset and cached by the releasing thread
+/// ** the thread pool is bounded, its surplus goes to the shared depot, the thread with the empty pool takes arenas from the depot
+class ProtoArena {
+ public:
+  static constexpr size_t INITIAL_BLOCK_SIZE = 2048;
+  static constexpr size_t MAX_BLOCK_SIZE = 16384;
+
+  struct Releaser {
+    void operator()(ProtoArena *arena) const;
+  };
+  using Lease = std::unique_ptr<ProtoArena, Releaser>;
+
+  /// @brief MessageDeleter - deleter of the message that can be owned by the arena
+  /// ** the message of the arena is freed with its arena, so only the heap message is deleted
+  struct MessageDeleter {
+    bool onHeap = true;
+    template <typename T>
+    void operator()(T *message) const {
+      if (onHeap) {
+        delete message;
+      }
+    }
+  };
+  template <typename T>
+  using Ptr = std::unique_ptr<T, MessageDeleter>;
+
+  ProtoArena();
+  ProtoArena(const ProtoArena &) = delete;
+  ProtoArena &operator=(const ProtoArena &) = delete;
+
+  static Lease acquire();
+
+  template <typename T>
+  Ptr<T> create() {
+    return Ptr<T>(google::protobuf::Arena::CreateMessage<T>(&_arena), MessageDeleter{false});
+  }
+
+  // frees all messages of the arena, the initial block is kept
+  void reset();
+
+ private:
+  alignas(alignof(std::max_align_t)) char _block[INITIAL_BLOCK_SIZE];
+  google::protobuf::Arena _arena;
+
+  static google::protobuf::ArenaOptions options(char *block);
+};
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // BROKER_PROTOARENA_H
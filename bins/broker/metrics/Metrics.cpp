@@ -0,0 +1,200 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Metrics.h"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+namespace upmq {
+namespace broker {
+
+void Metrics::Counter::write(std::ostream &out, const std::string &name, const std::string &labels) const {
+  sample(out, name, labels) << value() << '\n';
+}
+void Metrics::Gauge::write(std::ostream &out, const std::string &name, const std::string &labels) const {
+  sample(out, name, labels) << value() << '\n';
+}
+void Metrics::Callback::detach() {
+  std::lock_guard<std::mutex> lock(_lock);
+  _value = nullptr;
+}
+void Metrics::Callback::write(std::ostream &out, const std::string &name, const std::string &labels) const {
+  std::lock_guard<std::mutex> lock(_lock);
+  if (_value) {
+    sample(out, name, labels) << _value() << '\n';
+  }
+}
+Metrics::Probe &Metrics::Probe::operator=(Probe &&o) noexcept {
+  if (this != &o) {
+    if (_callback) {
+      _callback->detach();
+    }
+    _callback = std::move(o._callback);
+  }
+  return *this;
+}
+Metrics::Probe::~Probe() {
+  if (_callback) {
+    _callback->detach();
+  }
+}
+
+Metrics::Histogram::Histogram(std::vector<double> bounds) : _bounds(std::move(bounds)), _buckets(new std::atomic<uint64_t>[_bounds.size() + 1]) {
+  for (size_t i = 0; i <= _bounds.size(); ++i) {
+    _buckets[i] = 0;
+  }
+}
+void Metrics::Histogram::observe(double value) {
+  const auto bucket = static_cast<size_t>(std::lower_bound(_bounds.begin(), _bounds.end(), value) - _bounds.begin());
+  _buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  double sum = _sum.load(std::memory_order_relaxed);
+  while (!_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+  }
+}
+uint64_t Metrics::Histogram::count() const {
+  uint64_t result = 0;
+  for (size_t i = 0; i <= _bounds.size(); ++i) {
+    result += _buckets[i].load(std::memory_order_relaxed);
+  }
+  return result;
+}
+void Metrics::Histogram::write(std::ostream &out, const std::string &name, const std::string &labels) const {
+  const std::string separator = labels.empty() ? "" : ",";
+  // NOTE: buckets are read one by one, so the scrape during updates can be inconsistent by the last observations only
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < _bounds.size(); ++i) {
+    cumulative += _buckets[i].load(std::memory_order_relaxed);
+    out << name << "_bucket{" << labels << separator << "le=\"" << _bounds[i] << "\"} " << cumulative << '\n';
+  }
+  cumulative += _buckets[_bounds.size()].load(std::memory_order_relaxed);
+  out << name << "_bucket{" << labels << separator << "le=\"+Inf\"} " << cumulative << '\n';
+  sample(out, name + "_sum", labels) << _sum.load(std::memory_order_relaxed) << '\n';
+  sample(out, name + "_count", labels) << cumulative << '\n';
+}
+
+std::ostream &Metrics::sample(std::ostream &out, const std::string &name, const std::string &labels) {
+  out << name;
+  if (!labels.empty()) {
+    out << '{' << labels << '}';
+  }
+  return out << ' ';
+}
+std::string Metrics::renderLabels(const Labels &labels) {
+  std::string result;
+  for (const auto &label : labels) {
+    if (!result.empty()) {
+      result.push_back(',');
+    }
+    result.append(label.first).append("=\"");
+    for (char c : label.second) {
+      switch (c) {
+        case '\\':
+          result.append("\\\\");
+          break;
+        case '"':
+          result.append("\\\"");
+          break;
+        case '\n':
+          result.append("\\n");
+          break;
+        default:
+          result.push_back(c);
+      }
+    }
+    result.push_back('"');
+  }
+  return result;
+}
+const char *Metrics::typeName(Type type) {
+  switch (type) {
+    case Type::COUNTER:
+      return "counter";
+    case Type::HISTOGRAM:
+      return "histogram";
+    default:
+      return "gauge";
+  }
+}
+void Metrics::add(const std::string &name, const std::string &help, Type type, const Labels &labels, std::weak_ptr<const Metric> metric) {
+  std::lock_guard<std::mutex> lock(_lock);
+  auto it = _families.find(name);
+  if (it == _families.end()) {
+    it = _families.emplace(name, Family{help, type, {}}).first;
+  }
+  auto &series = it->second.series;
+  // NOTE: series of the released owners are dropped before the vector grows, so it stays bounded without scrapes
+  if (series.size() == series.capacity()) {
+    prune(series);
+  }
+  series.emplace_back(Series{renderLabels(labels), std::move(metric)});
+}
+void Metrics::prune(std::vector<Series> &series) {
+  series.erase(std::remove_if(series.begin(), series.end(), [](const Series &item) { return item.metric.expired(); }), series.end());
+}
+std::shared_ptr<Metrics::Counter> Metrics::counter(const std::string &name, const std::string &help, const Labels &labels) {
+  auto result = std::make_shared<Counter>();
+  add(name, help, Type::COUNTER, labels, result);
+  return result;
+}
+std::shared_ptr<Metrics::Gauge> Metrics::gauge(const std::string &name, const std::string &help, const Labels &labels) {
+  auto result = std::make_shared<Gauge>();
+  add(name, help, Type::GAUGE, labels, result);
+  return result;
+}
+std::shared_ptr<Metrics::Histogram> Metrics::histogram(const std::string &name,
+                                                       const std::string &help,
+                                                       const Labels &labels,
+                                                       std::vector<double> bounds) {
+  auto result = std::make_shared<Histogram>(std::move(bounds));
+  add(name, help, Type::HISTOGRAM, labels, result);
+  return result;
+}
+Metrics::Probe Metrics::probe(const std::string &name, const std::string &help, const Labels &labels, std::function<double()> value) {
+  auto result = std::make_shared<Callback>(std::move(value));
+  add(name, help, Type::GAUGE, labels, result);
+  return Probe(std::move(result));
+}
+std::string Metrics::toPrometheus() const {
+  std::ostringstream out;
+  out << std::setprecision(std::numeric_limits<double>::digits10);
+  std::lock_guard<std::mutex> lock(_lock);
+  for (auto family = _families.begin(); family != _families.end();) {
+    auto &series = family->second.series;
+    prune(series);
+    if (series.empty()) {
+      family = _families.erase(family);
+      continue;
+    }
+    out << "# HELP " << family->first << ' ' << family->second.help << '\n';
+    out << "# TYPE " << family->first << ' ' << typeName(family->second.type) << '\n';
+    for (const auto &item : series) {
+      // NOTE: the owner can release the series after the check above
+      std::shared_ptr<const Metric> metric = item.metric.lock();
+      if (metric) {
+        metric->write(out, family->first, item.labels);
+      }
+    }
+    ++family;
+  }
+  return out.str();
+}
+std::vector<double> Metrics::latencyBounds() {
+  return {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+}
+}  // namespace broker
+}  // namespace upmq
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_METRICS_H
+#define BROKER_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Singleton.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief Metrics - registry of broker metrics rendered in the Prometheus text format
+/// ** counters, gauges and histograms are updated by relaxed atomics, the hot path doesn't lock
+/// ** the owner (destination, connection) holds its series, the registry keeps weak references and drops expired series on the scrape
+///    and before the series of the family grow
+/// ** callback gauges are evaluated on the scrape, they have to read the memory state only
+class Metrics {
+ public:
+  // Labels - vector<name, value>
+  using Labels = std::vector<std::pair<std::string, std::string>>;
+
+  class Metric {
+   public:
+    virtual ~Metric() = default;
+    // writes samples of the series, labels are already rendered as "name=\"value\",..."
+    virtual void write(std::ostream &out, const std::string &name, const std::string &labels) const = 0;
+  };
+
+  class Counter : public Metric {
+    std::atomic<uint64_t> _value{0};
+
+   public:
+    void inc(uint64_t value = 1) { _value.fetch_add(value, std::memory_order_relaxed); }
+    uint64_t value() const { return _value.load(std::memory_order_relaxed); }
+    void write(std::ostream &out, const std::string &name, const std::string &labels) const override;
+  };
+
+  class Gauge : public Metric {
+    std::atomic<int64_t> _value{0};
+
+   public:
+    void set(int64_t value) { _value.store(value, std::memory_order_relaxed); }
+    void add(int64_t value = 1) { _value.fetch_add(value, std::memory_order_relaxed); }
+    void sub(int64_t value = 1) { _value.fetch_sub(value, std::memory_order_relaxed); }
+    int64_t value() const { return _value.load(std::memory_order_relaxed); }
+    void write(std::ostream &out, const std::string &name, const std::string &labels) const override;
+  };
+
+  /// @brief Histogram - cumulative buckets of observed values
+  /// ** bounds are upper bounds (le) in ascending order, the +Inf bucket is implicit
+  class Histogram : public Metric {
+    const std::vector<double> _bounds;
+    std::unique_ptr<std::atomic<uint64_t>[]> _buckets;
+    std::atomic<double> _sum{0};
+
+   public:
+    explicit Histogram(std::vector<double> bounds);
+    void observe(double value);
+    uint64_t count() const;
+    void write(std::ostream &out, const std::string &name, const std::string &labels) const override;
+  };
+
+  class Callback : public Metric {
+    mutable std::mutex _lock;
+    std::function<double()> _value;
+
+   public:
+    explicit Callback(std::function<double()> value) : _value(std::move(value)) {}
+    // the scrape doesn't call the detached callback
+    void detach();
+    void write(std::ostream &out, const std::string &name, const std::string &labels) const override;
+  };
+
+  /// @brief Probe - the callback gauge of the owner
+  /// ** the callback is detached by the destructor, so the running scrape doesn't call it for the destroyed owner
+  class Probe {
+    std::shared_ptr<Callback> _callback;
+
+   public:
+    Probe() = default;
+    explicit Probe(std::shared_ptr<Callback> callback) : _callback(std::move(callback)) {}
+    Probe(Probe &&) = default;
+    Probe &operator=(Probe &&o) noexcept;
+    Probe(const Probe &) = delete;
+    Probe &operator=(const Probe &) = delete;
+    ~Probe();
+  };
+
+  enum class Type { COUNTER, GAUGE, HISTOGRAM };
+
+ private:
+  struct Series {
+    std::string labels;
+    std::weak_ptr<const Metric> metric;
+  };
+  struct Family {
+    std::string help;
+    Type type;
+    std::vector<Series> series;
+  };
+
+  mutable std::mutex _lock;
+  mutable std::map<std::string, Family> _families;
+
+  void add(const std::string &name, const std::string &help, Type type, const Labels &labels, std::weak_ptr<const Metric> metric);
+  // drops series of the released owners
+  static void prune(std::vector<Series> &series);
+  static std::string renderLabels(const Labels &labels);
+  static std::ostream &sample(std::ostream &out, const std::string &name, const std::string &labels);
+  static const char *typeName(Type type);
+
+ public:
+  Metrics() = default;
+  Metrics(const Metrics &) = delete;
+  Metrics &operator=(const Metrics &) = delete;
+
+  std::shared_ptr<Counter> counter(const std::string &name, const std::string &help, const Labels &labels = {});
+  std::shared_ptr<Gauge> gauge(const std::string &name, const std::string &help, const Labels &labels = {});
+  std::shared_ptr<Histogram> histogram(const std::string &name,
+                                       const std::string &help,
+                                       const Labels &labels = {},
+                                       std::vector<double> bounds = latencyBounds());
+  // the gauge is evaluated on the scrape while the probe is held, the callback has to be thread-safe
+  Probe probe(const std::string &name, const std::string &help, const Labels &labels, std::function<double()> value);
+
+  // all series in the Prometheus text exposition format (version 0.0.4)
+  std::string toPrometheus() const;
+
+  // seconds, from 50us to 10s
+  static std::vector<double> latencyBounds();
+};
+}  // namespace broker
+}  // namespace upmq
+
+typedef Singleton<upmq::broker::Metrics> METRICS;
+
+#endif  // BROKER_METRICS_H
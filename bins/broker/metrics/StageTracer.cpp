@@ -0,0 +1,104 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "StageTracer.h"
+#include <chrono>
+#include "Configuration.h"
+
+namespace upmq {
+namespace broker {
+
+StageTracer::StageTracer(const std::string &destination) {
+  const std::string name = "upmq_message_stage_seconds";
+  const std::string help = "Latency of sampled messages between the broker stages";
+  Metrics &metrics = METRICS::Instance();
+  _store = metrics.histogram(name, help, {{"destination", destination}, {"stage", "store"}}, bounds());
+  _queue = metrics.histogram(name, help, {{"destination", destination}, {"stage", "queue"}}, bounds());
+  _write = metrics.histogram(name, help, {{"destination", destination}, {"stage", "write"}}, bounds());
+  _total = metrics.histogram(name, help, {{"destination", destination}, {"stage", "total"}}, bounds());
+}
+int64_t StageTracer::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+int64_t StageTracer::sample() {
+  static std::atomic<uint64_t> counter{0};
+  const size_t sampling = TRACE_CONFIG.sampling;
+  if ((sampling == 0) || ((counter.fetch_add(1, std::memory_order_relaxed) % sampling) != 0)) {
+    return 0;
+  }
+  return now();
+}
+std::vector<double> StageTracer::bounds() {
+  std::vector<double> result;
+  for (double decade = 0.00001; decade < 10; decade *= 10) {
+    result.push_back(decade);
+    result.push_back(decade * 2);
+    result.push_back(decade * 5);
+  }
+  result.push_back(10);
+  return result;
+}
+double StageTracer::seconds(int64_t from, int64_t to) { return (to > from) ? static_cast<double>(to - from) / 1e9 : 0; }
+void StageTracer::stored(const std::string &messageID, int64_t decoded) {
+  const int64_t stamp = now();
+  _store->observe(seconds(decoded, stamp));
+  std::lock_guard<std::mutex> lock(_lock);
+  if (_traced.size() >= MAX_TRACED) {
+    _traced.clear();
+  }
+  Stamps &stamps = _traced[messageID];
+  stamps.decoded = decoded;
+  stamps.stored = stamp;
+  _tracedCount = _traced.size();
+}
+void StageTracer::dispatched(const std::string &messageID, std::vector<Trace> &traces) {
+  // NOTE: unsampled destinations don't lock
+  if (_tracedCount.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  Trace trace;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    auto it = _traced.find(messageID);
+    if (it == _traced.end()) {
+      return;
+    }
+    trace.decoded = it->second.decoded;
+    trace.stored = it->second.stored;
+  }
+  trace.dispatched = now();
+  trace.tracer = shared_from_this();
+  _queue->observe(seconds(trace.stored, trace.dispatched));
+  traces.emplace_back(std::move(trace));
+}
+void StageTracer::forget(const std::string &messageID) {
+  if (_tracedCount.load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(_lock);
+  _traced.erase(messageID);
+  _tracedCount = _traced.size();
+}
+void StageTracer::written(const std::vector<Trace> &traces) {
+  const int64_t stamp = now();
+  for (const auto &trace : traces) {
+    trace.tracer->_write->observe(seconds(trace.dispatched, stamp));
+    trace.tracer->_total->observe(seconds(trace.decoded, stamp));
+  }
+}
+}  // namespace broker
+}  // namespace upmq
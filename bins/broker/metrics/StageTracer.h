@@ -0,0 +1,88 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BROKER_STAGETRACER_H
+#define BROKER_STAGETRACER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Metrics.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief StageTracer - latency of sampled messages between the stages of the destination
+/// ** decoded - the frame is read by Broker::read, one of TRACE_CONFIG.sampling messages is sampled
+/// ** stored - the message is committed into the destination
+/// ** dispatched - the message is taken by the subscription for the consumer
+/// ** written - the frame is written into the consumer socket
+/// ** stamps of the stored message are kept until the message is removed, every delivery of it is traced
+class StageTracer : public std::enable_shared_from_this<StageTracer> {
+ public:
+  /// @brief Trace - stamps of the dispatched message, it's carried by the frame to the writer
+  struct Trace {
+    std::shared_ptr<StageTracer> tracer;
+    int64_t decoded = 0;
+    int64_t stored = 0;
+    int64_t dispatched = 0;
+  };
+
+ private:
+  struct Stamps {
+    int64_t decoded = 0;
+    int64_t stored = 0;
+  };
+  // NOTE: stamps of aborted messages aren't forgotten, so the map is cleared when it's full
+  enum { MAX_TRACED = 4096 };
+
+  std::shared_ptr<Metrics::Histogram> _store;
+  std::shared_ptr<Metrics::Histogram> _queue;
+  std::shared_ptr<Metrics::Histogram> _write;
+  std::shared_ptr<Metrics::Histogram> _total;
+  std::mutex _lock;
+  std::unordered_map<std::string, Stamps> _traced;
+  std::atomic_size_t _tracedCount{0};
+
+  static double seconds(int64_t from, int64_t to);
+
+ public:
+  explicit StageTracer(const std::string &destination);
+  StageTracer(const StageTracer &) = delete;
+  StageTracer &operator=(const StageTracer &) = delete;
+
+  // monotonic nanoseconds
+  static int64_t now();
+  // decode stamp of the new message, 0 - the message isn't sampled
+  static int64_t sample();
+  // finer buckets than Metrics::latencyBounds, 1-2-5 steps from 10us to 10s
+  static std::vector<double> bounds();
+
+  void stored(const std::string &messageID, int64_t decoded);
+  // appends the trace if the message is sampled, the tracer has to be owned by the shared_ptr
+  void dispatched(const std::string &messageID, std::vector<Trace> &traces);
+  void forget(const std::string &messageID);
+  static void written(const std::vector<Trace> &traces);
+};
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // BROKER_STAGETRACER_H
@@ -0,0 +1,491 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_CONCURRENT_HASH_MAP_H
+#define BROKER_CONCURRENT_HASH_MAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <Poco/Hash.h>
+#include <Exception.h>
+#include "SlotTable.h"
+
+namespace upmq {
+
+/// @brief CHMEntry - item of the ConcurrentHashMap
+/// ** pins - count of handles and iterations which use the item now, erase waits for zero
+template <typename Key, typename Value>
+struct CHMEntry {
+  using KVPair = std::pair<Key, Value>;
+  using KeyType = Key;
+  using ValueType = Value;
+
+  CHMEntry(KVPair &&pair, size_t hash_) : kv(std::move(pair)), hash(hash_) {}
+  CHMEntry(const KVPair &pair, size_t hash_) : kv(pair), hash(hash_) {}
+
+  KVPair kv;
+  const size_t hash;
+  std::atomic_int pins{0};
+
+  void pin() { pins.fetch_add(1, std::memory_order_seq_cst); }
+  void unpin() { pins.fetch_sub(1, std::memory_order_release); }
+};
+
+/// @brief CHMReadLockedValue - the pinned item of the ConcurrentHashMap, same api as FSReadLockedValue
+/// ** the item can't be erased while the value exists
+template <typename Key, typename Value>
+class CHMReadLockedValue {
+  CHMEntry<Key, Value> *_entry = nullptr;
+
+  void unlock() noexcept {
+    if (_entry != nullptr) {
+      _entry->unpin();
+      _entry = nullptr;
+    }
+  }
+
+ public:
+  CHMReadLockedValue() = default;
+  // NOTE: takes the pinned entry
+  explicit CHMReadLockedValue(CHMEntry<Key, Value> *entry) : _entry(entry) {}
+  CHMReadLockedValue(const CHMReadLockedValue &) = delete;
+  CHMReadLockedValue(CHMReadLockedValue &&o) noexcept : _entry(o._entry) { o._entry = nullptr; }
+  CHMReadLockedValue &operator=(const CHMReadLockedValue &) = delete;
+  CHMReadLockedValue &operator=(CHMReadLockedValue &&o) noexcept {
+    if (this != &o) {
+      unlock();
+      _entry = o._entry;
+      o._entry = nullptr;
+    }
+    return *this;
+  }
+  ~CHMReadLockedValue() noexcept { unlock(); }
+  bool hasValue() const { return _entry != nullptr; }
+  const Value &operator*() const { return _entry->kv.second; }
+  const Value *operator->() const { return &_entry->kv.second; }
+  Value &operator*() { return _entry->kv.second; }
+  Value *operator->() { return &_entry->kv.second; }
+  const Key &key() const { return _entry->kv.first; }
+};
+
+/// @brief ConcurrentHashMap - fixed capacity concurrent map, drop-in replacement of FSUnorderedMap
+/// ** open addressing with linear probing, slots are packed by 4 into cache lines, the table is never moved
+/// ** find and iteration don't take locks: the probe is protected by the epoch, the found item is pinned
+/// ** iteration walks only the occupied slots marked in the bitmap, the epoch is entered once for the walk
+/// ** insert and erase are serialized by the writer mutex, erase unlinks the item and deletes it
+///    after the grace period and the last unpin, so the erased item is deleted synchronously as before
+template <typename Key, typename Value>
+class ConcurrentHashMap {
+ public:
+  using ItemType = CHMEntry<Key, Value>;
+  using LockedValue = CHMReadLockedValue<Key, Value>;
+
+ private:
+  enum : size_t { CACHE_LINE_SIZE = 64, MAX_THREADS = 1024 };
+  struct Slot {
+    std::atomic<size_t> hash{0};
+    std::atomic<ItemType *> entry{nullptr};
+  };
+  enum : size_t { SLOTS_PER_LINE = CACHE_LINE_SIZE / sizeof(Slot), SLOTS_PER_WORD = 64 };
+
+  /// @brief Pinned - live entries pinned by the walk, the first ones are kept on the stack
+  /// ** entries which weren't taken are unpinned by the destructor
+  class Pinned {
+    enum : size_t { ON_STACK = 32 };
+    ItemType *_onStack[ON_STACK];
+    std::vector<ItemType *> _onHeap;
+    size_t _size = 0;
+    size_t _next = 0;
+
+   public:
+    Pinned() = default;
+    Pinned(const Pinned &) = delete;
+    Pinned &operator=(const Pinned &) = delete;
+    ~Pinned() {
+      while (hasNext()) {
+        take()->unpin();
+      }
+    }
+    void push(ItemType *entry) {
+      if (_size < ON_STACK) {
+        _onStack[_size] = entry;
+      } else {
+        try {
+          _onHeap.push_back(entry);
+        } catch (...) {
+          entry->unpin();
+          throw;
+        }
+      }
+      ++_size;
+    }
+    bool hasNext() const { return _next < _size; }
+    // the caller unpins the taken entry
+    ItemType *take() {
+      const size_t index = _next++;
+      return (index < ON_STACK) ? _onStack[index] : _onHeap[index - ON_STACK];
+    }
+  };
+
+  size_t _size;
+  size_t _mask = 0;
+  std::unique_ptr<char[]> _memory;
+  Slot *_slots = nullptr;
+  // bit per slot with the live entry, changed under the writer lock
+  std::unique_ptr<std::atomic<uint64_t>[]> _occupied;
+  size_t _words = 0;
+  std::atomic<size_t> _realSize{0};
+  std::atomic<size_t> _maxProbe{0};
+  std::mutex _writeLock;
+
+  static ItemType *tombstone() { return reinterpret_cast<ItemType *>(static_cast<uintptr_t>(1)); }
+  static bool isLive(const ItemType *entry) { return (entry != nullptr) && (entry != tombstone()); }
+  // NOTE: all maps share the domain, the probe is short and doesn't call user code
+  static EpochDomain &epoch() {
+    static EpochDomain domain(MAX_THREADS);
+    return domain;
+  }
+  static size_t hashOf(const Key &key) { return Poco::hash(key); }
+
+  void allocate() {
+    size_t count = SLOTS_PER_LINE;
+    // NOTE: load factor is kept below a half, so the probe meets an empty slot soon
+    while (count < _size * 2) {
+      count <<= 1;
+    }
+    _mask = count - 1;
+    _memory.reset(new char[count * sizeof(Slot) + CACHE_LINE_SIZE]);
+    const uintptr_t addr = reinterpret_cast<uintptr_t>(_memory.get());
+    const uintptr_t aligned = (addr + CACHE_LINE_SIZE - 1) & ~static_cast<uintptr_t>(CACHE_LINE_SIZE - 1);
+    _slots = reinterpret_cast<Slot *>(aligned);
+    for (size_t i = 0; i < count; ++i) {
+      new (&_slots[i]) Slot();
+    }
+    _words = (count + SLOTS_PER_WORD - 1) / SLOTS_PER_WORD;
+    _occupied.reset(new std::atomic<uint64_t>[_words]);
+    for (size_t i = 0; i < _words; ++i) {
+      _occupied[i].store(0, std::memory_order_relaxed);
+    }
+  }
+  void release() {
+    if (_slots == nullptr) {
+      return;
+    }
+    for (size_t i = 0; i <= _mask; ++i) {
+      ItemType *entry = _slots[i].entry.load(std::memory_order_relaxed);
+      if (isLive(entry)) {
+        delete entry;
+      }
+      _slots[i].~Slot();
+    }
+    _slots = nullptr;
+    _memory.reset();
+    _occupied.reset();
+    _words = 0;
+  }
+  static uint64_t bitOf(size_t index) { return static_cast<uint64_t>(1) << (index % SLOTS_PER_WORD); }
+  void markOccupied(size_t index) { _occupied[index / SLOTS_PER_WORD].fetch_or(bitOf(index), std::memory_order_release); }
+  void markFree(size_t index) { _occupied[index / SLOTS_PER_WORD].fetch_and(~bitOf(index), std::memory_order_release); }
+
+  void checkSize() const {
+    if (_realSize + 1 == _size) {
+      throw EXCEPTION("ConcurrentHashMap is full", std::to_string(_realSize), -1);
+    }
+  }
+  // lock free lookup, returns the pinned entry or nullptr
+  ItemType *lookup(const Key &key) const {
+    const size_t hash = hashOf(key);
+    EpochDomain::Guard guard(epoch());
+    const size_t maxProbe = _maxProbe.load(std::memory_order_acquire);
+    for (size_t i = 0; i <= maxProbe; ++i) {
+      const Slot &slot = _slots[(hash + i) & _mask];
+      ItemType *entry = slot.entry.load(std::memory_order_acquire);
+      if (entry == nullptr) {
+        return nullptr;
+      }
+      if ((entry == tombstone()) || (slot.hash.load(std::memory_order_relaxed) != hash)) {
+        continue;
+      }
+      if ((entry->hash == hash) && (entry->kv.first == key)) {
+        entry->pin();
+        if (slot.entry.load(std::memory_order_seq_cst) == entry) {
+          return entry;
+        }
+        // NOTE: the entry is being erased
+        entry->unpin();
+        return nullptr;
+      }
+    }
+    return nullptr;
+  }
+  // pins the entry of the slot for the iteration, the caller is in the epoch
+  ItemType *pinSlot(size_t index) const {
+    const Slot &slot = _slots[index];
+    ItemType *entry = slot.entry.load(std::memory_order_acquire);
+    if (!isLive(entry)) {
+      return nullptr;
+    }
+    entry->pin();
+    if (slot.entry.load(std::memory_order_seq_cst) != entry) {
+      entry->unpin();
+      return nullptr;
+    }
+    return entry;
+  }
+  // under the writer lock, returns the slot index of the key or npos
+  size_t slotOf(const Key &key, size_t hash) const {
+    const size_t maxProbe = _maxProbe.load(std::memory_order_relaxed);
+    for (size_t i = 0; i <= maxProbe; ++i) {
+      const size_t index = (hash + i) & _mask;
+      ItemType *entry = _slots[index].entry.load(std::memory_order_relaxed);
+      if (entry == nullptr) {
+        break;
+      }
+      if (isLive(entry) && (entry->hash == hash) && (entry->kv.first == key)) {
+        return index;
+      }
+    }
+    return npos();
+  }
+  static size_t npos() { return static_cast<size_t>(-1); }
+  // under the writer lock
+  bool place(std::unique_ptr<ItemType> &item) {
+    const size_t hash = item->hash;
+    if (slotOf(item->kv.first, hash) != npos()) {
+      return false;
+    }
+    checkSize();
+    for (size_t i = 0; i <= _mask; ++i) {
+      const size_t index = (hash + i) & _mask;
+      Slot &slot = _slots[index];
+      if (!isLive(slot.entry.load(std::memory_order_relaxed))) {
+        if (i > _maxProbe.load(std::memory_order_relaxed)) {
+          _maxProbe.store(i, std::memory_order_release);
+        }
+        slot.hash.store(hash, std::memory_order_relaxed);
+        slot.entry.store(item.release(), std::memory_order_release);
+        markOccupied(index);
+        ++_realSize;
+        return true;
+      }
+    }
+    return false;
+  }
+  // under the writer lock, the tombstone followed by the empty slot isn't on any probe path
+  void unlink(size_t index) {
+    _slots[index].entry.store(tombstone(), std::memory_order_seq_cst);
+    markFree(index);
+    --_realSize;
+    if (_slots[(index + 1) & _mask].entry.load(std::memory_order_relaxed) != nullptr) {
+      return;
+    }
+    for (size_t i = index;; i = (i - 1) & _mask) {
+      if (_slots[i].entry.load(std::memory_order_relaxed) != tombstone()) {
+        break;
+      }
+      _slots[i].entry.store(nullptr, std::memory_order_release);
+    }
+  }
+  // waits for readers which could see the unlinked entries and deletes them
+  static void retire(std::vector<ItemType *> &entries) {
+    if (entries.empty()) {
+      return;
+    }
+    const uint64_t retired = epoch().retire();
+    while (epoch().minActiveEpoch() <= retired) {
+      std::this_thread::yield();
+    }
+    for (auto *entry : entries) {
+      while (entry->pins.load(std::memory_order_acquire) != 0) {
+        std::this_thread::yield();
+      }
+      delete entry;
+    }
+  }
+  // NOTE: user code isn't called in the epoch, the walk only pins the entries
+  void pinOccupied(Pinned &pinned) const {
+    EpochDomain::Guard guard(epoch());
+    for (size_t word = 0; word < _words; ++word) {
+      uint64_t bits = _occupied[word].load(std::memory_order_acquire);
+      for (size_t index = word * SLOTS_PER_WORD; bits != 0; ++index, bits >>= 1) {
+        if ((bits & 1) == 0) {
+          continue;
+        }
+        ItemType *entry = pinSlot(index);
+        if (entry != nullptr) {
+          pinned.push(entry);
+        }
+      }
+    }
+  }
+  template <typename F>
+  void forEachPinned(const F &f) const {
+    Pinned pinned;
+    pinOccupied(pinned);
+    while (pinned.hasNext()) {
+      ItemType *entry = pinned.take();
+      try {
+        f(*entry);
+      } catch (...) {
+        entry->unpin();
+        throw;
+      }
+      entry->unpin();
+    }
+  }
+
+ public:
+  explicit ConcurrentHashMap(size_t size) : _size(size) { allocate(); }
+  ConcurrentHashMap(ConcurrentHashMap &&o) noexcept
+      : _size(o._size),
+        _mask(o._mask),
+        _memory(std::move(o._memory)),
+        _slots(o._slots),
+        _occupied(std::move(o._occupied)),
+        _words(o._words),
+        _realSize(o._realSize.load()),
+        _maxProbe(o._maxProbe.load()) {
+    o._slots = nullptr;
+    o._words = 0;
+    o._realSize = 0;
+  }
+  ConcurrentHashMap &operator=(ConcurrentHashMap &&o) noexcept {
+    if (this != &o) {
+      release();
+      _size = o._size;
+      _mask = o._mask;
+      _memory = std::move(o._memory);
+      _slots = o._slots;
+      _occupied = std::move(o._occupied);
+      _words = o._words;
+      _realSize = o._realSize.load();
+      _maxProbe = o._maxProbe.load();
+      o._slots = nullptr;
+      o._words = 0;
+      o._realSize = 0;
+    }
+    return *this;
+  }
+  ConcurrentHashMap(const ConcurrentHashMap &) = delete;
+  ConcurrentHashMap &operator=(const ConcurrentHashMap &o) {
+    if (this != &o) {
+      clear();
+      o.applyForEach([this](const typename ItemType::KVPair &pair) { insert(pair); });
+    }
+    return *this;
+  }
+  ~ConcurrentHashMap() { release(); }
+
+  LockedValue find(const Key &key) const { return LockedValue(lookup(key)); }
+  template <typename F>
+  LockedValue findIf(const F &f) const {
+    Pinned pinned;
+    pinOccupied(pinned);
+    while (pinned.hasNext()) {
+      ItemType *entry = pinned.take();
+      bool found = false;
+      try {
+        found = f(entry->kv);
+      } catch (...) {
+        entry->unpin();
+        throw;
+      }
+      if (found) {
+        return LockedValue(entry);
+      }
+      entry->unpin();
+    }
+    return {};
+  }
+  bool contains(const Key &key) const { return LockedValue(lookup(key)).hasValue(); }
+  void insert(const std::pair<Key, Value> &pair) {
+    std::unique_ptr<ItemType> item(new ItemType(pair, hashOf(pair.first)));
+    std::lock_guard<std::mutex> lock(_writeLock);
+    place(item);
+  }
+  void insert(std::pair<Key, Value> &&pair) {
+    const size_t hash = hashOf(pair.first);
+    std::unique_ptr<ItemType> item(new ItemType(std::move(pair), hash));
+    std::lock_guard<std::mutex> lock(_writeLock);
+    place(item);
+  }
+  void emplace(Key &&key, Value &&value) { insert(std::pair<Key, Value>(std::move(key), std::move(value))); }
+  void erase(const Key &key) {
+    const size_t hash = hashOf(key);
+    std::vector<ItemType *> erased;
+    {
+      std::lock_guard<std::mutex> lock(_writeLock);
+      const size_t index = slotOf(key, hash);
+      if (index == npos()) {
+        return;
+      }
+      erased.push_back(_slots[index].entry.load(std::memory_order_relaxed));
+      unlink(index);
+    }
+    retire(erased);
+  }
+  template <typename F>
+  void eraseIf(const F &f) {
+    std::vector<ItemType *> erased;
+    {
+      std::lock_guard<std::mutex> lock(_writeLock);
+      for (size_t i = 0; i <= _mask; ++i) {
+        ItemType *entry = _slots[i].entry.load(std::memory_order_relaxed);
+        if (isLive(entry) && f(entry->kv)) {
+          erased.push_back(entry);
+          unlink(i);
+        }
+      }
+    }
+    retire(erased);
+  }
+  void clear() {
+    std::vector<ItemType *> erased;
+    {
+      std::lock_guard<std::mutex> lock(_writeLock);
+      for (size_t i = 0; i <= _mask; ++i) {
+        ItemType *entry = _slots[i].entry.exchange(nullptr, std::memory_order_seq_cst);
+        if (isLive(entry)) {
+          erased.push_back(entry);
+        }
+      }
+      for (size_t i = 0; i < _words; ++i) {
+        _occupied[i].store(0, std::memory_order_release);
+      }
+      _realSize = 0;
+    }
+    retire(erased);
+  }
+  size_t size() const { return _realSize; }
+  size_t capacity() const { return _size; }
+  template <typename F>
+  void applyForEach(const F &f) const {
+    forEachPinned([&f](const ItemType &entry) { f(entry.kv); });
+  }
+  template <typename F>
+  void changeForEach(const F &f) {
+    forEachPinned([&f](ItemType &entry) { f(entry.kv); });
+  }
+};
+}  // namespace upmq
+
+#endif  // BROKER_CONCURRENT_HASH_MAP_H
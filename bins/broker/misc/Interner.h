@@ -0,0 +1,105 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_INTERNER_H
+#define BROKER_INTERNER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MoveableRWLock.h"
+#include "Singleton.h"
+
+namespace upmq {
+
+/// @brief Interner - compact integer handles of the strings
+/// ** the handle is given on the first use and is valid until the last owner releases it, 0 is never given
+/// ** hot path maps and queues are keyed by handles, so a string is hashed once and isn't copied
+/// NOTE: every intern must be paired with the release, find and name don't take the reference
+class Interner {
+  struct Entry {
+    uint32_t handle;
+    uint32_t refs;
+  };
+  std::unordered_map<std::string, Entry> _handles;
+  // NOTE: the name is shared, so it outlives the release while somebody uses it
+  std::vector<std::shared_ptr<const std::string>> _names{nullptr};
+  std::vector<uint32_t> _free;
+  mutable MRWLock _lock;
+
+ public:
+  Interner() = default;
+  Interner(const Interner &) = delete;
+  Interner &operator=(const Interner &) = delete;
+
+  uint32_t intern(const std::string &name) {
+    upmq::ScopedWriteRWLock writeRWLock(_lock);
+    auto it = _handles.find(name);
+    if (it != _handles.end()) {
+      ++it->second.refs;
+      return it->second.handle;
+    }
+    uint32_t handle = 0;
+    if (_free.empty()) {
+      handle = static_cast<uint32_t>(_names.size());
+      _names.push_back(nullptr);
+    } else {
+      handle = _free.back();
+      _free.pop_back();
+    }
+    _handles.emplace(name, Entry{handle, 1});
+    _names[handle] = std::make_shared<const std::string>(name);
+    return handle;
+  }
+  // returns 0 if the string wasn't interned
+  uint32_t find(const std::string &name) const {
+    upmq::ScopedReadRWLock readRWLock(_lock);
+    auto it = _handles.find(name);
+    return (it == _handles.end()) ? 0 : it->second.handle;
+  }
+  // returns nullptr if the handle isn't used
+  std::shared_ptr<const std::string> name(uint32_t handle) const {
+    upmq::ScopedReadRWLock readRWLock(_lock);
+    if (handle >= _names.size()) {
+      return nullptr;
+    }
+    return _names[handle];
+  }
+  void release(uint32_t handle) {
+    upmq::ScopedWriteRWLock writeRWLock(_lock);
+    if ((handle == 0) || (handle >= _names.size()) || (_names[handle] == nullptr)) {
+      return;
+    }
+    auto it = _handles.find(*_names[handle]);
+    if (--it->second.refs > 0) {
+      return;
+    }
+    _handles.erase(it);
+    _names[handle].reset();
+    _free.push_back(handle);
+  }
+  size_t size() const {
+    upmq::ScopedReadRWLock readRWLock(_lock);
+    return _handles.size();
+  }
+};
+}  // namespace upmq
+
+typedef Singleton<upmq::Interner> INTERNER;
+
+#endif  // BROKER_INTERNER_H
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_SPSCQUEUE_H
+#define BROKER_SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace upmq {
+
+/// @brief SPSCQueue - bounded single producer single consumer queue
+/// ** capacity is rounded up to the power of two, push fails when the queue is full
+/// NOTE: exactly one thread pushes and exactly one thread pops
+template <typename T>
+class SPSCQueue {
+  enum { CACHE_LINE_SIZE = 64 };
+
+  std::unique_ptr<T[]> _items;
+  size_t _mask;
+  char _pad0[CACHE_LINE_SIZE];
+  std::atomic_size_t _head{0};  // owned by consumer
+  size_t _cachedTail = 0;
+  char _pad1[CACHE_LINE_SIZE];
+  std::atomic_size_t _tail{0};  // owned by producer
+  size_t _cachedHead = 0;
+  char _pad2[CACHE_LINE_SIZE];
+
+  static size_t roundUp(size_t capacity) {
+    size_t result = 2;
+    while (result < capacity) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+ public:
+  explicit SPSCQueue(size_t capacity) : _items(new T[roundUp(capacity)]), _mask(roundUp(capacity) - 1) {}
+  SPSCQueue(const SPSCQueue &) = delete;
+  SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+  size_t capacity() const { return _mask + 1; }
+
+  bool tryPush(T &&item) {
+    const size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _cachedHead > _mask) {
+      _cachedHead = _head.load(std::memory_order_acquire);
+      if (tail - _cachedHead > _mask) {
+        return false;
+      }
+    }
+    _items[tail & _mask] = std::move(item);
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+  bool tryPop(T &item) {
+    const size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _cachedTail) {
+      _cachedTail = _tail.load(std::memory_order_acquire);
+      if (head == _cachedTail) {
+        return false;
+      }
+    }
+    item = std::move(_items[head & _mask]);
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+  // may be called from any thread, the result is approximate
+  bool empty() const { return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire); }
+};
+
+}  // namespace upmq
+
+#endif  // BROKER_SPSCQUEUE_H
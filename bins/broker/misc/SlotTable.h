@@ -0,0 +1,259 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_SLOTTABLE_H
+#define BROKER_SLOTTABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace upmq {
+
+/// @brief EpochDomain - epoch based reclamation
+/// ** readers pin the current epoch, retired objects are deleted when no reader pinned the epoch of retirement
+/// NOTE: the domain must outlive every thread that entered it
+class EpochDomain {
+  enum { CACHE_LINE_SIZE = 64 };
+  struct Record {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic_bool used{false};
+    char pad[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>) - sizeof(std::atomic_bool)];
+  };
+  struct Local {
+    // NOTE: a thread can pin several domains at once (handlers table, concurrent maps),
+    // the entry of the domain is kept until the exit of the thread, so the thread attaches to the domain once
+    struct Entry {
+      EpochDomain *domain = nullptr;
+      Record *record = nullptr;
+      size_t depth = 0;
+    };
+    std::vector<Entry> entries;
+    ~Local() {
+      for (auto &entry : entries) {
+        entry.record->epoch.store(0, std::memory_order_release);
+        entry.record->used.store(false, std::memory_order_release);
+      }
+    }
+    Entry &of(EpochDomain *domain) {
+      for (auto &entry : entries) {
+        if (entry.domain == domain) {
+          return entry;
+        }
+      }
+      entries.emplace_back();
+      Entry &entry = entries.back();
+      entry.record = domain->attach();
+      entry.domain = domain;
+      return entry;
+    }
+  };
+  static Local &local() {
+    static thread_local Local loc;
+    return loc;
+  }
+
+  std::atomic<uint64_t> _epoch{1};
+  std::unique_ptr<Record[]> _records;
+  size_t _capacity;
+  std::atomic_size_t _highWater{0};
+
+  Record *attach() {
+    for (;;) {
+      for (size_t i = 0; i < _capacity; ++i) {
+        bool expected = false;
+        if (!_records[i].used.load(std::memory_order_relaxed) && _records[i].used.compare_exchange_strong(expected, true)) {
+          size_t hw = _highWater.load();
+          while (hw < i + 1 && !_highWater.compare_exchange_weak(hw, i + 1)) {
+          }
+          return &_records[i];
+        }
+      }
+      // NOTE: more threads than records, wait for the exit of any of them
+      std::this_thread::yield();
+    }
+  }
+
+ public:
+  class Guard {
+    EpochDomain *_domain;
+
+   public:
+    explicit Guard(EpochDomain &domain) : _domain(&domain) { _domain->enter(); }
+    Guard(Guard &&o) noexcept : _domain(o._domain) { o._domain = nullptr; }
+    Guard(const Guard &) = delete;
+    Guard &operator=(const Guard &) = delete;
+    Guard &operator=(Guard &&) = delete;
+    ~Guard() {
+      if (_domain != nullptr) {
+        _domain->leave();
+      }
+    }
+  };
+
+  explicit EpochDomain(size_t maxThreads) : _records(new Record[maxThreads]), _capacity(maxThreads) {}
+  EpochDomain(const EpochDomain &) = delete;
+  EpochDomain &operator=(const EpochDomain &) = delete;
+
+  void enter() {
+    Local::Entry &loc = local().of(this);
+    if (loc.depth++ == 0) {
+      // NOTE: the store must be visible before any pointer protected by this epoch is loaded
+      loc.record->epoch.store(_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+    }
+  }
+  void leave() {
+    Local::Entry &loc = local().of(this);
+    if (--loc.depth == 0) {
+      loc.record->epoch.store(0, std::memory_order_release);
+    }
+  }
+  // call after the object is unlinked, returns the epoch of retirement
+  uint64_t retire() { return _epoch.fetch_add(1, std::memory_order_seq_cst); }
+  // object retired at the epoch can be deleted if it's less than the result
+  uint64_t minActiveEpoch() const {
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+    const size_t hw = _highWater.load();
+    for (size_t i = 0; i < hw; ++i) {
+      const uint64_t epoch = _records[i].epoch.load(std::memory_order_seq_cst);
+      if (epoch != 0 && epoch < result) {
+        result = epoch;
+      }
+    }
+    return result;
+  }
+};
+
+/// @brief SlotTable - fixed capacity table of pointers addressed by generation tagged handles
+/// ** handle = (generation << INDEX_BITS) | index, so a stale handle never resolves to a new object in the reused slot
+/// ** lookup is wait-free, removed objects are deleted by reclaim() after the grace period
+/// ** insert/remove/reclaim are expected to be called by the owner, lookup by any thread
+template <typename T>
+class SlotTable {
+ public:
+  enum : size_t { INDEX_BITS = sizeof(size_t) * 4 };
+  static constexpr size_t INDEX_MASK = (static_cast<size_t>(1) << INDEX_BITS) - 1;
+  static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+  /// @brief Ptr - pinned pointer, object is alive until Ptr is destroyed
+  class Ptr {
+    EpochDomain::Guard _guard;
+    T *_value = nullptr;
+
+   public:
+    explicit Ptr(EpochDomain &domain) : _guard(domain) {}
+    Ptr(Ptr &&) noexcept = default;
+    Ptr(const Ptr &) = delete;
+    Ptr &operator=(const Ptr &) = delete;
+    Ptr &operator=(Ptr &&) = delete;
+    void reset(T *value) { _value = value; }
+    T *get() const { return _value; }
+    T *operator->() const { return _value; }
+    T &operator*() const { return *_value; }
+    explicit operator bool() const { return _value != nullptr; }
+    bool operator==(std::nullptr_t) const { return _value == nullptr; }
+    bool operator!=(std::nullptr_t) const { return _value != nullptr; }
+  };
+
+ private:
+  struct Slot {
+    std::atomic<T *> value{nullptr};
+    std::atomic<size_t> handle{npos};
+    size_t generation{0};
+  };
+  struct Retired {
+    uint64_t epoch;
+    T *value;
+  };
+  mutable EpochDomain _domain;
+  std::unique_ptr<Slot[]> _slots;
+  size_t _capacity;
+  std::vector<Retired> _retired;
+
+ public:
+  SlotTable(size_t capacity, size_t maxThreads) : _domain(maxThreads), _slots(new Slot[capacity]), _capacity(capacity) {}
+  SlotTable(const SlotTable &) = delete;
+  SlotTable &operator=(const SlotTable &) = delete;
+  ~SlotTable() {
+    for (size_t i = 0; i < _capacity; ++i) {
+      delete _slots[i].value.load();
+    }
+    for (auto &retired : _retired) {
+      delete retired.value;
+    }
+  }
+
+  static size_t index(size_t handle) { return handle & INDEX_MASK; }
+  size_t capacity() const { return _capacity; }
+
+  // publishes value into the free slot, returns handle
+  size_t insert(size_t slotIndex, T *value) {
+    Slot &slot = _slots[slotIndex];
+    ++slot.generation;
+    const size_t handle = ((slot.generation << INDEX_BITS) | slotIndex) & (npos >> 1);
+    slot.handle.store(handle, std::memory_order_relaxed);
+    slot.value.store(value, std::memory_order_release);
+    return handle;
+  }
+  Ptr find(size_t handle) const {
+    Ptr ptr(_domain);
+    const size_t slotIndex = index(handle);
+    if (slotIndex < _capacity) {
+      const Slot &slot = _slots[slotIndex];
+      T *value = slot.value.load(std::memory_order_seq_cst);
+      if (value != nullptr && slot.handle.load(std::memory_order_relaxed) == handle) {
+        ptr.reset(value);
+      }
+    }
+    return ptr;
+  }
+  // unlocked access for the owner
+  T *get(size_t slotIndex) const { return _slots[slotIndex].value.load(std::memory_order_acquire); }
+  // unlinks value from the slot and defers its deleting
+  void remove(size_t slotIndex) {
+    T *value = _slots[slotIndex].value.exchange(nullptr, std::memory_order_seq_cst);
+    if (value != nullptr) {
+      _retired.push_back(Retired{_domain.retire(), value});
+    }
+  }
+  // deletes retired values which can't be reached by readers anymore, returns count of still retired values
+  size_t reclaim() {
+    if (_retired.empty()) {
+      return 0;
+    }
+    const uint64_t minEpoch = _domain.minActiveEpoch();
+    std::vector<Retired> retired;
+    retired.swap(_retired);
+    for (auto &item : retired) {
+      if (item.epoch < minEpoch) {
+        delete item.value;
+      } else {
+        _retired.push_back(item);
+      }
+    }
+    return _retired.size();
+  }
+  size_t retiredCount() const { return _retired.size(); }
+};
+
+}  // namespace upmq
+
+#endif  // BROKER_SLOTTABLE_H
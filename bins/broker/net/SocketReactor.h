@@ -34,7 +34,7 @@ class Socket;
 
 std::size_t hash(const Poco::Net::Socket& socket);
 }  // namespace Poco
-#include "FixedSizeUnorderedMap.h"
+#include "ConcurrentHashMap.h"
 namespace upmq {
 
 namespace Net {
@@ -138,7 +138,7 @@ class SocketReactor : public Poco::Runnable {
  private:
   typedef Poco::AutoPtr<upmq::Net::SocketNotifier> NotifierPtr;
   typedef Poco::AutoPtr<upmq::Net::SocketNotification> NotificationPtr;
-  typedef FSUnorderedMap<Poco::Net::Socket, NotifierPtr> EventHandlerMap;
+  typedef ConcurrentHashMap<Poco::Net::Socket, NotifierPtr> EventHandlerMap;
 
   void dispatch(NotifierPtr& pNotifier, upmq::Net::SocketNotification* pNotification);
 
@@ -25,6 +25,7 @@
 #include "Poco/File.h"
 #include "S2SProto.h"
 #include "Session.h"
+#include "ShardPool.h"
 #include "Version.hpp"
 #include "fake_cpp14.h"
 
@@ -63,8 +64,9 @@ Broker::~Broker() {
 }
 const std::string &Broker::id() const { return _id; }
 void Broker::onEvent(const AsyncTCPHandler &ahandler, MessageDataContainer &sMessage) {
-  ahandler.log->information("%s", std::to_string(sMessage.handlerNum).append(" # => ").append(sMessage.typeName()));
-  std::shared_ptr<MessageDataContainer> outMessage = std::make_shared<MessageDataContainer>(new Proto::ProtoMessage());
+  BROKER_INFORMATION(ahandler.log, sMessage.handlerNum << " # => " << sMessage.typeName());
+  std::shared_ptr<MessageDataContainer> outMessage = MessageDataContainer::make();
+  outMessage->createHeader();
   try {
     switch (static_cast<int>(sMessage.type())) {
       case ProtoMessage::kConnect: {
@@ -103,6 +105,9 @@ void Broker::onEvent(const AsyncTCPHandler &ahandler, MessageDataContainer &sMes
       case ProtoMessage::kAck: {
         onAcknowledge(ahandler, sMessage, *outMessage);
       } break;
+      case ProtoMessage::kCredit: {
+        onCredit(ahandler, sMessage, *outMessage);
+      } break;
       case ProtoMessage::kSender: {
         onSender(ahandler, sMessage, *outMessage);
       } break;
@@ -152,7 +157,7 @@ void Broker::onEvent(const AsyncTCPHandler &ahandler, MessageDataContainer &sMes
     outMessage->setRRID(sMessage.rrID());
     outMessage->serialize();
     const_cast<AsyncTCPHandler &>(ahandler).put(std::move(outMessage));
-    ahandler.log->information("%s", std::to_string(sMessage.handlerNum).append(" * <= ").append("send reply on ").append(sMessage.typeName()));
+    BROKER_INFORMATION(ahandler.log, sMessage.handlerNum << " * <= " << "send reply on " << sMessage.typeName());
   }
 }
 void Broker::onConnect(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
@@ -199,7 +204,7 @@ void Broker::removeTcpConnection(const std::string &clientID, size_t tcpConnecti
   }
   if (needErase) {
     eraseConnection(clientID);
-    log->information("%s", std::to_string(tcpConnectionNum).append(" # => ").append("erase connection ").append(clientID));
+    BROKER_INFORMATION(log, tcpConnectionNum << " # => " << "erase connection " << clientID);
   }
 }
 void Broker::removeConsumers(const std::string &destinationID, const std::string &subscriptionID, size_t tcpNum) {
@@ -211,13 +216,8 @@ void Broker::onSetClientId(const AsyncTCPHandler &tcpHandler, const MessageDataC
   UNUSED_VAR(tcpHandler);
   UNUSED_VAR(outMessage);
   const Proto::ClientInfo &clientInfo = sMessage.clientInfo();
-  tcpHandler.log->information("%s",
-                              std::to_string(sMessage.handlerNum)
-                                  .append(" # => ")
-                                  .append(" : from ")
-                                  .append(clientInfo.old_client_id())
-                                  .append(" to ")
-                                  .append(clientInfo.new_client_id()));
+  BROKER_INFORMATION(tcpHandler.log,
+                     sMessage.handlerNum << " # => " << " : from " << clientInfo.old_client_id() << " to " << clientInfo.new_client_id());
 
   if (isConnectionExists(clientInfo.new_client_id())) {
     throw EXCEPTION("connection already exists", clientInfo.new_client_id(), ERROR_CLIENT_ID_EXISTS);
@@ -238,23 +238,19 @@ void Broker::onSetClientId(const AsyncTCPHandler &tcpHandler, const MessageDataC
 }
 void Broker::eraseConnection(const std::string &connectionID) {
   _connections.erase(connectionID);
-  log->information("%s", std::string("-").append(" # => ").append(" erased ").append(connectionID));
+  BROKER_INFORMATION(log, "-" << " # => " << " erased " << connectionID);
 }
 void Broker::onDisconnect(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   const Proto::Disconnect &disconnect = sMessage.disconnect();
-  tcpHandler.log->information("%s", std::to_string(sMessage.handlerNum).append(" # => ").append(" id : ").append(disconnect.client_id()));
+  BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " id : " << disconnect.client_id());
   outMessage.toDisconnect = true;
 }
 void Broker::onCreateSession(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   UNUSED_VAR(outMessage);
   const Proto::Session &session = sMessage.session();
-  tcpHandler.log->information("%s",
-                              std::to_string(sMessage.handlerNum)
-                                  .append(" # => ")
-                                  .append(" id : ")
-                                  .append(session.session_id())
-                                  .append(" ack : ")
-                                  .append(Session::acknowlegeName(session.acknowledge_type())));
+  BROKER_INFORMATION(tcpHandler.log,
+                     sMessage.handlerNum << " # => " << " id : " << session.session_id() << " ack : "
+                                         << Session::acknowlegeName(session.acknowledge_type()));
   if (tcpHandler.connection() == nullptr) {
     throw EXCEPTION("connection not found", sMessage.clientID, ERROR_ON_SESSION);
   }
@@ -263,7 +259,7 @@ void Broker::onCreateSession(const AsyncTCPHandler &tcpHandler, const MessageDat
 void Broker::onCloseSession(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   UNUSED_VAR(outMessage);
   const Proto::Unsession &unsession = sMessage.unsession();
-  tcpHandler.log->information("%s", std::to_string(sMessage.handlerNum).append(" # => ").append(" id : ").append(unsession.session_id()));
+  BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " id : " << unsession.session_id());
   if (tcpHandler.connection() == nullptr) {
     throw EXCEPTION("connection not found", sMessage.clientID, ERROR_ON_UNSESSION);
   }
@@ -272,7 +268,7 @@ void Broker::onCloseSession(const AsyncTCPHandler &tcpHandler, const MessageData
 void Broker::onBegin(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   UNUSED_VAR(outMessage);
   const Proto::Begin &begin = sMessage.begin();
-  tcpHandler.log->information("%s", std::to_string(sMessage.handlerNum).append(" # => ").append(" : on session : ").append(begin.session_id()));
+  BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " : on session : " << begin.session_id());
   if (tcpHandler.connection() == nullptr) {
     throw EXCEPTION("connection not found", sMessage.clientID, ERROR_ON_BEGIN);
   }
@@ -281,7 +277,7 @@ void Broker::onBegin(const AsyncTCPHandler &tcpHandler, const MessageDataContain
 void Broker::onCommit(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   UNUSED_VAR(outMessage);
   const Proto::Commit &commit = sMessage.commit();
-  tcpHandler.log->information("%s", std::to_string(sMessage.handlerNum).append(" # => ").append(" : on session : ").append(commit.session_id()));
+  BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " : on session : " << commit.session_id());
 
   if (tcpHandler.connection() == nullptr) {
     throw EXCEPTION("connection not found", sMessage.clientID, ERROR_ON_COMMIT);
@@ -291,7 +287,7 @@ void Broker::onCommit(const AsyncTCPHandler &tcpHandler, const MessageDataContai
 void Broker::onAbort(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   UNUSED_VAR(outMessage);
   const Proto::Abort &abort = sMessage.abort();
-  tcpHandler.log->information("%s", std::to_string(sMessage.handlerNum).append(" # => ").append(" : on session : ").append(abort.session_id()));
+  BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " : on session : " << abort.session_id());
   if (tcpHandler.connection() == nullptr) {
     throw EXCEPTION("connection not found", sMessage.clientID, ERROR_ON_COMMIT);
   }
@@ -306,6 +302,7 @@ void Broker::onMessage(const AsyncTCPHandler &tcpHandler, const MessageDataConta
 
   const Message &constMessage = sMessage.message();
   Destination &dest = EXCHANGE::Instance().destination(constMessage.destination_uri());
+  sMessage.destinationHandle = dest.handle();
 
   if (DESTINATION_CONFIG.forwardByProperty && (constMessage.property_size() > 0)) {
     auto &msg = const_cast<MessageDataContainer &>(sMessage);
@@ -327,20 +324,21 @@ void Broker::onMessage(const AsyncTCPHandler &tcpHandler, const MessageDataConta
       std::string s2sQueue(QUEUE_PREFIX);
       s2sQueue.append("://s2s");
       msg.mutableMessage().set_destination_uri(s2sQueue);
+      msg.destinationHandle = 0;
       if (constMessage.persistent()) {
         sMessage.moveDataTo(s2sQueue);
       }
     }
   }
-  tcpHandler.log->information("%s",
-                              std::to_string(sMessage.handlerNum)
-                                  .append(" # => ")
-                                  .append("id [")
-                                  .append(constMessage.message_id())
-                                  .append("] : into destination : ")
-                                  .append(constMessage.destination_uri()));
+  BROKER_INFORMATION(tcpHandler.log,
+                     sMessage.handlerNum << " # => " << "id [" << constMessage.message_id() << "] : into destination : "
+                                         << constMessage.destination_uri());
   tcpHandler.connection()->saveMessage(sMessage);
-  EXCHANGE::Instance().postNewMessageEvent(dest.name());
+  dest.postNewMessageEvent();
+  // NOTE: consumers aren't throttled, they have to send acknowledgements which release the budget
+  if (dest.memoryBudget()->isThrottling() && !tcpHandler.hasSubscriptions()) {
+    const_cast<AsyncTCPHandler &>(tcpHandler).throttle(*dest.memoryBudget());
+  }
 }
 void Broker::onSender(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   UNUSED_VAR(outMessage);
@@ -366,12 +364,7 @@ void Broker::onSubscription(const AsyncTCPHandler &tcpHandler, const MessageData
   if (tcpHandler.connection() == nullptr) {
     throw EXCEPTION("connection not found", sMessage.clientID, ERROR_ON_SUBSCRIPTION);
   }
-  tcpHandler.log->information("%s",
-                              std::to_string(sMessage.handlerNum)
-                                  .append(" # => ")
-                                  .append(" : on destination [")
-                                  .append(sMessage.subscription().destination_uri())
-                                  .append("]"));
+  BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " : on destination [" << sMessage.subscription().destination_uri() << "]");
   Destination &dest = EXCHANGE::Instance().destination(
       sMessage.subscription().destination_uri());  // NOTE: !NEED for pre-creation of destination, try to mitigate deadlock
   UNUSED_VAR(dest);
@@ -410,12 +403,8 @@ void Broker::onUnsubscription(const AsyncTCPHandler &tcpHandler, const MessageDa
       throw Exception(ex);
     }
   }
-  tcpHandler.log->information("%s",
-                              std::to_string(sMessage.handlerNum)
-                                  .append(" # => ")
-                                  .append(" : from destination [")
-                                  .append(sMessage.unsubscription().destination_uri())
-                                  .append("]"));
+  BROKER_INFORMATION(tcpHandler.log,
+                     sMessage.handlerNum << " # => " << " : from destination [" << sMessage.unsubscription().destination_uri() << "]");
   tcpHandler.eraseSubscription(sMessage);
 }
 void Broker::onAcknowledge(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
@@ -423,10 +412,26 @@ void Broker::onAcknowledge(const AsyncTCPHandler &tcpHandler, const MessageDataC
   if (tcpHandler.connection() == nullptr) {
     throw EXCEPTION("connection not found", sMessage.clientID, ERROR_ON_ACK_MESSAGE);
   }
-  tcpHandler.log->information(
-      "%s", std::to_string(sMessage.handlerNum).append(" # => ").append(" on message id [").append(sMessage.ack().message_id()).append("]"));
+  BROKER_INFORMATION(tcpHandler.log,
+                     sMessage.handlerNum << " # => " << " on message id [" << sMessage.ack().message_id() << "] ("
+                                         << sMessage.ack().message_ids_size() + 1 << ")");
   tcpHandler.connection()->processAcknowledge(sMessage);
 }
+void Broker::onCredit(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
+  UNUSED_VAR(outMessage);
+  const Proto::Credit &credit = sMessage.credit();
+  BROKER_INFORMATION(tcpHandler.log,
+                     sMessage.handlerNum << " # => " << " : on destination [" << credit.destination_uri() << "] credit : " << credit.credit_bytes());
+  try {
+    EXCHANGE::Instance()
+        .destination(credit.destination_uri(), Exchange::DestinationCreationMode::NO_CREATE)
+        .increaseCredit(sMessage.objectID(), credit.credit_bytes());
+  } catch (Exception &ex) {
+    if (ex.error() != ERROR_UNKNOWN) {
+      throw Exception(ex);
+    }
+  }
+}
 void Broker::onBrowser(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage) {
   UNUSED_VAR(tcpHandler);
   const Proto::Browser &browser = sMessage.browser();
@@ -440,17 +445,9 @@ void Broker::onDestination(const AsyncTCPHandler &tcpHandler, const MessageDataC
   UNUSED_VAR(outMessage);
   const Proto::Destination &destination = sMessage.destination();
   auto &dest = EXCHANGE::Instance().destination(destination.destination_uri());
-  tcpHandler.log->information(
-      "%s", std::to_string(sMessage.handlerNum).append(" # => ").append(" create destination (").append(destination.destination_uri()).append(")"));
+  BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " create destination (" << destination.destination_uri() << ")");
   if (!dest.hasOwner()) {
-    tcpHandler.log->information("%s",
-                                std::to_string(sMessage.handlerNum)
-                                    .append(" # => ")
-                                    .append(" | set owner (")
-                                    .append(sMessage.clientID)
-                                    .append(" : ")
-                                    .append(std::to_string(tcpHandler.num))
-                                    .append(")"));
+    BROKER_INFORMATION(tcpHandler.log, sMessage.handlerNum << " # => " << " | set owner (" << sMessage.clientID << " : " << tcpHandler.num << ")");
     dest.setOwner(sMessage.clientID, tcpHandler.num);
   }
 }
@@ -461,17 +458,9 @@ void Broker::onUndestination(const AsyncTCPHandler &tcpHandler, const MessageDat
     auto &dest = EXCHANGE::Instance().destination(undestination.destination_uri(), Exchange::DestinationCreationMode::NO_CREATE);
     if (dest.hasOwner() && (dest.owner().clientID == sMessage.clientID) && (dest.owner().tcpID == tcpHandler.num)) {
       EXCHANGE::Instance().deleteDestination(undestination.destination_uri());
-      tcpHandler.log->information("%s",
-                                  std::to_string(sMessage.handlerNum)
-                                      .append(" # => ")
-                                      .append(" delete destination (")
-                                      .append(undestination.destination_uri())
-                                      .append(")")
-                                      .append(" | owner (")
-                                      .append(sMessage.clientID)
-                                      .append(" : ")
-                                      .append(std::to_string(tcpHandler.num))
-                                      .append(")"));
+      BROKER_INFORMATION(tcpHandler.log,
+                         sMessage.handlerNum << " # => " << " delete destination (" << undestination.destination_uri() << ")" << " | owner ("
+                                             << sMessage.clientID << " : " << tcpHandler.num << ")");
     }
   } catch (Exception &) {  // -V565
     // NOTE : if destination not exists then do nothing
@@ -515,41 +504,47 @@ bool Broker::write(size_t num) {
         }
         try {
           sMessage.reset();
-          if (ahandler->outputQueue.try_dequeue(sMessage) && sMessage != nullptr) {
+          if (ahandler->pendingOutput != nullptr) {
+            sMessage.swap(ahandler->pendingOutput);
+          } else if (!ahandler->outputQueue.try_dequeue(sMessage)) {
+            sMessage.reset();
+          }
+          if (sMessage != nullptr) {
+            AsyncTCPHandler::OutputRelease outputRelease(*ahandler, *sMessage);
             if (sMessage->header.empty()) {
               sMessage->serialize();
             }
-            const std::string &messageId = sMessage->isMessage() ? sMessage->message().message_id() : emptyString;
-            AsyncTCPHandler::DataStatus status = AsyncTCPHandler::DataStatus::TRYAGAIN;
-            do {
-              status = ahandler->sendHeaderAndData(*sMessage);
-              if (status == AsyncTCPHandler::DataStatus::OK) {
-                ahandler->log->information("%s",
-                                           std::to_string(num)
-                                               .append(" * <= ")
-                                               .append("sent ")
-                                               .append(sMessage->typeName())
-                                               .append(" id[")
-                                               .append(messageId)
-                                               .append("]")
-                                               .append(" to (")
-                                               .append(sMessage->objectID())
-                                               .append("/")
-                                               .append(ahandler->peerAddress())
-                                               .append(")"));
+            const std::string &messageId = sMessage->isMessage() ? sMessage->messageID() : emptyString;
+            switch (ahandler->sendHeaderAndData(*sMessage)) {
+              case AsyncTCPHandler::DataStatus::OK:
+                ahandler->countSent(*sMessage);
+                if (!sMessage->traces.empty()) {
+                  StageTracer::written(sMessage->traces);
+                }
+                BROKER_INFORMATION(ahandler->log,
+                                   num << " * <= " << "sent " << sMessage->typeName() << " id[" << messageId << "]" << " to ("
+                                       << sMessage->objectID() << "/" << ahandler->peerAddress() << ")");
                 if (sMessage->toDisconnect) {
                   ahandler->onWritableLock.unlock();
                   ahandler->emitCloseEvent();
                   return true;
                 }
-              } else {
-                if (status == AsyncTCPHandler::DataStatus::AS_ERROR) {
+                break;
+              case AsyncTCPHandler::DataStatus::AS_ERROR:
+                ahandler->onWritableLock.unlock();
+                return true;
+              case AsyncTCPHandler::DataStatus::TRYAGAIN:
+                if (!_isWritable) {
                   ahandler->onWritableLock.unlock();
                   return true;
                 }
-                Poco::Thread::yield();
-              }
-            } while (status == AsyncTCPHandler::DataStatus::TRYAGAIN && _isWritable);
+                // NOTE: the socket or the ring is full, so the frame is kept with its sent bytes and the connection is put back
+                // to the writer queue (or to the shard) instead of spinning on it
+                outputRelease.dismiss();
+                ahandler->pendingOutput = std::move(sMessage);
+                ahandler->onWritableLock.unlock();
+                return false;
+            }
           }
         } catch (Exception &ex) {
           ahandler->log->error("%s",
@@ -596,8 +591,16 @@ bool Broker::read(size_t num) {
       if (ahandler->needErase()) {
         return true;
       }
-      memset(ahandler->pBuffer, 0, BUFFER_SIZE);
-      MessageDataContainer sMessage(STORAGE_CONFIG.data.get().toString());
+      if (ahandler->isOutputFull() || ahandler->isThrottled()) {
+        // NOTE: client doesn't read its output or the memory budget is exhausted,
+        // so stop reading new frames until writer drains the queue or messages are consumed
+        ahandler->onReadableLock.unlock();
+        ahandler->pauseRead();
+        return false;
+      }
+      // NOTE: the frame container and its buffers are recycled when the frame is processed
+      std::shared_ptr<MessageDataContainer> frame = MessageDataContainer::make(STORAGE_CONFIG.data.get().toString());
+      MessageDataContainer &sMessage = *frame;
       try {
         switch (ahandler->fillHeaderBodyLens()) {
           case AsyncTCPHandler::DataStatus::AS_ERROR:
@@ -719,20 +722,23 @@ bool Broker::read(size_t num) {
           return true;
         }
         sMessage.handlerNum = ahandler->num;
+        if (sMessage.isMessage()) {
+          sMessage.traceDecoded = StageTracer::sample();
+        }
         sMessage.clientID = ((ahandler->connection() != nullptr) ? ahandler->connection()->clientID() : emptyString);
 
         switch (static_cast<int>(sMessage.type())) {
           case ProtoMessage::kConnect: {
-            ahandler->log->information("%s", std::to_string(num).append(" * ").append("=> get connect frame"));
+            BROKER_INFORMATION(ahandler->log, num << " * " << "=> get connect frame");
             ahandler->storeClientInfo(sMessage);
-            ahandler->log->information("%s", std::to_string(num).append(" # => ").append(ahandler->toString()));
+            BROKER_INFORMATION(ahandler->log, num << " # => " << ahandler->toString());
           } break;
           case ProtoMessage::kSubscription: {
-            ahandler->log->information("%s", std::to_string(num).append(" * ").append("=> get subscription frame"));
+            BROKER_INFORMATION(ahandler->log, num << " * " << "=> get subscription frame");
             ahandler->initSubscription(sMessage);
           } break;
           default: {
-            ahandler->log->information("%s", std::to_string(num).append(" * ").append("=> get ").append(sMessage.typeName()).append(" frame"));
+            BROKER_INFORMATION(ahandler->log, num << " * " << "=> get " << sMessage.typeName() << " frame");
             break;
           }
         }
@@ -751,12 +757,20 @@ bool Broker::read(size_t num) {
         return true;
       }
       ahandler->onReadableLock.unlock();
+      ahandler->continueRead();
       return true;
     }
   }
   return true;
 }
 void Broker::start() {
+  if (THREADS_CONFIG.shards != 0) {
+    // NOTE: shard threads read and write their own connections instead of readable and writable pools
+    _isReadable = true;
+    _isWritable = true;
+    SHARDS::Instance().start();
+    return;
+  }
   if (!_isReadable) {
     _readbleAdapter = std::make_unique<Poco::RunnableAdapter<Broker>>(*this, &Broker::onReadable);
     int count = _readablePool.capacity() - 1;
@@ -776,6 +790,12 @@ void Broker::stop() {
   if (_isRunning) {
     _isRunning = false;
   }
+  if (THREADS_CONFIG.shards != 0) {
+    _isReadable = false;
+    _isWritable = false;
+    SHARDS::Instance().stop();
+    return;
+  }
   if (_isReadable) {
     _isReadable = false;
     _readablePool.joinAll();
@@ -789,12 +809,20 @@ void Broker::putReadable(size_t queueNum, size_t num) {
   if (!_isReadable) {
     return;
   }
+  if (THREADS_CONFIG.shards != 0) {
+    SHARDS::Instance().post(queueNum, ShardEvent(ShardEvent::READ, num));
+    return;
+  }
   rwput(_isReadable, _readableIndexes[queueNum], num);
 }
 void Broker::putWritable(size_t queueNum, size_t num) {
   if (!_isWritable) {
     return;
   }
+  if (THREADS_CONFIG.shards != 0) {
+    SHARDS::Instance().post(queueNum, ShardEvent(ShardEvent::WRITE, num));
+    return;
+  }
   rwput(_isWritable, _writableIndexes[queueNum], num);
 }
 
@@ -29,7 +29,7 @@
 #include "Configuration.h"
 #include "MessageDataContainer.h"
 #include "Singleton.h"
-#include <FixedSizeUnorderedMap.h>
+#include <ConcurrentHashMap.h>
 
 #include <Poco/Condition.h>
 #include <Poco/RWLock.h>
@@ -45,7 +45,7 @@ class Consumer;
 
 class Broker {
  public:
-  using ConnectionsList = FSUnorderedMap<std::string, std::unique_ptr<Connection>>;
+  using ConnectionsList = ConcurrentHashMap<std::string, std::unique_ptr<Connection>>;
   Poco::Logger *log{nullptr};
 
  private:
@@ -88,6 +88,7 @@ class Broker {
   static void onUnsubscribe(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage);
   static void onUnsubscription(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage);
   static void onAcknowledge(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage);
+  static void onCredit(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage);
   static void onBrowser(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage);
   static void onDestination(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage);
   static void onUndestination(const AsyncTCPHandler &tcpHandler, const MessageDataContainer &sMessage, MessageDataContainer &outMessage);
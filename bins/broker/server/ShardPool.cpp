@@ -0,0 +1,199 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ShardPool.h"
+#include <algorithm>
+#include <chrono>
+#include <fake_cpp14.h>
+#include "AsyncLogger.h"
+#include "Broker.h"
+#include "Configuration.h"
+#include "Exchange.h"
+
+namespace upmq {
+namespace broker {
+
+namespace {
+int64_t nowMs() { return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+constexpr int64_t DISPATCH_RETRY_DELAY_MS = 1000;
+constexpr int64_t IDLE_WAIT_MS = 100;
+}  // namespace
+
+ShardPool::Shard::Shard(size_t shards, size_t mailboxSize) {
+  mailboxes.reserve(shards);
+  for (size_t i = 0; i < shards; ++i) {
+    mailboxes.emplace_back(std::make_unique<SPSCQueue<ShardEvent>>(mailboxSize));
+  }
+}
+
+ShardPool::ShardPool() : _threadPool("shards", 1, static_cast<int>(THREADS_CONFIG.shards) + 1) {
+  const size_t count = THREADS_CONFIG.shards;
+  _shards.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    _shards.emplace_back(std::make_unique<Shard>(count, MAILBOX_SIZE));
+  }
+}
+ShardPool::~ShardPool() {
+  try {
+    stop();
+  } catch (...) {
+  }
+}
+int &ShardPool::currentShard() {
+  static thread_local int shard = -1;
+  return shard;
+}
+bool ShardPool::isEnabled() const { return !_shards.empty(); }
+size_t ShardPool::size() const { return _shards.size(); }
+size_t ShardPool::shardOf(uint32_t destination) const { return destination % _shards.size(); }
+
+void ShardPool::post(size_t shardNum, ShardEvent &&event) {
+  Shard &shard = *_shards[shardNum % _shards.size()];
+  const int current = currentShard();
+  // NOTE: the full mailbox falls back to the inbox, the shard thread must never block on another shard
+  if ((current < 0) || !shard.mailboxes[static_cast<size_t>(current)]->tryPush(std::move(event))) {
+    shard.inbox.enqueue(std::move(event));
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (shard.sleeping.load(std::memory_order_relaxed)) {
+    { std::lock_guard<std::mutex> lock(shard.lock); }
+    shard.wakeup.notify_one();
+  }
+}
+void ShardPool::postDispatch(uint32_t destination) { post(shardOf(destination), ShardEvent(destination)); }
+void ShardPool::delay(uint32_t destination) {
+  const int current = currentShard();
+  if (current < 0) {
+    postDispatch(destination);
+    return;
+  }
+  Shard &shard = *_shards[static_cast<size_t>(current)];
+  if (shard.delayed.empty()) {
+    shard.delayedDue = nowMs() + DISPATCH_RETRY_DELAY_MS;
+  }
+  shard.delayed.push_back(destination);
+}
+
+void ShardPool::start() {
+  if (!isEnabled() || _isRunning) {
+    return;
+  }
+  _threadAdapter = std::make_unique<Poco::RunnableAdapter<ShardPool>>(*this, &ShardPool::run);
+  _isRunning = true;
+  for (size_t i = 0; i < _shards.size(); ++i) {
+    _threadPool.start(*_threadAdapter);
+  }
+}
+void ShardPool::stop() {
+  if (_isRunning) {
+    _isRunning = false;
+    for (auto &shard : _shards) {
+      { std::lock_guard<std::mutex> lock(shard->lock); }
+      shard->wakeup.notify_all();
+    }
+    _threadPool.joinAll();
+  }
+}
+
+void ShardPool::run() {
+  const size_t num = _thrNum++;
+  currentShard() = static_cast<int>(num);
+  Shard &shard = *_shards[num];
+  ShardEvent event;
+  while (_isRunning) {
+    size_t handled = 0;
+    // NOTE: batches are bounded, so a busy producer doesn't starve the others
+    for (auto &mailbox : shard.mailboxes) {
+      for (size_t i = 0; (i < BATCH_SIZE) && mailbox->tryPop(event); ++i, ++handled) {
+        handle(num, event);
+      }
+    }
+    for (size_t i = 0; (i < BATCH_SIZE) && shard.inbox.try_dequeue(event); ++i, ++handled) {
+      handle(num, event);
+    }
+    takeDelayed(num);
+    if (handled == 0) {
+      wait(shard);
+    }
+  }
+  currentShard() = -1;
+}
+void ShardPool::handle(size_t shardNum, ShardEvent &event) {
+  try {
+    switch (event.type) {
+      case ShardEvent::READ:
+        BROKER::Instance().read(event.num);
+        break;
+      case ShardEvent::WRITE:
+        if (!BROKER::Instance().write(event.num)) {
+          post(shardNum, std::move(event));
+        }
+        break;
+      case ShardEvent::DISPATCH:
+        switch (EXCHANGE::Instance().dispatch(event.destination)) {
+          case Exchange::DispatchResult::AGAIN:
+            post(shardNum, std::move(event));
+            break;
+          case Exchange::DispatchResult::RETRY:
+            delay(event.destination);
+            break;
+          case Exchange::DispatchResult::DONE:
+            break;
+        }
+        break;
+    }
+  } catch (std::exception &ex) {
+    ASYNCLOGGER::Instance()
+        .get(LOG_CONFIG.name)
+        .error("%s", std::to_string(shardNum).append(" ! => shard error : ").append(std::string(ex.what())));
+  }
+}
+void ShardPool::takeDelayed(size_t shardNum) {
+  Shard &shard = *_shards[shardNum];
+  if (shard.delayed.empty() || (nowMs() < shard.delayedDue)) {
+    return;
+  }
+  std::vector<uint32_t> delayed;
+  delayed.swap(shard.delayed);
+  for (auto destination : delayed) {
+    ShardEvent event(destination);
+    handle(shardNum, event);
+  }
+}
+void ShardPool::wait(Shard &shard) const {
+  int64_t timeout = IDLE_WAIT_MS;
+  if (!shard.delayed.empty()) {
+    timeout = std::max<int64_t>(0, std::min<int64_t>(timeout, shard.delayedDue - nowMs()));
+  }
+  std::unique_lock<std::mutex> lock(shard.lock);
+  shard.sleeping.store(true, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (_isRunning && !hasEvents(shard)) {
+    shard.wakeup.wait_for(lock, std::chrono::milliseconds(timeout));
+  }
+  shard.sleeping.store(false, std::memory_order_relaxed);
+}
+bool ShardPool::hasEvents(const Shard &shard) {
+  for (const auto &mailbox : shard.mailboxes) {
+    if (!mailbox->empty()) {
+      return true;
+    }
+  }
+  return shard.inbox.size_approx() > 0;
+}
+
+}  // namespace broker
+}  // namespace upmq
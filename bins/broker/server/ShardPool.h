@@ -0,0 +1,105 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_SHARDPOOL_H
+#define BROKER_SHARDPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <Poco/RunnableAdapter.h>
+#include <Poco/ThreadPool.h>
+#include "BlockingConcurrentQueueHeader.h"
+#include "SPSCQueue.h"
+#include "Singleton.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief ShardEvent - work item of the shard
+struct ShardEvent {
+  enum Type : uint8_t { READ = 0, WRITE, DISPATCH };
+  Type type = READ;
+  size_t num = 0;           // handler number for READ and WRITE
+  uint32_t destination = 0;  // destination handle for DISPATCH
+
+  ShardEvent() = default;
+  ShardEvent(Type type_, size_t num_) : type(type_), num(num_) {}
+  explicit ShardEvent(uint32_t destination_) : type(DISPATCH), destination(destination_) {}
+};
+
+/// @brief ShardPool - thread per core mode of the broker
+/// ** connections and destinations are hashed to shards, the shard thread reads and writes its own sockets
+///    and dispatches its own destinations, so a message isn't passed between reader, subscriber and writer pools
+/// ** every shard has one SPSC mailbox per other shard and MPSC inbox for the reactor and other threads
+/// ** the shard sleeps only when all its mailboxes are empty
+class ShardPool {
+  enum { MAILBOX_SIZE = 4096, BATCH_SIZE = 64 };
+
+  struct Shard {
+    Shard(size_t shards, size_t mailboxSize);
+    // mailboxes[n] is filled only by the thread of the shard n
+    std::vector<std::unique_ptr<SPSCQueue<ShardEvent>>> mailboxes;
+    moodycamel::ConcurrentQueue<ShardEvent> inbox;
+    // delayed destinations, owned by the shard thread
+    std::vector<uint32_t> delayed;
+    int64_t delayedDue = 0;
+    std::mutex lock;
+    std::condition_variable wakeup;
+    std::atomic_bool sleeping{false};
+  };
+
+  std::vector<std::unique_ptr<Shard>> _shards;
+  std::atomic_bool _isRunning{false};
+  Poco::ThreadPool _threadPool;
+  std::unique_ptr<Poco::RunnableAdapter<ShardPool>> _threadAdapter;
+  std::atomic_size_t _thrNum{0};
+
+  static int &currentShard();
+  void run();
+  void handle(size_t shardNum, ShardEvent &event);
+  void takeDelayed(size_t shardNum);
+  void wait(Shard &shard) const;
+  static bool hasEvents(const Shard &shard);
+
+ public:
+  ShardPool();
+  virtual ~ShardPool();
+  ShardPool(const ShardPool &) = delete;
+  ShardPool &operator=(const ShardPool &) = delete;
+
+  bool isEnabled() const;
+  size_t size() const;
+  size_t shardOf(uint32_t destination) const;
+
+  void post(size_t shardNum, ShardEvent &&event);
+  void postDispatch(uint32_t destination);
+  // NOTE: must be called from the shard thread, the destination is dispatched again after the delay
+  void delay(uint32_t destination);
+
+  void start();
+  void stop();
+};
+}  // namespace broker
+}  // namespace upmq
+
+typedef Singleton<upmq::broker::ShardPool> SHARDS;
+
+#endif  // BROKER_SHARDPOOL_H
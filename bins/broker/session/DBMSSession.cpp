@@ -17,6 +17,8 @@
 #include "DBMSSession.h"
 #include <Exception.h>
 #include "DBMSConnectionPool.h"
+#include "Metrics.h"
+#include <chrono>
 upmq::broker::storage::DBMSSession::DBMSSession(std::shared_ptr<Poco::Data::Session> &&session, upmq::broker::storage::DBMSConnectionPool &dbmsPool)
     : _session(std::move(session)), _dbmsPool(dbmsPool) {}
 upmq::broker::storage::DBMSSession::~DBMSSession() {
@@ -41,7 +43,11 @@ void upmq::broker::storage::DBMSSession::commitTX() {
     throw EXCEPTION("dbms session was closed", _lastTXName, ERROR_WORKER);
   }
   if (_inTransaction) {
+    static const std::shared_ptr<Metrics::Histogram> commitSeconds =
+        METRICS::Instance().histogram("upmq_storage_commit_seconds", "Duration of the storage transaction commit");
+    const auto started = std::chrono::steady_clock::now();
     dbms::Instance().commitTX(*_session, _lastTXName);
+    commitSeconds->observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
   }
   _inTransaction = false;
 }
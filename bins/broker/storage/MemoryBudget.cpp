@@ -0,0 +1,119 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MemoryBudget.h"
+#include <utility>
+#include "AsyncHandlerRegestry.h"
+
+namespace upmq {
+namespace broker {
+
+MemoryBudget::Charge::Charge(std::shared_ptr<MemoryBudget> budget, int64_t bytes) : _budget(std::move(budget)), _bytes(bytes) {}
+MemoryBudget::Charge::Charge(Charge &&o) noexcept : _budget(std::move(o._budget)), _bytes(o._bytes) { o._bytes = 0; }
+MemoryBudget::Charge &MemoryBudget::Charge::operator=(Charge &&o) noexcept {
+  if (this != &o) {
+    release();
+    _budget = std::move(o._budget);
+    _bytes = o._bytes;
+    o._bytes = 0;
+  }
+  return *this;
+}
+MemoryBudget::Charge::~Charge() { release(); }
+void MemoryBudget::Charge::release() {
+  if (_budget) {
+    _budget->sub(_bytes);
+    _budget.reset();
+  }
+  _bytes = 0;
+}
+int64_t MemoryBudget::Charge::bytes() const { return _bytes; }
+
+MemoryBudget::MemoryBudget(int64_t limit, int highWatermark, int lowWatermark, MemoryBudget *parent) : _parent(parent) {
+  configure(limit, highWatermark, lowWatermark);
+}
+void MemoryBudget::configure(int64_t limit, int highWatermark, int lowWatermark) {
+  _limit = limit;
+  _high = limit / 100 * highWatermark;
+  _low = limit / 100 * lowWatermark;
+}
+MemoryBudget::Charge MemoryBudget::charge(const std::shared_ptr<MemoryBudget> &budget, int64_t bytes) {
+  if (!budget || (bytes <= 0)) {
+    return {};
+  }
+  budget->add(bytes);
+  return Charge(budget, bytes);
+}
+void MemoryBudget::add(int64_t bytes) {
+  const int64_t used = (_used += bytes);
+  if ((_limit > 0) && (used >= _high)) {
+    _throttling = true;
+  }
+  if (_parent != nullptr) {
+    _parent->add(bytes);
+  }
+}
+void MemoryBudget::sub(int64_t bytes) {
+  const int64_t used = (_used -= bytes);
+  if ((used < _low) && _throttling.exchange(false)) {
+    resumeWaiters();
+  }
+  if (_parent != nullptr) {
+    _parent->sub(bytes);
+  }
+}
+void MemoryBudget::resumeWaiters() {
+  std::unordered_set<size_t> waiters;
+  {
+    std::lock_guard<std::mutex> lock(_waitersLock);
+    waiters.swap(_waiters);
+  }
+  for (size_t num : waiters) {
+    auto ahandler = AHRegestry::Instance().aHandler(num);
+    if (ahandler != nullptr) {
+      ahandler->unthrottle();
+    }
+  }
+}
+bool MemoryBudget::isHigh(int64_t bytes) const {
+  if ((_limit > 0) && (_used + bytes >= _high)) {
+    return true;
+  }
+  return (_parent != nullptr) && _parent->isHigh(bytes);
+}
+bool MemoryBudget::isThrottling() const { return _throttling || ((_parent != nullptr) && _parent->isThrottling()); }
+bool MemoryBudget::wait(size_t handlerNum) {
+  MemoryBudget *budget = this;
+  while ((budget != nullptr) && !budget->_throttling) {
+    budget = budget->_parent;
+  }
+  if (budget == nullptr) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(budget->_waitersLock);
+    budget->_waiters.insert(handlerNum);
+  }
+  // NOTE: the budget could fall below the low watermark between the check and the insert
+  if (!budget->_throttling) {
+    budget->resumeWaiters();
+  }
+  return true;
+}
+int64_t MemoryBudget::used() const { return _used; }
+int64_t MemoryBudget::limit() const { return _limit; }
+}  // namespace broker
+}  // namespace upmq
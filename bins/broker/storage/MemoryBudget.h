@@ -0,0 +1,96 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_MEMORYBUDGET_H
+#define BROKER_MEMORYBUDGET_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include "Singleton.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief MemoryBudget - bytes of message bodies held by the broker (non-persistent storage, select caches, output queues)
+/// ** the destination budget is charged together with the broker one (parent)
+/// ** the budget is throttling from the high watermark until it falls below the low watermark
+/// ** producers wait for the throttling budget with paused reading, they are resumed at the low watermark
+/// ** limit 0 - unlimited, the bytes are counted anyway
+class MemoryBudget {
+ public:
+  /// @brief Charge - charged bytes, they are released with the charge
+  class Charge {
+    std::shared_ptr<MemoryBudget> _budget;
+    int64_t _bytes = 0;
+
+   public:
+    Charge() = default;
+    Charge(std::shared_ptr<MemoryBudget> budget, int64_t bytes);
+    Charge(Charge &&o) noexcept;
+    Charge &operator=(Charge &&o) noexcept;
+    Charge(const Charge &) = delete;
+    Charge &operator=(const Charge &) = delete;
+    ~Charge();
+    void release();
+    int64_t bytes() const;
+  };
+
+ private:
+  MemoryBudget *_parent = nullptr;
+  std::atomic<int64_t> _used{0};
+  int64_t _limit = 0;
+  int64_t _high = 0;
+  int64_t _low = 0;
+  std::atomic_bool _throttling{false};
+  std::mutex _waitersLock;
+  std::unordered_set<size_t> _waiters;
+
+  void add(int64_t bytes);
+  void sub(int64_t bytes);
+  void resumeWaiters();
+
+ public:
+  MemoryBudget() = default;
+  MemoryBudget(int64_t limit, int highWatermark, int lowWatermark, MemoryBudget *parent);
+  MemoryBudget(const MemoryBudget &) = delete;
+  MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+  // sets the limit (bytes) and watermarks (percents of the limit)
+  void configure(int64_t limit, int highWatermark, int lowWatermark);
+
+  // charges the budget and its parent, the budget has to be owned by the shared_ptr, so the charge can outlive its destination
+  static Charge charge(const std::shared_ptr<MemoryBudget> &budget, int64_t bytes);
+
+  // bytes would pass the high watermark of the budget or its parent
+  bool isHigh(int64_t bytes) const;
+  bool isThrottling() const;
+
+  // the handler waits for the throttling budget, false - nothing is throttling
+  // NOTE: the handler is resumed by AsyncTCPHandler::unthrottle
+  bool wait(size_t handlerNum);
+
+  int64_t used() const;
+  int64_t limit() const;
+};
+}  // namespace broker
+}  // namespace upmq
+
+typedef Singleton<upmq::broker::MemoryBudget> MEMORYBUDGET;
+
+#endif  // BROKER_MEMORYBUDGET_H
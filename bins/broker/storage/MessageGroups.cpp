@@ -0,0 +1,101 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MessageGroups.h"
+
+namespace upmq {
+namespace broker {
+
+std::string MessageGroups::owner(const std::string &groupID, int &outstanding) const {
+  upmq::ScopedReadRWLock readRWLock(_lock);
+  auto it = _groups.find(groupID);
+  if (it == _groups.end()) {
+    outstanding = 0;
+    return std::string();
+  }
+  outstanding = it->second.outstanding;
+  return it->second.owner;
+}
+void MessageGroups::assign(const std::string &groupID, const std::string &objectID, const std::string &messageID, int groupSeq) {
+  upmq::ScopedWriteRWLock writeRWLock(_lock);
+  auto it = _groups.find(groupID);
+  if (it == _groups.end()) {
+    it = _groups.emplace(groupID, Group()).first;
+    it->second.complete = (groupSeq <= 1);
+  }
+  Group &group = it->second;
+  const bool newOwner = (group.owner != objectID);
+  if (newOwner) {
+    group.owner = objectID;
+    group.outstanding = 0;
+  }
+  // NOTE: redelivered message is already counted by the same owner
+  if (group.messages.insert(messageID).second || newOwner) {
+    ++group.outstanding;
+  }
+}
+void MessageGroups::acknowledged(const std::string &groupID, const std::string &messageID, bool removed) {
+  upmq::ScopedWriteRWLock writeRWLock(_lock);
+  auto it = _groups.find(groupID);
+  if (it == _groups.end()) {
+    return;
+  }
+  Group &group = it->second;
+  if (group.outstanding > 0) {
+    --group.outstanding;
+  }
+  // NOTE: the group could stay open forever, so the table keeps only messages on the way to the owner
+  group.messages.erase(messageID);
+  if (!removed) {
+    group.complete = false;
+  }
+  if (group.messages.empty() && group.owner.empty()) {
+    _groups.erase(it);
+  }
+}
+void MessageGroups::release(const std::string &objectID) {
+  upmq::ScopedWriteRWLock writeRWLock(_lock);
+  for (auto it = _groups.begin(); it != _groups.end();) {
+    if (it->second.owner == objectID) {
+      it = _groups.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+bool MessageGroups::take(const std::string &groupID, std::vector<std::string> &messages) {
+  upmq::ScopedWriteRWLock writeRWLock(_lock);
+  auto it = _groups.find(groupID);
+  if (it == _groups.end()) {
+    return false;
+  }
+  const bool complete = it->second.complete;
+  if (complete) {
+    messages.assign(it->second.messages.begin(), it->second.messages.end());
+  }
+  _groups.erase(it);
+  return complete;
+}
+void MessageGroups::clear() {
+  upmq::ScopedWriteRWLock writeRWLock(_lock);
+  _groups.clear();
+}
+size_t MessageGroups::size() const {
+  upmq::ScopedReadRWLock readRWLock(_lock);
+  return _groups.size();
+}
+}  // namespace broker
+}  // namespace upmq
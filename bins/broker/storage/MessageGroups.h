@@ -0,0 +1,73 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_MESSAGEGROUPS_H
+#define BROKER_MESSAGEGROUPS_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "MoveableRWLock.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief MessageGroups - in-memory table of the message groups of the storage
+/// ** group id is the id in the storage (client group id + sender group uuid)
+/// ** all messages of the group are delivered to the owner while it's subscribed
+/// ** the group is closed by last_in_group in the storage, it's also the only state needed for the recovery
+/// ** after restart the table is filled again by the delivery
+/// ** acknowledged messages leave the table, the group without messages and owner leaves the table too
+class MessageGroups {
+ public:
+  struct Group {
+    std::string owner;
+    // NOTE: the table knows all messages of the group in the storage, the first one was seen and nothing acknowledged stays in the storage
+    bool complete = false;
+    // delivered and not acknowledged messages
+    int outstanding = 0;
+    std::unordered_set<std::string> messages;
+  };
+
+ private:
+  std::unordered_map<std::string, Group> _groups;
+  mutable MRWLock _lock;
+
+ public:
+  MessageGroups() = default;
+  MessageGroups(MessageGroups &&) = default;
+  MessageGroups &operator=(MessageGroups &&) = default;
+  MessageGroups(const MessageGroups &) = delete;
+  MessageGroups &operator=(const MessageGroups &) = delete;
+
+  // returns object_id of the owner or empty string if the group has no owner
+  std::string owner(const std::string &groupID, int &outstanding) const;
+  // message was sent to the consumer, the new owner doesn't inherit outstanding messages of the previous one
+  void assign(const std::string &groupID, const std::string &objectID, const std::string &messageID, int groupSeq);
+  // message is acknowledged, removed - it's removed from the storage too, otherwise the group is closed by the storage query
+  void acknowledged(const std::string &groupID, const std::string &messageID, bool removed);
+  // the consumer is gone, its groups lose the owner and not acknowledged messages (they are sent again)
+  void release(const std::string &objectID);
+  // forgets the group, returns false if the table doesn't know all messages of the group
+  bool take(const std::string &groupID, std::vector<std::string> &messages);
+  void clear();
+  size_t size() const;
+};
+}  // namespace broker
+}  // namespace upmq
+
+#endif  // BROKER_MESSAGEGROUPS_H
@@ -193,6 +193,8 @@ void Storage::resetMessagesBySession(const upmq::broker::Session &session) {
 }
 void Storage::removeGroupMessage(const std::string &groupID, const upmq::broker::Session &session) {
   std::vector<std::string> result;
+  // NOTE: the group table knows all delivered messages of the group, the storage is queried only after restart
+  const bool known = _groups.take(groupID, result);
   std::stringstream sql;
   sql << "select message_id from " << _messageTableID << " where group_id = \'" << groupID << "\'"
       << ";";
@@ -203,8 +205,10 @@ void Storage::removeGroupMessage(const std::string &groupID, const upmq::broker:
     tempDBMSSession->beginTX(groupID);
   }
   storage::DBMSSession &dbSession = externConnection ? *session.currentDBSession : *tempDBMSSession;
-  TRY_POCO_DATA_EXCEPTION { dbSession << sql.str(), Poco::Data::Keywords::into(result), Poco::Data::Keywords::now; }
-  CATCH_POCO_DATA_EXCEPTION_PURE("can't get message group for ack", sql.str(), ERROR_ON_ACK_MESSAGE)
+  if (!known) {
+    TRY_POCO_DATA_EXCEPTION { dbSession << sql.str(), Poco::Data::Keywords::into(result), Poco::Data::Keywords::now; }
+    CATCH_POCO_DATA_EXCEPTION_PURE("can't get message group for ack", sql.str(), ERROR_ON_ACK_MESSAGE)
+  }
 
   for (const auto &msgID : result) {
     removeMessage(msgID, dbSession);
@@ -213,31 +217,6 @@ void Storage::removeGroupMessage(const std::string &groupID, const upmq::broker:
     tempDBMSSession->commitTX();
   }
 }
-message::GroupStatus Storage::checkIsGroupClosed(const MessageDataContainer &sMessage, const Session &session) const {
-  int result = -1;
-  std::stringstream sql;
-  sql << "select count(last_in_group) from " << _messageTableID << " where last_in_group = \'TRUE\' and group_id in "
-      << "(select group_id from " << _messageTableID << " where message_id = \'" << sMessage.ack().message_id() << "\'"
-      << " and delivery_status <> " << message::DELIVERED << ")"
-      << ";";
-  bool externConnection = (session.currentDBSession != nullptr);
-  std::unique_ptr<storage::DBMSSession> tempDBMSSession;
-  if (!externConnection) {
-    tempDBMSSession = std::make_unique<storage::DBMSSession>(dbms::Instance().dbmsSession());
-  }
-  storage::DBMSSession &dbSession = externConnection ? *session.currentDBSession : *tempDBMSSession;
-  TRY_POCO_DATA_EXCEPTION { dbSession << sql.str(), Poco::Data::Keywords::into(result), Poco::Data::Keywords::now; }
-  CATCH_POCO_DATA_EXCEPTION_PURE("can't check last in group for ack", sql.str(), ERROR_ON_ACK_MESSAGE)
-
-  switch (result) {
-    case 0:
-      return message::GroupStatus::ONE_OF_GROUP;
-    case 1:
-      return message::GroupStatus::LAST_IN_GROUP;
-    default:
-      return message::GroupStatus::NOT_IN_GROUP;
-  }
-}
 int Storage::deleteMessageHeader(storage::DBMSSession &dbSession, const std::string &messageID) {
   std::stringstream sql;
   int persistent = static_cast<int>(!_nonPersistent.contains(messageID));
@@ -303,6 +282,9 @@ void Storage::removeMessage(const std::string &messageID, storage::DBMSSession &
   if (subscribersCount <= 0) {
     deleteMessageInfoFromJournal(dbSession, messageID);
     deleteMessageDataIfExists(messageID, wasPersistent);
+    _parent->removeDeliveryHeaders(messageID);
+    _parent->countRemoved(1);
+    _parent->tracer().forget(messageID);
   } else {
     updateSubscribersCount(dbSession, messageID);
   }
@@ -372,7 +354,9 @@ void Storage::save(const upmq::broker::Session &session, const MessageDataContai
   const std::string &messageID = message.message_id();
 
   if (!message.persistent()) {
-    _nonPersistent.insert(std::make_pair(messageID, std::shared_ptr<MessageDataContainer>(sMessage.clone())));
+    std::shared_ptr<MessageDataContainer> nonPersistent(sMessage.clone());
+    holdNonPersistentData(*nonPersistent);
+    _nonPersistent.insert(std::make_pair(messageID, std::move(nonPersistent)));
   }
   try {
     saveMessageProperties(session, message);
@@ -391,6 +375,17 @@ void Storage::save(const upmq::broker::Session &session, const MessageDataContai
     throw;
   }
 }
+void Storage::holdNonPersistentData(MessageDataContainer &sMessage) const {
+  const auto size = static_cast<int64_t>(sMessage.data.size());
+  const std::shared_ptr<MemoryBudget> &budget = _parent->memoryBudget();
+  // NOTE: the newest body is delivered last, so it's the coldest one to be spilled
+  if (MEMORY_CONFIG.spill && !sMessage.withFile() && (size > 0) && budget->isHigh(size)) {
+    sMessage.spilledData = SPILLSTORE::Instance().write(sMessage.data);
+    std::string().swap(sMessage.data);
+    return;
+  }
+  sMessage.memoryCharge = MemoryBudget::charge(budget, size);
+}
 bool Storage::checkTTLIsOut(const std::string &stringMessageTime, Poco::Int64 ttl) {
   if (ttl <= 0) {
     return false;
@@ -665,6 +660,7 @@ void Storage::abort(const Session &session) {
   std::string mainTXTable = "\"" + std::to_string(Poco::hash(_extParentID + "_" + session.txName())) + "\"";
   std::stringstream sql;
   bool tbExist = false;
+  size_t aborted = 0;
   sql << "select 1 from " << mainTXTable << ";";
   std::unique_ptr<storage::DBMSSession> dbSession = dbms::Instance().dbmsSessionPtr();
   dbSession->beginTX(session.id());
@@ -683,7 +679,11 @@ void Storage::abort(const Session &session) {
     sql << "delete from " << STORAGE_CONFIG.messageJournal(_parent->name()) << " where message_id in ("
         << " select message_id from " << mainTXTable << ");";
 
-    TRY_POCO_DATA_EXCEPTION { *dbSession << sql.str(), Poco::Data::Keywords::now; }
+    // NOTE: the journal rows are counted by the destination depth, the message of the topic is removed by the first subscription
+    TRY_POCO_DATA_EXCEPTION {
+      Poco::Data::Statement remove = (*dbSession << sql.str());
+      aborted = remove.execute();
+    }
     CATCH_POCO_DATA_EXCEPTION_PURE("can't abort", sql.str(), ERROR_ON_ABORT)
     sql.str("");
     sql << "delete from " << _propertyTableID << " where message_id in ("
@@ -701,6 +701,7 @@ void Storage::abort(const Session &session) {
 
   session.currentDBSession->commitTX();
   session.currentDBSession.reset(nullptr);
+  _parent->countRemoved(aborted);
   _parent->postNewMessageEvent();
 }
 void Storage::dropTXTable(storage::DBMSSession &dbSession, const std::string &mainTXTable) const {
@@ -708,9 +709,15 @@ void Storage::dropTXTable(storage::DBMSSession &dbSession, const std::string &ma
   sql << "drop table if exists " << mainTXTable << ";";
   dbSession << sql.str(), Poco::Data::Keywords::now;
 }
-std::vector<MessageInfo> Storage::getMessagesBelow(const Session &session, const std::string &messageID) const {
+std::vector<MessageInfo> Storage::getMessagesBelow(const Session &session, const Proto::Ack &ack) const {
   if (!session.isClientAcknowledge()) {
-    return std::vector<MessageInfo>{MessageInfo(messageID)};
+    std::vector<MessageInfo> acked;
+    acked.reserve(static_cast<size_t>(ack.message_ids_size()) + 1);
+    acked.emplace_back(ack.message_id());
+    for (const auto &messageID : ack.message_ids()) {
+      acked.emplace_back(messageID);
+    }
+    return acked;
   }
   std::vector<MessageInfo> result;
   std::stringstream sql;
@@ -745,6 +752,18 @@ void Storage::setMessageToWasSent(const std::string &messageID, const Consumer &
   TRY_POCO_DATA_EXCEPTION { dbms::Instance().doNow(sql.str()); }
   CATCH_POCO_DATA_EXCEPTION_PURE("can't set message to was_sent ", sql.str(), ERROR_STORAGE)
 }
+void Storage::setMessageConsumer(const std::string &messageID, const Consumer &consumer) {
+  std::stringstream sql;
+  sql << "update " << _messageTableID << " set consumer_id = \'" << consumer.id << "\'";
+  if (consumer.session.type == SESSION_TRANSACTED) {
+    consumer.session.txName = BROKER::Instance().currentTransaction(consumer.clientID, consumer.session.id);
+    sql << ",  transaction_id = \'" << consumer.session.txName << "\'";
+  }
+  sql << " where message_id = \'" << messageID << "\'"
+      << ";";
+  TRY_POCO_DATA_EXCEPTION { dbms::Instance().doNow(sql.str()); }
+  CATCH_POCO_DATA_EXCEPTION_PURE("can't set message consumer ", sql.str(), ERROR_STORAGE)
+}
 void Storage::setMessagesToWasSent(storage::DBMSSession &dbSession, const Consumer &consumer) {
   if (!consumer.select->empty()) {
     std::stringstream sql;
@@ -760,7 +779,7 @@ void Storage::setMessagesToWasSent(storage::DBMSSession &dbSession, const Consum
       if (i > 0) {
         sql << " or ";
       }
-      sql << "message_id = \'" << messages[i]->message().message_id() << "\'";
+      sql << "message_id = \'" << messages[i]->messageID() << "\'";
     }
     sql << ";";
     TRY_POCO_DATA_EXCEPTION { dbSession << sql.str(), Poco::Data::Keywords::now; }
@@ -949,46 +968,17 @@ std::shared_ptr<MessageDataContainer> Storage::makeMessage(storage::DBMSSession
 
     bool needToFillProperties = true;
 
-    sMessage = std::make_shared<MessageDataContainer>(STORAGE_CONFIG.data.get().toString());
+    sMessage = MessageDataContainer::make(STORAGE_CONFIG.data.get().toString());
     try {
-      Proto::Message &message = sMessage->createMessageHeader(consumer.objectID);
       sMessage->clientID = Poco::replace(consumer.clientID, "-browser", "");
       sMessage->handlerNum = consumer.tcpNum;
 
-      message.set_message_id(msgInfo.messageId);
-      message.set_destination_uri(_parent->uri());
-      message.set_priority(msgInfo.priority);
-      message.set_persistent(msgInfo.persistent == 1);
-      message.set_sender_id(BROKER::Instance().id());
       sMessage->data.clear();
       if (msgInfo.persistent == 1) {
-        std::string data = sMessage->message().message_id();
-        data[2] = '_';
-        data = Exchange::mainDestinationPath(sMessage->message().destination_uri()) + "/" + data;
-        auto &pmap = *message.mutable_property();
-        if (useFileLink) {
-          Poco::Path path = STORAGE_CONFIG.data.get();
-          path.append(data);
-          pmap[s2s::proto::upmq_data_link].set_value_string(path.toString());
-          pmap[s2s::proto::upmq_data_link].set_is_null(false);
-
-          pmap[s2s::proto::upmq_data_parts_number].set_value_int(0);
-          pmap[s2s::proto::upmq_data_parts_number].set_is_null(false);
-
-          pmap[s2s::proto::upmq_data_parts_count].set_value_int(0);
-          pmap[s2s::proto::upmq_data_parts_count].set_is_null(false);
-
-          pmap[s2s::proto::upmq_data_part_size].set_value_int(0);
-          pmap[s2s::proto::upmq_data_part_size].set_is_null(false);
-        } else {
-          pmap.erase(s2s::proto::upmq_data_link);
-
-          pmap.erase(s2s::proto::upmq_data_parts_number);
-
-          pmap.erase(s2s::proto::upmq_data_parts_count);
-
-          pmap.erase(s2s::proto::upmq_data_part_size);
-
+        if (!useFileLink) {
+          std::string data = msgInfo.messageId;
+          data[2] = '_';
+          data = Exchange::mainDestinationPath(_parent->uri()) + "/" + data;
           sMessage->setWithFile(true);
           sMessage->data = data;
         }
@@ -996,37 +986,32 @@ std::shared_ptr<MessageDataContainer> Storage::makeMessage(storage::DBMSSession
         auto item = _nonPersistent.find(msgInfo.messageId);
         if (item.hasValue()) {
           needToFillProperties = (*item)->message().property_size() > 0;
-          sMessage->data = (*item)->data;
+          if ((*item)->spilledData) {
+            sMessage->data = BufferPool::reserve((*item)->spilledData->size());
+            (*item)->spilledData->read(sMessage->data);
+          } else {
+            sMessage->data = BufferPool::copy((*item)->data);
+          }
+          // NOTE: the copy is held by the select cache and the output queue until it's sent
+          sMessage->memoryCharge = MemoryBudget::charge(_parent->memoryBudget(), static_cast<int64_t>(sMessage->data.size()));
         } else {
           removeMessage(msgInfo.messageId, dbSession);
           return {};
         }
       }
-      if (!msgInfo.correlationID.isNull()) {
-        message.set_correlation_id(msgInfo.correlationID.value());
-      }
-      if (!msgInfo.replyTo.isNull()) {
-        message.set_reply_to(msgInfo.replyTo);
-      }
-      message.set_type(msgInfo.type);
-      message.set_timestamp(msgInfo.timestamp);
-      message.set_timetolive(msgInfo.ttl);
-      message.set_expiration(msgInfo.expiration);
-      if (sMessage) {
-        sMessage->setDeliveryCount(msgInfo.deliveryCount);
-      }
-      message.set_body_type(msgInfo.bodyType);
-      message.set_session_id(consumer.session.id);
       if (!msgInfo.groupID.value().empty()) {
-        Poco::StringTokenizer groupIDAll(msgInfo.groupID, "+", Poco::StringTokenizer::TOK_TRIM);
-        message.set_group_id(groupIDAll[0]);
-      } else {
-        message.set_group_id(msgInfo.groupID.value());
+        sMessage->groupID = msgInfo.groupID.value();
       }
-      message.set_group_seq(msgInfo.groupSeq);
-      if (needToFillProperties) {
-        fillProperties(dbSession, message);
+      // NOTE: the header is built and serialized once, deliveries copy it with own session, object id and delivery count
+      std::shared_ptr<const DeliveryHeader> deliveryHeader = _parent->deliveryHeader(msgInfo.messageId, useFileLink);
+      if (!deliveryHeader) {
+        ProtoArena::Lease arena = ProtoArena::acquire();
+        ProtoArena::Ptr<Proto::Message> message = arena->create<Proto::Message>();
+        fillMessageHeader(dbSession, msgInfo, useFileLink, needToFillProperties, *message);
+        deliveryHeader = std::make_shared<const DeliveryHeader>(*message);
+        _parent->addDeliveryHeader(useFileLink, deliveryHeader);
       }
+      sMessage->setDeliveryHeader(std::move(deliveryHeader), consumer.objectID, consumer.session.id, msgInfo.deliveryCount);
     } catch (Exception &ex) {
       removeMessage(msgInfo.messageId, dbSession);
       throw Exception(ex);
@@ -1034,6 +1019,54 @@ std::shared_ptr<MessageDataContainer> Storage::makeMessage(storage::DBMSSession
   }
   return sMessage;
 }
+void Storage::fillMessageHeader(
+    storage::DBMSSession &dbSession, const consumer::Msg &msgInfo, bool useFileLink, bool needToFillProperties, Proto::Message &message) {
+  message.set_message_id(msgInfo.messageId);
+  message.set_destination_uri(_parent->uri());
+  message.set_priority(msgInfo.priority);
+  message.set_persistent(msgInfo.persistent == 1);
+  message.set_sender_id(BROKER::Instance().id());
+  if ((msgInfo.persistent == 1) && useFileLink) {
+    std::string data = msgInfo.messageId;
+    data[2] = '_';
+    data = Exchange::mainDestinationPath(message.destination_uri()) + "/" + data;
+    auto &pmap = *message.mutable_property();
+    Poco::Path path = STORAGE_CONFIG.data.get();
+    path.append(data);
+    pmap[s2s::proto::upmq_data_link].set_value_string(path.toString());
+    pmap[s2s::proto::upmq_data_link].set_is_null(false);
+
+    pmap[s2s::proto::upmq_data_parts_number].set_value_int(0);
+    pmap[s2s::proto::upmq_data_parts_number].set_is_null(false);
+
+    pmap[s2s::proto::upmq_data_parts_count].set_value_int(0);
+    pmap[s2s::proto::upmq_data_parts_count].set_is_null(false);
+
+    pmap[s2s::proto::upmq_data_part_size].set_value_int(0);
+    pmap[s2s::proto::upmq_data_part_size].set_is_null(false);
+  }
+  if (!msgInfo.correlationID.isNull()) {
+    message.set_correlation_id(msgInfo.correlationID.value());
+  }
+  if (!msgInfo.replyTo.isNull()) {
+    message.set_reply_to(msgInfo.replyTo);
+  }
+  message.set_type(msgInfo.type);
+  message.set_timestamp(msgInfo.timestamp);
+  message.set_timetolive(msgInfo.ttl);
+  message.set_expiration(msgInfo.expiration);
+  message.set_body_type(msgInfo.bodyType);
+  if (!msgInfo.groupID.value().empty()) {
+    Poco::StringTokenizer groupIDAll(msgInfo.groupID, "+", Poco::StringTokenizer::TOK_TRIM);
+    message.set_group_id(groupIDAll[0]);
+  } else {
+    message.set_group_id(msgInfo.groupID.value());
+  }
+  message.set_group_seq(msgInfo.groupSeq);
+  if (needToFillProperties) {
+    fillProperties(dbSession, message);
+  }
+}
 void Storage::fillProperties(storage::DBMSSession &dbSession, Proto::Message &message) {
   std::stringstream sql;
   sql << "select "
@@ -1123,6 +1156,7 @@ void Storage::fillProperties(storage::DBMSSession &dbSession, Proto::Message &me
   CATCH_POCO_DATA_EXCEPTION_PURE_TROW_INVALID_SQL("can't fill properties", sql.str(), ERROR_ON_GET_MESSAGE)
 }
 void Storage::dropTables() {
+  _groups.clear();
   std::stringstream sql;
   sql << "drop table if exists " << _messageTableID << ";" << non_std_endl;
   TRY_POCO_DATA_EXCEPTION { dbms::Instance().doNow(sql.str()); }
@@ -1137,5 +1171,6 @@ bool Storage::hasTransaction(const Session &session) const {
   upmq::ScopedReadRWLock readRWLock(_txSessionsLock);
   return (_txSessions.find(session.id()) != _txSessions.end());
 }
+MessageGroups &Storage::groups() const { return _groups; }
 }  // namespace broker
 }  // namespace upmq
@@ -20,9 +20,10 @@
 #include <Poco/RWLock.h>
 #include <memory>
 #include <string>
-#include "FixedSizeUnorderedMap.h"
+#include "ConcurrentHashMap.h"
 #include "DBMSSession.h"
 #include "MessageDataContainer.h"
+#include "MessageGroups.h"
 #include "MoveableRWLock.h"
 
 namespace upmq {
@@ -37,7 +38,7 @@ struct Msg;
 
 class Storage {
  public:
-  using NonPersistentMessagesListType = FSUnorderedMap<std::string, std::shared_ptr<MessageDataContainer>>;
+  using NonPersistentMessagesListType = ConcurrentHashMap<std::string, std::shared_ptr<MessageDataContainer>>;
   /// @brief TransactSessionsListType - set<transact_session_id>
   using TransactSessionsListType = std::unordered_set<std::string>;
 
@@ -49,6 +50,7 @@ class Storage {
   std::string _extParentID;
   TransactSessionsListType _txSessions;
   mutable upmq::MRWLock _txSessionsLock;
+  mutable MessageGroups _groups;
 
  private:
   std::string saveTableName(const upmq::broker::Session &session) const;
@@ -56,6 +58,8 @@ class Storage {
                                                     const consumer::Msg &msgInfo,
                                                     const Consumer &consumer,
                                                     bool useFileLink);
+  void fillMessageHeader(
+      storage::DBMSSession &dbSession, const consumer::Msg &msgInfo, bool useFileLink, bool needToFillProperties, Proto::Message &message);
   void fillProperties(storage::DBMSSession &dbSession, Proto::Message &message);
   int deleteMessageHeader(storage::DBMSSession &dbSession, const std::string &messageID);
   void deleteMessageProperties(storage::DBMSSession &dbSession, const std::string &messageID);
@@ -66,6 +70,8 @@ class Storage {
   void saveMessageHeader(const upmq::broker::Session &session, const MessageDataContainer &sMessage);
   void saveMessageProperties(const upmq::broker::Session &session, const Message &message);
   bool checkTTLIsOut(const std::string &stringMessageTime, Poco::Int64 ttl);
+  // charges the memory budget with the body or spills it over the high watermark
+  void holdNonPersistentData(MessageDataContainer &sMessage) const;
 
  public:
   explicit Storage(const std::string &messageTableID, size_t nonPersistentSize);
@@ -89,8 +95,10 @@ class Storage {
   std::string generateSQLMainTable(const std::string &tableName) const;
   std::vector<std::string> generateSQLMainTableIndexes(const std::string &tableName) const;
   std::string generateSQLProperties() const;
-  std::vector<MessageInfo> getMessagesBelow(const upmq::broker::Session &session, const std::string &messageID) const;
+  std::vector<MessageInfo> getMessagesBelow(const upmq::broker::Session &session, const Proto::Ack &ack) const;
   void setMessageToWasSent(const std::string &messageID, const Consumer &consumer);
+  // NOTE: moves the sent message to another consumer without the new delivery
+  void setMessageConsumer(const std::string &messageID, const Consumer &consumer);
   void setMessagesToWasSent(storage::DBMSSession &dbSession, const Consumer &consumer);
   void setMessageToDelivered(const upmq::broker::Session &session, const std::string &messageID);
   void setMessagesToNotSent(const Consumer &consumer);
@@ -101,7 +109,7 @@ class Storage {
   int64_t size();
   void dropTables();
   bool hasTransaction(const upmq::broker::Session &session) const;
-  message::GroupStatus checkIsGroupClosed(const MessageDataContainer &sMessage, const upmq::broker::Session &session) const;
+  MessageGroups &groups() const;
 };
 }  // namespace broker
 }  // namespace upmq
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SpillStore.h"
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <utility>
+#include "Exception.h"
+#include "ProtoBuf.h"
+
+namespace upmq {
+namespace broker {
+
+SpillStore::Segment::Segment(std::string path) : _path(std::move(path)) {
+  _file.open(_path, std::ios_base::out | std::ios_base::in | std::ios_base::binary | std::ios_base::trunc);
+  if (!_file.is_open()) {
+    throw EXCEPTION("can't open spill segment", _path, Proto::ERROR_STORAGE);
+  }
+}
+SpillStore::Segment::~Segment() {
+  try {
+    _file.close();
+    Poco::File(_path).remove();
+  } catch (...) {
+  }
+}
+uint64_t SpillStore::Segment::append(const std::string &data) {
+  std::lock_guard<std::mutex> lock(_lock);
+  const uint64_t offset = _size;
+  _file.seekp(static_cast<std::streamoff>(offset));
+  _file.write(data.data(), static_cast<std::streamsize>(data.size()));
+  if (!_file.good()) {
+    _file.clear();
+    throw EXCEPTION("can't write spill segment", _path, Proto::ERROR_STORAGE);
+  }
+  _size += data.size();
+  return offset;
+}
+void SpillStore::Segment::read(uint64_t offset, size_t size, std::string &out) {
+  std::lock_guard<std::mutex> lock(_lock);
+  out.resize(size);
+  _file.seekg(static_cast<std::streamoff>(offset));
+  _file.read(&out[0], static_cast<std::streamsize>(size));
+  if (!_file.good()) {
+    _file.clear();
+    throw EXCEPTION("can't read spill segment", _path, Proto::ERROR_STORAGE);
+  }
+}
+uint64_t SpillStore::Segment::size() {
+  std::lock_guard<std::mutex> lock(_lock);
+  return _size;
+}
+
+SpillStore::Record::Record(std::shared_ptr<Segment> segment, uint64_t offset, size_t size)
+    : _segment(std::move(segment)), _offset(offset), _size(size) {}
+size_t SpillStore::Record::size() const { return _size; }
+void SpillStore::Record::read(std::string &out) const {
+  if (_size == 0) {
+    out.clear();
+    return;
+  }
+  _segment->read(_offset, _size, out);
+}
+
+void SpillStore::configure(const std::string &path, uint64_t segmentSize) {
+  std::lock_guard<std::mutex> lock(_lock);
+  Poco::File dir(path);
+  // NOTE: segments of the previous run have no owners
+  if (dir.exists()) {
+    dir.remove(true);
+  }
+  dir.createDirectories();
+  _path = path;
+  _segmentSize = segmentSize;
+  _current.reset();
+  _enabled = true;
+}
+bool SpillStore::isEnabled() const { return _enabled; }
+std::shared_ptr<const SpillStore::Record> SpillStore::write(const std::string &data) {
+  std::shared_ptr<Segment> segment;
+  {
+    std::lock_guard<std::mutex> lock(_lock);
+    if (!_current || (_current->size() >= _segmentSize)) {
+      Poco::Path segmentPath(_path);
+      segmentPath.makeDirectory().setFileName("segment-" + std::to_string(++_segmentNum) + ".spill");
+      _current = std::make_shared<Segment>(segmentPath.toString());
+    }
+    segment = _current;
+  }
+  const uint64_t offset = segment->append(data);
+  return std::make_shared<const Record>(std::move(segment), offset, data.size());
+}
+}  // namespace broker
+}  // namespace upmq
@@ -0,0 +1,86 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BROKER_SPILLSTORE_H
+#define BROKER_SPILLSTORE_H
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "Singleton.h"
+
+namespace upmq {
+namespace broker {
+
+/// @brief SpillStore - temporary segment files of non-persistent bodies moved out of the memory budget
+/// ** bodies are appended to the current segment, the full segment is replaced by the new one
+/// ** the segment lives while its records exist, the file is removed with the segment
+/// ** segments aren't recovered, the directory is cleaned by configure
+class SpillStore {
+  class Segment {
+    std::string _path;
+    std::fstream _file;
+    std::mutex _lock;
+    uint64_t _size = 0;
+
+   public:
+    explicit Segment(std::string path);
+    Segment(const Segment &) = delete;
+    Segment &operator=(const Segment &) = delete;
+    ~Segment();
+    uint64_t append(const std::string &data);
+    void read(uint64_t offset, size_t size, std::string &out);
+    uint64_t size();
+  };
+
+ public:
+  /// @brief Record - the body in the segment
+  class Record {
+    std::shared_ptr<Segment> _segment;
+    uint64_t _offset;
+    size_t _size;
+
+   public:
+    Record(std::shared_ptr<Segment> segment, uint64_t offset, size_t size);
+    size_t size() const;
+    void read(std::string &out) const;
+  };
+
+ private:
+  std::mutex _lock;
+  std::shared_ptr<Segment> _current;
+  std::string _path;
+  uint64_t _segmentSize = 0;
+  uint64_t _segmentNum = 0;
+  bool _enabled = false;
+
+ public:
+  SpillStore() = default;
+  SpillStore(const SpillStore &) = delete;
+  SpillStore &operator=(const SpillStore &) = delete;
+
+  void configure(const std::string &path, uint64_t segmentSize);
+  bool isEnabled() const;
+  std::shared_ptr<const Record> write(const std::string &data);
+};
+}  // namespace broker
+}  // namespace upmq
+
+typedef Singleton<upmq::broker::SpillStore> SPILLSTORE;
+
+#endif  // BROKER_SPILLSTORE_H
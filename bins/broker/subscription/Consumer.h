@@ -88,6 +88,15 @@ class Consumer {
   std::string id;
   int maxNotAckMsg;
   mutable bool abort = false;
+  // NOTE: max count of messages in the one MessageBatch frame, 0 or 1 - every message is sent by own frame
+  int batchSize = 0;
+  // NOTE: consumers of the higher priority get messages first, the weight is the share among consumers of the same priority
+  int priority = 0;
+  int weight = 1;
+  // NOTE: state of the smooth weighted round-robin
+  mutable int64_t currentWeight = 0;
+  // NOTE: interned objectID, the destination keys the not-ack and credit lists by it
+  uint32_t handle = 0;
 
   mutable std::shared_ptr<std::deque<std::shared_ptr<MessageDataContainer>>> select;
 
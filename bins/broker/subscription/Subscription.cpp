@@ -15,6 +15,7 @@
  */
 
 #include "Subscription.h"
+#include <Poco/String.h>
 #include <Poco/UUIDGenerator.h>
 #include <protocol.pb.h>
 #include <NextBindParam.h>
@@ -28,6 +29,8 @@
 #include "MiscDefines.h"
 #include "TopicSender.h"
 #include <fake_cpp14.h>
+#include <algorithm>
+#include <iterator>
 
 namespace upmq {
 namespace broker {
@@ -40,6 +43,7 @@ Subscription::Subscription(const Destination &destination, const std::string &id
       _storage(_id, STORAGE_CONFIG.messages.nonPresistentSize),
       _destination(destination),
       _isRunning(new std::atomic_bool(false)),
+      _hasEvents(new std::atomic_bool(true)),
       _currentConsumerNumber(0),
       _consumersT("\"" + _id + "_subscription\""),
       _messageCounter(0),
@@ -130,20 +134,26 @@ void Subscription::save(const Session &session, const MessageDataContainer &sMes
     TRY_POCO_DATA_EXCEPTION { _storage.save(session, sMessage); }
     CATCH_POCO_DATA_EXCEPTION_PURE("can't save message", "", ERROR_ON_SAVE_MESSAGE)
     session.currentDBSession->commitTX();
-    _destination.postNewMessageEvent();
+    postNewMessageEvent();
   }
 }
 void Subscription::commit(const Session &session) {
   _storage.commit(session);
-  _destination.postNewMessageEvent();
+  postNewMessageEvent();
 }
 void Subscription::abort(const Session &session) {
   _storage.abort(session);
-  _destination.postNewMessageEvent();
+  postNewMessageEvent();
 }
 
-void Subscription::addClient(
-    const Session &session, size_t tcpConnectionNum, const std::string &objectID, const std::string &selector, Subscription::LocalMode localMode) {
+void Subscription::addClient(const Session &session,
+                             size_t tcpConnectionNum,
+                             const std::string &objectID,
+                             const std::string &selector,
+                             Subscription::LocalMode localMode,
+                             int batchSize,
+                             int priority,
+                             int weight) {
   std::stringstream sql;
   // NOTE: if subscription is browser then make client_id more unique
   std::string clientID = session.connection().clientID();
@@ -202,7 +212,7 @@ void Subscription::addClient(
     selectCache = std::make_shared<std::deque<std::shared_ptr<MessageDataContainer>>>();
   }
 
-  _destination.addToNotAckList(objectID, session.connection().maxNotAcknowledgedMessages(tcpConnectionNum));
+  const uint32_t consumerHandle = _destination.addToNotAckList(objectID, session.connection().maxNotAcknowledgedMessages(tcpConnectionNum));
 
   upmq::ScopedWriteRWLock writeRWLock(_consumersLock);
   _consumers.emplace_back(Consumer::genConsumerID(clientID, std::to_string(tcpConnectionNum), session.id(), selector),
@@ -217,6 +227,10 @@ void Subscription::addClient(
                                    _type == Type::BROWSER,
                                    session.connection().maxNotAcknowledgedMessages(tcpConnectionNum),
                                    selectCache));
+  _consumers.back().second.batchSize = batchSize;
+  _consumers.back().second.priority = priority;
+  _consumers.back().second.weight = (weight > 0) ? weight : 1;
+  _consumers.back().second.handle = consumerHandle;
 }
 const std::string &Subscription::routingKey() const { return _routingKey; }
 void Subscription::onEvent(const void *pSender, const MessageDataContainer *&sMessage) {
@@ -236,7 +250,7 @@ void Subscription::onEvent(const void *pSender, const MessageDataContainer *&sMe
 bool Subscription::isDurable() const { return _type == Type::DURABLE; }
 bool Subscription::isBrowser() const { return _type == Type::BROWSER; }
 void Subscription::start() {
-  _destination.postNewMessageEvent();
+  postNewMessageEvent();
   if (*_isRunning) {
     return;
   }
@@ -273,18 +287,20 @@ void Subscription::start(const Consumer &consumer) {
   start();
 }
 void Subscription::recover() {
-  upmq::ScopedReadRWLock readRWLock(_consumersLock);
+  upmq::ScopedWriteRWLock writeRWLock(_consumersLock);
   for (const auto &consumer : _consumers) {
     _storage.setMessagesToNotSent(consumer.second);
     consumer.second.select->clear();
   }
+  _groupMessages.clear();
 }
 void Subscription::recover(const Consumer &consumer) {
   try {
-    upmq::ScopedReadRWLock readRWLock(_consumersLock);
+    upmq::ScopedWriteRWLock writeRWLock(_consumersLock);
     const Consumer &cons = byClientAndHandlerAndSessionIDs(consumer.clientID, consumer.tcpNum, consumer.session.id);
     _storage.setMessagesToNotSent(cons);
     cons.select->clear();
+    _groupMessages.erase(cons.objectID);
   } catch (Exception &ex) {
     UNUSED_VAR(ex);
   }
@@ -294,79 +310,110 @@ Subscription::ProcessMessageResult Subscription::getNextMessage() {
   std::string messageID;
   ScopedWriteTryLocker swTryLocker(_consumersLock, false);
   if (swTryLocker.tryLock()) {
-    const Consumer *consumer = at(_currentConsumerNumber);
-    if ((consumer == nullptr) || !consumer->isRunning) {
-      changeCurrentConsumerNumber();
-      swTryLocker.unlock();
-      return ProcessMessageResult::CONSUMER_NOT_RAN;
-    }
-    if (!_destination.canSendNextMessages(consumer->objectID)) {
+    ProcessMessageResult notReady = ProcessMessageResult::CONSUMER_NOT_RAN;
+    const Consumer *consumer = nextConsumer(notReady);
+    if (consumer == nullptr) {
+      if (notReady == ProcessMessageResult::CONSUMER_NOT_RAN) {
+        changeCurrentConsumerNumber();
+      }
       swTryLocker.unlock();
-      return ProcessMessageResult::CONSUMER_CANT_SEND;
+      return notReady;
     }
 
     std::shared_ptr<MessageDataContainer> sMessage;
     Storage &storage = (_destination.isQueueFamily() && !isBrowser()) ? _destination.storage() : _storage;
-    const bool useFileLink = _destination.isSubscriberUseFileLink(consumer->clientID);
+    bool useFileLink = _destination.isSubscriberUseFileLink(consumer->clientID);
     size_t consumersSize = _consumers.size();
+    const bool withGroups = useGroups(storage);
+    size_t batchSize = (consumer->batchSize > 1) ? static_cast<size_t>(consumer->batchSize) : 1;
+    std::vector<std::shared_ptr<MessageDataContainer>> batch;
+    size_t idleSelectors = 0;
+    bool tryNextSelector = false;
+    auto flushBatch = [this, &consumer, &batch]() {
+      try {
+        deliverBatch(*consumer, batch);
+      } catch (Exception &ex) {
+        batch.clear();
+        log->error("%s", std::to_string(consumer->tcpNum).append(" ! <= [").append("deliverBatch").append("] ").append(ex.message()));
+      }
+    };
     do {
+      tryNextSelector = false;
       try {
-        sMessage = storage.get(*consumer, useFileLink);
+        sMessage = takeGroupMessage(*consumer);
+        if (!sMessage) {
+          sMessage = storage.get(*consumer, useFileLink);
+        }
       } catch (Exception &ex) {
+        flushBatch();
         consumer->select->clear();
         log->error("%s", std::string(consumer->clientID).append(" ! <= [").append(std::string(__FUNCTION__)).append("] ").append(ex.message()));
         swTryLocker.unlock();
         return ProcessMessageResult::SOME_ERROR;
       } catch (std::exception &stdex) {
+        flushBatch();
         consumer->select->clear();
         log->error("%s", std::string(consumer->clientID).append(" ! <= [").append(std::string(__FUNCTION__)).append("] ").append(stdex.what()));
         swTryLocker.unlock();
         return ProcessMessageResult::SOME_ERROR;
       }
       if (sMessage) {
-        if (!sMessage->message().has_group_id()) {
+        groupID = sMessage->groupID;
+        if (withGroups && !groupID.empty()) {
+          const Consumer *owner = groupOwner(storage, *consumer, useFileLink, groupID);
+          if ((owner != nullptr) && (owner != consumer)) {
+            flushBatch();
+            parkGroupMessage(storage, *owner, std::move(sMessage));
+            swTryLocker.unlock();
+            return ProcessMessageResult::OK_COMPLETE;
+          }
+          storage.groups().assign(groupID, consumer->objectID, sMessage->messageID(), sMessage->groupSeq());
+          changeCurrentConsumerNumber();
+        } else if (!sMessage->hasGroupID()) {
           changeCurrentConsumerNumber();
-          groupID.clear();
-        } else {
-          groupID = sMessage->message().group_id();
         }
 
-        messageID = sMessage->message().message_id();
-        sMessage->protoMessage().set_request_reply_id(0);
+        messageID = sMessage->messageID();
+        sMessage->setRRID(0);
+        if (!_destination.canSendMessage(consumer->handle, *sMessage)) {
+          // NOTE: the message waits for the credit in front of the messages parked for the consumer,
+          // the consumer isn't ready until then, so the other consumers are dispatched in the next pass
+          flushBatch();
+          _groupMessages[consumer->objectID].emplace_front(std::move(sMessage));
+          swTryLocker.unlock();
+          return ProcessMessageResult::OK_COMPLETE;
+        }
+        _destination.tracer().dispatched(messageID, sMessage->traces);
 
         try {
-          sMessage->serialize();
-          AHRegestry::Instance().put(consumer->tcpNum, std::move(sMessage));
-          ++_messageCounter;
-          const size_t tid = (size_t)(Poco::Thread::currentTid());
-          log->information("%s",
-                           std::to_string(consumer->tcpNum)
-                               .append(" * <= from subs => ")
-                               .append(_name)
-                               .append(" : consumer [ tid(")
-                               .append(std::to_string(tid))
-                               .append(") ")
-                               .append(std::to_string(consumer->num))
-                               .append(":")
-                               .append(consumer->clientID)
-                               .append(":")
-                               .append((useFileLink ? "use_file_link" : "standard"))
-                               .append("] to client : ")
-                               .append(consumer->objectID)
-                               .append(" >> send message [")
-                               .append(messageID)
-                               .append("] (")
-                               .append(std::to_string(_messageCounter))
-                               .append(")"));
-
-          _destination.decreesNotAcknowledged(consumer->objectID);
-          if (consumer->session.type == Proto::Acknowledge::CLIENT_ACKNOWLEDGE || !consumer->select->empty()) {
-            EXCHANGE::Instance().addNewMessageEvent(_destination.name());
+          int64_t deliverySize = 0;
+          if ((batchSize > 1) && !sMessage->withFile()) {
+            // NOTE: the frame is sent when the batch is full or the consumer has no more ready messages
+            deliverySize = static_cast<int64_t>(sMessage->headerSize() + sMessage->dataSize());
+            batch.emplace_back(std::move(sMessage));
+            if (batch.size() >= batchSize) {
+              deliverBatch(*consumer, batch);
+            }
+          } else {
+            deliverBatch(*consumer, batch);
+            sMessage->serialize();
+            deliverySize = static_cast<int64_t>(sMessage->header.size() + sMessage->dataSize());
+            AHRegestry::Instance().put(consumer->tcpNum, std::move(sMessage));
+            _destination.countDequeued(1);
           }
+          _destination.decreaseCredit(consumer->handle, deliverySize);
+          ++_messageCounter;
+          BROKER_INFORMATION(log,
+                             consumer->tcpNum << " * <= from subs => " << _name << " : consumer [ tid(" << (size_t)(Poco::Thread::currentTid())
+                                              << ") " << consumer->num << ":" << consumer->clientID << ":"
+                                              << (useFileLink ? "use_file_link" : "standard") << "] to client : " << consumer->objectID
+                                              << " >> send message [" << messageID << "] (" << _messageCounter << ")");
+
+          _destination.decreesNotAcknowledged(consumer->handle);
           if (_destination.isQueueFamily() && _destination.consumerMode() == ConsumerMode::ROUND_ROBIN) {
             for (const auto &cn : _consumers) {
-              if (cn.second.objectID != consumer->objectID) {
-                _destination.decreesNotAcknowledged(cn.second.objectID);
+              if (cn.second.handle != consumer->handle) {
+                _destination.decreesNotAcknowledged(cn.second.handle);
               }
             }
             changeCurrentConsumerNumber();
@@ -380,24 +427,109 @@ Subscription::ProcessMessageResult Subscription::getNextMessage() {
             if (_consumers.empty()) {
               *_isRunning = false;
             }
+          } else {
+            flushBatch();
           }
           swTryLocker.unlock();
           return ProcessMessageResult::SOME_ERROR;
         }
       } else {
+        flushBatch();
         messageID.clear();
         if (consumersWithSelectorsOnly()) {
           changeCurrentConsumerNumber();
+          // NOTE: the selector matches nothing, the other consumers are tried in this pass instead of a new event
+          if (++idleSelectors < consumersSize) {
+            consumer = nextConsumer(notReady);
+            if (consumer == nullptr) {
+              swTryLocker.unlock();
+              return notReady;
+            }
+            useFileLink = _destination.isSubscriberUseFileLink(consumer->clientID);
+            batchSize = (consumer->batchSize > 1) ? static_cast<size_t>(consumer->batchSize) : 1;
+            tryNextSelector = true;
+            continue;
+          }
         }
         swTryLocker.unlock();
         return ProcessMessageResult::NO_MESSAGE;
       }
-    } while (consumersSize == 1 && !consumer->select->empty());
+      // NOTE: the batch of the consumer is filled up before the next consumer is chosen, whatever the count of consumers
+    } while (tryNextSelector || (((consumersSize == 1 && !consumer->select->empty()) || !batch.empty()) &&
+                                 _destination.canSendNextMessages(consumer->handle) && !isConsumerOutputFull(*consumer)));
+    flushBatch();
     swTryLocker.unlock();
     return ProcessMessageResult::OK_COMPLETE;
   }
   return ProcessMessageResult::CONSUMER_LOCKED;
 }
+void Subscription::deliverBatch(const Consumer &consumer, std::vector<std::shared_ptr<MessageDataContainer>> &batch) const {
+  if (batch.empty()) {
+    return;
+  }
+  std::shared_ptr<MessageDataContainer> frame;
+  if (batch.size() == 1) {
+    frame = std::move(batch.front());
+  } else {
+    frame = MessageDataContainer::make();
+    frame->serializeMessageBatch(consumer.objectID, batch);
+    for (auto &item : batch) {
+      std::move(item->traces.begin(), item->traces.end(), std::back_inserter(frame->traces));
+    }
+  }
+  _destination.countDequeued(batch.size());
+  batch.clear();
+  frame->serialize();
+  AHRegestry::Instance().put(consumer.tcpNum, std::move(frame));
+}
+bool Subscription::useGroups(const Storage &storage) const {
+  // NOTE: consumers of the round robin queue share the select cache, so the group has to be bound to the consumer
+  return (&storage == &_destination.storage()) && _destination.consumerMode() == ConsumerMode::ROUND_ROBIN;
+}
+const Consumer *Subscription::groupOwner(const Storage &storage, const Consumer &consumer, bool useFileLink, const std::string &groupID) const {
+  int outstanding = 0;
+  const std::string ownerID = storage.groups().owner(groupID, outstanding);
+  if (ownerID.empty() || (ownerID == consumer.objectID)) {
+    return nullptr;
+  }
+  for (const auto &item : _consumers) {
+    const Consumer &owner = item.second;
+    if (owner.objectID != ownerID) {
+      continue;
+    }
+    // NOTE: the group is taken over if its owner is stopped and nothing of the group is on the way to it
+    auto parked = _groupMessages.find(ownerID);
+    const bool hasParked = (parked != _groupMessages.end()) && !parked->second.empty();
+    if (!owner.isRunning && (outstanding == 0) && !hasParked) {
+      return nullptr;
+    }
+    if (owner.selector || (_destination.isSubscriberUseFileLink(owner.clientID) != useFileLink)) {
+      return nullptr;
+    }
+    return &owner;
+  }
+  return nullptr;
+}
+void Subscription::parkGroupMessage(Storage &storage, const Consumer &owner, std::shared_ptr<MessageDataContainer> sMessage) {
+  storage.setMessageConsumer(sMessage->messageID(), owner);
+  sMessage->setObjectID(owner.objectID);
+  sMessage->resetSessionId(owner.session.id);
+  sMessage->clientID = Poco::replace(owner.clientID, "-browser", "");
+  sMessage->handlerNum = owner.tcpNum;
+  _groupMessages[owner.objectID].emplace_back(std::move(sMessage));
+}
+std::shared_ptr<MessageDataContainer> Subscription::takeGroupMessage(const Consumer &consumer) {
+  auto it = _groupMessages.find(consumer.objectID);
+  if (it == _groupMessages.end()) {
+    return {};
+  }
+  std::shared_ptr<MessageDataContainer> sMessage = std::move(it->second.front());
+  it->second.pop_front();
+  if (it->second.empty()) {
+    _groupMessages.erase(it);
+  }
+  return sMessage;
+}
 void Subscription::changeCurrentConsumerNumber() const {
   if (_consumers.empty()) {
     _currentConsumerNumber = 0;
@@ -405,7 +537,75 @@ void Subscription::changeCurrentConsumerNumber() const {
     ++_currentConsumerNumber;
     _currentConsumerNumber %= _consumers.size();
   }
-  EXCHANGE::Instance().addNewMessageEvent(_destination.name());
+}
+void Subscription::postNewMessageEvent() const { _destination.postSubscriptionEvent(*this); }
+void Subscription::setHasEvents() const { _hasEvents->store(true, std::memory_order_release); }
+bool Subscription::takeEvents() const { return _hasEvents->exchange(false, std::memory_order_acq_rel); }
+const Consumer *Subscription::nextConsumer(ProcessMessageResult &notReady) const {
+  const size_t count = _consumers.size();
+  notReady = ProcessMessageResult::CONSUMER_NOT_RAN;
+  if (count == 0) {
+    return nullptr;
+  }
+  // NOTE: consumers are visited from the current one, so the ties are rotated like in the plain round-robin
+  auto consumerAt = [this, count](size_t k) -> const Consumer & { return _consumers[count - 1 - ((_currentConsumerNumber + k) % count)].second; };
+  auto isReady = [this](const Consumer &consumer) {
+    return consumer.isRunning && _destination.canSendNextMessages(consumer.handle) && !isConsumerOutputFull(consumer);
+  };
+  if (count == 1) {
+    const Consumer &consumer = consumerAt(0);
+    if (!consumer.isRunning) {
+      return nullptr;
+    }
+    if (!isReady(consumer)) {
+      notReady = ProcessMessageResult::CONSUMER_CANT_SEND;
+      return nullptr;
+    }
+    return &consumer;
+  }
+
+  std::vector<std::pair<size_t, const Consumer *>> ready;
+  ready.reserve(count);
+  int priority = 0;
+  for (size_t k = 0; k < count; ++k) {
+    const Consumer &consumer = consumerAt(k);
+    if (!consumer.isRunning) {
+      continue;
+    }
+    notReady = ProcessMessageResult::CONSUMER_CANT_SEND;
+    if (isReady(consumer)) {
+      if (ready.empty() || (consumer.priority > priority)) {
+        priority = consumer.priority;
+      }
+      ready.emplace_back(k, &consumer);
+    }
+  }
+  if (ready.empty()) {
+    return nullptr;
+  }
+
+  // NOTE: smooth weighted round-robin among ready consumers of the highest priority,
+  // busy consumers are skipped and don't accumulate the weight
+  // consumers with selectors could wait for different messages, so the priority isn't applied to them
+  const bool usePriority = !consumersWithSelectorsOnly();
+  const Consumer *chosen = nullptr;
+  size_t chosenNum = 0;
+  int64_t totalWeight = 0;
+  for (const auto &item : ready) {
+    const Consumer &consumer = *item.second;
+    if (usePriority && (consumer.priority != priority)) {
+      continue;
+    }
+    consumer.currentWeight += consumer.weight;
+    totalWeight += consumer.weight;
+    if ((chosen == nullptr) || (consumer.currentWeight > chosen->currentWeight)) {
+      chosen = &consumer;
+      chosenNum = item.first;
+    }
+  }
+  chosen->currentWeight -= totalWeight;
+  _currentConsumerNumber = (_currentConsumerNumber + chosenNum) % count;
+  return chosen;
 }
 const Consumer *Subscription::at(size_t index) const {
   auto consEnd = _consumers.rend();
@@ -446,7 +646,9 @@ Subscription::ConsumersListType::iterator Subscription::eraseConsumer(ConsumersL
   sql << "delete from " << _consumersT << " where object_id = \'" << it->second.objectID << "\';";
   TRY_POCO_DATA_EXCEPTION { dbms::Instance().doNow(sql.str()); }
   CATCH_POCO_DATA_EXCEPTION_PURE_NO_INVALIDEXCEPT_NO_EXCEPT("can't remove consumer", sql.str(), ERROR_ON_UNSUBSCRIPTION)
-  _destination.remFromNotAck(it->second.objectID);
+  _destination.remFromNotAck(it->second.handle);
+  _groupMessages.erase(it->second.objectID);
+  _destination.storage().groups().release(it->second.objectID);
   return _consumers.erase(it);
 }
 bool Subscription::removeClient(size_t tcpConnectionNum, const std::string &sessionID) {
@@ -463,7 +665,7 @@ bool Subscription::removeClient(size_t tcpConnectionNum, const std::string &sess
     return result;
   }
 
-  _destination.postNewMessageEvent();
+  postNewMessageEvent();
 
   return result;
 }
@@ -561,6 +763,14 @@ bool Subscription::consumersWithSelectorsOnly() const {
   }
   return false;
 }
+bool Subscription::isConsumerOutputFull(const Consumer &consumer) const {
+  auto ahandler = AHRegestry::Instance().aHandler(consumer.tcpNum);
+  if ((ahandler != nullptr) && ahandler->isOutputFull()) {
+    ahandler->waitOutput(_destination.name());
+    return true;
+  }
+  return false;
+}
 bool Subscription::hasSnapshot() const { return _hasSnapshot; }
 void Subscription::setHasSnapshot(bool hasSnapshot) { _hasSnapshot = hasSnapshot; }
 Subscription::Info Subscription::info() const {
@@ -568,6 +778,11 @@ Subscription::Info Subscription::info() const {
   return Subscription::Info(_id, _name, _type, static_cast<int>(_consumers.size()), _messageCounter, *_isRunning);
 }
 
+size_t Subscription::consumersCount() const {
+  upmq::ScopedReadRWLock readRWLock(_consumersLock);
+  return _consumers.size();
+}
+
 void Subscription::resetConsumersCache() {
   upmq::ScopedReadRWLock readRWLock(_consumersLock);
   for (auto &consumer : _consumers) {
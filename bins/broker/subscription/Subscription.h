@@ -79,6 +79,8 @@ class Subscription {
   mutable Storage _storage;
   const Destination &_destination;
   std::unique_ptr<std::atomic_bool> _isRunning;
+  // NOTE: the subscription got events, the destination dispatches only subscriptions with events
+  std::unique_ptr<std::atomic_bool> _hasEvents;
   mutable size_t _currentConsumerNumber;
   std::string _consumersT;
 
@@ -89,6 +91,11 @@ class Subscription {
   mutable bool _isInited;
   mutable bool _hasSnapshot;
   std::shared_ptr<std::deque<std::shared_ptr<MessageDataContainer>>> _roundRobinCache;
+  /// @brief GroupMessagesList - map<object_id, messages of the groups owned by the consumer>
+  /// ** message of the group is parked here if it's taken from the round robin cache by another consumer
+  /// ** message that doesn't fit the credit window of the consumer is parked here too
+  using GroupMessagesList = std::unordered_map<std::string, std::deque<std::shared_ptr<MessageDataContainer>>>;
+  GroupMessagesList _groupMessages;
 
  public:
   Subscription(const upmq::broker::Destination &destination,
@@ -104,8 +111,14 @@ class Subscription {
   void commit(const Session &session);
   void abort(const Session &session);
 
-  void addClient(
-      const Session &session, size_t tcpConnectionNum, const std::string &objectID, const std::string &selector, Subscription::LocalMode localMode);
+  void addClient(const Session &session,
+                 size_t tcpConnectionNum,
+                 const std::string &objectID,
+                 const std::string &selector,
+                 Subscription::LocalMode localMode,
+                 int batchSize = 0,
+                 int priority = 0,
+                 int weight = 1);
   bool removeClient(size_t tcpConnectionNum, const std::string &sessionID);
   void removeClients();
   const std::string &routingKey() const;
@@ -138,14 +151,30 @@ class Subscription {
   bool hasSnapshot() const;
   void setHasSnapshot(bool hasSnapshot);
   ProcessMessageResult getNextMessage();
+  // marks the subscription and schedules its destination
+  void postNewMessageEvent() const;
+  void setHasEvents() const;
+  // returns true if the subscription got events since the last call
+  bool takeEvents() const;
   Info info() const;
+  size_t consumersCount() const;
   void resetConsumersCache();
 
  private:
   Subscription::ConsumersListType::iterator eraseConsumer(ConsumersListType::iterator it);
   void changeCurrentConsumerNumber() const;
+  // ready consumer of the highest priority chosen by the weights, nullptr and the reason if nobody is ready
+  const Consumer *nextConsumer(ProcessMessageResult &notReady) const;
+  // sends collected messages as the one MessageBatch frame, the single message is sent as is
+  void deliverBatch(const Consumer &consumer, std::vector<std::shared_ptr<MessageDataContainer>> &batch) const;
   bool allConsumersStopped();
   bool consumersWithSelectorsOnly() const;
+  bool isConsumerOutputFull(const Consumer &consumer) const;
+  bool useGroups(const Storage &storage) const;
+  // owner of the message group, nullptr if the group is free or its owner can't take it
+  const Consumer *groupOwner(const Storage &storage, const Consumer &consumer, bool useFileLink, const std::string &groupID) const;
+  void parkGroupMessage(Storage &storage, const Consumer &owner, std::shared_ptr<MessageDataContainer> sMessage);
+  std::shared_ptr<MessageDataContainer> takeGroupMessage(const Consumer &consumer);
   bool removeConsumer(size_t tcpConnectionNum, const std::string &sessionID);
   void removeConsumers(size_t tcpConnectionNum);
 };
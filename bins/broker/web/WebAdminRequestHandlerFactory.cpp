@@ -16,8 +16,14 @@
 
 #include "WebAdminRequestHandlerFactory.h"
 #include "WebAdminRequestHandler.h"
+#include "MetricsRequestHandler.h"
+#include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/URI.h>
 
 Poco::Net::HTTPRequestHandler *WebAdminRequestHandlerFactory::createRequestHandler(const Poco::Net::HTTPServerRequest &request) {
-  (void)request;
+  // NOTE: scrapers could add the query string, so only the path is compared
+  if (Poco::URI(request.getURI()).getPath() == "/metrics") {
+    return new MetricsRequestHandler;
+  }
   return new WebAdminRequestHandler;
 }
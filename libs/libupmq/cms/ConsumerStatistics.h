@@ -0,0 +1,45 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _CMS_CONSUMERSTATISTICS_H_
+#define _CMS_CONSUMERSTATISTICS_H_
+
+#include <cms/Config.h>
+
+namespace cms {
+
+/**
+ * Counters of the frames received by the consumer, it's implemented by the consumers of the provider.
+ *
+ * @since 1.2
+ */
+class CMS_API ConsumerStatistics {
+ public:
+  virtual ~ConsumerStatistics(){};
+
+  /**
+   * @return count of the frames with the batch of messages (consumer.batchSize) received by the consumer.
+   */
+  virtual long long getReceivedBatches() const = 0;
+
+  /**
+   * @return count of the messages received by the consumer in the batches.
+   */
+  virtual long long getReceivedBatchedMessages() const = 0;
+};
+}  // namespace cms
+
+#endif /*_CMS_CONSUMERSTATISTICS_H_*/
@@ -89,8 +89,9 @@ class TcpSocketImpl {
   int trafficClass;
   int soTimeout;
   int soLinger;
+  bool localSocket;
 
-  TcpSocketImpl()
+  explicit TcpSocketImpl(bool localSocket_)
       : socketHandle(nullptr),
         handleIsRemote(false),
         localAddress(nullptr),
@@ -103,7 +104,8 @@ class TcpSocketImpl {
         connected(false),
         trafficClass(0),
         soTimeout(-1),
-        soLinger(-1) {}
+        soLinger(-1),
+        localSocket(localSocket_) {}
 };
 }  // namespace tcp
 }  // namespace net
@@ -111,7 +113,10 @@ class TcpSocketImpl {
 }  // namespace decaf
 
 ////////////////////////////////////////////////////////////////////////////////
-TcpSocket::TcpSocket() : impl(new TcpSocketImpl) {}
+TcpSocket::TcpSocket() : impl(new TcpSocketImpl(false)) {}
+
+////////////////////////////////////////////////////////////////////////////////
+TcpSocket::TcpSocket(bool localSocket) : impl(new TcpSocketImpl(localSocket)) {}
 
 ////////////////////////////////////////////////////////////////////////////////
 TcpSocket::~TcpSocket() {
@@ -154,7 +159,15 @@ void TcpSocket::create() {
     }
 
     // Create the actual socket.
-    this->impl->socketHandle = std::make_unique<Poco::Net::StreamSocket>(Poco::Net::SocketAddress::Family::IPv4);
+    if (this->impl->localSocket) {
+#ifdef POCO_HAS_UNIX_SOCKET
+      this->impl->socketHandle = std::make_unique<Poco::Net::StreamSocket>(Poco::Net::SocketAddress::Family::UNIX_LOCAL);
+#else
+      throw UnsupportedOperationException(__FILE__, __LINE__, "Unix domain sockets are not supported on this platform.");
+#endif
+    } else {
+      this->impl->socketHandle = std::make_unique<Poco::Net::StreamSocket>(Poco::Net::SocketAddress::Family::IPv4);
+    }
 
     // Initialize the Socket's FileDescriptor
     this->fd = new SocketFileDescriptor(static_cast<long>(this->impl->socketHandle->impl()->sockfd()));
@@ -288,7 +301,15 @@ void TcpSocket::connect(const std::string &hostname, int bindPort, int timeout)
     }
 
     // Create the Address data
-    impl->remoteAddress = std::make_unique<Poco::Net::SocketAddress>(Poco::Net::AddressFamily::IPv4, hostname, static_cast<Poco::UInt16>(bindPort));
+    if (impl->localSocket) {
+#ifdef POCO_HAS_UNIX_SOCKET
+      impl->remoteAddress = std::make_unique<Poco::Net::SocketAddress>(Poco::Net::SocketAddress::Family::UNIX_LOCAL, hostname);
+#else
+      throw UnsupportedOperationException(__FILE__, __LINE__, "Unix domain sockets are not supported on this platform.");
+#endif
+    } else {
+      impl->remoteAddress = std::make_unique<Poco::Net::SocketAddress>(Poco::Net::AddressFamily::IPv4, hostname, static_cast<Poco::UInt16>(bindPort));
+    }
 
     bool oldNonblockSetting = 0;
     Poco::Timespan oldRecvTimeoutSetting = 0;
@@ -352,6 +373,9 @@ void TcpSocket::connect(const std::string &hostname, int bindPort, int timeout)
 ////////////////////////////////////////////////////////////////////////////////
 std::string TcpSocket::getLocalAddress() const {
   if (!isClosed()) {
+    if (this->impl->localSocket) {
+      return this->impl->socketHandle->address().toString();
+    }
     return this->impl->socketHandle->address().host().toString();
   }
 
@@ -521,7 +545,8 @@ int TcpSocket::getOption(int option) const {
     } else if (option == SocketOptions::SOCKET_OPTION_RCVBUF) {
       value = impl->socketHandle->getReceiveBufferSize();
     } else if (option == SocketOptions::SOCKET_OPTION_TCP_NODELAY) {
-      value = impl->socketHandle->getNoDelay();
+      // unix domain socket doesn't buffer small writes
+      value = impl->localSocket ? 1 : impl->socketHandle->getNoDelay();
     } else if (option == SocketOptions::SOCKET_OPTION_KEEPALIVE) {
       value = impl->socketHandle->getKeepAlive();
     } else {
@@ -564,7 +589,9 @@ void TcpSocket::setOption(int option, int value) {
     } else if (option == SocketOptions::SOCKET_OPTION_RCVBUF) {
       impl->socketHandle->setReceiveBufferSize(value);
     } else if (option == SocketOptions::SOCKET_OPTION_TCP_NODELAY) {
-      impl->socketHandle->setNoDelay(value > 0);
+      if (!impl->localSocket) {
+        impl->socketHandle->setNoDelay(value > 0);
+      }
     } else if (option == SocketOptions::SOCKET_OPTION_KEEPALIVE) {
       impl->socketHandle->setKeepAlive(value > 0);
     } else {
@@ -53,6 +53,17 @@ class DECAF_API TcpSocket : public decaf::net::SocketImpl {
    */
   TcpSocket();
 
+  /**
+   * Construct a non-connected socket.
+   *
+   * @param localSocket
+   *      if true the socket is a unix domain socket, the host name given to connect
+   *      is the path of the socket file and the port is ignored.
+   *
+   * @throws SocketException thrown if an error occurs while creating the Socket.
+   */
+  explicit TcpSocket(bool localSocket);
+
   /**
    * Releases the socket handle but not gracefully shut down the connection.
    */
@@ -28,6 +28,7 @@
 #include <transport/failover/FailoverTransportFactory.h>
 #include <transport/tcp/TcpTransport.h>
 
+#include <decaf/lang/Long.h>
 #include <decaf/util/UUID.h>
 #include <utility>
 using namespace upmq;
@@ -50,6 +51,13 @@ ConnectionImpl::ConnectionImpl(const string &uri, const string &username, const
       _uriInternal(uri),
       _uri(),
       _transportWait(),
+      _maxOutputBytes(0),
+      _consumerCreditBytes(0),
+      _consumerBatchSize(0),
+      _consumerAckBatchSize(0),
+      _consumerAckBatchTimeout(0),
+      _consumerPriority(0),
+      _consumerWeight(1),
       _closed(false),
       _started(false),
       _stoped(false) {
@@ -62,6 +70,13 @@ ConnectionImpl::ConnectionImpl(const string &uri, const string &username, const
 
     Properties properties = upmq::transport::URISupport::parseQuery(_uri.getQuery());
     _transportWait = Integer::parseInt(properties.getProperty("transport.wait", "30000"));
+    _maxOutputBytes = Long::parseLong(properties.getProperty("connection.maxOutputBytes", "0"));
+    _consumerCreditBytes = Long::parseLong(properties.getProperty("consumer.creditBytes", "0"));
+    _consumerBatchSize = Integer::parseInt(properties.getProperty("consumer.batchSize", "0"));
+    _consumerAckBatchSize = Integer::parseInt(properties.getProperty("consumer.ackBatchSize", "0"));
+    _consumerAckBatchTimeout = Long::parseLong(properties.getProperty("consumer.ackBatchTimeout", "100"));
+    _consumerPriority = Integer::parseInt(properties.getProperty("consumer.priority", "0"));
+    _consumerWeight = Integer::parseInt(properties.getProperty("consumer.weight", "1"));
 
     transport = TransportRegistry::getInstance().findFactory(_uri.getScheme())->create(_uri);
     if (transport.get() == nullptr) {
@@ -75,6 +90,9 @@ ConnectionImpl::ConnectionImpl(const string &uri, const string &username, const
     request->getProtoMessage().set_object_id(_objectId);
 
     request->getConnect().set_client_id(_objectId);
+    if (_maxOutputBytes > 0) {
+      request->getConnect().set_max_output_bytes(_maxOutputBytes);
+    }
     if (!request->getConnect().IsInitialized()) {
       throw cms::CMSException("request not initialized");
     }
@@ -295,6 +313,25 @@ Pointer<Response> ConnectionImpl::asyncRequest(Pointer<Command> command) {
   CATCH_ALL_THROW_CMSEXCEPTION
 }
 
+void ConnectionImpl::oneway(Pointer<Command> command) {
+  try {
+    this->transport->oneway(std::move(command));
+  }
+  CATCH_ALL_THROW_CMSEXCEPTION
+}
+
+long long ConnectionImpl::getConsumerCreditBytes() const { return _consumerCreditBytes; }
+
+int ConnectionImpl::getConsumerBatchSize() const { return _consumerBatchSize; }
+
+int ConnectionImpl::getConsumerAckBatchSize() const { return _consumerAckBatchSize; }
+
+long long ConnectionImpl::getConsumerAckBatchTimeout() const { return _consumerAckBatchTimeout; }
+
+int ConnectionImpl::getConsumerPriority() const { return _consumerPriority; }
+
+int ConnectionImpl::getConsumerWeight() const { return _consumerWeight; }
+
 void ConnectionImpl::addDispatcher(ConsumerImpl *consumerImpl) {
   try {
     synchronized(&_lockCommand) { _dispatchersMap.insert(make_pair(consumerImpl->getObjectId(), consumerImpl)); }
@@ -359,6 +396,13 @@ void ConnectionImpl::onCommand(Pointer<Command> command) {
             // cout << " to consumer " << dispatcher->getObjectId() << endl;
           }
         }
+      } else if (upmqCommand->_header->ProtoMessageType_case() == Proto::ProtoMessage::kMessageBatch) {
+        synchronized(&_lockCommand) {
+          ConsumerImpl *dispatcher = getDispatcher(upmqCommand->getObjectId());
+          if (dispatcher != nullptr) {
+            dispatcher->dispatchBatch(command);
+          }
+        }
       }
     }
   }
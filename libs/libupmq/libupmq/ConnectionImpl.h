@@ -88,6 +88,14 @@ class ConnectionImpl : public cms::Connection, public TransportListener {
 
   Pointer<Response> syncRequest(Pointer<Command> command);
   Pointer<Response> asyncRequest(Pointer<Command> command);
+  void oneway(Pointer<Command> command);
+
+  long long getConsumerCreditBytes() const;
+  int getConsumerBatchSize() const;
+  int getConsumerAckBatchSize() const;
+  long long getConsumerAckBatchTimeout() const;
+  int getConsumerPriority() const;
+  int getConsumerWeight() const;
 
   bool isAlive() const;
   bool isStarted() const;
@@ -117,6 +125,13 @@ class ConnectionImpl : public cms::Connection, public TransportListener {
   string _uriInternal;
   URI _uri;
   int _transportWait;
+  long long _maxOutputBytes;
+  long long _consumerCreditBytes;
+  int _consumerBatchSize;
+  int _consumerAckBatchSize;
+  long long _consumerAckBatchTimeout;
+  int _consumerPriority;
+  int _consumerWeight;
 
   bool _closed;
   bool _started;
@@ -21,11 +21,13 @@
 
 #include "BytesMessageImpl.h"
 #include "MapMessageImpl.h"
+#include "MessageFactoryImpl.h"
 #include "MessageImpl.h"
 #include "ObjectMessageImpl.h"
 #include "StreamMessageImpl.h"
 #include "TextMessageImpl.h"
 
+#include <decaf/lang/System.h>
 #include <decaf/lang/exceptions/InterruptedException.h>
 #include <decaf/util/UUID.h>
 
@@ -33,6 +35,7 @@
 #include <transport/FifoMessageDispatchChannel.h>
 #include <transport/UPMQCommand.h>
 
+#include <cstring>
 #include <stdexcept>
 #include <utility>
 
@@ -59,10 +62,23 @@ ConsumerImpl::ConsumerImpl(
       _messageListener(nullptr),
       _browserCount(0),
       _onMessageThread(nullptr),
-      _activeOnMessageLock(new ReentrantLock()) {
+      _activeOnMessageLock(new ReentrantLock()),
+      _creditBytes(0),
+      _batchSize(0),
+      _ackBatchSize(0),
+      _ackBatchTimeout(0),
+      _pendingAcksSince(0),
+      _bufferedBytes(0),
+      _consumedBytes(0),
+      _receivedBatches(0),
+      _receivedBatchedMessages(0) {
   if (session == nullptr) {
     throw cms::CMSException("invalid session (is null)");
   }
+  _creditBytes = _session->_connection->getConsumerCreditBytes();
+  _batchSize = _session->_connection->getConsumerBatchSize();
+  _ackBatchSize = _session->_connection->getConsumerAckBatchSize();
+  _ackBatchTimeout = _session->_connection->getConsumerAckBatchTimeout();
 
   try {
     _messageQueue = new SimplePriorityMessageDispatchChannel();
@@ -113,6 +129,7 @@ void ConsumerImpl::start() {
 
 void ConsumerImpl::stop() {
   try {
+    flushAcks();
     unsubscribe();
 
     setStarted(false);
@@ -120,6 +137,7 @@ void ConsumerImpl::stop() {
 
     _messageQueue->clear();
     _messageQueue->stop();
+    grantCredit(_bufferedBytes.exchange(0), true);
 
     if (_onMessageThread != nullptr) {
       _messageQueue->close();  // need areceive return before join
@@ -148,6 +166,7 @@ void ConsumerImpl::close() {
 
     if (isStarted() || (isStoped() && !isClosed())) {
       try {
+        flushAcks();
         unsubscription();
       }
       CATCH_ALL_NOTHROW
@@ -198,6 +217,24 @@ void ConsumerImpl::subscription() {
 
     subscription.set_browse(getType() == Type::BROWSER);
 
+    if (_creditBytes > 0) {
+      subscription.set_credit_bytes(_creditBytes);
+      _bufferedBytes = 0;
+      _consumedBytes = 0;
+    }
+
+    if (_batchSize > 1) {
+      subscription.set_batch_size(_batchSize);
+    }
+
+    if (_session->_connection->getConsumerPriority() != 0) {
+      subscription.set_priority(_session->_connection->getConsumerPriority());
+    }
+
+    if (_session->_connection->getConsumerWeight() > 1) {
+      subscription.set_weight(_session->_connection->getConsumerWeight());
+    }
+
     if (!subscription.IsInitialized()) {
       throw cms::CMSException("request not initialized");
     }
@@ -374,9 +411,7 @@ cms::Message *ConsumerImpl::receive() {
       command.reset(nullptr);
     } while (message->isExpired());
 
-    if (_session->getAcknowledgeMode() != cms::Session::CLIENT_ACKNOWLEDGE) {
-      message->acknowledge();
-    }
+    acknowledgeReceived(message);
 
     return message;
   }
@@ -406,9 +441,7 @@ cms::Message *ConsumerImpl::receive(int timeout) {
       message = commandToMessage(std::move(command));
     } while (message->isExpired());
 
-    if (_session->getAcknowledgeMode() != cms::Session::CLIENT_ACKNOWLEDGE) {
-      message->acknowledge();
-    }
+    acknowledgeReceived(message);
 
     return message;
   }
@@ -434,9 +467,7 @@ cms::Message *ConsumerImpl::receiveNoWait() {
       command.reset(nullptr);
     } while (message->isExpired());
 
-    if (_session->getAcknowledgeMode() != cms::Session::CLIENT_ACKNOWLEDGE) {
-      message->acknowledge();
-    }
+    acknowledgeReceived(message);
 
     return message;
   }
@@ -453,9 +484,7 @@ void ConsumerImpl::run() {
       if (msg != nullptr) {
         _activeOnMessageLock->lock();
         if (isStarted() && !isStoped() && _messageListener != nullptr) {
-          if (_session->getAcknowledgeMode() != cms::Session::CLIENT_ACKNOWLEDGE) {
-            msg->acknowledge();
-          }
+          acknowledgeReceived(msg);
           _session->syncOnMessage(_messageListener, msg);
         }
         _activeOnMessageLock->unlock();
@@ -550,6 +579,12 @@ void ConsumerImpl::checkClosed() {
 
 Pointer<Command> ConsumerImpl::dequeue(long long timeout) {
   try {
+    if (_messageQueue->isEmpty()) {
+      // NOTE: coalesced acks must not wait while the consumer sleeps or polls, broker could wait for them
+      flushAcks();
+      // NOTE: broker doesn't send the message bigger than the rest of the window, so the consumed bytes are granted before waiting
+      grantCredit(0, true);
+    }
     return _messageQueue->dequeue(timeout);
   } catch (InterruptedException &) {
     // TODO check
@@ -562,16 +597,129 @@ Pointer<Command> ConsumerImpl::dequeue(long long timeout) {
 
 void ConsumerImpl::dispatch(const Pointer<Command> &message) {
   try {
+    if (_creditBytes > 0) {
+      UPMQCommand *command = dynamic_cast<UPMQCommand *>(message.get());
+      if (command != nullptr) {
+        _bufferedBytes += command->_frameSize;
+      }
+    }
     _messageQueue->enqueue(message);
   }
   CATCH_ALL_THROW_CMSEXCEPTION
 }
 
+void ConsumerImpl::dispatchBatch(const Pointer<Command> &batch) {
+  try {
+    UPMQCommand *command = dynamic_cast<UPMQCommand *>(batch.get());
+    if (command == nullptr) {
+      return;
+    }
+    Proto::MessageBatch *messageBatch = command->_header->mutable_message_batch();
+    const int count = messageBatch->message_size();
+    if (count != messageBatch->body_size_size()) {
+      throw cms::CMSException("invalid message batch");
+    }
+    ++_receivedBatches;
+    _receivedBatchedMessages += count;
+    long long offset = 0;
+    for (int i = 0; i < count; ++i) {
+      const long long bodySize = static_cast<long long>(messageBatch->body_size(i));
+      if (bodySize < 0 || offset + bodySize > command->_bodyBuffSize) {
+        throw cms::CMSException("invalid message batch body size");
+      }
+      Proto::ProtoMessage *header = new Proto::ProtoMessage();
+      header->set_object_id(command->getObjectId());
+      header->set_request_reply_id(0);
+      header->mutable_message()->Swap(messageBatch->mutable_message(i));
+
+      unsigned char *bodyBuff = nullptr;
+      if (bodySize > 0) {
+        bodyBuff = new unsigned char[size_t(bodySize)];
+        memcpy(bodyBuff, command->_bodyBuff + offset, size_t(bodySize));
+      }
+      offset += bodySize;
+
+      Pointer<UPMQCommand> message(MessageFactoryImpl::getProperMessage(header, bodyBuff, bodySize));
+      // NOTE: the broker charges the credit by the size of the separate message frame
+      message->_frameSize = static_cast<long long>(header->ByteSizeLong()) + bodySize;
+      message->setResponse(false);
+
+      long long ttl = header->message().timetolive();
+      if (ttl > 0) {
+        header->mutable_message()->set_expiration(ttl + System::currentTimeMillis());
+      }
+      message->_consumer = this;
+      dispatch(message.dynamicCast<Command>());
+    }
+  }
+  CATCH_ALL_THROW_CMSEXCEPTION
+}
+
+long long ConsumerImpl::getReceivedBatches() const { return _receivedBatches; }
+
+long long ConsumerImpl::getReceivedBatchedMessages() const { return _receivedBatchedMessages; }
+
+void ConsumerImpl::acknowledgeReceived(cms::Message *message) {
+  const cms::Session::AcknowledgeMode mode = _session->getAcknowledgeMode();
+  if (mode == cms::Session::CLIENT_ACKNOWLEDGE) {
+    return;
+  }
+  UPMQCommand *command = dynamic_cast<UPMQCommand *>(message);
+  if (_ackBatchSize <= 1 || command == nullptr || (mode != cms::Session::AUTO_ACKNOWLEDGE && mode != cms::Session::DUPS_OK_ACKNOWLEDGE)) {
+    message->acknowledge();
+    return;
+  }
+  std::lock_guard<std::mutex> lock(_pendingAcksLock);
+  const Proto::Message &protoMessage = command->getMessage();
+  if (!_pendingAcks.empty() && _pendingAcksDestination != protoMessage.destination_uri()) {
+    flushAcksLocked();
+  }
+  if (_pendingAcks.empty()) {
+    _pendingAcksDestination = protoMessage.destination_uri();
+    _pendingAcksSince = System::currentTimeMillis();
+  }
+  _pendingAcks.emplace_back(protoMessage.message_id());
+  if (static_cast<int>(_pendingAcks.size()) >= _ackBatchSize || (System::currentTimeMillis() - _pendingAcksSince) >= _ackBatchTimeout) {
+    flushAcksLocked();
+  }
+}
+
+void ConsumerImpl::flushAcks() {
+  std::lock_guard<std::mutex> lock(_pendingAcksLock);
+  flushAcksLocked();
+}
+
+void ConsumerImpl::flushAcksLocked() {
+  if (_pendingAcks.empty() || _session == nullptr) {
+    return;
+  }
+  Pointer<UPMQCommand> request(new UPMQCommand());
+  request->getProtoMessage().set_object_id(getObjectId());
+
+  Proto::Ack &ack = request->getAck();
+  ack.set_receipt_id(_pendingAcks.front());
+  ack.set_message_id(_pendingAcks.front());
+  for (size_t i = 1; i < _pendingAcks.size(); ++i) {
+    ack.add_message_ids(_pendingAcks[i]);
+  }
+  ack.set_session_id(_session->getObjectId());
+  ack.set_destination_uri(_pendingAcksDestination);
+  ack.set_subscription_name(getSubscription());
+  _pendingAcks.clear();
+
+  if (!ack.IsInitialized()) {
+    throw cms::CMSException("request not initialized");
+  }
+
+  _session->_connection->syncRequest(request.dynamicCast<Command>())->processReceipt();
+}
+
 void ConsumerImpl::purge() {
   try {
     _messageQueue->stop();
     _messageQueue->clear();
     _messageQueue->start();
+    grantCredit(_bufferedBytes.exchange(0), true);
   }
   CATCH_ALL_THROW_CMSEXCEPTION
 }
@@ -589,6 +737,10 @@ cms::Message *ConsumerImpl::commandToMessage(const Pointer<Command>& comm) {
   if (command == nullptr) {
     throw cms::CMSException("error message type");
   }
+  if (_creditBytes > 0) {
+    _bufferedBytes -= command->_frameSize;
+    grantCredit(command->_frameSize);
+  }
   cms::Message *message = nullptr;
   switch (command->getMessage().body_type()) {
     case Proto::Body::BODYTYPE_NOT_SET:
@@ -616,4 +768,34 @@ cms::Message *ConsumerImpl::commandToMessage(const Pointer<Command>& comm) {
   return message;
 }
 
+void ConsumerImpl::grantCredit(long long size, bool force) {
+  if (_creditBytes <= 0 || _session == nullptr || _session->_connection == nullptr) {
+    return;
+  }
+  const long long consumed = (_consumedBytes += size);
+  // NOTE: grant credits by half of window to keep broker sending while client process messages
+  if (consumed <= 0 || (!force && consumed < _creditBytes / 2)) {
+    return;
+  }
+  const long long granted = _consumedBytes.exchange(0);
+  if (granted <= 0) {
+    return;
+  }
+
+  Pointer<UPMQCommand> request(new UPMQCommand());
+  request->getProtoMessage().set_object_id(_objectId);
+
+  Proto::Credit &credit = request->getCredit();
+  credit.set_destination_uri(_destination->getUri());
+  credit.set_subscription_name(getSubscription());
+  credit.set_session_id(_session->getObjectId());
+  credit.set_credit_bytes(granted);
+
+  if (!credit.IsInitialized()) {
+    throw cms::CMSException("request not initialized");
+  }
+
+  _session->_connection->oneway(request.dynamicCast<Command>());
+}
+
 #endif  //__MapMessageImpl_CPP__
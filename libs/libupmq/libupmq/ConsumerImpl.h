@@ -17,8 +17,14 @@
 #ifndef __MessageConsumerImpl_H__
 #define __MessageConsumerImpl_H__
 
+#include <cms/ConsumerStatistics.h>
 #include <cms/MessageConsumer.h>
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include <decaf/lang/Pointer.h>
 #include <decaf/util/concurrent/locks/ReentrantLock.h>
 #include <transport/Command.h>
@@ -35,7 +41,7 @@ using namespace decaf::util::concurrent::locks;
 using namespace upmq::transport;
 using namespace upmq::transport;
 
-class ConsumerImpl : public cms::MessageConsumer, public cms::QueueBrowser, cms::MessageEnumeration, Dispatcher, Runnable {
+class ConsumerImpl : public cms::MessageConsumer, public cms::QueueBrowser, public cms::ConsumerStatistics, cms::MessageEnumeration, Dispatcher, Runnable {
  public:
   enum class Type {
     CONSUMER,
@@ -67,6 +73,9 @@ class ConsumerImpl : public cms::MessageConsumer, public cms::QueueBrowser, cms:
   bool hasMoreMessages() override;
   cms::Message *nextMessage() override;
 
+  long long getReceivedBatches() const override;
+  long long getReceivedBatchedMessages() const override;
+
   void close() override;
   void start() override;
   void stop() override;
@@ -80,6 +89,11 @@ class ConsumerImpl : public cms::MessageConsumer, public cms::QueueBrowser, cms:
 
   void dispatch(const decaf::lang::Pointer<upmq::transport::Command> &message) override;
 
+  /**
+   * Unpacks MessageBatch frame into the separate messages and dispatches them in order.
+   */
+  void dispatchBatch(const decaf::lang::Pointer<upmq::transport::Command> &batch);
+
   void run() override;
 
   bool isAlive() const;
@@ -138,7 +152,25 @@ class ConsumerImpl : public cms::MessageConsumer, public cms::QueueBrowser, cms:
   Thread *_onMessageThread;
   ReentrantLock *_activeOnMessageLock;
 
+  long long _creditBytes;
+  int _batchSize;
+  int _ackBatchSize;
+  long long _ackBatchTimeout;
+  std::mutex _pendingAcksLock;
+  std::vector<std::string> _pendingAcks;
+  std::string _pendingAcksDestination;
+  long long _pendingAcksSince;
+  std::atomic<long long> _bufferedBytes;
+  std::atomic<long long> _consumedBytes;
+  std::atomic<long long> _receivedBatches;
+  std::atomic<long long> _receivedBatchedMessages;
+
   cms::Message *commandToMessage(const Pointer<Command>& pointer);
+  void grantCredit(long long size, bool force = false);
+  // acknowledges received message, AUTO and DUPS_OK acks are coalesced into the one frame by count and age
+  void acknowledgeReceived(cms::Message *message);
+  void flushAcks();
+  void flushAcksLocked();
 };
 
 #endif  //__MessageConsumerImpl_H__
@@ -20,11 +20,13 @@
 #include <transport/TransportRegistry.h>
 
 #include <transport/failover/FailoverTransportFactory.h>
+#include <transport/shm/ShmTransportFactory.h>
 #include <transport/tcp/TcpTransportFactory.h>
 
 using namespace upmq;
 using namespace upmq::transport;
 using namespace upmq::transport::tcp;
+using namespace upmq::transport::shm;
 using namespace upmq::transport::failover;
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -59,5 +61,9 @@ void UPMQCPP::registerTransports() {
   TransportRegistry::initialize();
 
   TransportRegistry::getInstance().registerFactory("tcp", new TcpTransportFactory());
+  // unix domain socket to the broker on the same host, unix:///path/to/broker.sock
+  TransportRegistry::getInstance().registerFactory("unix", new TcpTransportFactory());
+  // shared memory rings negotiated over the unix socket of the broker, shm:///path/to/broker.sock
+  TransportRegistry::getInstance().registerFactory("shm", new ShmTransportFactory());
   TransportRegistry::getInstance().registerFactory("failover", new FailoverTransportFactory());
 }
@@ -35,6 +35,7 @@ UPMQCommand::UPMQCommand()
       _headerSize(0),
       _bodyString(EMPTY_STRING),
       _bodySize(0),
+      _frameSize(0),
       _response(true),
       _consumer(nullptr) {}
 
@@ -50,6 +51,7 @@ UPMQCommand::UPMQCommand(const UPMQCommand &o)
       _headerSize(o._headerSize),
       _bodyString(o._bodyString),
       _bodySize(o._bodySize),
+      _frameSize(o._frameSize),
       _response(o._response),
       _consumer(o._consumer) {
   if (_bodyBuffSize) {
@@ -70,6 +72,7 @@ UPMQCommand::UPMQCommand(Proto::ProtoMessage *header, unsigned char *body_buff,
       _headerSize(0),
       _bodyString(EMPTY_STRING),
       _bodySize(0),
+      _frameSize(0),
       _response(true),
       _consumer(nullptr) {}
 
@@ -169,9 +172,15 @@ std::string UPMQCommand::typeName() const {
       case Proto::ProtoMessage::kAck:
         type = "Ack";
         break;
+      case Proto::ProtoMessage::kCredit:
+        type = "Credit";
+        break;
       case Proto::ProtoMessage::kMessage:
         type = "Message";
         break;
+      case Proto::ProtoMessage::kMessageBatch:
+        type = "MessageBatch";
+        break;
       case Proto::ProtoMessage::kReceipt:
         type = "Receipt";
         break;
@@ -330,6 +339,8 @@ Proto::Browser &UPMQCommand::getBrowser() const { return *_header->mutable_brows
 
 Proto::Ack &UPMQCommand::getAck() const { return *_header->mutable_ack(); }
 
+Proto::Credit &UPMQCommand::getCredit() const { return *_header->mutable_credit(); }
+
 Proto::Sender &UPMQCommand::getSender() const { return *_header->mutable_sender(); }
 
 Proto::Unsender &UPMQCommand::getUnsender() const { return *_header->mutable_unsender(); }
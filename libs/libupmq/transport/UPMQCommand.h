@@ -94,6 +94,7 @@ class UPMQCommand : public Response {
   Proto::Commit &getCommit() const;
   Proto::Abort &getAbort() const;
   Proto::Ack &getAck() const;
+  Proto::Credit &getCredit() const;
   Proto::Sender &getSender() const;
   Proto::Unsender &getUnsender() const;
   Proto::Ping &getPing() const;
@@ -141,6 +142,9 @@ class UPMQCommand : public Response {
   mutable string _bodyString;
   mutable int _bodySize;
 
+  // for income message, size of the frame as it was read from the wire
+  long long _frameSize;
+
   bool _response;
 
   void *_consumer;
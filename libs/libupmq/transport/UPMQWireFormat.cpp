@@ -86,6 +86,7 @@ Pointer<transport::Command> UPMQWireFormat::unmarshal(const upmq::transport::Tra
   }
 
   Pointer<UPMQCommand> command(MessageFactoryImpl::getProperMessage(header, bodyBuff, bodySize));
+  command->_frameSize = headerSize + bodySize;
 
   if (command->getProtoMessage().request_reply_id() == 0) {
     command->setResponse(false);
@@ -0,0 +1,453 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ShmTransport.h"
+
+#include <ShmRing.h>
+#include <decaf/internal/net/SocketFileDescriptor.h>
+#include <decaf/internal/net/tcp/TcpSocket.h>
+#include <decaf/io/BufferedInputStream.h>
+#include <decaf/io/BufferedOutputStream.h>
+#include <decaf/io/DataInputStream.h>
+#include <decaf/io/DataOutputStream.h>
+#include <decaf/io/IOException.h>
+#include <decaf/io/InputStream.h>
+#include <decaf/io/OutputStream.h>
+#include <decaf/lang/exceptions/IndexOutOfBoundsException.h>
+#include <decaf/lang/exceptions/NullPointerException.h>
+#include <decaf/lang/exceptions/UnsupportedOperationException.h>
+#include <decaf/net/SocketException.h>
+#include <transport/IOTransport.h>
+
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#ifdef UPMQ_HAS_SHM_RING
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+
+using namespace std;
+using namespace upmq;
+using namespace upmq::transport;
+using namespace upmq::transport::shm;
+using namespace decaf;
+using namespace decaf::net;
+using namespace decaf::io;
+using namespace decaf::lang;
+using namespace decaf::lang::exceptions;
+using decaf::internal::net::SocketFileDescriptor;
+using decaf::internal::net::tcp::TcpSocket;
+
+namespace upmq {
+namespace transport {
+namespace shm {
+
+#ifdef UPMQ_HAS_SHM_RING
+namespace {
+
+// how long the waiting side sleeps on the socket between the checks of the closed flag, ms
+constexpr int WAIT_TIMEOUT = 100;
+
+void checkBounds(const unsigned char *buffer, int size, int offset, int length) {
+  if (buffer == nullptr) {
+    throw NullPointerException(__FILE__, __LINE__, "Buffer passed is Null");
+  }
+  if (size < 0) {
+    throw IndexOutOfBoundsException(__FILE__, __LINE__, "size parameter out of Bounds: %d.", size);
+  }
+  if (offset > size || offset < 0) {
+    throw IndexOutOfBoundsException(__FILE__, __LINE__, "offset parameter out of Bounds: %d.", offset);
+  }
+  if (length < 0 || length > size - offset) {
+    throw IndexOutOfBoundsException(__FILE__, __LINE__, "length parameter out of Bounds: %d.", length);
+  }
+}
+
+/**
+ * Reads frames of the broker from the ring, sleeps on the socket until the doorbell if the ring is empty.
+ */
+class ShmInputStream : public InputStream {
+  upmq::shm::Ring ring;
+  int fd;
+  std::atomic_bool closed{false};
+
+ public:
+  ShmInputStream(const upmq::shm::Ring &ring_, int fd_) : InputStream(), ring(ring_), fd(fd_) {}
+
+  int available() const override {
+    if (closed) {
+      throw IOException(__FILE__, __LINE__, "The stream is closed");
+    }
+    return static_cast<int>(std::min<uint64_t>(ring.readable(), INT_MAX));
+  }
+
+  void close() override {
+    if (!closed.exchange(true)) {
+      // NOTE: wakes up the reader sleeping in poll
+      ::shutdown(fd, SHUT_RDWR);
+    }
+  }
+
+ protected:
+  int doReadByte() override {
+    unsigned char buffer[1];
+    int result = doReadArrayBounded(buffer, 1, 0, 1);
+    return result == -1 ? result : buffer[0];
+  }
+
+  int doReadArrayBounded(unsigned char *buffer, int size, int offset, int length) override {
+    if (length == 0) {
+      return 0;
+    }
+    checkBounds(buffer, size, offset, length);
+
+    for (;;) {
+      if (closed) {
+        throw IOException(__FILE__, __LINE__, "The stream is closed");
+      }
+      const size_t n = ring.read(reinterpret_cast<char *>(buffer + offset), static_cast<size_t>(length));
+      if (n > 0) {
+        return static_cast<int>(n);
+      }
+      if (!ring.prepareWait()) {
+        continue;
+      }
+      struct pollfd pfd {};
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      const int result = ::poll(&pfd, 1, WAIT_TIMEOUT);
+      if (result < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw IOException(__FILE__, __LINE__, "ShmInputStream::read - poll error: %s", strerror(errno));
+      }
+      if (result == 0) {
+        continue;
+      }
+      if ((pfd.revents & POLLIN) != 0) {
+        char bell[64];
+        const ssize_t bytes = ::recv(fd, bell, sizeof(bell), MSG_DONTWAIT);
+        if (bytes > 0 || (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))) {
+          continue;
+        }
+      }
+      // broker has closed the connection, the rest of the ring is still delivered
+      if (ring.isEmpty()) {
+        return -1;
+      }
+    }
+  }
+};
+
+/**
+ * Writes frames to the ring of the broker, the broker is woken up on flush if it sleeps.
+ */
+class ShmOutputStream : public OutputStream {
+  upmq::shm::Ring ring;
+  int fd;
+  std::atomic_bool closed{false};
+
+  void notify() {
+    if (ring.needNotify()) {
+      // NOTE: if the socket buffer is full, the broker is woken up by the bytes already sent
+      const ssize_t n = ::send(fd, &upmq::shm::DOORBELL, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+      (void)n;
+    }
+  }
+
+  void waitForSpace() {
+    struct pollfd pfd {};
+    pfd.fd = fd;
+    pfd.events = 0;
+    if ((::poll(&pfd, 1, 0) > 0) && ((pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) != 0)) {
+      throw IOException(__FILE__, __LINE__, "ShmOutputStream::write - broker has closed the connection");
+    }
+    std::this_thread::yield();
+  }
+
+ public:
+  ShmOutputStream(const upmq::shm::Ring &ring_, int fd_) : OutputStream(), ring(ring_), fd(fd_) {}
+
+  void close() override { closed = true; }
+
+  void flush() override {
+    if (closed) {
+      throw IOException(__FILE__, __LINE__, "ShmOutputStream::flush - This Stream has been closed.");
+    }
+    notify();
+  }
+
+ protected:
+  void doWriteByte(unsigned char c) override { doWriteArrayBounded(&c, 1, 0, 1); }
+
+  void doWriteArrayBounded(const unsigned char *buffer, int size, int offset, int length) override {
+    if (length == 0) {
+      return;
+    }
+    checkBounds(buffer, size, offset, length);
+
+    while (length > 0) {
+      if (closed) {
+        throw IOException(__FILE__, __LINE__, "ShmOutputStream::write - This Stream has been closed.");
+      }
+      const size_t n = ring.write(reinterpret_cast<const char *>(buffer + offset), static_cast<size_t>(length));
+      if (n == 0) {
+        // NOTE: the broker must read the ring to free it, so it's woken up before the waiting
+        notify();
+        waitForSpace();
+        continue;
+      }
+      offset += static_cast<int>(n);
+      length -= static_cast<int>(n);
+    }
+  }
+};
+
+}  // namespace
+#endif  // UPMQ_HAS_SHM_RING
+
+class ShmTransportImpl {
+ private:
+  ShmTransportImpl(const ShmTransportImpl &);
+  ShmTransportImpl &operator=(const ShmTransportImpl &);
+
+ public:
+  int connectTimeout;
+
+  std::unique_ptr<TcpSocket> socket;
+#ifdef UPMQ_HAS_SHM_RING
+  std::unique_ptr<upmq::shm::Segment> segment;
+#endif
+  std::unique_ptr<decaf::io::DataInputStream> dataInputStream;
+  std::unique_ptr<decaf::io::DataOutputStream> dataOutputStream;
+
+  decaf::net::URI location;
+
+  int outputBufferSize;
+  int inputBufferSize;
+  long long ringSize;
+
+  explicit ShmTransportImpl(const decaf::net::URI &location_)
+      : connectTimeout(0),
+        socket(),
+        dataInputStream(),
+        dataOutputStream(),
+        location(location_),
+        outputBufferSize(8192),
+        inputBufferSize(8192),
+        ringSize(4 * 1024 * 1024) {}
+};
+}  // namespace shm
+}  // namespace transport
+}  // namespace upmq
+
+////////////////////////////////////////////////////////////////////////////////
+ShmTransport::ShmTransport(Pointer<Transport> next_, const decaf::net::URI &location_)
+    : TransportFilter(std::move(next_)), impl(new ShmTransportImpl(location_)) {}
+
+////////////////////////////////////////////////////////////////////////////////
+ShmTransport::~ShmTransport() {
+  try {
+    close();
+  }
+  AMQ_CATCHALL_NOTHROW()
+
+  try {
+    delete this->impl;
+  }
+  AMQ_CATCHALL_NOTHROW()
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::beforeNextIsStarted() {
+  try {
+    connect();
+  }
+  AMQ_CATCH_RETHROW(IOException)
+  AMQ_CATCH_EXCEPTION_CONVERT(Exception, IOException)
+  AMQ_CATCHALL_THROW(IOException)
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::afterNextIsStopped() {
+  try {
+    // The IOTransport is now stopped, so we can safely closed the socket
+    // and no asynchronous exceptions should be triggered.
+    if (impl->socket.get() != nullptr) {
+      impl->socket->close();
+    }
+  }
+  AMQ_CATCH_RETHROW(IOException)
+  AMQ_CATCH_EXCEPTION_CONVERT(Exception, IOException)
+  AMQ_CATCHALL_THROW(IOException)
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::doClose() {
+  try {
+    if (impl->socket.get() != nullptr) {
+      impl->socket->close();
+    }
+  }
+  AMQ_CATCH_RETHROW(IOException)
+  AMQ_CATCH_EXCEPTION_CONVERT(Exception, IOException)
+  AMQ_CATCHALL_THROW(IOException)
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::connect() {
+  try {
+#ifdef UPMQ_HAS_SHM_RING
+    URI uri = this->impl->location;
+
+    // shm:///path/to/broker.sock, the path is the address of the unix socket
+    if (uri.getPath().empty()) {
+      throw SocketException(__FILE__, __LINE__, "Connection URI was not provided or is invalid: %s", uri.toString().c_str());
+    }
+
+    impl->socket.reset(new TcpSocket(true));
+    impl->socket->create();
+    impl->socket->connect(uri.getPath(), 0, impl->connectTimeout);
+
+    const SocketFileDescriptor *descriptor = dynamic_cast<const SocketFileDescriptor *>(impl->socket->getFileDescriptor());
+    if (descriptor == nullptr) {
+      throw IOException(__FILE__, __LINE__, "ShmTransport::connect - socket has no descriptor");
+    }
+    const int fd = static_cast<int>(descriptor->getValue());
+
+    // Create the segment, it's alive in the broker after passing even if the client closes the descriptor.
+    const uint64_t ringSize = static_cast<uint64_t>(impl->ringSize);
+    const int memfd = upmq::shm::Segment::create(ringSize);
+    if (memfd < 0) {
+      throw IOException(__FILE__, __LINE__, "ShmTransport::connect - can't create shared memory segment: %s", strerror(errno));
+    }
+    const uint64_t segmentSize = upmq::shm::Segment::segmentSize(ringSize);
+    std::unique_ptr<upmq::shm::Segment> segment(new upmq::shm::Segment());
+    if (!segment->map(memfd, segmentSize, true)) {
+      ::close(memfd);
+      throw IOException(__FILE__, __LINE__, "ShmTransport::connect - can't map shared memory segment");
+    }
+
+    // Handshake pseudo frame has the same lengths prefix as a regular frame.
+    char hbLens[sizeof(uint32_t) + sizeof(uint64_t)];
+    const uint32_t magic = upmq::shm::HANDSHAKE_MAGIC;
+    memcpy(hbLens, &magic, sizeof(magic));
+    memcpy(&hbLens[sizeof(magic)], &segmentSize, sizeof(segmentSize));
+
+    struct iovec iov {};
+    iov.iov_base = hbLens;
+    iov.iov_len = sizeof(hbLens);
+    union {
+      struct cmsghdr align;
+      char data[CMSG_SPACE(sizeof(int))];
+    } control{};
+    struct msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data;
+    msg.msg_controllen = sizeof(control.data);
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &memfd, sizeof(memfd));
+
+    ssize_t n = 0;
+    do {
+      n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    const int sendError = errno;
+    ::close(memfd);
+    if (n != static_cast<ssize_t>(sizeof(hbLens))) {
+      throw IOException(__FILE__, __LINE__, "ShmTransport::connect - can't send handshake: %s", strerror(sendError));
+    }
+
+    char ack = 0;
+    do {
+      n = ::recv(fd, &ack, 1, 0);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1 || ack != upmq::shm::HANDSHAKE_ACK) {
+      throw IOException(__FILE__, __LINE__, "ShmTransport::connect - broker has rejected shared memory segment");
+    }
+
+    // Cast it to an IO transport so we can wire up the ring streams.
+    IOTransport *ioTransport = dynamic_cast<IOTransport *>(next.get());
+    if (ioTransport == nullptr) {
+      throw UPMQException(__FILE__,
+                          __LINE__,
+                          "ShmTransport::ShmTransport - "
+                          "transport must be of type IOTransport");
+    }
+
+    // Wrap with the Buffered streams, so the shared positions are updated once per buffer, we own the ring streams
+    Pointer<InputStream> inputStream(
+        new BufferedInputStream(new ShmInputStream(segment->toClient(), fd), this->impl->inputBufferSize, true));
+    Pointer<OutputStream> outputStream(
+        new BufferedOutputStream(new ShmOutputStream(segment->toBroker(), fd), this->impl->outputBufferSize, true));
+
+    this->impl->segment = std::move(segment);
+    this->impl->dataInputStream.reset(new DataInputStream(inputStream.release(), true));
+    this->impl->dataOutputStream.reset(new DataOutputStream(outputStream.release(), true));
+
+    // Give the IOTransport the streams.
+    ioTransport->setInputStream(impl->dataInputStream.get());
+    ioTransport->setOutputStream(impl->dataOutputStream.get());
+#else
+    throw UnsupportedOperationException(__FILE__, __LINE__, "Shared memory transport is not supported on this platform.");
+#endif
+  }
+  AMQ_CATCH_RETHROW(UPMQException)
+  AMQ_CATCH_EXCEPTION_CONVERT(Exception, UPMQException)
+  AMQ_CATCHALL_THROW(UPMQException)
+}
+
+////////////////////////////////////////////////////////////////////////////////
+bool ShmTransport::isConnected() const {
+  if (this->impl->socket.get() != nullptr) {
+    return this->impl->socket->isConnected();
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::setConnectTimeout(int soConnectTimeout) { this->impl->connectTimeout = soConnectTimeout; }
+
+////////////////////////////////////////////////////////////////////////////////
+int ShmTransport::getConnectTimeout() const { return this->impl->connectTimeout; }
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::setInputBufferSize(int inputBufferSize) { this->impl->inputBufferSize = inputBufferSize; }
+
+////////////////////////////////////////////////////////////////////////////////
+int ShmTransport::getInputBufferSize() const { return this->impl->inputBufferSize; }
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::setOutputBufferSize(int outputBufferSize) { this->impl->outputBufferSize = outputBufferSize; }
+
+////////////////////////////////////////////////////////////////////////////////
+int ShmTransport::getOutputBufferSize() const { return this->impl->outputBufferSize; }
+
+////////////////////////////////////////////////////////////////////////////////
+void ShmTransport::setRingSize(long long ringSize) { this->impl->ringSize = ringSize; }
+
+////////////////////////////////////////////////////////////////////////////////
+long long ShmTransport::getRingSize() const { return this->impl->ringSize; }
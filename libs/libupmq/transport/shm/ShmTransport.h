@@ -0,0 +1,102 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UPMQ_TRANSPORT_SHM_SHMTRANSPORT_H_
+#define _UPMQ_TRANSPORT_SHM_SHMTRANSPORT_H_
+
+#include <decaf/lang/Pointer.h>
+#include <decaf/net/URI.h>
+#include <transport/Config.h>
+#include <transport/TransportFilter.h>
+
+namespace upmq {
+namespace transport {
+namespace shm {
+
+using decaf::lang::Pointer;
+
+class ShmTransportImpl;
+
+/**
+ * Implements a shared memory transport filter to the broker on the same host, the
+ * transport wraps an instance of an IOTransport like the TcpTransport does.
+ *
+ * The transport connects to the unix socket of the broker, creates the shared memory
+ * segment with two rings and passes it to the broker, then frames are read from and
+ * written to the rings, the socket only wakes up the waiting side.
+ *
+ * URI: shm:///path/to/broker.sock?shm.ringSize=4194304
+ */
+class UPMQCPP_API ShmTransport : public TransportFilter {
+ private:
+  ShmTransportImpl *impl;
+
+ private:
+  ShmTransport(const ShmTransport &);
+  ShmTransport &operator=(const ShmTransport &);
+
+ public:
+  /**
+   * Creates a new instance of a ShmTransport, the transport is left unconnected
+   * and is in a unusable state until the connect method is called.
+   *
+   * @param next
+   *      The next transport in the chain
+   * @param location
+   *      The URI of the unix socket of the broker.
+   */
+  ShmTransport(Pointer<Transport> next, const decaf::net::URI &location);
+
+  ~ShmTransport() override;
+
+  void setConnectTimeout(int soConnectTimeout);
+  int getConnectTimeout() const;
+
+  void setInputBufferSize(int inputBufferSize);
+  int getInputBufferSize() const;
+
+  void setOutputBufferSize(int outputBufferSize);
+  int getOutputBufferSize() const;
+
+  /**
+   * Size of each ring in bytes, must be the power of two.
+   */
+  void setRingSize(long long ringSize);
+  long long getRingSize() const;
+
+ public:  // Transport Methods
+  bool isFaultTolerant() const override { return false; }
+
+  bool isConnected() const override;
+
+ protected:
+  void beforeNextIsStarted() override;
+
+  void afterNextIsStopped() override;
+
+  void doClose() override;
+
+  /**
+   * Connects the unix socket, passes the shared memory segment to the broker and
+   * wires up the ring streams to the IOTransport.
+   */
+  void connect();
+};
+}  // namespace shm
+}  // namespace transport
+}  // namespace upmq
+
+#endif /*_UPMQ_TRANSPORT_SHM_SHMTRANSPORT_H_*/
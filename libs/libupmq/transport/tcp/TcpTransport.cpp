@@ -19,6 +19,7 @@
 #include <decaf/lang/exceptions/IllegalArgumentException.h>
 #include <decaf/lang/exceptions/NullPointerException.h>
 #include <decaf/net/SocketFactory.h>
+#include <decaf/internal/net/tcp/TcpSocket.h>
 #include <decaf/util/concurrent/atomic/AtomicBoolean.h>
 #include <transport/IOTransport.h>
 
@@ -148,16 +149,26 @@ void TcpTransport::connect() {
 
     URI uri = this->impl->location;
 
-    // Ensure something is actually passed in for the URI
-    if (uri.getAuthority().empty()) {
-      throw SocketException(__FILE__, __LINE__, "Connection URI was not provided or is invalid: %s", uri.toString().c_str());
-    }
+    if (isLocal()) {
+      // unix:///path/to/broker.sock, the path is the address of the socket
+      if (uri.getPath().empty()) {
+        throw SocketException(__FILE__, __LINE__, "Connection URI was not provided or is invalid: %s", uri.toString().c_str());
+      }
+
+      // Connect the socket.
+      impl->socket->connect(uri.getPath(), 0, impl->connectTimeout);
+    } else {
+      // Ensure something is actually passed in for the URI
+      if (uri.getAuthority().empty()) {
+        throw SocketException(__FILE__, __LINE__, "Connection URI was not provided or is invalid: %s", uri.toString().c_str());
+      }
 
-    // Connect the socket.
-    string host = uri.getHost();
-    int port = uri.getPort();
+      // Connect the socket.
+      string host = uri.getHost();
+      int port = uri.getPort();
 
-    impl->socket->connect(host, port, impl->connectTimeout);
+      impl->socket->connect(host, port, impl->connectTimeout);
+    }
 
     // Cast it to an IO transport so we can wire up the socket
     // input and output streams.
@@ -215,6 +226,9 @@ void TcpTransport::connect() {
 ////////////////////////////////////////////////////////////////////////////////
 Socket *TcpTransport::createSocket() {
   try {
+    if (isLocal()) {
+      return new Socket(new decaf::internal::net::tcp::TcpSocket(true));
+    }
     SocketFactory *factory = SocketFactory::getDefault();
     return factory->createSocket();
   }
@@ -223,6 +237,9 @@ Socket *TcpTransport::createSocket() {
   DECAF_CATCHALL_THROW(IOException)
 }
 
+////////////////////////////////////////////////////////////////////////////////
+bool TcpTransport::isLocal() const { return this->impl->location.getScheme() == "unix"; }
+
 ////////////////////////////////////////////////////////////////////////////////
 void TcpTransport::configureSocket(Socket *socket) {
   try {
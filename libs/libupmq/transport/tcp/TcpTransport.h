@@ -119,6 +119,11 @@ class UPMQCPP_API TcpTransport : public TransportFilter {
    */
   virtual decaf::net::Socket *createSocket();
 
+  /**
+   * @return true if the transport uses unix domain socket (unix:// scheme)
+   */
+  bool isLocal() const;
+
   /**
    * Using options from configuration URI, configure the socket options before the
    * Socket instance is connected to the Server.  Subclasses can override this option
@@ -0,0 +1,226 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UPMQ_SHM_RING_H
+#define UPMQ_SHM_RING_H
+
+// Shared memory transport between libupmq and the broker on the same host (linux only)
+// ** client creates memfd segment with two SPSC byte rings and passes it to the broker over the unix socket
+// ** rings carry the same frames as the socket: uint32 header size, uint64 body size, header, body
+// ** after the handshake the socket is used only as the doorbell for the sleeping side and to detect disconnect
+
+#ifdef __linux__
+#define UPMQ_HAS_SHM_RING 1
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#endif
+
+namespace upmq {
+namespace shm {
+
+enum : uint32_t {
+  // handshake pseudo frame: header size is the magic, body size is the segment size, memfd is passed by SCM_RIGHTS
+  HANDSHAKE_MAGIC = 0x48535055,  // "UPSH"
+  SEGMENT_VERSION = 1
+};
+// byte sent back by the broker when the segment is accepted
+constexpr char HANDSHAKE_ACK = 'A';
+// byte sent to wake up the side which waits for the ring
+constexpr char DOORBELL = 'D';
+constexpr uint64_t DEFAULT_RING_SIZE = 4 * 1024 * 1024;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared memory rings need lock free 64-bit atomics");
+
+struct RingControl {
+  alignas(64) std::atomic<uint64_t> head;      // read position, owned by consumer
+  alignas(64) std::atomic<uint64_t> tail;      // write position, owned by producer
+  alignas(64) std::atomic<uint32_t> waiting;  // consumer sleeps until the doorbell
+};
+
+struct SegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t ringSize;
+  RingControl toBroker;
+  RingControl toClient;
+};
+
+/// @brief Ring - single producer single consumer byte ring over the shared memory
+class Ring {
+  RingControl *_ctl;
+  char *_data;
+  uint64_t _size;
+
+ public:
+  Ring(RingControl *ctl, char *data, uint64_t size) : _ctl(ctl), _data(data), _size(size) {}
+
+  uint64_t readable() const { return _ctl->tail.load(std::memory_order_acquire) - _ctl->head.load(std::memory_order_relaxed); }
+  bool isEmpty() const { return readable() == 0; }
+
+  // producer, returns count of written bytes, 0 if ring is full
+  size_t write(const char *buf, size_t len) {
+    const uint64_t tail = _ctl->tail.load(std::memory_order_relaxed);
+    const uint64_t used = tail - _ctl->head.load(std::memory_order_acquire);
+    // NOTE: positions are written by the other process, so they are never trusted for memory bounds
+    const size_t n = static_cast<size_t>(std::min<uint64_t>((used < _size) ? (_size - used) : 0, len));
+    if (n == 0) {
+      return 0;
+    }
+    const size_t pos = static_cast<size_t>(tail & (_size - 1));
+    const size_t first = std::min<size_t>(n, static_cast<size_t>(_size) - pos);
+    memcpy(_data + pos, buf, first);
+    memcpy(_data, buf + first, n - first);
+    _ctl->tail.store(tail + n, std::memory_order_release);
+    return n;
+  }
+  // consumer, returns count of read bytes, 0 if ring is empty
+  size_t read(char *buf, size_t len) {
+    const uint64_t head = _ctl->head.load(std::memory_order_relaxed);
+    const uint64_t avail = _ctl->tail.load(std::memory_order_acquire) - head;
+    const size_t n = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(avail, _size), len));
+    if (n == 0) {
+      return 0;
+    }
+    const size_t pos = static_cast<size_t>(head & (_size - 1));
+    const size_t first = std::min<size_t>(n, static_cast<size_t>(_size) - pos);
+    memcpy(buf, _data + pos, first);
+    memcpy(buf + first, _data, n - first);
+    _ctl->head.store(head + n, std::memory_order_release);
+    return n;
+  }
+  // consumer, announces sleeping, returns false if data arrived meanwhile and the consumer must not sleep
+  bool prepareWait() {
+    _ctl->waiting.store(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (readable() > 0) {
+      _ctl->waiting.store(0, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+  // producer, after write, returns true if the consumer sleeps and the doorbell has to be rung
+  bool needNotify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return (_ctl->waiting.load(std::memory_order_relaxed) != 0) && (_ctl->waiting.exchange(0) != 0);
+  }
+};
+
+/// @brief Segment - mapping of the shared memory with two rings
+class Segment {
+  void *_addr = MAP_FAILED;
+  size_t _size = 0;
+  uint64_t _ringSize = 0;
+  SegmentHeader *_header = nullptr;
+
+ public:
+  Segment() = default;
+  Segment(const Segment &) = delete;
+  Segment &operator=(const Segment &) = delete;
+  ~Segment() {
+    if (_addr != MAP_FAILED) {
+      ::munmap(_addr, _size);
+    }
+  }
+
+  static size_t segmentSize(uint64_t ringSize) { return sizeof(SegmentHeader) + 2 * static_cast<size_t>(ringSize); }
+  static bool isValidRingSize(uint64_t ringSize) { return (ringSize >= 4096) && ((ringSize & (ringSize - 1)) == 0); }
+
+  // creates anonymous memory file for the segment, returns fd or -1
+  static int create(uint64_t ringSize) {
+    if (!isValidRingSize(ringSize)) {
+      errno = EINVAL;
+      return -1;
+    }
+    const int fd = static_cast<int>(::syscall(SYS_memfd_create, "upmq-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING));
+    if (fd < 0) {
+      return -1;
+    }
+    // NOTE: the size is sealed, so the broker can't get SIGBUS from the truncated mapping
+    if ((::ftruncate(fd, static_cast<off_t>(segmentSize(ringSize))) != 0) || (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0)) {
+      const int error = errno;
+      ::close(fd);
+      errno = error;
+      return -1;
+    }
+    return fd;
+  }
+  // maps the segment, creator initializes it, other side validates it against the expected size
+  bool map(int fd, uint64_t expectedSize, bool init) {
+    struct stat st {};
+    if ((::fstat(fd, &st) != 0) || (static_cast<uint64_t>(st.st_size) != expectedSize) || (expectedSize <= sizeof(SegmentHeader))) {
+      return false;
+    }
+    if (!init) {
+      const int seals = ::fcntl(fd, F_GET_SEALS);
+      if ((seals < 0) || ((seals & F_SEAL_SHRINK) == 0)) {
+        return false;
+      }
+    }
+    const uint64_t ringSize = (expectedSize - sizeof(SegmentHeader)) / 2;
+    if (!isValidRingSize(ringSize) || (segmentSize(ringSize) != expectedSize)) {
+      return false;
+    }
+    _size = static_cast<size_t>(expectedSize);
+    _ringSize = ringSize;
+    _addr = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (_addr == MAP_FAILED) {
+      return false;
+    }
+    _header = static_cast<SegmentHeader *>(_addr);
+    if (init) {
+      // NOTE: memory of the new file is zeroed, so only the description is filled
+      _header->magic = HANDSHAKE_MAGIC;
+      _header->version = SEGMENT_VERSION;
+      _header->ringSize = ringSize;
+    } else if ((_header->magic != HANDSHAKE_MAGIC) || (_header->version != SEGMENT_VERSION) || (_header->ringSize != ringSize)) {
+      return false;
+    }
+    return true;
+  }
+  size_t size() const { return _size; }
+  Ring toBroker() const { return Ring(&_header->toBroker, static_cast<char *>(_addr) + sizeof(SegmentHeader), _ringSize); }
+  Ring toClient() const { return Ring(&_header->toClient, static_cast<char *>(_addr) + sizeof(SegmentHeader) + _ringSize, _ringSize); }
+};
+
+}  // namespace shm
+}  // namespace upmq
+
+#endif  // __linux__
+
+#endif  // UPMQ_SHM_RING_H
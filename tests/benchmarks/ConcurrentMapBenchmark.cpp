@@ -0,0 +1,122 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Lookup benchmark of the broker maps keyed by destination names:
+//  buckets - FSUnorderedMap, list per bucket guarded by own rw-lock
+//  open    - ConcurrentHashMap, open addressing, lookups are lock free
+// every thread does finds and, by the workload, replaces random keys (erase + insert)
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ConcurrentHashMap.h"
+#include "FixedSizeUnorderedMap.h"
+
+namespace {
+
+constexpr size_t KEYS = 1024;
+constexpr size_t CAPACITY = 4096;
+
+struct Item {
+  explicit Item(size_t n) : num(n) {}
+  size_t num;
+  std::atomic<uint64_t> counter{0};
+  void touch() { counter.fetch_add(1, std::memory_order_relaxed); }
+};
+
+struct Workload {
+  const char *name;
+  // count of writes per 1000 operations
+  unsigned writes;
+};
+
+std::vector<std::string> makeKeys() {
+  std::vector<std::string> keys;
+  keys.reserve(KEYS);
+  for (size_t i = 0; i < KEYS; ++i) {
+    keys.emplace_back("queue://benchmark/destination-" + std::to_string(i));
+  }
+  return keys;
+}
+
+template <typename Map>
+double run(const std::vector<std::string> &keys, size_t threads, const Workload &workload, std::chrono::milliseconds duration) {
+  Map map(CAPACITY);
+  for (size_t i = 0; i < KEYS; ++i) {
+    map.insert(std::make_pair(keys[i], std::make_shared<Item>(i)));
+  }
+  std::atomic_bool isRunning{true};
+  std::atomic<uint64_t> total{0};
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&map, &keys, &workload, &isRunning, &total, t]() {
+      std::mt19937 gen(static_cast<unsigned>(t));
+      std::uniform_int_distribution<size_t> keyDist(0, KEYS - 1);
+      std::uniform_int_distribution<unsigned> opDist(0, 999);
+      uint64_t ops = 0;
+      while (isRunning.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 256; ++i) {
+          const size_t k = keyDist(gen);
+          if (opDist(gen) < workload.writes) {
+            map.erase(keys[k]);
+            map.insert(std::make_pair(keys[k], std::make_shared<Item>(k)));
+          } else {
+            auto item = map.find(keys[k]);
+            if (item.hasValue()) {
+              (*item)->touch();
+            }
+          }
+        }
+        ops += 256;
+      }
+      total += ops;
+    });
+  }
+  std::this_thread::sleep_for(duration);
+  isRunning = false;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  return static_cast<double>(total.load()) / (static_cast<double>(duration.count()) / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const std::chrono::milliseconds duration((argc > 1) ? std::atoi(argv[1]) : 1000);
+  const size_t threadsList[] = {4, 8, 16, 32};
+  const Workload workloads[] = {{"read-only", 0}, {"read-heavy", 10}, {"mixed", 100}};
+  const std::vector<std::string> keys = makeKeys();
+
+  using Buckets = upmq::FSUnorderedMap<std::string, std::shared_ptr<Item>>;
+  using Open = upmq::ConcurrentHashMap<std::string, std::shared_ptr<Item>>;
+
+  printf("%12s %8s %18s %18s %8s\n", "workload", "threads", "buckets ops/s", "open ops/s", "speedup");
+  for (const auto &workload : workloads) {
+    for (size_t threads : threadsList) {
+      const double bucketsOps = run<Buckets>(keys, threads, workload, duration);
+      const double openOps = run<Open>(keys, threads, workload, duration);
+      printf("%12s %8zu %18.0f %18.0f %7.2fx\n", workload.name, threads, bucketsOps, openOps, openOps / bucketsOps);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Contention benchmark of handler lookups:
+//  mutex  - vector of shared_ptr guarded by mutex, lookup returns shared_ptr copy
+//  slots  - SlotTable with generation tagged handles and epoch based reclamation
+// one extra thread constantly removes and inserts handlers like connect/disconnect does
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SlotTable.h"
+
+namespace {
+
+constexpr size_t CONNECTIONS = 1024;
+
+struct Handler {
+  explicit Handler(size_t n) : num(n) {}
+  size_t num;
+  std::atomic<uint64_t> counter{0};
+  void touch() { counter.fetch_add(1, std::memory_order_relaxed); }
+};
+
+class MutexTable {
+  mutable std::mutex _mutex;
+  std::vector<std::shared_ptr<Handler>> _handlers;
+
+ public:
+  MutexTable() : _handlers(CONNECTIONS) {
+    for (size_t i = 0; i < CONNECTIONS; ++i) {
+      _handlers[i] = std::make_shared<Handler>(i);
+    }
+  }
+  size_t handle(size_t index) const { return index; }
+  std::shared_ptr<Handler> find(size_t num) const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _handlers[num];
+  }
+  void churn(size_t index) {
+    std::shared_ptr<Handler> handler = std::make_shared<Handler>(index);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _handlers[index] = std::move(handler);
+  }
+};
+
+class SlotsTable {
+  upmq::SlotTable<Handler> _table;
+  std::vector<std::atomic<size_t>> _handles;
+
+ public:
+  explicit SlotsTable(size_t threads) : _table(CONNECTIONS, threads + 2), _handles(CONNECTIONS) {
+    for (size_t i = 0; i < CONNECTIONS; ++i) {
+      _handles[i] = _table.insert(i, new Handler(i));
+    }
+  }
+  size_t handle(size_t index) const { return _handles[index].load(std::memory_order_relaxed); }
+  upmq::SlotTable<Handler>::Ptr find(size_t num) const { return _table.find(num); }
+  void churn(size_t index) {
+    _table.remove(index);
+    _handles[index] = _table.insert(index, new Handler(index));
+    _table.reclaim();
+  }
+};
+
+template <typename Table>
+double run(Table &table, size_t threads, std::chrono::milliseconds duration) {
+  std::atomic_bool isRunning{true};
+  std::atomic<uint64_t> total{0};
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back([&table, &isRunning, &total, t]() {
+      std::mt19937 gen(static_cast<unsigned>(t));
+      std::uniform_int_distribution<size_t> dist(0, CONNECTIONS - 1);
+      uint64_t ops = 0;
+      while (isRunning.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 256; ++i) {
+          auto handler = table.find(table.handle(dist(gen)));
+          if (handler != nullptr) {
+            handler->touch();
+          }
+        }
+        ops += 256;
+      }
+      total += ops;
+    });
+  }
+  std::thread churner([&table, &isRunning]() {
+    size_t index = 0;
+    while (isRunning.load(std::memory_order_relaxed)) {
+      table.churn(index);
+      index = (index + 1) % CONNECTIONS;
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  });
+  std::this_thread::sleep_for(duration);
+  isRunning = false;
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  churner.join();
+  return static_cast<double>(total.load()) / (static_cast<double>(duration.count()) / 1000.0);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  const std::chrono::milliseconds duration((argc > 1) ? std::atoi(argv[1]) : 1000);
+  const size_t threadsList[] = {8, 16, 32, 64};
+
+  printf("%8s %18s %18s %8s\n", "threads", "mutex lookups/s", "slots lookups/s", "speedup");
+  for (size_t threads : threadsList) {
+    double mutexOps = 0;
+    double slotsOps = 0;
+    {
+      MutexTable table;
+      mutexOps = run(table, threads, duration);
+    }
+    {
+      SlotsTable table(threads);
+      slotsOps = run(table, threads, duration);
+    }
+    printf("%8zu %18.0f %18.0f %7.2fx\n", threads, mutexOps, slotsOps, slotsOps / mutexOps);
+  }
+  return 0;
+}
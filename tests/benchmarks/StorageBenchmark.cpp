@@ -0,0 +1,304 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Storage benchmark of the DBMS backends, one backend per run:
+//  sqlite-file   - sqlite-native, database file in the temporary directory
+//  sqlite-memory - sqlite-native, file::memory:?cache=shared
+//  postgresql    - the connection string is the third argument (only with ENABLE_POSTGRESQL), use the scratch database
+// the queue is prefilled up to the table size, then every operation is measured on count messages:
+//  save      - journal row, header and properties in own transaction (Exchange::saveMessage)
+//  copy-to   - all not delivered messages into the browser storage, per copied message
+//  get       - select of maxNotAckMsg batches marked as sent (Storage::get)
+//  was-sent  - status update of the single message (Storage::setMessageToWasSent)
+//  delivered - status update in the transaction of the acknowledge (Storage::setMessageToDelivered)
+//  remove    - removal in the transaction of the acknowledge (Storage::removeMessage)
+//  commit    - transaction of TX_SIZE saved messages, per transaction
+//  abort     - transaction of TX_SIZE saved messages, per transaction
+// every result is the json line with the broker version, so runs of backends and versions can be compared
+
+#include <Poco/File.h>
+#include <Poco/Path.h>
+#include <Poco/Process.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "About.h"
+#include "Broker.h"
+#include "Configuration.h"
+#include "Connection.h"
+#include "Consumer.h"
+#include "DBMSConnectionPool.h"
+#include "Destination.h"
+#include "Exchange.h"
+#include "MessageDataContainer.h"
+#include "MessageStorage.h"
+#include "Session.h"
+
+using upmq::broker::Configuration;
+using upmq::broker::Consumer;
+using upmq::broker::Destination;
+using upmq::broker::MessageDataContainer;
+using upmq::broker::Session;
+using upmq::broker::Storage;
+
+namespace {
+
+constexpr int BATCH_SIZE = 100;
+constexpr size_t TX_SIZE = 10;
+
+using SelectCache = std::deque<std::shared_ptr<MessageDataContainer>>;
+
+struct Backend {
+  std::string name;
+  std::string dbms;
+  std::string value;
+  bool usePath = false;
+};
+
+struct Case {
+  size_t tableSize;
+  size_t properties;
+};
+
+class Bench {
+  const Backend &_backend;
+  const size_t _count;
+  const std::string _version;
+  upmq::broker::Connection _connection;
+  size_t _messageNum = 0;
+
+ public:
+  Bench(const Backend &backend, size_t count) : _backend(backend), _count(count), _version(upmq::broker::About::version()), _connection("storage-bench") {}
+
+  void run(const Case &c) {
+    const std::string name = "storage-bench-" + std::to_string(c.tableSize) + "-" + std::to_string(c.properties);
+    const std::string uri = "queue://" + name;
+    Destination &dest = EXCHANGE::Instance().destination(uri);
+    Storage &storage = dest.storage();
+
+    Session session(_connection, name + "-auto", Proto::Acknowledge::AUTO_ACKNOWLEDGE);
+    for (size_t i = 0; i < c.tableSize; ++i) {
+      EXCHANGE::Instance().saveMessage(session, *makeMessage(uri, c.properties));
+    }
+
+    std::vector<std::shared_ptr<MessageDataContainer>> messages;
+    messages.reserve(_count);
+    for (size_t i = 0; i < _count; ++i) {
+      messages.emplace_back(makeMessage(uri, c.properties));
+    }
+    report("save", c, _count, measure([&session, &messages]() {
+             for (const auto &message : messages) {
+               EXCHANGE::Instance().saveMessage(session, *message);
+             }
+           }));
+    messages.clear();
+
+    {
+      const Consumer browser = makeConsumer(session, name + "-browser", true);
+      Storage copy(dest.id() + "_storage_bench_browser", STORAGE_CONFIG.messages.nonPresistentSize);
+      copy.setParent(&dest);
+      report("copy-to", c, c.tableSize + _count, measure([&storage, &copy, &browser]() { storage.copyTo(copy, browser); }));
+      copy.dropTables();
+    }
+
+    const Consumer consumer = makeConsumer(session, name + "-consumer", false);
+    std::vector<std::string> ids;
+    ids.reserve(_count);
+    report("get", c, _count, measure([this, &storage, &consumer, &ids]() {
+             while (ids.size() < _count) {
+               std::shared_ptr<MessageDataContainer> sMessage = storage.get(consumer, true);
+               if (!sMessage) {
+                 break;
+               }
+               ids.emplace_back(sMessage->messageID());
+             }
+           }));
+
+    report("was-sent", c, ids.size(), measure([&storage, &consumer, &ids]() {
+             for (const auto &id : ids) {
+               storage.setMessageToWasSent(id, consumer);
+             }
+           }));
+    report("delivered", c, ids.size(), measure([&storage, &session, &ids]() {
+             for (const auto &id : ids) {
+               session.currentDBSession = dbms::Instance().dbmsSessionPtr();
+               session.currentDBSession->beginTX(id);
+               storage.setMessageToDelivered(session, id);
+               session.currentDBSession->commitTX();
+               session.currentDBSession.reset(nullptr);
+             }
+           }));
+    report("remove", c, ids.size(), measure([&storage, &ids]() {
+             for (const auto &id : ids) {
+               std::unique_ptr<upmq::broker::storage::DBMSSession> dbSession = dbms::Instance().dbmsSessionPtr();
+               dbSession->beginTX(id);
+               storage.removeMessage(id, *dbSession);
+               dbSession->commitTX();
+             }
+           }));
+
+    Session txSession(_connection, name + "-tx", Proto::Acknowledge::SESSION_TRANSACTED);
+    const size_t transactions = std::max<size_t>(1, _count / TX_SIZE);
+    report("commit", c, transactions, measureTransactions(txSession, uri, c.properties, transactions, false));
+    report("abort", c, transactions, measureTransactions(txSession, uri, c.properties, transactions, true));
+  }
+
+ private:
+  std::shared_ptr<MessageDataContainer> makeMessage(const std::string &uri, size_t properties) {
+    auto sMessage = std::make_shared<MessageDataContainer>();
+    Proto::Message &message = sMessage->createMessageHeader("storage-bench");
+    message.set_message_id("ID:storage-bench-" + std::to_string(++_messageNum));
+    message.set_destination_uri(uri);
+    message.set_persistent(true);
+    message.set_priority(4);
+    message.set_type("storage-bench");
+    for (size_t i = 0; i < properties; ++i) {
+      (*message.mutable_property())["property_" + std::to_string(i)].set_value_string("value_" + std::to_string(i));
+    }
+    sMessage->clientID = "storage-bench";
+    return sMessage;
+  }
+
+  static Consumer makeConsumer(const Session &session, const std::string &objectID, bool browser) {
+    return Consumer(0, "storage-bench", 0, objectID, session.id(), session.type(), "", false, browser, BATCH_SIZE, std::make_shared<SelectCache>());
+  }
+
+  // NOTE: only commit or abort is measured, messages of the transaction are saved before
+  double measureTransactions(Session &txSession, const std::string &uri, size_t properties, size_t transactions, bool rollback) {
+    double seconds = 0;
+    for (size_t t = 0; t < transactions; ++t) {
+      for (size_t i = 0; i < TX_SIZE; ++i) {
+        txSession.saveMessage(*makeMessage(uri, properties));
+      }
+      seconds += measure([&txSession, rollback]() {
+        if (rollback) {
+          txSession.abort();
+        } else {
+          txSession.commit();
+        }
+      });
+    }
+    return seconds;
+  }
+
+  template <typename F>
+  static double measure(F &&f) {
+    const auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  void report(const char *op, const Case &c, size_t ops, double seconds) const {
+    const double opsPerSecond = (seconds > 0) ? (static_cast<double>(ops) / seconds) : 0.0;
+    const double usPerOp = (ops > 0) ? (seconds * 1000000.0 / static_cast<double>(ops)) : 0.0;
+    printf(
+        "{\"version\":\"%s\",\"backend\":\"%s\",\"op\":\"%s\",\"table_size\":%zu,\"properties\":%zu,\"ops\":%zu,"
+        "\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"us_per_op\":%.3f}\n",
+        _version.c_str(),
+        _backend.name.c_str(),
+        op,
+        c.tableSize,
+        c.properties,
+        ops,
+        seconds,
+        opsPerSecond,
+        usPerOp);
+    fflush(stdout);
+  }
+};
+
+bool makeBackend(const std::string &name, int argc, char *argv[], Backend &backend) {
+  backend.name = name;
+  if (name == "sqlite-file") {
+    backend.dbms = "sqlite-native";
+    backend.value = "storage-bench.db";
+    backend.usePath = true;
+    return true;
+  }
+  if (name == "sqlite-memory") {
+    backend.dbms = "sqlite-native";
+    backend.value = "file::memory:?cache=shared";
+    backend.usePath = false;
+    return true;
+  }
+#ifdef HAS_POSTGRESQL
+  if ((name == "postgresql") && (argc > 3)) {
+    backend.dbms = "postgresql";
+    backend.value = argv[3];
+    backend.usePath = false;
+    return true;
+  }
+#else
+  (void)argc;
+  (void)argv;
+#endif
+  return false;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  Backend backend;
+  if ((argc < 2) || !makeBackend(argv[1], argc, argv, backend)) {
+    fprintf(stderr, "usage: %s sqlite-file|sqlite-memory|postgresql [count] [connection-string]\n", argv[0]);
+    return 1;
+  }
+  const size_t count = (argc > 2) ? static_cast<size_t>(std::atoi(argv[2])) : 1000;
+
+  Poco::Path dir(Poco::Path::temp());
+  dir.pushDirectory("upmq-storage-bench-" + std::to_string(Poco::Process::id()));
+
+  CONFIGURATION::Instance().setName("storage_bench");
+  Configuration::Storage storage;
+  storage.connection.props.dbmsType = Configuration::Storage::type(backend.dbms);
+  storage.connection.value.usePath = backend.usePath;
+  storage.connection.value.set(backend.value);
+  storage.connection.path.assign(dir).pushDirectory("db");
+  storage.data.set(Poco::Path(dir).pushDirectory("data").toString());
+  storage.setMessageJournal(CONFIGURATION::Instance().name());
+  CONFIGURATION::Instance().setStorage(storage);
+
+  int result = 0;
+  try {
+    dbms::Instance();
+    BROKER::Instance();
+    EXCHANGE::Instance();
+
+    Bench bench(backend, count);
+    const size_t tableSizes[] = {0, count, count * 10};
+    const size_t propertiesList[] = {0, 4, 16};
+    for (size_t tableSize : tableSizes) {
+      for (size_t properties : propertiesList) {
+        bench.run({tableSize, properties});
+      }
+    }
+  } catch (std::exception &ex) {
+    fprintf(stderr, "storage-bench: %s\n", ex.what());
+    result = 1;
+  }
+
+  try {
+    Poco::File(dir).remove(true);
+  } catch (...) {
+  }
+  return result;
+}
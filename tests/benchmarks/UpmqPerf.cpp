@@ -0,0 +1,514 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// End-to-end benchmark of the broker through libupmq:
+//  producers and consumers run in own threads with own connections against one destination
+//  every message carries the monotonic send time, consumers measure the end-to-end latency
+//  results (rates, bytes, latency percentiles) are written as JSON to stdout or the --output file
+// consumers stop when all sent messages are received or nothing is received for --idle-timeout after producers are done
+// (selectors and dups-ok acknowledge make the expected count unknown)
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cms/ConnectionFactory.h>
+#include <cms/Connection.h>
+#include <cms/Session.h>
+#include <cms/BytesMessage.h>
+
+#define OPTPARSE_IMPLEMENTATION
+#define OPTPARSE_API static
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wshadow"
+#endif
+#include "optparse.h"
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+const char *const SENT_PROPERTY = "perf_sent_ns";
+const char *const PRODUCER_PROPERTY = "perf_producer";
+
+struct Options {
+  std::string uri = "tcp://localhost:12345";
+  std::string destination = "upmq-perf";
+  bool useTopic = false;
+  int producers = 1;
+  int consumers = 1;
+  long count = 10000;
+  bool persistent = true;
+  int minSize = 256;
+  int maxSize = 256;
+  cms::Session::AcknowledgeMode ackMode = cms::Session::AUTO_ACKNOWLEDGE;
+  // messages per commit (transacted) or per acknowledge (client acknowledge)
+  long batch = 100;
+  std::string selector;
+  long idleTimeout = 5000;
+  std::string output;
+};
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char *ackName(cms::Session::AcknowledgeMode mode) {
+  switch (mode) {
+    case cms::Session::SESSION_TRANSACTED:
+      return "transacted";
+    case cms::Session::CLIENT_ACKNOWLEDGE:
+      return "client";
+    case cms::Session::DUPS_OK_ACKNOWLEDGE:
+      return "dups-ok";
+    default:
+      return "auto";
+  }
+}
+
+std::string jsonString(const std::string &s) {
+  std::string result("\"");
+  for (char c : s) {
+    if ((c == '"') || (c == '\\')) {
+      result.push_back('\\');
+    }
+    result.push_back(c);
+  }
+  return result.append("\"");
+}
+
+/// @brief Client - connection, session and destination of one producer or consumer
+struct Client {
+  std::unique_ptr<cms::ConnectionFactory> factory;
+  std::unique_ptr<cms::Connection> connection;
+  std::unique_ptr<cms::Session> session;
+  std::unique_ptr<cms::Destination> destination;
+
+  Client(const Options &options, cms::Session::AcknowledgeMode mode) {
+    factory.reset(cms::ConnectionFactory::createCMSConnectionFactory(options.uri));
+    connection.reset(factory->createConnection());
+    connection->start();
+    session.reset(connection->createSession(mode));
+    if (options.useTopic) {
+      destination.reset(session->createTopic(options.destination));
+    } else {
+      destination.reset(session->createQueue(options.destination));
+    }
+  }
+  ~Client() {
+    try {
+      destination.reset();
+      session->close();
+      connection->close();
+    } catch (...) {
+    }
+  }
+};
+
+struct ProducerResult {
+  long sent = 0;
+  uint64_t bytes = 0;
+  int64_t finished = 0;
+  std::string error;
+};
+
+struct ConsumerResult {
+  long received = 0;
+  uint64_t bytes = 0;
+  int64_t lastReceived = 0;
+  std::vector<int64_t> latencies;
+  std::string error;
+};
+
+void produce(const Options &options, int num, std::atomic_int &ready, std::atomic_bool &start, ProducerResult &result) {
+  bool isReady = false;
+  try {
+    const bool transacted = (options.ackMode == cms::Session::SESSION_TRANSACTED);
+    Client client(options, transacted ? cms::Session::SESSION_TRANSACTED : cms::Session::AUTO_ACKNOWLEDGE);
+    std::unique_ptr<cms::MessageProducer> producer(client.session->createProducer(client.destination.get()));
+    const int deliveryMode = options.persistent ? cms::DeliveryMode::PERSISTENT : cms::DeliveryMode::NON_PERSISTENT;
+    std::mt19937 gen(static_cast<unsigned>(num));
+    std::uniform_int_distribution<int> sizeDist(options.minSize, options.maxSize);
+    std::vector<unsigned char> payload(static_cast<size_t>(options.maxSize), 'x');
+    ++ready;
+    isReady = true;
+    while (!start) {
+      std::this_thread::yield();
+    }
+    for (long i = 1; i <= options.count; ++i) {
+      const int size = sizeDist(gen);
+      std::unique_ptr<cms::BytesMessage> message(client.session->createBytesMessage(payload.data(), size));
+      message->setIntProperty(PRODUCER_PROPERTY, num);
+      message->setLongProperty(SENT_PROPERTY, nowNs());
+      producer->send(message.get(), deliveryMode, cms::Message::DEFAULT_MSG_PRIORITY, cms::Message::DEFAULT_TIME_TO_LIVE);
+      if (transacted && ((i % options.batch) == 0)) {
+        client.session->commit();
+      }
+      ++result.sent;
+      result.bytes += static_cast<uint64_t>(size);
+    }
+    if (transacted) {
+      client.session->commit();
+    }
+    producer->close();
+  } catch (cms::CMSException &ex) {
+    result.error = ex.getMessage();
+  } catch (std::exception &ex) {
+    result.error = ex.what();
+  }
+  if (!isReady) {
+    ++ready;
+  }
+  result.finished = nowNs();
+}
+
+void consume(const Options &options,
+             long expected,
+             std::atomic<long> &queueReceived,
+             std::atomic_int &ready,
+             std::atomic_bool &producersDone,
+             ConsumerResult &result) {
+  bool isReady = false;
+  try {
+    Client client(options, options.ackMode);
+    std::unique_ptr<cms::MessageConsumer> consumer(options.selector.empty()
+                                                       ? client.session->createConsumer(client.destination.get())
+                                                       : client.session->createConsumer(client.destination.get(), options.selector));
+    result.latencies.reserve(static_cast<size_t>(options.count * options.producers / (options.useTopic ? 1 : options.consumers)));
+    ++ready;
+    isReady = true;
+    int64_t idleSince = 0;
+    for (;;) {
+      std::unique_ptr<cms::Message> message(consumer->receive(100));
+      if (message == nullptr) {
+        if (!producersDone) {
+          continue;
+        }
+        const int64_t now = nowNs();
+        if (idleSince == 0) {
+          idleSince = now;
+        } else if ((now - idleSince) / 1000000 >= options.idleTimeout) {
+          break;
+        }
+        continue;
+      }
+      idleSince = 0;
+      const int64_t received = nowNs();
+      result.latencies.push_back(received - message->getLongProperty(SENT_PROPERTY));
+      result.bytes += static_cast<uint64_t>(dynamic_cast<cms::BytesMessage &>(*message).getBodyLength());
+      result.lastReceived = received;
+      ++result.received;
+      if ((result.received % options.batch) == 0) {
+        if (options.ackMode == cms::Session::SESSION_TRANSACTED) {
+          client.session->commit();
+        } else if (options.ackMode == cms::Session::CLIENT_ACKNOWLEDGE) {
+          message->acknowledge();
+        }
+      }
+      // NOTE: queue consumers share the messages, topic consumers get all of them
+      const long done = options.useTopic ? result.received : ++queueReceived;
+      if ((expected > 0) && (done >= expected)) {
+        break;
+      }
+    }
+    if (options.ackMode == cms::Session::SESSION_TRANSACTED) {
+      client.session->commit();
+    }
+    consumer->close();
+  } catch (cms::CMSException &ex) {
+    result.error = ex.getMessage();
+  } catch (std::exception &ex) {
+    result.error = ex.what();
+  }
+  if (!isReady) {
+    ++ready;
+  }
+}
+
+double percentile(const std::vector<int64_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const auto index = static_cast<size_t>(p / 100.0 * static_cast<double>(sorted.size() - 1) + 0.5);
+  return static_cast<double>(sorted[std::min(index, sorted.size() - 1)]) / 1000.0;
+}
+
+void writeJSON(std::ostream &out,
+               const Options &options,
+               int64_t started,
+               const std::vector<ProducerResult> &producers,
+               const std::vector<ConsumerResult> &consumers) {
+  long sent = 0;
+  long received = 0;
+  uint64_t sentBytes = 0;
+  uint64_t receivedBytes = 0;
+  int64_t produced = started;
+  int64_t consumed = started;
+  std::vector<int64_t> latencies;
+  std::vector<std::string> errors;
+  for (const auto &producer : producers) {
+    sent += producer.sent;
+    sentBytes += producer.bytes;
+    produced = std::max(produced, producer.finished);
+    if (!producer.error.empty()) {
+      errors.emplace_back(producer.error);
+    }
+  }
+  for (const auto &consumer : consumers) {
+    received += consumer.received;
+    receivedBytes += consumer.bytes;
+    consumed = std::max(consumed, consumer.lastReceived);
+    latencies.insert(latencies.end(), consumer.latencies.begin(), consumer.latencies.end());
+    if (!consumer.error.empty()) {
+      errors.emplace_back(consumer.error);
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  const double produceSeconds = static_cast<double>(produced - started) / 1e9;
+  const double consumeSeconds = static_cast<double>(consumed - started) / 1e9;
+  double mean = 0;
+  for (int64_t latency : latencies) {
+    mean += static_cast<double>(latency) / 1000.0;
+  }
+  if (!latencies.empty()) {
+    mean /= static_cast<double>(latencies.size());
+  }
+
+  out << std::fixed << std::setprecision(3);
+  out << "{\n";
+  out << "  \"config\": {\n";
+  out << "    \"uri\": " << jsonString(options.uri) << ",\n";
+  out << "    \"destination\": " << jsonString(std::string(options.useTopic ? "topic://" : "queue://") + options.destination) << ",\n";
+  out << "    \"producers\": " << options.producers << ",\n";
+  out << "    \"consumers\": " << options.consumers << ",\n";
+  out << "    \"count\": " << options.count << ",\n";
+  out << "    \"persistent\": " << (options.persistent ? "true" : "false") << ",\n";
+  out << "    \"size\": {\"min\": " << options.minSize << ", \"max\": " << options.maxSize << "},\n";
+  out << "    \"ack\": " << jsonString(ackName(options.ackMode)) << ",\n";
+  out << "    \"batch\": " << options.batch << ",\n";
+  out << "    \"selector\": " << jsonString(options.selector) << "\n";
+  out << "  },\n";
+  out << "  \"sent\": " << sent << ",\n";
+  out << "  \"received\": " << received << ",\n";
+  out << "  \"produce\": {\"seconds\": " << produceSeconds << ", \"msgs_per_sec\": " << ((produceSeconds > 0) ? sent / produceSeconds : 0)
+      << ", \"mb_per_sec\": " << ((produceSeconds > 0) ? static_cast<double>(sentBytes) / 1048576.0 / produceSeconds : 0) << "},\n";
+  out << "  \"consume\": {\"seconds\": " << consumeSeconds << ", \"msgs_per_sec\": " << ((consumeSeconds > 0) ? received / consumeSeconds : 0)
+      << ", \"mb_per_sec\": " << ((consumeSeconds > 0) ? static_cast<double>(receivedBytes) / 1048576.0 / consumeSeconds : 0) << "},\n";
+  out << "  \"latency_us\": {\"min\": " << percentile(latencies, 0) << ", \"mean\": " << mean << ", \"p50\": " << percentile(latencies, 50)
+      << ", \"p90\": " << percentile(latencies, 90) << ", \"p99\": " << percentile(latencies, 99) << ", \"p99.9\": " << percentile(latencies, 99.9)
+      << ", \"max\": " << percentile(latencies, 100) << "},\n";
+  out << "  \"errors\": [";
+  for (size_t i = 0; i < errors.size(); ++i) {
+    out << ((i == 0) ? "" : ", ") << jsonString(errors[i]);
+  }
+  out << "]\n";
+  out << "}\n";
+}
+
+void usage(const struct optparse_long *opt_option) {
+  std::cout << "upmq-perf usage : " << std::endl;
+  for (size_t i = 0; opt_option[i].longname != nullptr; ++i) {
+    std::cout << "\t"
+              << "--" << std::left << std::setw(16) << opt_option[i].longname << " -" << (char)opt_option[i].shortname << " \t"
+              << opt_option[i].description << std::endl;
+  }
+}
+
+bool parseSize(const std::string &arg, Options &options) {
+  const std::string::size_type pos = arg.find(':');
+  options.minSize = std::stoi(arg.substr(0, pos));
+  options.maxSize = (pos == std::string::npos) ? options.minSize : std::stoi(arg.substr(pos + 1));
+  return (options.minSize >= 0) && (options.maxSize >= options.minSize);
+}
+
+bool parseAck(const std::string &arg, Options &options) {
+  if (arg == "auto") {
+    options.ackMode = cms::Session::AUTO_ACKNOWLEDGE;
+  } else if (arg == "client") {
+    options.ackMode = cms::Session::CLIENT_ACKNOWLEDGE;
+  } else if (arg == "dups-ok") {
+    options.ackMode = cms::Session::DUPS_OK_ACKNOWLEDGE;
+  } else if (arg == "transacted") {
+    options.ackMode = cms::Session::SESSION_TRANSACTED;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  (void)argc;
+  Options options;
+
+  static const struct optparse_long opt_option[] = {
+      {"uri", 'u', OPTPARSE_REQUIRED, true, "broker connection string, default is tcp://localhost:12345"},
+      {"destination", 'd', OPTPARSE_REQUIRED, true, "destination name, default is upmq-perf"},
+      {"type", 't', OPTPARSE_REQUIRED, true, "destination type [queue or topic], default is queue"},
+      {"producers", 'p', OPTPARSE_REQUIRED, true, "producers count, default is 1"},
+      {"consumers", 'c', OPTPARSE_REQUIRED, true, "consumers count, default is 1"},
+      {"count", 'n', OPTPARSE_REQUIRED, true, "messages per producer, default is 10000"},
+      {"delivery-mode", 'm', OPTPARSE_REQUIRED, true, "[persistent or not-persistent], default is persistent"},
+      {"size", 's', OPTPARSE_REQUIRED, true, "body size in bytes, N or MIN:MAX for the uniform distribution, default is 256"},
+      {"ack", 'a', OPTPARSE_REQUIRED, true, "[auto, client, dups-ok or transacted], default is auto"},
+      {"batch", 'b', OPTPARSE_REQUIRED, true, "messages per commit (transacted) or per acknowledge (client), default is 100"},
+      {"selector", 'S', OPTPARSE_REQUIRED, true, "consumer selector, producers set the int property perf_producer"},
+      {"idle-timeout", 'i', OPTPARSE_REQUIRED, true, "ms without messages after producers are done to stop consumers, default is 5000"},
+      {"output", 'o', OPTPARSE_REQUIRED, true, "JSON result file, default is stdout"},
+      {"help", 'h', OPTPARSE_NONE, false, "show help"},
+      {nullptr, 0, OPTPARSE_NONE, false, nullptr},
+  };
+
+  int option;
+  struct optparse parser {};
+  optparse_init(&parser, argv);
+  try {
+    while ((option = optparse_long(&parser, opt_option, nullptr)) != -1) {
+      const std::string arg = (parser.optarg != nullptr) ? parser.optarg : "";
+      bool valid = true;
+      switch (option) {
+        case 'u':
+          options.uri = arg;
+          break;
+        case 'd':
+          options.destination = arg;
+          break;
+        case 't':
+          valid = (arg == "queue") || (arg == "topic");
+          options.useTopic = (arg == "topic");
+          break;
+        case 'p':
+          options.producers = std::stoi(arg);
+          valid = (options.producers > 0);
+          break;
+        case 'c':
+          options.consumers = std::stoi(arg);
+          valid = (options.consumers > 0);
+          break;
+        case 'n':
+          options.count = std::stol(arg);
+          valid = (options.count > 0);
+          break;
+        case 'm':
+          valid = (arg == "persistent") || (arg == "not-persistent");
+          options.persistent = (arg == "persistent");
+          break;
+        case 's':
+          valid = parseSize(arg, options);
+          break;
+        case 'a':
+          valid = parseAck(arg, options);
+          break;
+        case 'b':
+          options.batch = std::stol(arg);
+          valid = (options.batch > 0);
+          break;
+        case 'S':
+          options.selector = arg;
+          break;
+        case 'i':
+          options.idleTimeout = std::stol(arg);
+          break;
+        case 'o':
+          options.output = arg;
+          break;
+        case 'h':
+          usage(opt_option);
+          return 0;
+        default:
+          valid = false;
+      }
+      if (!valid) {
+        std::cerr << "invalid option " << static_cast<char>(option) << " " << arg << std::endl;
+        usage(opt_option);
+        return -1;
+      }
+    }
+  } catch (std::exception &ex) {
+    std::cerr << "invalid option value : " << ex.what() << std::endl;
+    usage(opt_option);
+    return -1;
+  }
+
+  const long total = options.count * options.producers;
+  // NOTE: queue consumers count the messages together, every topic consumer receives all of them
+  long expected = total;
+  if (!options.selector.empty() || (options.ackMode == cms::Session::DUPS_OK_ACKNOWLEDGE)) {
+    expected = 0;
+  }
+
+  std::vector<ProducerResult> producerResults(static_cast<size_t>(options.producers));
+  std::vector<ConsumerResult> consumerResults(static_cast<size_t>(options.consumers));
+  std::atomic_bool start{false};
+  std::atomic_bool producersDone{false};
+  std::atomic_int ready{0};
+  std::atomic_int producersReady{0};
+  std::atomic<long> queueReceived{0};
+
+  std::vector<std::thread> consumers;
+  for (auto &result : consumerResults) {
+    consumers.emplace_back(consume, std::cref(options), expected, std::ref(queueReceived), std::ref(ready), std::ref(producersDone), std::ref(result));
+  }
+  // NOTE: topic consumers have to be subscribed before the first message
+  while (ready < options.consumers) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  std::vector<std::thread> producers;
+  for (int i = 0; i < options.producers; ++i) {
+    producers.emplace_back(produce, std::cref(options), i, std::ref(producersReady), std::ref(start), std::ref(producerResults[static_cast<size_t>(i)]));
+  }
+  // NOTE: connections are opened before the measurement
+  while (producersReady < options.producers) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  const int64_t started = nowNs();
+  start = true;
+  for (auto &producer : producers) {
+    producer.join();
+  }
+  producersDone = true;
+  for (auto &consumer : consumers) {
+    consumer.join();
+  }
+
+  if (options.output.empty()) {
+    writeJSON(std::cout, options, started, producerResults, consumerResults);
+  } else {
+    std::ofstream out(options.output);
+    writeJSON(out, options, started, producerResults, consumerResults);
+  }
+  for (const auto &result : producerResults) {
+    if (!result.error.empty()) {
+      return 1;
+    }
+  }
+  return 0;
+}
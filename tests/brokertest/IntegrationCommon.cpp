@@ -21,10 +21,15 @@ const int IntegrationCommon::defaultDelay = 1000;
 const unsigned int IntegrationCommon::defaultMsgCount = 5;
 // 200;
 bool IntegrationCommon::debug = false;
+const std::string IntegrationCommon::unixSocketPath = "/tmp/upmq-brokertest.sock";
 
 ////////////////////////////////////////////////////////////////////////////////
 IntegrationCommon::IntegrationCommon()
-    : urlCommon("tcp://127.0.0.1:"), stompURL(urlCommon + "12345?transport.trace=false"), openwireURL(urlCommon + "12345?transport.trace=false") {}
+    : urlCommon("tcp://127.0.0.1:"),
+      stompURL(urlCommon + "12345?transport.trace=false"),
+      openwireURL(urlCommon + "12345?transport.trace=false"),
+      unixURL("unix://" + unixSocketPath + "?transport.trace=false"),
+      shmURL("shm://" + unixSocketPath + "?transport.trace=false") {}
 
 ////////////////////////////////////////////////////////////////////////////////
 IntegrationCommon &IntegrationCommon::getInstance() {
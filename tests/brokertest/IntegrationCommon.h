@@ -27,10 +27,16 @@ class IntegrationCommon {
 
   virtual std::string getOpenwireURL() const { return this->openwireURL; }
 
+  // NOTE: broker must listen the unix socket (broker.net.unix-socket) at unixSocketPath
+  virtual std::string getUnixURL() const { return this->unixURL; }
+
+  virtual std::string getShmURL() const { return this->shmURL; }
+
  public:  // Statics
   static const int defaultDelay;
   static const unsigned int defaultMsgCount;
   static bool debug;
+  static const std::string unixSocketPath;
 
   static IntegrationCommon &getInstance();
 
@@ -41,6 +47,8 @@ class IntegrationCommon {
   std::string urlCommon;
   std::string stompURL;
   std::string openwireURL;
+  std::string unixURL;
+  std::string shmURL;
 };
 
 #endif /*_INTEGRATIONCOMMON_H_*/
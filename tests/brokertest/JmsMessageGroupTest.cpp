@@ -15,6 +15,8 @@
  */
 
 #include <fake_cpp14.h>
+#include <map>
+#include <set>
 #include "JmsMessageGroupTest.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -45,4 +47,43 @@ TEST_F(JmsMessageGroupTest, testMessageSend) {
   EXPECT_TRUE(message->getStringProperty("JMSXGroupID") == GROUPID);
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(JmsMessageGroupTest, testMessageGroupAffinity) {
+  const int groupSize = 3;
+  const std::vector<std::string> groups = {"TEST-GROUP-A", "TEST-GROUP-B"};
+
+  cms::Session *session(cmsProvider->getSession());
+  cms::MessageConsumer *consumer = cmsProvider->getConsumer();
+  std::unique_ptr<cms::MessageConsumer> consumer2(session->createConsumer(cmsProvider->getDestination()));
+  cms::MessageProducer *producer = cmsProvider->getProducer();
+  producer->setDeliveryMode(DeliveryMode::NON_PERSISTENT);
+
+  for (const auto &group : groups) {
+    for (int i = 0; i < groupSize; ++i) {
+      std::unique_ptr<cms::TextMessage> txtMessage(session->createTextMessage("TEST MESSAGE"));
+      txtMessage->setStringProperty("JMSXGroupID", group);
+      EXPECT_NO_THROW(producer->send(txtMessage.get()));
+    }
+  }
+
+  // all messages of the group have to be received by the one consumer
+  std::map<std::string, std::set<const cms::MessageConsumer *>> receivers;
+  int received = 0;
+  for (cms::MessageConsumer *cons : {consumer, consumer2.get()}) {
+    std::unique_ptr<cms::Message> message;
+    while (true) {
+      EXPECT_NO_THROW(message.reset(cons->receive(1000)));
+      if (message == nullptr) {
+        break;
+      }
+      receivers[message->getStringProperty("JMSXGroupID")].insert(cons);
+      ++received;
+    }
+  }
+  EXPECT_EQ(received, groupSize * static_cast<int>(groups.size()));
+  for (const auto &group : groups) {
+    EXPECT_EQ(receivers[group].size(), 1u) << group;
+  }
+}
+
 void JmsMessageGroupTest::TearDown() {}
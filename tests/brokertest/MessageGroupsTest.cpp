@@ -0,0 +1,87 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "MessageGroupsTest.h"
+#include <string>
+#include <vector>
+
+////////////////////////////////////////////////////////////////////////////////
+void MessageGroupsTest::deliverOpenGroup(const std::string &groupID, const std::string &objectID, int count, bool removed) {
+  for (int i = 0; i < count; ++i) {
+    const std::string messageID = "ID:" + groupID + "-" + std::to_string(i);
+    groups.assign(groupID, objectID, messageID, i + 1);
+    groups.acknowledged(groupID, messageID, removed);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(MessageGroupsTest, testLongOpenGroupDoesNotGrow) {
+  deliverOpenGroup("group", "consumer", 10000, true);
+
+  int outstanding = -1;
+  EXPECT_EQ(groups.owner("group", outstanding), "consumer");
+  EXPECT_EQ(outstanding, 0);
+  EXPECT_EQ(groups.size(), 1u);
+
+  // NOTE: removed messages aren't kept, so the closed group has nothing left to remove
+  std::vector<std::string> messages;
+  EXPECT_TRUE(groups.take("group", messages));
+  EXPECT_TRUE(messages.empty()) << "acknowledged messages are still kept : " << messages.size();
+  EXPECT_EQ(groups.size(), 0u);
+}
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(MessageGroupsTest, testAcknowledgedInStorageIsClosedByQuery) {
+  deliverOpenGroup("group", "consumer", 1000, false);
+  groups.assign("group", "consumer", "ID:group-last", 1001);
+
+  std::vector<std::string> messages;
+  EXPECT_FALSE(groups.take("group", messages));
+  EXPECT_TRUE(messages.empty());
+}
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(MessageGroupsTest, testOutstandingMessagesAreKept) {
+  groups.assign("group", "consumer", "ID:group-0", 1);
+  groups.assign("group", "consumer", "ID:group-1", 2);
+  groups.acknowledged("group", "ID:group-0", true);
+
+  int outstanding = 0;
+  EXPECT_EQ(groups.owner("group", outstanding), "consumer");
+  EXPECT_EQ(outstanding, 1);
+
+  std::vector<std::string> messages;
+  EXPECT_TRUE(groups.take("group", messages));
+  ASSERT_EQ(messages.size(), 1u);
+  EXPECT_EQ(messages.front(), "ID:group-1");
+}
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(MessageGroupsTest, testReleasedOwnerLeavesTable) {
+  for (int i = 0; i < 100; ++i) {
+    const std::string groupID = "group-" + std::to_string(i);
+    groups.assign(groupID, (i % 2 == 0) ? "consumer-0" : "consumer-1", "ID:" + groupID, 1);
+  }
+  EXPECT_EQ(groups.size(), 100u);
+
+  groups.release("consumer-0");
+  EXPECT_EQ(groups.size(), 50u);
+
+  int outstanding = 0;
+  EXPECT_TRUE(groups.owner("group-0", outstanding).empty());
+  EXPECT_EQ(groups.owner("group-1", outstanding), "consumer-1");
+
+  groups.clear();
+  EXPECT_EQ(groups.size(), 0u);
+}
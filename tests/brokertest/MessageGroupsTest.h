@@ -0,0 +1,37 @@
+/*
+ * Copyright 2014-present IVK JSC. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _MESSAGEGROUPSTEST_H_
+#define _MESSAGEGROUPSTEST_H_
+
+#include <gtest/gtest.h>
+#include "MessageGroups.h"
+
+// NOTE: the table of the broker storage is tested without the broker
+class MessageGroupsTest : public ::testing::Test {
+ protected:
+  MessageGroupsTest() = default;
+
+  ~MessageGroupsTest() override = default;
+
+  // delivers and acknowledges count messages of the open group
+  void deliverOpenGroup(const std::string &groupID, const std::string &objectID, int count, bool removed);
+
+  upmq::broker::MessageGroups groups;
+};
+
+#endif /*_MESSAGEGROUPSTEST_H_*/
@@ -20,11 +20,15 @@
 
 #include <cms/Connection.h>
 #include <cms/ConnectionFactory.h>
+#include <cms/ConsumerStatistics.h>
 #include <cms/Session.h>
 #include <fake_cpp14.h>
 #include <list>
+#include <vector>
 #include <array>
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 using namespace cms;
 ////////////////////////////////////////////////////////////////////////////////
@@ -33,6 +37,38 @@ void SimpleTest::SetUp() {
   cmsProvider->cleanUpDestination();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+void SimpleTest::roundTrip(const std::string &url, int count, size_t bodySize) {
+  cmsProvider = std::make_unique<CMSProvider>(url);
+  cms::Session *session(cmsProvider->getSession());
+
+  cms::MessageConsumer *consumer = cmsProvider->getConsumer();
+  cms::MessageProducer *producer = cmsProvider->getProducer();
+
+  auto body = [bodySize](int num) { return std::to_string(num) + " " + std::string(bodySize, static_cast<char>('a' + num % 26)); };
+  for (int i = 0; i < count; ++i) {
+    producer->setDeliveryMode((i % 2 == 0) ? DeliveryMode::PERSISTENT : DeliveryMode::NON_PERSISTENT);
+    std::unique_ptr<cms::TextMessage> txtMessage(session->createTextMessage(body(i)));
+    txtMessage->setIntProperty("num", i);
+    producer->send(txtMessage.get());
+  }
+
+  int received = 0;
+  std::unique_ptr<cms::Message> message;
+  while (received < count) {
+    message.reset(consumer->receive(3000));
+    if (message == nullptr) {
+      break;
+    }
+    EXPECT_EQ(message->getIntProperty("num"), received) << "invalid order msg : " << message->getCMSMessageID();
+    auto *txtMessage = dynamic_cast<cms::TextMessage *>(message.get());
+    ASSERT_TRUE(txtMessage != nullptr);
+    EXPECT_TRUE(txtMessage->getText() == body(received)) << "invalid body msg : " << message->getCMSMessageID();
+    ++received;
+  }
+  EXPECT_EQ(received, count) << "messages were lost on " << url;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(SimpleTest, testAutoAck) {
   cms::Session *session(cmsProvider->getSession());
@@ -309,6 +345,41 @@ TEST_F(SimpleTest, testReceiveAlreadyInQueue) {
   session->close();
 }
 
+////////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testTopicWildcards) {
+  std::unique_ptr<cms::ConnectionFactory> factory(ConnectionFactory::createCMSConnectionFactory(cmsProvider->getBrokerURL()));
+  std::unique_ptr<cms::Connection> connection(factory->createConnection());
+  std::unique_ptr<cms::Session> session(connection->createSession());
+  const std::string root = CMSProvider::newUUID();
+  std::unique_ptr<cms::Topic> topic(session->createTopic(root + "/a/c"));
+  std::unique_ptr<cms::Topic> parentTopic(session->createTopic(root + "/a"));
+  std::unique_ptr<cms::Topic> starTopic(session->createTopic(root + "/*/c"));
+  std::unique_ptr<cms::Topic> hashTopic(session->createTopic(root + "/#"));
+  std::unique_ptr<cms::Topic> otherTopic(session->createTopic(root + "/b"));
+  std::unique_ptr<cms::MessageConsumer> parentConsumer(session->createConsumer(parentTopic.get()));
+  std::unique_ptr<cms::MessageConsumer> starConsumer(session->createConsumer(starTopic.get()));
+  std::unique_ptr<cms::MessageConsumer> hashConsumer(session->createConsumer(hashTopic.get()));
+  std::unique_ptr<cms::MessageConsumer> otherConsumer(session->createConsumer(otherTopic.get()));
+  std::unique_ptr<cms::MessageProducer> producer(session->createProducer(topic.get()));
+  producer->setDeliveryMode(DeliveryMode::NON_PERSISTENT);
+  connection->start();
+
+  std::unique_ptr<cms::TextMessage> textMessage(session->createTextMessage("TEST MESSAGE"));
+  producer->send(textMessage.get());
+
+  std::unique_ptr<cms::Message> message(parentConsumer->receive(3000));
+  EXPECT_TRUE(message != nullptr);
+  message.reset(starConsumer->receive(3000));
+  EXPECT_TRUE(message != nullptr);
+  message.reset(hashConsumer->receive(3000));
+  EXPECT_TRUE(message != nullptr);
+  message.reset(otherConsumer->receive(500));
+  EXPECT_TRUE(message == nullptr);
+
+  producer->close();
+  session->close();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 TEST_F(SimpleTest, testQuickCreateAndDestroy) {
   std::unique_ptr<cms::ConnectionFactory> factory(ConnectionFactory::createCMSConnectionFactory(cmsProvider->getBrokerURL()));
@@ -701,5 +772,292 @@ TEST_F(SimpleTest, DISABLED_testDestinationCount) {
   cmsProvider->reconnectSession();
 }
 ///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testConsumerCredit) {
+  const int creditBytes = 4096;
+  const int bodySize = 1000;
+  const int count = 20;
+  std::unique_ptr<cms::ConnectionFactory> creditFactory(
+      ConnectionFactory::createCMSConnectionFactory(getBrokerURL() + "&consumer.creditBytes=" + std::to_string(creditBytes)));
+  std::unique_ptr<cms::ConnectionFactory> plainFactory(ConnectionFactory::createCMSConnectionFactory(getBrokerURL()));
+  std::unique_ptr<cms::Connection> creditConnection(creditFactory->createConnection());
+  std::unique_ptr<cms::Connection> plainConnection(plainFactory->createConnection());
+  std::unique_ptr<cms::Session> creditSession(creditConnection->createSession());
+  std::unique_ptr<cms::Session> plainSession(plainConnection->createSession());
+
+  std::unique_ptr<cms::Queue> queue(creditSession->createQueue(CMSProvider::newUUID()));
+  std::unique_ptr<cms::MessageConsumer> creditConsumer(creditSession->createConsumer(queue.get()));
+  std::unique_ptr<cms::MessageProducer> producer(plainSession->createProducer(queue.get()));
+  producer->setDeliveryMode(DeliveryMode::PERSISTENT);
+  creditConnection->start();
+
+  std::unique_ptr<cms::TextMessage> txtMessage(plainSession->createTextMessage(std::string(bodySize, 'x')));
+  for (int i = 0; i < count; ++i) {
+    txtMessage->setIntProperty("num", i);
+    producer->send(txtMessage.get());
+  }
+  // NOTE: nothing is consumed, so the credit consumer gets only its window and the rest stays in the queue
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+  std::unique_ptr<cms::MessageConsumer> plainConsumer(plainSession->createConsumer(queue.get()));
+  plainConnection->start();
+
+  std::unique_ptr<cms::Message> message;
+  int firstPlainNum = -1;
+  int plainReceived = 0;
+  for (;;) {
+    message.reset(plainConsumer->receive(2000));
+    if (message == nullptr) {
+      break;
+    }
+    if (firstPlainNum < 0) {
+      firstPlainNum = message->getIntProperty("num");
+    }
+    EXPECT_EQ(message->getIntProperty("num"), firstPlainNum + plainReceived) << "invalid order msg : " << message->getCMSMessageID();
+    ++plainReceived;
+  }
+  ASSERT_GT(firstPlainNum, 0) << "credit consumer got nothing or everything";
+  // NOTE: the first message that doesn't fit the window waits in the broker for the credit of its consumer
+  EXPECT_LE((firstPlainNum - 1) * bodySize, creditBytes) << "dispatch didn't stop at the credit window";
+  EXPECT_EQ(firstPlainNum + plainReceived, count);
+
+  int creditReceived = 0;
+  for (;;) {
+    message.reset(creditConsumer->receive(2000));
+    if (message == nullptr) {
+      break;
+    }
+    EXPECT_EQ(message->getIntProperty("num"), creditReceived) << "invalid order msg : " << message->getCMSMessageID();
+    ++creditReceived;
+  }
+  EXPECT_EQ(creditReceived, firstPlainNum) << "credit consumer didn't resume after the credit";
+
+  producer->close();
+  creditConsumer->close();
+  plainConsumer->close();
+  creditSession->close();
+  plainSession->close();
+}
+///////////////////////////////////////////////////////////////////////////////
+#ifndef _WIN32
+TEST_F(SimpleTest, testUnixSocket) { roundTrip(IntegrationCommon::getInstance().getUnixURL(), 100, 1024); }
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testSharedMemory) { roundTrip(IntegrationCommon::getInstance().getShmURL(), 100, 1024); }
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testSharedMemoryRingWrap) {
+  // NOTE: the bodies are bigger than the ring, so every frame wraps the ring and waits for the reader
+  roundTrip(IntegrationCommon::getInstance().getShmURL() + "&shm.ringSize=65536", 20, 200000);
+}
+#endif
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testConsumerBatch) {
+  // NOTE: the count is bigger than the not-ack window of the broker (100 messages) and the credit is granted many times,
+  // so both are accounted per message of the batch
+  cmsProvider = std::make_unique<CMSProvider>(getBrokerURL() + "&consumer.batchSize=16&consumer.creditBytes=8192");
+  cms::Session *session(cmsProvider->getSession());
+
+  cms::MessageProducer *producer = cmsProvider->getProducer();
+
+  // NOTE: persistent bodies are read from the data files and sent alone, they split the batches of in-memory bodies
+  const int count = 300;
+  auto isPersistent = [](int num) { return (num % 3 == 0); };
+  auto body = [](int num) { return "body " + std::to_string(num) + " " + std::string(static_cast<size_t>(num % 7) * 100, 'b'); };
+  for (int i = 0; i < count; ++i) {
+    producer->setDeliveryMode(isPersistent(i) ? DeliveryMode::PERSISTENT : DeliveryMode::NON_PERSISTENT);
+    std::unique_ptr<cms::TextMessage> txtMessage(session->createTextMessage(body(i)));
+    txtMessage->setIntProperty("num", i);
+    producer->send(txtMessage.get());
+  }
+
+  // NOTE: the consumer is created when the queue is filled, so the broker has several messages at hand for every batch
+  cms::MessageConsumer *consumer = cmsProvider->getConsumer();
+
+  int received = 0;
+  std::unique_ptr<cms::Message> message;
+  while (received < count) {
+    message.reset(consumer->receive(3000));
+    if (message == nullptr) {
+      break;
+    }
+    EXPECT_EQ(message->getIntProperty("num"), received) << "invalid order msg : " << message->getCMSMessageID();
+    EXPECT_EQ(message->getCMSDeliveryMode(), isPersistent(received) ? DeliveryMode::PERSISTENT : DeliveryMode::NON_PERSISTENT);
+    auto *txtMessage = dynamic_cast<cms::TextMessage *>(message.get());
+    ASSERT_TRUE(txtMessage != nullptr);
+    EXPECT_TRUE(txtMessage->getText() == body(received)) << "invalid body msg : " << message->getCMSMessageID();
+    ++received;
+  }
+  EXPECT_EQ(received, count) << "consumer stalled on the not-ack or credit window";
+  message.reset(consumer->receive(1000));
+  EXPECT_TRUE(message == nullptr) << "message was sent twice";
+
+  auto *statistics = dynamic_cast<cms::ConsumerStatistics *>(consumer);
+  ASSERT_TRUE(statistics != nullptr);
+  EXPECT_GT(statistics->getReceivedBatches(), 0) << "messages were not sent in batches";
+  EXPECT_GT(statistics->getReceivedBatchedMessages(), statistics->getReceivedBatches());
+
+  // NOTE: every message of the batches was acked, so nothing is redelivered to the new consumer
+  cmsProvider->reconnectSession();
+  message.reset(cmsProvider->getConsumer()->receive(1000));
+  EXPECT_TRUE(message == nullptr) << "acked message was redelivered";
+}
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testConsumerBatchSeveralConsumers) {
+  const std::string url = getBrokerURL() + "&consumer.batchSize=16";
+  cmsProvider = std::make_unique<CMSProvider>(url);
+  CMSProvider secondProvider(url);
+  cms::Session *session(cmsProvider->getSession());
+
+  cms::MessageProducer *producer = cmsProvider->getProducer();
+  producer->setDeliveryMode(DeliveryMode::NON_PERSISTENT);
+
+  // NOTE: the count is bigger than the not-ack window of one consumer (100 messages), so the second consumer gets messages
+  // while the first one is subscribed
+  const int count = 400;
+  for (int i = 0; i < count; ++i) {
+    std::unique_ptr<cms::TextMessage> txtMessage(session->createTextMessage("body " + std::to_string(i)));
+    txtMessage->setIntProperty("num", i);
+    producer->send(txtMessage.get());
+  }
+
+  std::array<cms::MessageConsumer *, 2> consumers{{cmsProvider->getConsumer(), secondProvider.getConsumer()}};
+  std::array<int, 2> lastNum{{-1, -1}};
+  std::vector<bool> seen(static_cast<size_t>(count), false);
+  int received = 0;
+  int idle = 0;
+  std::unique_ptr<cms::Message> message;
+  while (received < count && idle < 30) {
+    bool any = false;
+    for (size_t i = 0; i < consumers.size(); ++i) {
+      message.reset(consumers[i]->receive(100));
+      if (message == nullptr) {
+        continue;
+      }
+      any = true;
+      const int num = message->getIntProperty("num");
+      ASSERT_TRUE(num >= 0 && num < count);
+      EXPECT_FALSE(seen[static_cast<size_t>(num)]) << "message was sent twice : " << num;
+      EXPECT_GT(num, lastNum[i]) << "invalid order msg : " << message->getCMSMessageID();
+      seen[static_cast<size_t>(num)] = true;
+      lastNum[i] = num;
+      ++received;
+    }
+    idle = any ? 0 : idle + 1;
+  }
+  EXPECT_EQ(received, count);
+
+  // NOTE: the second consumer is subscribed while the first one is, so its batches are filled with several consumers
+  for (auto *consumer : consumers) {
+    auto *statistics = dynamic_cast<cms::ConsumerStatistics *>(consumer);
+    ASSERT_TRUE(statistics != nullptr);
+    EXPECT_GT(statistics->getReceivedBatches(), 0) << "messages were not sent in batches";
+    EXPECT_GT(statistics->getReceivedBatchedMessages(), statistics->getReceivedBatches());
+  }
+  secondProvider.close();
+}
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testConnectionMaxOutputBytes) {
+  // NOTE: the output limit is less than one message, so the broker pauses the connection on every big message
+  cmsProvider = std::make_unique<CMSProvider>(getBrokerURL() + "&connection.maxOutputBytes=4096");
+  cms::Session *session(cmsProvider->getSession());
+
+  cms::MessageConsumer *consumer = cmsProvider->getConsumer();
+  cms::MessageProducer *producer = cmsProvider->getProducer();
+  producer->setDeliveryMode(DeliveryMode::NON_PERSISTENT);
+
+  const int count = 200;
+  auto body = [](int num) { return std::string((num % 2 == 0) ? 65536 : 512, static_cast<char>('a' + num % 26)); };
+  for (int i = 0; i < count; ++i) {
+    std::unique_ptr<cms::TextMessage> txtMessage(session->createTextMessage(body(i)));
+    txtMessage->setIntProperty("num", i);
+    producer->send(txtMessage.get());
+  }
+
+  int received = 0;
+  std::unique_ptr<cms::Message> message;
+  while (received < count) {
+    message.reset(consumer->receive(3000));
+    if (message == nullptr) {
+      break;
+    }
+    EXPECT_EQ(message->getIntProperty("num"), received) << "invalid order msg : " << message->getCMSMessageID();
+    auto *txtMessage = dynamic_cast<cms::TextMessage *>(message.get());
+    ASSERT_TRUE(txtMessage != nullptr);
+    EXPECT_TRUE(txtMessage->getText() == body(received)) << "invalid body msg : " << message->getCMSMessageID();
+    ++received;
+  }
+  EXPECT_EQ(received, count) << "connection stalled on the output limit";
+}
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testConsumerPriority) {
+  std::unique_ptr<cms::ConnectionFactory> lowFactory(ConnectionFactory::createCMSConnectionFactory(getBrokerURL()));
+  std::unique_ptr<cms::ConnectionFactory> highFactory(ConnectionFactory::createCMSConnectionFactory(getBrokerURL() + "&consumer.priority=10"));
+  std::unique_ptr<cms::Connection> lowConnection(lowFactory->createConnection());
+  std::unique_ptr<cms::Connection> highConnection(highFactory->createConnection());
+  std::unique_ptr<cms::Session> lowSession(lowConnection->createSession());
+  std::unique_ptr<cms::Session> highSession(highConnection->createSession());
+
+  std::unique_ptr<cms::Queue> queue(lowSession->createQueue(CMSProvider::newUUID()));
+  std::unique_ptr<cms::MessageConsumer> lowConsumer(lowSession->createConsumer(queue.get()));
+  std::unique_ptr<cms::MessageConsumer> highConsumer(highSession->createConsumer(queue.get()));
+  std::unique_ptr<cms::MessageProducer> producer(lowSession->createProducer(queue.get()));
+  producer->setDeliveryMode(DeliveryMode::NON_PERSISTENT);
+  lowConnection->start();
+  highConnection->start();
+
+  const int count = 10;
+  std::unique_ptr<cms::TextMessage> textMessage(lowSession->createTextMessage("TEST MESSAGE"));
+  for (int i = 0; i < count; ++i) {
+    producer->send(textMessage.get());
+  }
+
+  std::unique_ptr<cms::Message> message;
+  for (int i = 0; i < count; ++i) {
+    message.reset(highConsumer->receive(3000));
+    EXPECT_TRUE(message != nullptr) << "high priority consumer missed message " << i;
+  }
+  message.reset(lowConsumer->receive(500));
+  EXPECT_TRUE(message == nullptr);
+
+  producer->close();
+  lowConsumer->close();
+  highConsumer->close();
+  lowSession->close();
+  highSession->close();
+}
+///////////////////////////////////////////////////////////////////////////////
+TEST_F(SimpleTest, testConsumerAckBatchReceiveNoWait) {
+  // NOTE: the ack batch is bigger than the not-ack window of the broker (100 messages), so polling must flush coalesced acks
+  cmsProvider = std::make_unique<CMSProvider>(getBrokerURL() + "&consumer.ackBatchSize=1000&consumer.ackBatchTimeout=600000");
+  cms::Session *session(cmsProvider->getSession());
+
+  cms::MessageConsumer *consumer = cmsProvider->getConsumer();
+  cms::MessageProducer *producer = cmsProvider->getProducer();
+  producer->setDeliveryMode(DeliveryMode::NON_PERSISTENT);
+  std::unique_ptr<cms::TextMessage> txtMessage(session->createTextMessage("TEST MESSAGE"));
+
+  const int count = 300;
+  for (int i = 0; i < count; ++i) {
+    txtMessage->setIntProperty("num", i);
+    producer->send(txtMessage.get());
+  }
+
+  int received = 0;
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(15);
+  while ((received < count) && (std::chrono::steady_clock::now() < deadline)) {
+    std::unique_ptr<cms::Message> message(consumer->receiveNoWait());
+    if (message == nullptr) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    EXPECT_EQ(message->getIntProperty("num"), received) << "invalid order msg : " << message->getCMSMessageID();
+    ++received;
+  }
+  EXPECT_EQ(received, count) << "consumer stalled on the not-ack window";
+
+  // NOTE: every message was acked by the batch, so nothing is redelivered to the new consumer
+  cmsProvider->reconnectSession();
+  std::unique_ptr<cms::Message> message(cmsProvider->getConsumer()->receive(1000));
+  EXPECT_TRUE(message == nullptr) << "acked message was redelivered : " << message->getCMSMessageID();
+}
+///////////////////////////////////////////////////////////////////////////////
 
 void SimpleTest::TearDown() {}
@@ -36,6 +36,9 @@ class SimpleTest : public ::testing::Test {
     return url;
   }
 
+  // sends count persistent and non-persistent messages through the url and receives them back
+  void roundTrip(const std::string &url, int count, size_t bodySize);
+
   std::unique_ptr<CMSProvider> cmsProvider;
   static std::string _getBrokerURL() { return IntegrationCommon::getInstance().getOpenwireURL(); }
 };